@@ -80,7 +80,6 @@ HEADERS += src/bignum.h \
            src/koinmudra-config.h \
            src/db.h \
            src/eccryptoverify.h \
-           src/ecwrapper.h \
            src/hash.h \
            src/init.h \
            src/swifttx.h \
@@ -374,7 +373,6 @@ SOURCES += src/activemasternode.cpp \
            src/koinmudra.cpp \
            src/db.cpp \
            src/eccryptoverify.cpp \
-           src/ecwrapper.cpp \
            src/editaddressdialog.cpp \
            src/hash.cpp \
            src/init.cpp \
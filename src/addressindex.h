@@ -0,0 +1,196 @@
+// Copyright (c) 2018 The KoinMudra developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_ADDRESSINDEX_H
+#define BITCOIN_ADDRESSINDEX_H
+
+#include "amount.h"
+#include "crypto/common.h"
+#include "script/script.h"
+#include "serialize.h"
+#include "uint256.h"
+
+/** What the hash in an address index entry stands for */
+enum AddressIndexType {
+    ADDRESS_INDEX_NONE = 0,
+    ADDRESS_INDEX_KEY = 1,    //! CKeyID: pay-to-pubkey and pay-to-pubkey-hash outputs
+    ADDRESS_INDEX_SCRIPT = 2, //! CScriptID: pay-to-script-hash outputs
+};
+
+/**
+ * Heights and positions are stored big-endian, so that the entries for one
+ * address are sorted by height in the database and can be read by range.
+ */
+template <typename Stream>
+inline void WriteIndexBE32(Stream& s, uint32_t n)
+{
+    unsigned char buf[4];
+    WriteBE32(buf, n);
+    s.write((char*)buf, sizeof(buf));
+}
+
+template <typename Stream>
+inline uint32_t ReadIndexBE32(Stream& s)
+{
+    unsigned char buf[4];
+    s.read((char*)buf, sizeof(buf));
+    return ReadBE32(buf);
+}
+
+/** An output paying to, or an input spending from, an address */
+struct CAddressIndexKey {
+    unsigned char type;
+    uint160 hashBytes;
+    int blockHeight;
+    unsigned int txindex;
+    uint256 txhash;
+    unsigned int index;
+    bool spending;
+
+    CAddressIndexKey()
+    {
+        SetNull();
+    }
+
+    CAddressIndexKey(unsigned char typeIn, const uint160& hashBytesIn, int blockHeightIn, unsigned int txindexIn,
+        const uint256& txhashIn, unsigned int indexIn, bool spendingIn) : type(typeIn), hashBytes(hashBytesIn), blockHeight(blockHeightIn),
+                                                                       txindex(txindexIn), txhash(txhashIn), index(indexIn), spending(spendingIn) {}
+
+    void SetNull()
+    {
+        type = ADDRESS_INDEX_NONE;
+        hashBytes = 0;
+        blockHeight = 0;
+        txindex = 0;
+        txhash = 0;
+        index = 0;
+        spending = false;
+    }
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        return 1 + 20 + 4 + 4 + 32 + 4 + 1;
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        s << type;
+        s << hashBytes;
+        WriteIndexBE32(s, blockHeight);
+        WriteIndexBE32(s, txindex);
+        s << txhash;
+        WriteIndexBE32(s, index);
+        s << spending;
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
+    {
+        s >> type;
+        s >> hashBytes;
+        blockHeight = ReadIndexBE32(s);
+        txindex = ReadIndexBE32(s);
+        s >> txhash;
+        index = ReadIndexBE32(s);
+        s >> spending;
+    }
+};
+
+/** Prefix of all the address index entries of one address, optionally from a given height on */
+struct CAddressIndexIteratorKey {
+    unsigned char type;
+    uint160 hashBytes;
+    bool fHeight;
+    int blockHeight;
+
+    CAddressIndexIteratorKey(unsigned char typeIn, const uint160& hashBytesIn) : type(typeIn), hashBytes(hashBytesIn), fHeight(false), blockHeight(0) {}
+    CAddressIndexIteratorKey(unsigned char typeIn, const uint160& hashBytesIn, int blockHeightIn) : type(typeIn), hashBytes(hashBytesIn), fHeight(true), blockHeight(blockHeightIn) {}
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        return 1 + 20 + (fHeight ? 4 : 0);
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        s << type;
+        s << hashBytes;
+        if (fHeight)
+            WriteIndexBE32(s, blockHeight);
+    }
+};
+
+/** An unspent output paying to an address */
+struct CAddressUnspentKey {
+    unsigned char type;
+    uint160 hashBytes;
+    uint256 txhash;
+    unsigned int index;
+
+    CAddressUnspentKey()
+    {
+        SetNull();
+    }
+
+    CAddressUnspentKey(unsigned char typeIn, const uint160& hashBytesIn, const uint256& txhashIn, unsigned int indexIn) : type(typeIn), hashBytes(hashBytesIn), txhash(txhashIn), index(indexIn) {}
+
+    void SetNull()
+    {
+        type = ADDRESS_INDEX_NONE;
+        hashBytes = 0;
+        txhash = 0;
+        index = 0;
+    }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(type);
+        READWRITE(hashBytes);
+        READWRITE(txhash);
+        READWRITE(index);
+    }
+};
+
+/** Amount, script and height of an unspent output; a null value erases the entry */
+struct CAddressUnspentValue {
+    CAmount satoshis;
+    CScript script;
+    int blockHeight;
+
+    CAddressUnspentValue()
+    {
+        SetNull();
+    }
+
+    CAddressUnspentValue(CAmount satoshisIn, const CScript& scriptIn, int blockHeightIn) : satoshis(satoshisIn), script(scriptIn), blockHeight(blockHeightIn) {}
+
+    void SetNull()
+    {
+        satoshis = -1;
+        script.clear();
+        blockHeight = 0;
+    }
+
+    bool IsNull() const
+    {
+        return satoshis == -1;
+    }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(satoshis);
+        READWRITE(script);
+        READWRITE(blockHeight);
+    }
+};
+
+#endif // BITCOIN_ADDRESSINDEX_H
@@ -0,0 +1,84 @@
+// Copyright (c) 2018 The KoinMudra developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include <limits>
+
+#include <sys/time.h>
+
+using namespace benchmark;
+
+static double gettimedouble(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_usec * 0.000001 + tv.tv_sec;
+}
+
+BenchRunner::BenchmarkMap& BenchRunner::Benchmarks()
+{
+    // Constructed on first use, as the runners register from static initializers
+    static BenchmarkMap benchmarks;
+    return benchmarks;
+}
+
+BenchRunner::BenchRunner(const std::string& name, BenchFunction func)
+{
+    Benchmarks().insert(std::make_pair(name, func));
+}
+
+std::vector<Result> BenchRunner::RunAll(const std::string& strFilter, double elapsedTimeForOne)
+{
+    std::vector<Result> vResults;
+    for (BenchmarkMap::iterator it = Benchmarks().begin(); it != Benchmarks().end(); ++it) {
+        if (it->first.find(strFilter) == std::string::npos)
+            continue;
+        State state(it->first, elapsedTimeForOne);
+        it->second(state);
+        if (state.GetResult().count > 0)
+            vResults.push_back(state.GetResult());
+    }
+    return vResults;
+}
+
+State::State(const std::string& nameIn, double maxElapsedIn)
+    : maxElapsed(maxElapsedIn), timeCheckCount(1)
+{
+    result.name = nameIn;
+    result.count = 0;
+    result.min = std::numeric_limits<double>::max();
+    result.max = std::numeric_limits<double>::min();
+    result.average = 0;
+}
+
+bool State::KeepRunning()
+{
+    int64_t& count = result.count;
+    double now;
+    if (count == 0) {
+        beginTime = now = gettimedouble();
+    } else {
+        // timeCheckCount is used to avoid calling gettime most of the time,
+        // so benchmarks that run very quickly get consistent results.
+        if ((count + 1) % timeCheckCount != 0) {
+            ++count;
+            return true; // keep going
+        }
+        now = gettimedouble();
+        double elapsedOne = (now - lastTime) / timeCheckCount;
+        if (elapsedOne < result.min) result.min = elapsedOne;
+        if (elapsedOne > result.max) result.max = elapsedOne;
+        if (elapsedOne * timeCheckCount < maxElapsed / 16) timeCheckCount *= 2;
+    }
+    lastTime = now;
+    ++count;
+
+    if (now - beginTime < maxElapsed) return true; // Keep going
+
+    --count;
+
+    result.average = (now - beginTime) / count;
+    return false;
+}
@@ -0,0 +1,85 @@
+// Copyright (c) 2018 The KoinMudra developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BENCH_BENCH_H
+#define BITCOIN_BENCH_BENCH_H
+
+#include <map>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include <boost/function.hpp>
+#include <boost/preprocessor/cat.hpp>
+#include <boost/preprocessor/stringize.hpp>
+
+/**
+ * Minimal benchmarking framework.
+ *
+ * A benchmark is a function taking a State, registered with BENCHMARK():
+ *
+ *     static void CODE_TO_TIME(benchmark::State& state)
+ *     {
+ *         ... do any setup needed...
+ *         while (state.KeepRunning()) {
+ *             ... do stuff you want to time...
+ *         }
+ *         ... do any cleanup needed...
+ *     }
+ *
+ *     BENCHMARK(CODE_TO_TIME);
+ *
+ * The loop runs for about a second of wall clock time and records the
+ * fastest, slowest and average iteration.
+ */
+namespace benchmark
+{
+/** Timings of one benchmark, in seconds per iteration */
+struct Result {
+    std::string name;
+    int64_t count;
+    double min;
+    double max;
+    double average;
+};
+
+class State
+{
+private:
+    double maxElapsed;
+    double beginTime;
+    double lastTime;
+    int64_t timeCheckCount;
+    Result result;
+
+public:
+    State(const std::string& nameIn, double maxElapsedIn);
+
+    bool KeepRunning();
+
+    /** Timings once KeepRunning() has returned false; count is 0 if the loop never ran. */
+    const Result& GetResult() const { return result; }
+};
+
+typedef boost::function<void(State&)> BenchFunction;
+
+class BenchRunner
+{
+private:
+    typedef std::map<std::string, BenchFunction> BenchmarkMap;
+    static BenchmarkMap& Benchmarks();
+
+public:
+    BenchRunner(const std::string& name, BenchFunction func);
+
+    /** Run the benchmarks whose name contains strFilter, in name order. */
+    static std::vector<Result> RunAll(const std::string& strFilter = "", double elapsedTimeForOne = 1.0);
+};
+} // namespace benchmark
+
+// BENCHMARK(foo) expands to:  benchmark::BenchRunner bench_11foo("foo", foo);
+#define BENCHMARK(n) \
+    benchmark::BenchRunner BOOST_PP_CAT(bench_, BOOST_PP_CAT(__LINE__, n))(BOOST_PP_STRINGIZE(n), n);
+
+#endif // BITCOIN_BENCH_BENCH_H
@@ -0,0 +1,91 @@
+// Copyright (c) 2018 The KoinMudra developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "fixtures.h"
+
+#include "chainparams.h"
+#include "clientversion.h"
+#include "crypto/quark.h"
+#include "crypto/sha256.h"
+#include "util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <univalue.h>
+
+static void PrintCSV(const std::vector<benchmark::Result>& vResults)
+{
+    printf("#Benchmark,count,min,max,average\n");
+    for (unsigned int i = 0; i < vResults.size(); i++) {
+        const benchmark::Result& result = vResults[i];
+        printf("%s", strprintf("%s,%d,%g,%g,%g\n", result.name, result.count, result.min, result.max, result.average).c_str());
+    }
+}
+
+/** Results together with the version and fixture sizes they were measured with, so runs can be compared */
+static void PrintJSON(const std::vector<benchmark::Result>& vResults)
+{
+    UniValue fixtures(UniValue::VOBJ);
+    fixtures.push_back(Pair("blocks", GetBenchBlocks()));
+    fixtures.push_back(Pair("masternodes", GetBenchMasternodes()));
+    fixtures.push_back(Pair("utxos", GetBenchUtxos()));
+
+    UniValue benchmarks(UniValue::VARR);
+    for (unsigned int i = 0; i < vResults.size(); i++) {
+        const benchmark::Result& result = vResults[i];
+        UniValue entry(UniValue::VOBJ);
+        entry.push_back(Pair("name", result.name));
+        entry.push_back(Pair("count", result.count));
+        entry.push_back(Pair("min", result.min));
+        entry.push_back(Pair("max", result.max));
+        entry.push_back(Pair("average", result.average));
+        benchmarks.push_back(entry);
+    }
+
+    UniValue output(UniValue::VOBJ);
+    output.push_back(Pair("version", FormatFullVersion()));
+    output.push_back(Pair("fixtures", fixtures));
+    output.push_back(Pair("benchmarks", benchmarks));
+    printf("%s\n", output.write(2).c_str());
+}
+
+int main(int argc, char** argv)
+{
+    ParseParameters(argc, argv);
+    if (mapArgs.count("-?") || mapArgs.count("-help")) {
+        std::string strUsage = "Usage:\n  bench_koinmudra [options]\n\n";
+        strUsage += HelpMessageGroup("Options:");
+        strUsage += HelpMessageOpt("-?", "This help message");
+        strUsage += HelpMessageOpt("-filter=<name>", "Only run the benchmarks whose name contains <name>");
+        strUsage += HelpMessageOpt("-time=<seconds>", "Time to spend running each benchmark (default: 1)");
+        strUsage += HelpMessageOpt("-output=<format>", "Print the results as csv or json (default: csv)");
+        strUsage += HelpMessageGroup("Fixture options:");
+        strUsage += HelpMessageOpt("-blocks=<n>", strprintf("Length of the synthetic chain (default: %u)", DEFAULT_BENCH_BLOCKS));
+        strUsage += HelpMessageOpt("-masternodes=<n>", strprintf("Number of synthetic masternodes (default: %u)", DEFAULT_BENCH_MASTERNODES));
+        strUsage += HelpMessageOpt("-utxos=<n>", strprintf("Number of synthetic wallet coins (default: %u)", DEFAULT_BENCH_UTXOS));
+        printf("%s", strUsage.c_str());
+        return 0;
+    }
+
+    std::string strOutput = GetArg("-output", "csv");
+    if (strOutput != "csv" && strOutput != "json") {
+        fprintf(stderr, "Error: Unknown output format '%s'\n", strOutput.c_str());
+        return 1;
+    }
+
+    SetupEnvironment();
+    fPrintToDebugLog = false; // don't want to write to debug.log file
+    SelectParams(CBaseChainParams::REGTEST);
+    QuarkAutoDetect();
+    SHA256AutoDetect();
+
+    double dTime = atof(GetArg("-time", "1").c_str());
+    std::vector<benchmark::Result> vResults = benchmark::BenchRunner::RunAll(GetArg("-filter", ""), dTime > 0 ? dTime : 1.0);
+    if (strOutput == "json")
+        PrintJSON(vResults);
+    else
+        PrintCSV(vResults);
+}
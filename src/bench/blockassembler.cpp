@@ -0,0 +1,125 @@
+// Copyright (c) 2018 The KoinMudra developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "fixtures.h"
+
+#include "coins.h"
+#include "main.h"
+#include "miner.h"
+#include "script/script.h"
+#include "txmempool.h"
+
+#include <assert.h>
+#include <vector>
+
+/**
+ * Fill the mempool with nTx transactions spending anyone-can-spend coins.
+ * Out of every four, two spend confirmed coins and two extend the second of
+ * those into a chain, so that packages of up to three transactions form.
+ */
+static void FillMempool(CCoinsViewCache& view, unsigned int nTx, int nHeight)
+{
+    CMutableTransaction txFund;
+    txFund.vin.resize(1);
+    txFund.vin[0].prevout.n = 0;
+    txFund.vin[0].prevout.hash = view.GetBestBlock();
+    txFund.vout.resize(nTx);
+    for (unsigned int i = 0; i < nTx; i++) {
+        txFund.vout[i].scriptPubKey = CScript() << OP_TRUE;
+        txFund.vout[i].nValue = 1000000;
+    }
+    CTransaction txFunded(txFund);
+    AddCoins(view, txFunded, 1);
+
+    COutPoint prevout;
+    CAmount nValueIn = 0;
+    for (unsigned int i = 0; i < nTx; i++) {
+        if (i % 4 < 2) {
+            prevout = COutPoint(txFunded.GetHash(), i);
+            nValueIn = txFund.vout[i].nValue;
+        }
+        CAmount nFee = 1000 + (i * 7919) % 50000;
+
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = prevout;
+        tx.vout.resize(1);
+        tx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+        tx.vout[0].nValue = nValueIn - nFee;
+        mempool.addUnchecked(tx.GetHash(), CTxMemPoolEntry(tx, nFee, 0, 0.0, nHeight));
+
+        prevout = COutPoint(tx.GetHash(), 0);
+        nValueIn = tx.vout[0].nValue;
+    }
+}
+
+// Latency of filling a block template from mempools of growing size
+static void AssembleBlock(benchmark::State& state, unsigned int nMempoolTx)
+{
+    LOCK2(cs_main, mempool.cs);
+
+    CBlockIndex index;
+    index.nHeight = 100;
+    uint256 hashBest = uint256(nMempoolTx);
+    index.phashBlock = &mapBlockIndex.insert(std::make_pair(hashBest, &index)).first->first;
+
+    CCoinsView viewDummy;
+    CCoinsViewCache viewFund(&viewDummy);
+    viewFund.SetBestBlock(hashBest);
+    FillMempool(viewFund, nMempoolTx, index.nHeight);
+
+    while (state.KeepRunning()) {
+        CBlockTemplate blocktemplate;
+        CCoinsViewCache view(&viewFund);
+        CBlockAssembler assembler(blocktemplate, view, index.nHeight + 1);
+        assembler.AddPriorityTxs();
+        assembler.AddPackageTxs();
+    }
+
+    mempool.clear();
+    mapBlockIndex.erase(hashBest);
+}
+
+static void AssembleBlock1000(benchmark::State& state)
+{
+    AssembleBlock(state, 1000);
+}
+static void AssembleBlock10000(benchmark::State& state)
+{
+    AssembleBlock(state, 10000);
+}
+static void AssembleBlock50000(benchmark::State& state)
+{
+    AssembleBlock(state, 50000);
+}
+
+// All of CreateNewBlock() on the synthetic chain and masternode list, with -utxos transactions in the mempool
+static void CreateBlockTemplate(benchmark::State& state)
+{
+    CBenchChain chain;
+    CBenchMasternodes masternodes;
+
+    CCoinsView viewDummy;
+    CCoinsViewCache viewTip(&viewDummy);
+    viewTip.SetBestBlock(chain.Tip()->GetBlockHash());
+    CCoinsViewCache* pcoinsTipOld = pcoinsTip;
+    pcoinsTip = &viewTip;
+    FillMempool(viewTip, GetBenchUtxos(), chain.Tip()->nHeight);
+
+    CScript scriptPubKey = CScript() << OP_TRUE;
+    while (state.KeepRunning()) {
+        CBlockTemplate* pblocktemplate = CreateNewBlock(scriptPubKey, NULL, false);
+        assert(pblocktemplate);
+        delete pblocktemplate;
+    }
+
+    mempool.clear();
+    pcoinsTip = pcoinsTipOld;
+}
+
+BENCHMARK(AssembleBlock1000);
+BENCHMARK(AssembleBlock10000);
+BENCHMARK(AssembleBlock50000);
+BENCHMARK(CreateBlockTemplate);
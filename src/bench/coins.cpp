@@ -0,0 +1,63 @@
+// Copyright (c) 2018 The KoinMudra developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "fixtures.h"
+
+#include "coins.h"
+
+#include <memory>
+
+// Looking up coins that are in the cache already
+static void CoinsViewCacheAccess(benchmark::State& state)
+{
+    CBenchCoins coins;
+
+    unsigned int i = 0;
+    while (state.KeepRunning()) {
+        coins.view.AccessCoin(coins.vOutpoints[i]);
+        if (++i == coins.vOutpoints.size())
+            i = 0;
+    }
+}
+
+// Pulling coins into a cache from the one below it, as a block's view does from pcoinsTip
+static void CoinsViewCacheFetch(benchmark::State& state)
+{
+    CBenchCoins coins;
+    std::unique_ptr<CCoinsViewCache> pview(new CCoinsViewCache(&coins.view));
+
+    unsigned int i = 0;
+    while (state.KeepRunning()) {
+        pview->AccessCoin(coins.vOutpoints[i]);
+        if (++i == coins.vOutpoints.size()) {
+            // Every coin is cached now, start over with an empty cache
+            pview.reset(new CCoinsViewCache(&coins.view));
+            i = 0;
+        }
+    }
+}
+
+// Spending a coin and adding one in its place, as connecting a block does for each input and output
+static void CoinsViewCacheSpendAdd(benchmark::State& state)
+{
+    CBenchCoins coins;
+    std::unique_ptr<CCoinsViewCache> pview(new CCoinsViewCache(&coins.view));
+
+    unsigned int i = 0;
+    while (state.KeepRunning()) {
+        const COutPoint& prevout = coins.vOutpoints[i];
+        Coin coin;
+        pview->SpendCoin(prevout, &coin);
+        pview->AddCoin(COutPoint(prevout.hash, prevout.n + 4), coin, false);
+        if (++i == coins.vOutpoints.size()) {
+            pview.reset(new CCoinsViewCache(&coins.view));
+            i = 0;
+        }
+    }
+}
+
+BENCHMARK(CoinsViewCacheAccess);
+BENCHMARK(CoinsViewCacheFetch);
+BENCHMARK(CoinsViewCacheSpendAdd);
@@ -0,0 +1,128 @@
+// Copyright (c) 2018 The KoinMudra developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "fixtures.h"
+
+#include "chainparams.h"
+#include "kernel.h"
+#include "main.h"
+#include "masternode.h"
+#include "masternodeman.h"
+#include "random.h"
+#include "util.h"
+
+#include <algorithm>
+#include <string.h>
+
+int GetBenchBlocks()
+{
+    // Kernels need a stake modifier about half an hour past their block, pings a dozen blocks of depth
+    return std::max(100, (int)GetArg("-blocks", DEFAULT_BENCH_BLOCKS));
+}
+
+int GetBenchMasternodes()
+{
+    return std::max(1, (int)GetArg("-masternodes", DEFAULT_BENCH_MASTERNODES));
+}
+
+int GetBenchUtxos()
+{
+    return std::max(1, (int)GetArg("-utxos", DEFAULT_BENCH_UTXOS));
+}
+
+static uint256 InsecureRand256()
+{
+    uint256 hash;
+    for (unsigned int i = 0; i < hash.size() / 4; i++) {
+        uint32_t n = insecure_rand();
+        memcpy(hash.begin() + 4 * i, &n, 4);
+    }
+    return hash;
+}
+
+CBenchChain::CBenchChain()
+{
+    const int nBlocks = GetBenchBlocks();
+    seed_insecure_rand(true);
+
+    vHeaders.resize(nBlocks);
+    vIndex.resize(nBlocks);
+    LOCK(cs_main);
+    for (int i = 0; i < nBlocks; i++) {
+        CBlockHeader& header = vHeaders[i];
+        header.nVersion = 4;
+        header.hashPrevBlock = i > 0 ? vHeaders[i - 1].GetHash() : uint256(0);
+        header.hashMerkleRoot = InsecureRand256();
+        header.nTime = Params().GenesisBlock().nTime + i * BENCH_BLOCK_SPACING;
+        header.nBits = Params().ProofOfWorkLimit().GetCompact();
+        header.nNonce = insecure_rand();
+
+        CBlockIndex& index = vIndex[i];
+        index.nVersion = header.nVersion;
+        index.hashMerkleRoot = header.hashMerkleRoot;
+        index.nTime = header.nTime;
+        index.nBits = header.nBits;
+        index.nNonce = header.nNonce;
+        index.nHeight = i;
+        index.pprev = i > 0 ? &vIndex[i - 1] : NULL;
+        index.nStatus = BLOCK_VALID_SCRIPTS | BLOCK_HAVE_DATA;
+        index.nChainTx = i + 1;
+        index.SetStakeModifier(((uint64_t)insecure_rand() << 32) | insecure_rand(), true);
+        index.phashBlock = &mapBlockIndex.insert(std::make_pair(header.GetHash(), &index)).first->first;
+        index.BuildSkip();
+    }
+    chainActive.SetTip(Tip());
+}
+
+CBenchChain::~CBenchChain()
+{
+    LOCK(cs_main);
+    chainActive.SetTip(NULL);
+    // Drop the stake modifier index's pointers into vIndex along with the chain
+    UpdateStakeModifierIndex();
+    for (unsigned int i = 0; i < vHeaders.size(); i++)
+        mapBlockIndex.erase(vHeaders[i].GetHash());
+    masternodeHeights.Clear();
+}
+
+CBenchMasternodes::CBenchMasternodes()
+{
+    const int nMasternodes = GetBenchMasternodes();
+    seed_insecure_rand(true);
+
+    std::vector<unsigned char> vchPubKey(33);
+    for (int i = 0; i < nMasternodes; i++) {
+        CMasternode mn;
+        mn.vin = CTxIn(COutPoint(InsecureRand256(), insecure_rand() % 4));
+        vchPubKey[0] = 0x02;
+        for (unsigned int j = 1; j < vchPubKey.size(); j++)
+            vchPubKey[j] = insecure_rand();
+        mn.pubKeyCollateralAddress = CPubKey(vchPubKey);
+        mn.pubKeyMasternode = mn.pubKeyCollateralAddress;
+        mn.lastPing = CMasternodePing(mn.vin);
+        mn.unitTest = true;
+        mnodeman.Add(mn);
+    }
+}
+
+CBenchMasternodes::~CBenchMasternodes()
+{
+    mnodeman.Clear();
+}
+
+CBenchCoins::CBenchCoins() : view(&viewEmpty)
+{
+    const int nCoins = GetBenchUtxos();
+    seed_insecure_rand(true);
+
+    vOutpoints.reserve(nCoins);
+    for (int i = 0; i < nCoins; i++) {
+        CTxOut out;
+        out.nValue = (1 + insecure_rand() % 100000) * CENT;
+        uint256 hashKey = InsecureRand256();
+        out.scriptPubKey = GetScriptForDestination(CKeyID(uint160(std::vector<unsigned char>(hashKey.begin(), hashKey.begin() + 20))));
+        vOutpoints.push_back(COutPoint(InsecureRand256(), insecure_rand() % 4));
+        view.AddCoin(vOutpoints.back(), Coin(out, 1 + insecure_rand() % 1000, false, false), false);
+    }
+}
@@ -0,0 +1,88 @@
+// Copyright (c) 2018 The KoinMudra developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BENCH_FIXTURES_H
+#define BITCOIN_BENCH_FIXTURES_H
+
+#include "chain.h"
+#include "coins.h"
+#include "primitives/block.h"
+
+#include <vector>
+
+/** Default for -blocks, the length of the synthetic chain */
+static const int DEFAULT_BENCH_BLOCKS = 1000;
+/** Default for -masternodes, the size of the synthetic masternode list */
+static const int DEFAULT_BENCH_MASTERNODES = 2000;
+/** Default for -utxos, the number of coins in the synthetic wallet */
+static const int DEFAULT_BENCH_UTXOS = 10000;
+
+/** Seconds between the blocks of a CBenchChain */
+static const int BENCH_BLOCK_SPACING = 60;
+
+/** Fixture sizes from -blocks, -masternodes and -utxos, raised to what the fixtures need */
+int GetBenchBlocks();
+int GetBenchMasternodes();
+int GetBenchUtxos();
+
+/*
+ * Synthetic state for the benchmarks. Every fixture seeds insecure_rand()
+ * with a fixed value before building its contents, so the same sizes give
+ * the same fixture on every run and every machine.
+ */
+
+/**
+ * An active chain of -blocks headers, BENCH_BLOCK_SPACING seconds apart,
+ * each of which generated a stake modifier. The blocks are indexed in
+ * mapBlockIndex under their Quark hashes and form chainActive until the
+ * fixture is destroyed.
+ */
+class CBenchChain
+{
+private:
+    CBenchChain(const CBenchChain&);
+    void operator=(const CBenchChain&);
+
+public:
+    std::vector<CBlockHeader> vHeaders;
+    std::vector<CBlockIndex> vIndex;
+
+    CBenchChain();
+    ~CBenchChain();
+
+    CBlockIndex* Tip() { return &vIndex.back(); }
+};
+
+/**
+ * -masternodes enabled masternodes in mnodeman, pinged at the tip of the
+ * active chain, so a CBenchChain must exist first. They are marked as unit
+ * test masternodes so that Check() does not look up their collateral.
+ */
+class CBenchMasternodes
+{
+private:
+    CBenchMasternodes(const CBenchMasternodes&);
+    void operator=(const CBenchMasternodes&);
+
+public:
+    CBenchMasternodes();
+    ~CBenchMasternodes();
+};
+
+/** -utxos wallet coins paying to pay-to-pubkey-hash scripts, cached on top of an empty view */
+class CBenchCoins
+{
+private:
+    CBenchCoins(const CBenchCoins&);
+    void operator=(const CBenchCoins&);
+
+public:
+    CCoinsView viewEmpty;
+    CCoinsViewCache view;
+    std::vector<COutPoint> vOutpoints;
+
+    CBenchCoins();
+};
+
+#endif // BITCOIN_BENCH_FIXTURES_H
@@ -0,0 +1,62 @@
+// Copyright (c) 2018 The KoinMudra developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "fixtures.h"
+
+#include "kernel.h"
+#include "main.h"
+
+#include <vector>
+
+/** A target per coin day of 1, which no kernel meets, so searches always run to the end */
+static const unsigned int BENCH_KERNEL_BITS = 0x03000001;
+/** Timestamps searched per coin, as the staking wallet does */
+static const unsigned int BENCH_HASH_DRIFT = 45;
+
+// Checking the kernel of a proof-of-stake block, as ConnectBlock() does for every one of them
+static void StakeKernelCheck(benchmark::State& state)
+{
+    CBenchChain chain;
+    CBlock blockFrom(chain.vHeaders[chain.vHeaders.size() / 2]);
+    CMutableTransaction txPrev;
+    txPrev.vout.resize(1);
+    txPrev.vout[0].nValue = 1000 * COIN;
+    COutPoint prevout(txPrev.GetHash(), 0);
+    unsigned int nTimeTx = blockFrom.GetBlockTime() + 3600;
+
+    while (state.KeepRunning()) {
+        uint256 hashProofOfStake;
+        CheckStakeKernelHash(BENCH_KERNEL_BITS, blockFrom, txPrev, prevout, nTimeTx, 0, true, hashProofOfStake);
+    }
+}
+
+// Searching the kernels of all wallet coins for a stake, as the staking wallet does every round
+static void StakeKernelSearch(benchmark::State& state)
+{
+    CBenchChain chain;
+    CBenchCoins coins;
+
+    std::vector<CStakeKernel> vKernels(coins.vOutpoints.size());
+    for (unsigned int i = 0; i < coins.vOutpoints.size(); i++) {
+        const COutPoint& prevout = coins.vOutpoints[i];
+        CMutableTransaction txPrev;
+        txPrev.vout.resize(prevout.n + 1);
+        txPrev.vout[prevout.n] = coins.view.AccessCoin(prevout).out;
+        // Coins come from the first half of the chain, where stake modifiers have been selected
+        const CBlockIndex* pindexFrom = &chain.vIndex[i % (chain.vIndex.size() / 2)];
+        PrepareStakeKernel(BENCH_KERNEL_BITS, pindexFrom, txPrev, prevout, vKernels[i]);
+    }
+    unsigned int nTimeTx = chain.Tip()->GetBlockTime();
+
+    while (state.KeepRunning()) {
+        size_t nKernel;
+        unsigned int nTimeFound;
+        uint256 hashProofOfStake;
+        FindStakeKernel(vKernels, nTimeTx, BENCH_HASH_DRIFT, nKernel, nTimeFound, hashProofOfStake);
+    }
+}
+
+BENCHMARK(StakeKernelCheck);
+BENCHMARK(StakeKernelSearch);
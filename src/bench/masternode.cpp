@@ -0,0 +1,47 @@
+// Copyright (c) 2018 The KoinMudra developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "fixtures.h"
+
+#include "masternodeman.h"
+
+#include <algorithm>
+#include <assert.h>
+
+/** Heights the uncached benchmark cycles through, more than the rank and score context caches hold */
+static const int MASTERNODE_BENCH_HEIGHTS = 200;
+
+// Ranking at heights whose scores are not cached, as when a new block comes in
+static void MasternodeRanks(benchmark::State& state)
+{
+    CBenchChain chain;
+    CBenchMasternodes masternodes;
+    const int nTipHeight = chain.Tip()->nHeight;
+    const int nHeights = std::min(MASTERNODE_BENCH_HEIGHTS, nTipHeight - 1);
+
+    int i = 0;
+    while (state.KeepRunning()) {
+        std::vector<std::pair<int, CMasternode> > vecRanks = mnodeman.GetMasternodeRanks(nTipHeight - nHeights + 1 + i);
+        assert(!vecRanks.empty());
+        if (++i == nHeights)
+            i = 0;
+    }
+}
+
+// Ranking at the same height over and over, as the masternode list RPCs and winner votes do
+static void MasternodeRanksCached(benchmark::State& state)
+{
+    CBenchChain chain;
+    CBenchMasternodes masternodes;
+    const int nTipHeight = chain.Tip()->nHeight;
+
+    while (state.KeepRunning()) {
+        std::vector<std::pair<int, CMasternode> > vecRanks = mnodeman.GetMasternodeRanks(nTipHeight);
+        assert(!vecRanks.empty());
+    }
+}
+
+BENCHMARK(MasternodeRanks);
+BENCHMARK(MasternodeRanksCached);
@@ -0,0 +1,50 @@
+// Copyright (c) 2018 The KoinMudra developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "fixtures.h"
+
+#include "amount.h"
+#include "txmempool.h"
+
+#include <vector>
+
+// Adding transactions that spend the wallet coins to the mempool, one at a time as they are accepted
+static void MempoolAddUnchecked(benchmark::State& state)
+{
+    CBenchCoins coins;
+
+    // Pay-to-pubkey-hash spends of the size a signed one has
+    std::vector<unsigned char> vchSig(72, 0x30);
+    std::vector<unsigned char> vchPubKey(33, 0x02);
+    std::vector<CTxMemPoolEntry> vEntries;
+    std::vector<uint256> vHashes;
+    for (unsigned int i = 0; i < coins.vOutpoints.size(); i++) {
+        const CTxOut& out = coins.view.AccessCoin(coins.vOutpoints[i]).out;
+        CAmount nFee = 10000 + (i * 7919) % 50000;
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = coins.vOutpoints[i];
+        tx.vin[0].scriptSig = CScript() << vchSig << vchPubKey;
+        tx.vout.resize(2);
+        tx.vout[0].scriptPubKey = out.scriptPubKey;
+        tx.vout[0].nValue = (out.nValue - nFee) / 2;
+        tx.vout[1].scriptPubKey = out.scriptPubKey;
+        tx.vout[1].nValue = out.nValue - nFee - tx.vout[0].nValue;
+        vEntries.push_back(CTxMemPoolEntry(tx, nFee, 0, 0.0, 1));
+        vHashes.push_back(tx.GetHash());
+    }
+
+    CTxMemPool pool(CFeeRate(0));
+    unsigned int i = 0;
+    while (state.KeepRunning()) {
+        pool.addUnchecked(vHashes[i], vEntries[i]);
+        if (++i == vEntries.size()) {
+            pool.clear();
+            i = 0;
+        }
+    }
+}
+
+BENCHMARK(MempoolAddUnchecked);
@@ -0,0 +1,42 @@
+// Copyright (c) 2018 The KoinMudra developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "primitives/block.h"
+
+/** About as many transactions as a full block holds */
+static const unsigned int MERKLE_BENCH_TXS = 2000;
+
+static CBlock BenchBlock()
+{
+    CBlock block;
+    for (unsigned int i = 0; i < MERKLE_BENCH_TXS; i++) {
+        CMutableTransaction tx;
+        tx.nLockTime = i;
+        block.vtx.push_back(CTransaction(tx));
+    }
+    return block;
+}
+
+// The root only, as CheckBlock() and CreateNewBlock() need it
+static void MerkleRoot(benchmark::State& state)
+{
+    CBlock block = BenchBlock();
+    while (state.KeepRunning()) {
+        bool fMutated;
+        block.ComputeMerkleRoot(&fMutated);
+    }
+}
+
+// The whole tree, kept for GetMerkleBranch()
+static void MerkleTree(benchmark::State& state)
+{
+    CBlock block = BenchBlock();
+    while (state.KeepRunning())
+        block.BuildMerkleTree();
+}
+
+BENCHMARK(MerkleRoot);
+BENCHMARK(MerkleTree);
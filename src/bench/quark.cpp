@@ -0,0 +1,59 @@
+// Copyright (c) 2018 The KoinMudra developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "crypto/quark.h"
+#include "hash.h"
+#include "primitives/block.h"
+#include "utilstrencodings.h"
+
+#include <vector>
+
+/** Messages QuarkHashBatch() is handed at once, as many as its widest kernel takes */
+static const unsigned int QUARK_BENCH_BATCH = 8;
+
+static CBlockHeader BenchHeader(unsigned int n)
+{
+    CBlockHeader header;
+    header.nVersion = 4;
+    header.hashPrevBlock = Hash(BEGIN(n), END(n));
+    header.hashMerkleRoot = Hash(header.hashPrevBlock.begin(), header.hashPrevBlock.end());
+    header.nTime = 1500000000 + n;
+    header.nBits = 0x1e0fffff;
+    header.nNonce = n;
+    return header;
+}
+
+// One block header, the way CBlockHeader::GetHash() hashes it
+static void HashQuarkHeader(benchmark::State& state)
+{
+    CBlockHeader header = BenchHeader(0);
+    while (state.KeepRunning()) {
+        header.nNonce++;
+        HashQuark(BEGIN(header.nVersion), END(header.nNonce));
+    }
+}
+
+// A batch of block headers per iteration, the way a headers message is hashed
+static void HashQuarkHeaderBatch(benchmark::State& state)
+{
+    std::vector<CBlockHeader> vHeaders;
+    std::vector<const unsigned char*> vIn;
+    for (unsigned int i = 0; i < QUARK_BENCH_BATCH; i++)
+        vHeaders.push_back(BenchHeader(i));
+    for (unsigned int i = 0; i < QUARK_BENCH_BATCH; i++)
+        vIn.push_back((const unsigned char*)BEGIN(vHeaders[i].nVersion));
+    const size_t nLen = END(vHeaders[0].nNonce) - BEGIN(vHeaders[0].nVersion);
+    std::vector<unsigned char> vOut(32 * QUARK_BENCH_BATCH);
+
+    while (state.KeepRunning()) {
+        for (unsigned int i = 0; i < QUARK_BENCH_BATCH; i++)
+            vHeaders[i].nNonce++;
+        QuarkHashBatch(&vOut[0], &vIn[0], nLen, vIn.size());
+    }
+}
+
+BENCHMARK(HashQuarkHeader);
+BENCHMARK(HashQuarkHeaderBatch);
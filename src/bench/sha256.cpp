@@ -0,0 +1,59 @@
+// Copyright (c) 2018 The KoinMudra developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "crypto/sha256.h"
+
+#include <vector>
+
+/** Inputs SHA256D64() is handed at once, as for one level of a full block's merkle tree */
+static const unsigned int SHA256D64_BENCH_BLOCKS = 1024;
+
+/**
+ * Select the transforms one benchmark measures. A benchmark whose transforms
+ * this machine lacks does not run, and so is left out of the results.
+ */
+static bool UseSHA256(unsigned int nUse, const std::string& strName)
+{
+    return SHA256AutoDetect(nUse).find(strName) != std::string::npos;
+}
+
+static void SHA256_1M(benchmark::State& state, unsigned int nUse, const std::string& strName)
+{
+    if (UseSHA256(nUse, strName)) {
+        std::vector<unsigned char> in(1000000);
+        unsigned char hash[CSHA256::OUTPUT_SIZE];
+        while (state.KeepRunning())
+            CSHA256().Write(&in[0], in.size()).Finalize(hash);
+    }
+    SHA256AutoDetect();
+}
+
+static void SHA256D64_1024(benchmark::State& state, unsigned int nUse, const std::string& strName)
+{
+    if (UseSHA256(nUse, strName)) {
+        std::vector<unsigned char> in(64 * SHA256D64_BENCH_BLOCKS);
+        std::vector<unsigned char> out(32 * SHA256D64_BENCH_BLOCKS);
+        while (state.KeepRunning())
+            SHA256D64(&out[0], &in[0], SHA256D64_BENCH_BLOCKS);
+    }
+    SHA256AutoDetect();
+}
+
+static void SHA256_1M_Standard(benchmark::State& state) { SHA256_1M(state, 0, "standard"); }
+static void SHA256_1M_SHANI(benchmark::State& state) { SHA256_1M(state, SHA256_USE_SHANI, "shani"); }
+static void SHA256D64_1024_Standard(benchmark::State& state) { SHA256D64_1024(state, 0, "standard"); }
+static void SHA256D64_1024_SSE41(benchmark::State& state) { SHA256D64_1024(state, SHA256_USE_SSE41, "sse4.1"); }
+static void SHA256D64_1024_AVX2(benchmark::State& state) { SHA256D64_1024(state, SHA256_USE_AVX2, "avx2"); }
+static void SHA256D64_1024_SHANI(benchmark::State& state) { SHA256D64_1024(state, SHA256_USE_SHANI, "shani"); }
+static void SHA256D64_1024_Best(benchmark::State& state) { SHA256D64_1024(state, SHA256_USE_ALL, ""); }
+
+BENCHMARK(SHA256_1M_Standard);
+BENCHMARK(SHA256_1M_SHANI);
+BENCHMARK(SHA256D64_1024_Standard);
+BENCHMARK(SHA256D64_1024_SSE41);
+BENCHMARK(SHA256D64_1024_AVX2);
+BENCHMARK(SHA256D64_1024_SHANI);
+BENCHMARK(SHA256D64_1024_Best);
@@ -0,0 +1,79 @@
+// Copyright (c) 2018 The KoinMudra developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "pubkey.h"
+#include "random.h"
+#include "script/sigcache.h"
+
+#include <vector>
+
+/** Number of distinct signatures cycled through by the benchmarks */
+static const unsigned int SIGCACHE_BENCH_ENTRIES = 100000;
+
+static void FillSigCache(CSignatureCache& cache, std::vector<uint256>& vHashes, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey)
+{
+    vHashes.resize(SIGCACHE_BENCH_ENTRIES);
+    for (unsigned int i = 0; i < SIGCACHE_BENCH_ENTRIES; i++) {
+        vHashes[i] = GetRandHash();
+        cache.Set(vHashes[i], vchSig, pubKey);
+    }
+}
+
+static CPubKey BenchPubKey()
+{
+    std::vector<unsigned char> vch(33, 0x5a);
+    vch[0] = 0x02;
+    return CPubKey(vch);
+}
+
+static void SigCacheLookupHit(benchmark::State& state)
+{
+    CSignatureCache cache(DEFAULT_MAX_SIG_CACHE_SIZE << 20);
+    std::vector<unsigned char> vchSig(72, 0x30);
+    CPubKey pubKey = BenchPubKey();
+    std::vector<uint256> vHashes;
+    FillSigCache(cache, vHashes, vchSig, pubKey);
+
+    unsigned int i = 0;
+    while (state.KeepRunning()) {
+        cache.Get(vHashes[i], vchSig, pubKey, false);
+        if (++i == vHashes.size())
+            i = 0;
+    }
+}
+
+static void SigCacheLookupMiss(benchmark::State& state)
+{
+    CSignatureCache cache(DEFAULT_MAX_SIG_CACHE_SIZE << 20);
+    std::vector<unsigned char> vchSig(72, 0x30);
+    CPubKey pubKey = BenchPubKey();
+    std::vector<uint256> vHashes;
+    FillSigCache(cache, vHashes, vchSig, pubKey);
+    uint256 hashMissing = GetRandHash();
+
+    while (state.KeepRunning())
+        cache.Get(hashMissing, vchSig, pubKey, false);
+}
+
+// Inserts into a full cache, the worst case as every one of them displaces entries
+static void SigCacheInsertFull(benchmark::State& state)
+{
+    CSignatureCache cache(1 << 20);
+    std::vector<unsigned char> vchSig(72, 0x30);
+    CPubKey pubKey = BenchPubKey();
+    std::vector<uint256> vHashes;
+    FillSigCache(cache, vHashes, vchSig, pubKey);
+
+    uint256 hash = GetRandHash();
+    while (state.KeepRunning()) {
+        *hash.begin() += 1;
+        cache.Set(hash, vchSig, pubKey);
+    }
+}
+
+BENCHMARK(SigCacheLookupHit);
+BENCHMARK(SigCacheLookupMiss);
+BENCHMARK(SigCacheInsertFull);
@@ -0,0 +1,64 @@
+// Copyright (c) 2018 The KoinMudra developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "eccryptoverify.h"
+#include "key.h"
+#include "pubkey.h"
+#include "random.h"
+
+#include <assert.h>
+#include <vector>
+
+/** A signature of a random hash by a fresh compressed key */
+static void SetupVerify(CPubKey& pubKey, uint256& hash, std::vector<unsigned char>& vchSig)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    pubKey = key.GetPubKey();
+    hash = GetRandHash();
+    bool fSigned = key.Sign(hash, vchSig);
+    assert(fSigned);
+}
+
+static void VerifyParseDER(benchmark::State& state)
+{
+    CPubKey pubKey;
+    uint256 hash;
+    std::vector<unsigned char> vchSig;
+    SetupVerify(pubKey, hash, vchSig);
+
+    unsigned char vchRS[64];
+    while (state.KeepRunning())
+        eccrypto::ParseDERSignatureLax(&vchSig[0], vchSig.size(), vchRS);
+}
+
+static void VerifyParsePubKey(benchmark::State& state)
+{
+    CPubKey pubKey;
+    uint256 hash;
+    std::vector<unsigned char> vchSig;
+    SetupVerify(pubKey, hash, vchSig);
+
+    while (state.KeepRunning())
+        pubKey.IsFullyValid();
+}
+
+static void VerifyECDSA(benchmark::State& state)
+{
+    CPubKey pubKey;
+    uint256 hash;
+    std::vector<unsigned char> vchSig;
+    SetupVerify(pubKey, hash, vchSig);
+
+    while (state.KeepRunning()) {
+        bool fValid = pubKey.Verify(hash, vchSig);
+        assert(fValid);
+    }
+}
+
+BENCHMARK(VerifyParseDER);
+BENCHMARK(VerifyParsePubKey);
+BENCHMARK(VerifyECDSA);
@@ -0,0 +1,94 @@
+// Copyright (c) 2018 The KoinMudra developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "util.h"
+
+#ifdef ENABLE_WALLET
+#include "random.h"
+#include "wallet.h"
+#include "walletscan.h"
+
+#include <assert.h>
+#include <vector>
+
+static const unsigned int WALLETSCAN_BENCH_BLOCKS = 100;
+static const unsigned int WALLETSCAN_BENCH_TXS = 250;
+static const unsigned int WALLETSCAN_BENCH_KEYS = 20000;
+
+static CKeyID RandomKeyID()
+{
+    uint256 hash = GetRandHash();
+    return CKeyID(uint160(std::vector<unsigned char>(hash.begin(), hash.begin() + 20)));
+}
+
+/**
+ * Blocks of pay-to-pubkey-hash transactions, about one in a hundred paying a
+ * key of matchSet, which holds as many keys as a large wallet.
+ */
+static void SetupWalletScan(CScriptMatchSet& matchSet, std::vector<boost::shared_ptr<CScannedBlock> >& vBlocks)
+{
+    std::vector<CKeyID> vKeys;
+    for (unsigned int i = 0; i < WALLETSCAN_BENCH_KEYS; i++) {
+        vKeys.push_back(RandomKeyID());
+        matchSet.setKeyIDs.insert(vKeys.back());
+    }
+
+    for (unsigned int i = 0; i < WALLETSCAN_BENCH_BLOCKS; i++) {
+        CBlock block;
+        for (unsigned int j = 0; j < WALLETSCAN_BENCH_TXS; j++) {
+            CMutableTransaction tx;
+            tx.vin.resize(1);
+            tx.vin[0].prevout.hash = GetRandHash();
+            tx.vout.resize(2);
+            for (unsigned int k = 0; k < tx.vout.size(); k++) {
+                CKeyID keyID = GetRand(200) == 0 ? vKeys[GetRand(vKeys.size())] : RandomKeyID();
+                tx.vout[k].scriptPubKey = GetScriptForDestination(keyID);
+                tx.vout[k].nValue = 1000000;
+            }
+            block.vtx.push_back(tx);
+        }
+        vBlocks.push_back(boost::shared_ptr<CScannedBlock>(new CScannedBlock(block)));
+    }
+}
+
+/** Match all blocks the way ScanForWalletTransactions() walks the chain */
+static void WalletScan(benchmark::State& state, int nThreads)
+{
+    CScriptMatchSet matchSet;
+    std::vector<boost::shared_ptr<CScannedBlock> > vBlocks;
+    SetupWalletScan(matchSet, vBlocks);
+    const size_t nBlocksAhead = RESCAN_BLOCKS_AHEAD_PER_THREAD * (nThreads + 1);
+
+    CWalletScanner scanner(matchSet, nThreads);
+    while (state.KeepRunning()) {
+        unsigned int nPushed = 0;
+        unsigned int nMatches = 0;
+        for (unsigned int i = 0; i < vBlocks.size(); i++) {
+            while (nPushed < vBlocks.size() && scanner.GetQueueSize() < nBlocksAhead) {
+                vBlocks[nPushed]->fDone = false;
+                scanner.Push(vBlocks[nPushed++]);
+            }
+            boost::shared_ptr<CScannedBlock> pscanned = scanner.Pop();
+            for (unsigned int j = 0; j < pscanned->vMayBeMine.size(); j++)
+                nMatches += pscanned->vMayBeMine[j];
+        }
+        assert(nMatches > 0);
+    }
+}
+
+static void WalletScan1Thread(benchmark::State& state)
+{
+    WalletScan(state, 0);
+}
+
+static void WalletScan4Threads(benchmark::State& state)
+{
+    WalletScan(state, 4);
+}
+
+BENCHMARK(WalletScan1Thread);
+BENCHMARK(WalletScan4Threads);
+#endif // ENABLE_WALLET
@@ -0,0 +1,106 @@
+// Copyright (c) 2018 The KoinMudra developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilemap.h"
+
+#include "chainparams.h"
+#include "main.h"
+#include "util.h"
+
+#include <errno.h>
+#include <string.h>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+CMappedBlockFile::~CMappedBlockFile()
+{
+#ifndef WIN32
+    munmap((void*)pdata, nSize);
+#endif
+}
+
+boost::shared_ptr<const CMappedBlockFile> CBlockFileMap::MapFile(int nFile)
+{
+    boost::shared_ptr<const CMappedBlockFile> file;
+#ifndef WIN32
+    boost::filesystem::path path = GetBlockPosFilename(CDiskBlockPos(nFile, 0), "blk");
+    int fd = open(path.string().c_str(), O_RDONLY);
+    if (fd == -1)
+        return file;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        void* pdata = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (pdata != MAP_FAILED)
+            file.reset(new CMappedBlockFile(nFile, (const char*)pdata, st.st_size));
+        else
+            LogPrintf("%s : cannot map %s: %s\n", __func__, path.string(), strerror(errno));
+    }
+    close(fd);
+#endif
+    return file;
+}
+
+/** Size of the block stored at pos, if the block lies entirely within the mapping */
+static bool GetMappedBlockSize(const CMappedBlockFile& file, const CDiskBlockPos& pos, unsigned int& nSizeRet)
+{
+    if (file.nSize < pos.nPos)
+        return false;
+    memcpy(&nSizeRet, file.pdata + pos.nPos - sizeof(unsigned int), sizeof(unsigned int));
+    return pos.nPos + (size_t)nSizeRet <= file.nSize;
+}
+
+bool CBlockFileMap::GetBlock(const CDiskBlockPos& pos, CMappedBlock& blockRet)
+{
+    // Blocks are stored behind the network magic and their size, see WriteBlockToDisk()
+    const size_t nHeaderSize = MESSAGE_START_SIZE + sizeof(unsigned int);
+    if (pos.IsNull() || pos.nPos < nHeaderSize)
+        return false;
+
+    boost::shared_ptr<const CMappedBlockFile> file;
+    unsigned int nBlockSize;
+    {
+        LOCK(cs);
+        std::list<boost::shared_ptr<const CMappedBlockFile> >::iterator it = lruFiles.begin();
+        while (it != lruFiles.end() && (*it)->nFile != pos.nFile)
+            ++it;
+        if (it != lruFiles.end()) {
+            file = *it;
+            lruFiles.erase(it);
+        }
+
+        if (!file || !GetMappedBlockSize(*file, pos, nBlockSize)) {
+            // Not mapped yet, or the block was appended after the file was mapped
+            file = MapFile(pos.nFile);
+            if (!file)
+                return false;
+        }
+
+        lruFiles.push_front(file);
+        while (lruFiles.size() > nMaxFiles)
+            lruFiles.pop_back();
+    }
+
+    if (!GetMappedBlockSize(*file, pos, nBlockSize))
+        return error("%s : block at position %d in file %d runs past the end of the file", __func__, pos.nPos, pos.nFile);
+    if (memcmp(file->pdata + pos.nPos - nHeaderSize, Params().MessageStart(), MESSAGE_START_SIZE) != 0)
+        return error("%s : block magic mismatch at position %d in file %d", __func__, pos.nPos, pos.nFile);
+    if (nBlockSize > MAX_BLOCK_SIZE)
+        return error("%s : block size %u too large at position %d in file %d", __func__, nBlockSize, pos.nPos, pos.nFile);
+
+    blockRet.file = file;
+    blockRet.pbegin = file->pdata + pos.nPos;
+    blockRet.pend = blockRet.pbegin + nBlockSize;
+    return true;
+}
+
+void CBlockFileMap::Clear()
+{
+    LOCK(cs);
+    lruFiles.clear();
+}
@@ -0,0 +1,73 @@
+// Copyright (c) 2018 The KoinMudra developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKFILEMAP_H
+#define BITCOIN_BLOCKFILEMAP_H
+
+#include "sync.h"
+
+#include <list>
+#include <stddef.h>
+
+#include <boost/shared_ptr.hpp>
+
+struct CDiskBlockPos;
+
+/** Default for -blockmmap: only where the address space easily holds the mapped files */
+static const bool DEFAULT_BLOCK_MMAP = sizeof(void*) > 4;
+/** Default for -blockmmapfiles, the number of block files kept mapped */
+static const unsigned int DEFAULT_BLOCK_MMAP_FILES = 8;
+
+/** Read-only mapping of a whole block file, unmapped when the last user lets go. */
+class CMappedBlockFile
+{
+private:
+    CMappedBlockFile(const CMappedBlockFile&);
+    void operator=(const CMappedBlockFile&);
+
+public:
+    int nFile;
+    const char* pdata;
+    size_t nSize;
+
+    CMappedBlockFile(int nFileIn, const char* pdataIn, size_t nSizeIn) : nFile(nFileIn), pdata(pdataIn), nSize(nSizeIn) {}
+    ~CMappedBlockFile();
+};
+
+/** Serialized block inside a mapped block file. Holding it keeps the mapping alive. */
+struct CMappedBlock {
+    boost::shared_ptr<const CMappedBlockFile> file;
+    const char* pbegin;
+    const char* pend;
+
+    CMappedBlock() : pbegin(NULL), pend(NULL) {}
+};
+
+/**
+ * Serves blocks straight out of memory mapped blk?????.dat files, keeping the
+ * most recently used files mapped. A file that has grown past its mapping
+ * since it was mapped is mapped again. Where memory mapping is not available,
+ * or a file cannot be mapped, GetBlock() fails and callers read the file.
+ */
+class CBlockFileMap
+{
+private:
+    CCriticalSection cs;
+    size_t nMaxFiles;
+    //! most recently used first
+    std::list<boost::shared_ptr<const CMappedBlockFile> > lruFiles;
+
+    boost::shared_ptr<const CMappedBlockFile> MapFile(int nFile);
+
+public:
+    CBlockFileMap(size_t nMaxFilesIn) : nMaxFiles(nMaxFilesIn > 0 ? nMaxFilesIn : 1) {}
+
+    /** Locate the block stored at pos, checking the magic and size stored in front of it. */
+    bool GetBlock(const CDiskBlockPos& pos, CMappedBlock& blockRet);
+
+    /** Drop all mappings; blocks handed out stay readable until released. */
+    void Clear();
+};
+
+#endif // BITCOIN_BLOCKFILEMAP_H
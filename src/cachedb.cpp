@@ -0,0 +1,58 @@
+// Copyright (c) 2018 The KoinMudra developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "cachedb.h"
+
+#include "util.h"
+
+#include <vector>
+
+CCacheDB::CCacheDB(const std::string& strName, size_t nCacheSize, bool fWipe)
+    : CLevelDBWrapper(GetDataDir() / strName, nCacheSize, false, fWipe), nPass(1), nChanged(0)
+{
+}
+
+bool CCacheDB::Commit()
+{
+    std::vector<std::map<std::string, CRecord>::iterator> vErased;
+    for (std::map<std::string, CRecord>::iterator it = mapRecords.begin(); it != mapRecords.end(); ++it) {
+        if (it->second.nPass != nPass) {
+            batch.EraseRaw(it->first);
+            vErased.push_back(it);
+            nChanged++;
+        }
+    }
+
+    LogPrint("masternode", "%s : %u of %u records changed\n", __func__, nChanged, mapRecords.size() - vErased.size());
+
+    // Only remember what the database holds once it does
+    bool fOk = nChanged == 0 || WriteBatch(batch, true);
+    if (fOk) {
+        for (std::map<std::string, uint256>::const_iterator it = mapWritten.begin(); it != mapWritten.end(); ++it)
+            mapRecords[it->first].hash = it->second;
+        for (unsigned int i = 0; i < vErased.size(); i++)
+            mapRecords.erase(vErased[i]);
+    }
+    batch = CLevelDBBatch();
+    mapWritten.clear();
+    nChanged = 0;
+    // pass 0 marks records that were loaded but not put yet
+    if (++nPass == 0)
+        nPass = 1;
+    return fOk;
+}
+
+bool CCacheDB::Wipe()
+{
+    CLevelDBBatch batchWipe;
+    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+    for (pcursor->SeekToFirst(); pcursor->Valid(); pcursor->Next()) {
+        batchWipe.EraseRaw(pcursor->key().ToString());
+    }
+    mapRecords.clear();
+    mapWritten.clear();
+    batch = CLevelDBBatch();
+    nChanged = 0;
+    return WriteBatch(batchWipe, true);
+}
@@ -0,0 +1,120 @@
+// Copyright (c) 2018 The KoinMudra developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CACHEDB_H
+#define BITCOIN_CACHEDB_H
+
+#include "hash.h"
+#include "leveldbwrapper.h"
+#include "uint256.h"
+
+#include <map>
+#include <string>
+
+#include <boost/scoped_ptr.hpp>
+
+/**
+ * LevelDB store for a cache that is kept as one record per map entry, in
+ * tables named by a single character.
+ *
+ * A write pass puts every record with WriteRecord()/WriteMap() and ends with
+ * Commit(). Only records whose serialization changed since they were last
+ * read or written reach the database, and records not put during the pass
+ * are erased, so the cost of a write follows what changed rather than the
+ * size of the cache. Loading streams the records of a table back with
+ * ReadMap().
+ */
+class CCacheDB : public CLevelDBWrapper
+{
+private:
+    struct CRecord {
+        uint256 hash;
+        unsigned int nPass;
+    };
+
+    //! hash of every stored value and the write pass that last put it, by serialized key
+    std::map<std::string, CRecord> mapRecords;
+    //! hashes of the values written in this pass, for mapRecords once the pass is committed
+    std::map<std::string, uint256> mapWritten;
+    CLevelDBBatch batch;
+    unsigned int nPass;
+    unsigned int nChanged;
+
+    CCacheDB(const CCacheDB&);
+    void operator=(const CCacheDB&);
+
+public:
+    CCacheDB(const std::string& strName, size_t nCacheSize, bool fWipe = false);
+
+    template <typename K, typename V>
+    void WriteRecord(char chTable, const K& key, const V& value)
+    {
+        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        ssKey << chTable << key;
+        CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+        ssValue << value;
+
+        std::string strKey = ssKey.str();
+        CRecord& record = mapRecords[strKey];
+        record.nPass = nPass;
+        uint256 hash = Hash(ssValue.begin(), ssValue.end());
+        if (record.hash != hash) {
+            mapWritten[strKey] = hash;
+            batch.WriteRaw(strKey, ssValue.str());
+            nChanged++;
+        }
+    }
+
+    template <typename M>
+    void WriteMap(char chTable, const M& map)
+    {
+        for (typename M::const_iterator it = map.begin(); it != map.end(); ++it)
+            WriteRecord(chTable, it->first, it->second);
+    }
+
+    /**
+     * Erase the records that were not put in this pass and write the changes out.
+     * If that fails, the next pass writes and erases them again.
+     */
+    bool Commit();
+
+    /** Read all records of a table into map, remembering them for later passes. */
+    template <typename M>
+    bool ReadMap(char chTable, M& map)
+    {
+        boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+
+        CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+        ssKeySet << chTable;
+        pcursor->Seek(ssKeySet.str());
+
+        while (pcursor->Valid()) {
+            try {
+                leveldb::Slice slKey = pcursor->key();
+                if (slKey.size() == 0 || slKey[0] != chTable)
+                    break;
+                CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+                char chType;
+                typename M::key_type key;
+                ssKey >> chType >> key;
+
+                leveldb::Slice slValue = pcursor->value();
+                CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+                CRecord& record = mapRecords[slKey.ToString()];
+                record.hash = Hash(ssValue.begin(), ssValue.end());
+                record.nPass = 0; // loaded, but not put by a write pass yet
+                ssValue >> map[key];
+                pcursor->Next();
+            } catch (std::exception& e) {
+                return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+            }
+        }
+        return true;
+    }
+
+    /** Erase every record, e.g. after a record failed to load. */
+    bool Wipe();
+};
+
+#endif // BITCOIN_CACHEDB_H
@@ -159,7 +159,7 @@ genesis hash: 000003ae3fefd5b8d2b5da9f14bf653be25905c30c3d0a9f22ba0885d24013c0
         txNew.vout[0].scriptPubKey     = CScript() << ParseHex("040ec90902813b0528228715b76d72ad505772b5c462b4b11c668b5d0da3a5e9d236fd7754cdc23a245ec9e54d9afab53440700c6b8a61fbdd6d864c28672d583a") << OP_CHECKSIG;
         genesis.vtx.push_back(txNew);
         genesis.hashPrevBlock          = 0;
-        genesis.hashMerkleRoot         = genesis.BuildMerkleTree();
+        genesis.hashMerkleRoot         = genesis.ComputeMerkleRoot();
         genesis.nVersion               = 1;
         genesis.nTime                  = 1593648000;
         genesis.nBits                  = 504365040;
@@ -212,7 +212,7 @@ genesis hash: 000003ae3fefd5b8d2b5da9f14bf653be25905c30c3d0a9f22ba0885d24013c0
         fMineBlocksOnDemand            = false;
         fSkipProofOfWorkCheck          = false;
         fTestnetToBeDeprecatedFieldRPC = false;
-        fHeadersFirstSyncingActive     = false;
+        fHeadersFirstSyncingActive     = true;
 
         nPoolMaxTransactions           = 3;
         strSporkKey                    = "0446c867d14ac892741c068436c05b6b161957aed0261dfa52e830eb124030fb19d96a206563c3011bec319e268b0284d42e48e59c24da7fd1b2012986e9bcef7f";
@@ -0,0 +1,212 @@
+// Copyright (c) 2018 The KoinMudra developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "crypto/quark.h"
+
+#include "crypto/sph_blake.h"
+#include "crypto/sph_bmw.h"
+#include "crypto/sph_groestl.h"
+#include "crypto/sph_jh.h"
+#include "crypto/sph_keccak.h"
+#include "crypto/sph_skein.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__amd64__) || defined(__i386__)
+#if defined(ENABLE_AVX2)
+#include <cpuid.h>
+namespace quark_avx2
+{
+void Blake512_4way(unsigned char* out[4], const unsigned char* const in[4], size_t len);
+void Blake512_64_4way(unsigned char* out[4], const unsigned char* const in[4]);
+void Bmw512_4way(unsigned char* out[4], const unsigned char* const in[4]);
+void Jh512_4way(unsigned char* out[4], const unsigned char* const in[4]);
+void Keccak512_4way(unsigned char* out[4], const unsigned char* const in[4]);
+void Skein512_4way(unsigned char* out[4], const unsigned char* const in[4]);
+}
+#endif
+#endif
+
+// Internal implementation code.
+namespace
+{
+/// Scalar Quark stages, wrapping the sph_* reference code.
+namespace quark
+{
+void Blake512(unsigned char* out, const unsigned char* in, size_t len)
+{
+    static unsigned char pblank[1];
+    sph_blake512_context ctx;
+    sph_blake512_init(&ctx);
+    sph_blake512(&ctx, len == 0 ? pblank : in, len);
+    sph_blake512_close(&ctx, out);
+}
+
+#define QUARK_STAGE(name, algo)                                     \
+    void name(unsigned char* out, const unsigned char* in)          \
+    {                                                               \
+        sph_##algo##_context ctx;                                   \
+        sph_##algo##_init(&ctx);                                    \
+        sph_##algo(&ctx, in, 64);                                   \
+        sph_##algo##_close(&ctx, out);                              \
+    }
+
+QUARK_STAGE(Bmw512, bmw512)
+QUARK_STAGE(Groestl512, groestl512)
+QUARK_STAGE(Jh512, jh512)
+QUARK_STAGE(Keccak512, keccak512)
+QUARK_STAGE(Skein512, skein512)
+
+#undef QUARK_STAGE
+
+void Blake512Of64(unsigned char* out, const unsigned char* in) { Blake512(out, in, 64); }
+
+/** Number of messages carried through the stages together. */
+static const size_t LANES = 8;
+
+typedef void (*Stage1Fn)(unsigned char* out, const unsigned char* in);
+typedef void (*Stage4Fn)(unsigned char* out[4], const unsigned char* const in[4]);
+typedef void (*First4Fn)(unsigned char* out[4], const unsigned char* const in[4], size_t len);
+
+/** A Quark stage over 64-byte inputs: the scalar code plus an optional 4-lane kernel. */
+struct Stage {
+    Stage1Fn one;
+    Stage4Fn four;
+};
+
+Stage blake = {Blake512Of64, NULL};
+Stage bmw = {Bmw512, NULL};
+Stage groestl = {Groestl512, NULL};
+Stage jh = {Jh512, NULL};
+Stage keccak = {Keccak512, NULL};
+Stage skein = {Skein512, NULL};
+First4Fn blakeFirst4 = NULL;
+
+/** Run a stage on the lanes listed in idx, four at a time when a kernel is available. */
+void Run(const Stage& stage, unsigned char (*dst)[64], const unsigned char (*src)[64], const size_t* idx, size_t count)
+{
+    size_t i = 0;
+    if (stage.four) {
+        unsigned char scratch[64];
+        // A lone leftover lane is cheaper through the scalar code.
+        while (i + 2 <= count) {
+            unsigned char* out[4];
+            const unsigned char* in[4];
+            for (size_t k = 0; k < 4; k++) {
+                if (i + k < count) {
+                    out[k] = dst[idx[i + k]];
+                    in[k] = src[idx[i + k]];
+                } else {
+                    out[k] = scratch;
+                    in[k] = src[idx[i]];
+                }
+            }
+            stage.four(out, in);
+            i += 4;
+        }
+    }
+    for (; i < count; i++)
+        stage.one(dst[idx[i]], src[idx[i]]);
+}
+
+/** Run one of two stages on each lane, depending on bit 3 of its current hash. */
+void Branch(const Stage& set, const Stage& unset, unsigned char (*dst)[64], const unsigned char (*src)[64], size_t n)
+{
+    size_t a[LANES], b[LANES], na = 0, nb = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (src[i][0] & 8)
+            a[na++] = i;
+        else
+            b[nb++] = i;
+    }
+    Run(set, dst, src, a, na);
+    Run(unset, dst, src, b, nb);
+}
+
+void HashLanes(unsigned char* out, const unsigned char* const* in, size_t len, size_t n)
+{
+    unsigned char x[LANES][64], y[LANES][64];
+    size_t all[LANES];
+    for (size_t i = 0; i < n; i++)
+        all[i] = i;
+
+    size_t i = 0;
+    if (blakeFirst4) {
+        unsigned char scratch[64];
+        for (; i + 2 <= n; i += 4) {
+            unsigned char* o[4];
+            const unsigned char* m[4];
+            for (size_t k = 0; k < 4; k++) {
+                o[k] = i + k < n ? x[i + k] : scratch;
+                m[k] = i + k < n ? in[i + k] : in[i];
+            }
+            blakeFirst4(o, m, len);
+        }
+    }
+    for (; i < n; i++)
+        Blake512(x[i], in[i], len);
+
+    Run(bmw, y, x, all, n);
+    Branch(groestl, skein, x, y, n);
+    Run(groestl, y, x, all, n);
+    Run(jh, x, y, all, n);
+    Branch(blake, bmw, y, x, n);
+    Run(keccak, x, y, all, n);
+    Run(skein, y, x, all, n);
+    Branch(keccak, jh, x, y, n);
+
+    for (size_t k = 0; k < n; k++)
+        memcpy(out + 32 * k, x[k], 32);
+}
+
+} // namespace quark
+
+#if defined(__x86_64__) || defined(__amd64__) || defined(__i386__)
+#if defined(ENABLE_AVX2)
+/** Check whether the CPU and the OS support AVX2. */
+bool HaveAVX2()
+{
+    uint32_t eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+        return false;
+    // OSXSAVE and AVX, then the OS must save both XMM and YMM state.
+    if ((ecx & (1 << 27)) == 0 || (ecx & (1 << 28)) == 0)
+        return false;
+    uint32_t xcr0_lo, xcr0_hi;
+    __asm__("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+    if ((xcr0_lo & 6) != 6)
+        return false;
+    __cpuid_count(7, 0, eax, ebx, ecx, edx);
+    return (ebx & (1 << 5)) != 0;
+}
+#endif
+#endif
+
+} // namespace
+
+std::string QuarkAutoDetect()
+{
+#if defined(__x86_64__) || defined(__amd64__) || defined(__i386__)
+#if defined(ENABLE_AVX2)
+    if (HaveAVX2()) {
+        quark::blakeFirst4 = quark_avx2::Blake512_4way;
+        quark::blake.four = quark_avx2::Blake512_64_4way;
+        quark::bmw.four = quark_avx2::Bmw512_4way;
+        quark::jh.four = quark_avx2::Jh512_4way;
+        quark::keccak.four = quark_avx2::Keccak512_4way;
+        quark::skein.four = quark_avx2::Skein512_4way;
+        return "avx2(4way)";
+    }
+#endif
+#endif
+    return "standard";
+}
+
+void QuarkHashBatch(unsigned char* out, const unsigned char* const* in, size_t len, size_t n)
+{
+    for (size_t i = 0; i < n; i += quark::LANES) {
+        size_t lanes = n - i < quark::LANES ? n - i : quark::LANES;
+        quark::HashLanes(out + 32 * i, in + i, len, lanes);
+    }
+}
@@ -0,0 +1,24 @@
+// Copyright (c) 2018 The KoinMudra developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CRYPTO_QUARK_H
+#define BITCOIN_CRYPTO_QUARK_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string>
+
+/** Autodetect the best available multi-buffer Quark implementation.
+ *  Returns the name of the implementation. */
+std::string QuarkAutoDetect();
+
+/** Compute the Quark hashes of n messages of len bytes each.
+ *
+ *  Messages are hashed several at a time with the SIMD kernels selected by
+ *  QuarkAutoDetect(), falling back to the sph_* reference code. out receives
+ *  32 bytes per message, in the same order as in.
+ */
+void QuarkHashBatch(unsigned char* out, const unsigned char* const* in, size_t len, size_t n);
+
+#endif // BITCOIN_CRYPTO_QUARK_H
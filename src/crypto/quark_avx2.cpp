@@ -0,0 +1,663 @@
+// Copyright (c) 2018 The KoinMudra developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// Four-lane AVX2 kernels for the 64-bit Quark stages (BLAKE-512, BMW-512,
+// Keccak-512 and Skein-512). Every lane carries a different message of the
+// same length; results are bit-identical to the sph_* reference code.
+
+#ifdef ENABLE_AVX2
+
+#include <stdint.h>
+#include <string.h>
+#include <immintrin.h>
+
+#include "crypto/common.h"
+
+namespace quark_avx2 {
+namespace {
+
+__m256i inline K(uint64_t x) { return _mm256_set1_epi64x(x); }
+__m256i inline Add(__m256i x, __m256i y) { return _mm256_add_epi64(x, y); }
+__m256i inline Sub(__m256i x, __m256i y) { return _mm256_sub_epi64(x, y); }
+__m256i inline Xor(__m256i x, __m256i y) { return _mm256_xor_si256(x, y); }
+__m256i inline Xor(__m256i x, __m256i y, __m256i z) { return Xor(Xor(x, y), z); }
+__m256i inline Or(__m256i x, __m256i y) { return _mm256_or_si256(x, y); }
+__m256i inline AndNot(__m256i x, __m256i y) { return _mm256_andnot_si256(x, y); }
+__m256i inline ShL(__m256i x, int n) { return _mm256_slli_epi64(x, n); }
+__m256i inline ShR(__m256i x, int n) { return _mm256_srli_epi64(x, n); }
+__m256i inline RotL(__m256i x, int n) { return Or(ShL(x, n), ShR(x, 64 - n)); }
+__m256i inline RotR(__m256i x, int n) { return Or(ShR(x, n), ShL(x, 64 - n)); }
+
+/** Load 64 bytes from each of four lanes as eight little-endian words. */
+void inline Load8(__m256i w[8], const unsigned char* const in[4])
+{
+    for (int half = 0; half < 2; half++) {
+        __m256i r0 = _mm256_loadu_si256((const __m256i*)(in[0] + 32 * half));
+        __m256i r1 = _mm256_loadu_si256((const __m256i*)(in[1] + 32 * half));
+        __m256i r2 = _mm256_loadu_si256((const __m256i*)(in[2] + 32 * half));
+        __m256i r3 = _mm256_loadu_si256((const __m256i*)(in[3] + 32 * half));
+        __m256i t0 = _mm256_unpacklo_epi64(r0, r1);
+        __m256i t1 = _mm256_unpackhi_epi64(r0, r1);
+        __m256i t2 = _mm256_unpacklo_epi64(r2, r3);
+        __m256i t3 = _mm256_unpackhi_epi64(r2, r3);
+        w[4 * half + 0] = _mm256_permute2x128_si256(t0, t2, 0x20);
+        w[4 * half + 1] = _mm256_permute2x128_si256(t1, t3, 0x20);
+        w[4 * half + 2] = _mm256_permute2x128_si256(t0, t2, 0x31);
+        w[4 * half + 3] = _mm256_permute2x128_si256(t1, t3, 0x31);
+    }
+}
+
+/** Store eight words as 64 little-endian bytes to each of four lanes. */
+void inline Store8(unsigned char* out[4], const __m256i w[8])
+{
+    for (int half = 0; half < 2; half++) {
+        __m256i t0 = _mm256_unpacklo_epi64(w[4 * half + 0], w[4 * half + 1]);
+        __m256i t1 = _mm256_unpackhi_epi64(w[4 * half + 0], w[4 * half + 1]);
+        __m256i t2 = _mm256_unpacklo_epi64(w[4 * half + 2], w[4 * half + 3]);
+        __m256i t3 = _mm256_unpackhi_epi64(w[4 * half + 2], w[4 * half + 3]);
+        _mm256_storeu_si256((__m256i*)(out[0] + 32 * half), _mm256_permute2x128_si256(t0, t2, 0x20));
+        _mm256_storeu_si256((__m256i*)(out[1] + 32 * half), _mm256_permute2x128_si256(t1, t3, 0x20));
+        _mm256_storeu_si256((__m256i*)(out[2] + 32 * half), _mm256_permute2x128_si256(t0, t2, 0x31));
+        _mm256_storeu_si256((__m256i*)(out[3] + 32 * half), _mm256_permute2x128_si256(t1, t3, 0x31));
+    }
+}
+
+__m256i inline ByteSwap(__m256i x)
+{
+    const __m256i mask = _mm256_set_epi8(8, 9, 10, 11, 12, 13, 14, 15, 0, 1, 2, 3, 4, 5, 6, 7,
+                                         8, 9, 10, 11, 12, 13, 14, 15, 0, 1, 2, 3, 4, 5, 6, 7);
+    return _mm256_shuffle_epi8(x, mask);
+}
+
+/// BLAKE-512
+namespace blake {
+
+const uint64_t IV[8] = {
+    0x6A09E667F3BCC908ull, 0xBB67AE8584CAA73Bull, 0x3C6EF372FE94F82Bull, 0xA54FF53A5F1D36F1ull,
+    0x510E527FADE682D1ull, 0x9B05688C2B3E6C1Full, 0x1F83D9ABFB41BD6Bull, 0x5BE0CD19137E2179ull};
+
+const uint64_t CB[16] = {
+    0x243F6A8885A308D3ull, 0x13198A2E03707344ull, 0xA4093822299F31D0ull, 0x082EFA98EC4E6C89ull,
+    0x452821E638D01377ull, 0xBE5466CF34E90C6Cull, 0xC0AC29B7C97C50DDull, 0x3F84D5B5B5470917ull,
+    0x9216D5D98979FB1Bull, 0xD1310BA698DFB5ACull, 0x2FFD72DBD01ADFB7ull, 0xB8E1AFED6A267E96ull,
+    0xBA7C9045F12C7F99ull, 0x24A19947B3916CF7ull, 0x0801F2E2858EFC16ull, 0x636920D871574E69ull};
+
+const unsigned char SIGMA[10][16] = {
+    {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+    {14, 10, 4, 8, 9, 15, 13, 6, 1, 12, 0, 2, 11, 7, 5, 3},
+    {11, 8, 12, 0, 5, 2, 15, 13, 10, 14, 3, 6, 7, 1, 9, 4},
+    {7, 9, 3, 1, 13, 12, 11, 14, 2, 6, 5, 10, 4, 0, 15, 8},
+    {9, 0, 5, 7, 2, 4, 10, 15, 14, 1, 11, 12, 6, 8, 3, 13},
+    {2, 12, 6, 10, 0, 11, 8, 3, 4, 13, 7, 5, 15, 14, 1, 9},
+    {12, 5, 1, 15, 14, 13, 4, 10, 0, 7, 6, 3, 9, 2, 8, 11},
+    {13, 11, 7, 14, 12, 1, 3, 9, 5, 0, 15, 4, 8, 6, 2, 10},
+    {6, 15, 14, 9, 11, 3, 0, 8, 12, 2, 13, 7, 1, 4, 10, 5},
+    {10, 2, 8, 4, 7, 6, 1, 5, 15, 11, 9, 14, 3, 12, 13, 0}};
+
+void inline G(const __m256i m[16], const unsigned char* s, int i, __m256i& a, __m256i& b, __m256i& c, __m256i& d)
+{
+    a = Add(Add(a, b), Xor(m[s[2 * i]], K(CB[s[2 * i + 1]])));
+    d = _mm256_shuffle_epi32(Xor(d, a), 0xB1);
+    c = Add(c, d);
+    b = RotR(Xor(b, c), 25);
+    a = Add(Add(a, b), Xor(m[s[2 * i + 1]], K(CB[s[2 * i]])));
+    d = RotR(Xor(d, a), 16);
+    c = Add(c, d);
+    b = RotR(Xor(b, c), 11);
+}
+
+/** Compress one 128-byte block per lane with the given bit counter. */
+void Compress(__m256i h[8], const unsigned char* const blk[4], uint64_t t0)
+{
+    __m256i m[16], v[16];
+    const unsigned char* hi[4] = {blk[0] + 64, blk[1] + 64, blk[2] + 64, blk[3] + 64};
+    Load8(m, blk);
+    Load8(m + 8, hi);
+    for (int i = 0; i < 16; i++)
+        m[i] = ByteSwap(m[i]);
+
+    for (int i = 0; i < 8; i++)
+        v[i] = h[i];
+    v[8] = K(CB[0]);
+    v[9] = K(CB[1]);
+    v[10] = K(CB[2]);
+    v[11] = K(CB[3]);
+    v[12] = K(t0 ^ CB[4]);
+    v[13] = K(t0 ^ CB[5]);
+    v[14] = K(CB[6]);
+    v[15] = K(CB[7]);
+
+    for (int r = 0; r < 16; r++) {
+        const unsigned char* s = SIGMA[r % 10];
+        G(m, s, 0, v[0], v[4], v[8], v[12]);
+        G(m, s, 1, v[1], v[5], v[9], v[13]);
+        G(m, s, 2, v[2], v[6], v[10], v[14]);
+        G(m, s, 3, v[3], v[7], v[11], v[15]);
+        G(m, s, 4, v[0], v[5], v[10], v[15]);
+        G(m, s, 5, v[1], v[6], v[11], v[12]);
+        G(m, s, 6, v[2], v[7], v[8], v[13]);
+        G(m, s, 7, v[3], v[4], v[9], v[14]);
+    }
+
+    for (int i = 0; i < 8; i++)
+        h[i] = Xor(h[i], v[i], v[i + 8]);
+}
+
+} // namespace blake
+
+/// BMW-512
+namespace bmw {
+
+__m256i inline s0(__m256i x) { return Xor(Xor(ShR(x, 1), ShL(x, 3)), Xor(RotL(x, 4), RotL(x, 37))); }
+__m256i inline s1(__m256i x) { return Xor(Xor(ShR(x, 1), ShL(x, 2)), Xor(RotL(x, 13), RotL(x, 43))); }
+__m256i inline s2(__m256i x) { return Xor(Xor(ShR(x, 2), ShL(x, 1)), Xor(RotL(x, 19), RotL(x, 53))); }
+__m256i inline s3(__m256i x) { return Xor(Xor(ShR(x, 2), ShL(x, 2)), Xor(RotL(x, 28), RotL(x, 59))); }
+__m256i inline s4(__m256i x) { return Xor(ShR(x, 1), x); }
+__m256i inline s5(__m256i x) { return Xor(ShR(x, 2), x); }
+
+/** f0 input combination: the five (M ^ H) words that feed W[j]. */
+const unsigned char WIDX[16][5] = {
+    {5, 7, 10, 13, 14}, {6, 8, 11, 14, 15}, {0, 7, 9, 12, 15}, {0, 1, 8, 10, 13},
+    {1, 2, 9, 11, 14}, {3, 2, 10, 12, 15}, {4, 0, 3, 11, 13}, {1, 4, 5, 12, 14},
+    {2, 5, 6, 13, 15}, {0, 3, 6, 7, 14}, {8, 1, 4, 7, 15}, {8, 0, 2, 5, 9},
+    {1, 3, 6, 9, 10}, {2, 4, 7, 10, 11}, {3, 5, 8, 11, 12}, {12, 4, 6, 9, 13}};
+
+/** Whether the matching WIDX term is subtracted rather than added. */
+const bool WNEG[16][5] = {
+    {0, 1, 0, 0, 0}, {0, 1, 0, 0, 1}, {0, 0, 0, 1, 0}, {0, 1, 0, 1, 0},
+    {0, 0, 0, 1, 1}, {0, 1, 0, 1, 0}, {0, 1, 1, 1, 0}, {0, 1, 1, 1, 1},
+    {0, 1, 1, 0, 1}, {0, 1, 0, 1, 0}, {0, 1, 1, 1, 0}, {0, 1, 1, 1, 0},
+    {0, 0, 1, 1, 0}, {0, 0, 0, 0, 0}, {0, 1, 0, 1, 1}, {0, 1, 1, 1, 0}};
+
+__m256i inline AddElt(const __m256i m[16], const __m256i h[16], int j)
+{
+    int j0 = j & 15, j3 = (j + 3) & 15, j10 = (j + 10) & 15;
+    __m256i t = Sub(Add(RotL(m[j0], j0 + 1), RotL(m[j3], j3 + 1)), RotL(m[j10], j10 + 1));
+    return Xor(Add(t, K((uint64_t)(j + 16) * 0x0555555555555555ull)), h[(j + 7) & 15]);
+}
+
+void Compress(const __m256i m[16], const __m256i h[16], __m256i dh[16])
+{
+    __m256i q[32], x[16];
+    for (int i = 0; i < 16; i++)
+        x[i] = Xor(m[i], h[i]);
+    for (int j = 0; j < 16; j++) {
+        __m256i w = x[WIDX[j][0]];
+        for (int k = 1; k < 5; k++)
+            w = WNEG[j][k] ? Sub(w, x[WIDX[j][k]]) : Add(w, x[WIDX[j][k]]);
+        switch (j % 5) {
+        case 0: w = s0(w); break;
+        case 1: w = s1(w); break;
+        case 2: w = s2(w); break;
+        case 3: w = s3(w); break;
+        default: w = s4(w); break;
+        }
+        q[j] = Add(w, h[(j + 1) & 15]);
+    }
+    for (int i = 16; i < 18; i++) {
+        __m256i t = AddElt(m, h, i - 16);
+        for (int k = 0; k < 16; k += 4) {
+            t = Add(t, s1(q[i - 16 + k]));
+            t = Add(t, s2(q[i - 15 + k]));
+            t = Add(t, s3(q[i - 14 + k]));
+            t = Add(t, s0(q[i - 13 + k]));
+        }
+        q[i] = t;
+    }
+    for (int i = 18; i < 32; i++) {
+        __m256i t = AddElt(m, h, i - 16);
+        t = Add(t, Add(q[i - 16], RotL(q[i - 15], 5)));
+        t = Add(t, Add(q[i - 14], RotL(q[i - 13], 11)));
+        t = Add(t, Add(q[i - 12], RotL(q[i - 11], 27)));
+        t = Add(t, Add(q[i - 10], RotL(q[i - 9], 32)));
+        t = Add(t, Add(q[i - 8], RotL(q[i - 7], 37)));
+        t = Add(t, Add(q[i - 6], RotL(q[i - 5], 43)));
+        t = Add(t, Add(q[i - 4], RotL(q[i - 3], 53)));
+        t = Add(t, Add(s4(q[i - 2]), s5(q[i - 1])));
+        q[i] = t;
+    }
+
+    __m256i xl = Xor(Xor(Xor(q[16], q[17]), Xor(q[18], q[19])), Xor(Xor(q[20], q[21]), Xor(q[22], q[23])));
+    __m256i xh = Xor(xl, Xor(Xor(Xor(q[24], q[25]), Xor(q[26], q[27])), Xor(Xor(q[28], q[29]), Xor(q[30], q[31]))));
+    dh[0] = Add(Xor(ShL(xh, 5), ShR(q[16], 5), m[0]), Xor(xl, q[24], q[0]));
+    dh[1] = Add(Xor(ShR(xh, 7), ShL(q[17], 8), m[1]), Xor(xl, q[25], q[1]));
+    dh[2] = Add(Xor(ShR(xh, 5), ShL(q[18], 5), m[2]), Xor(xl, q[26], q[2]));
+    dh[3] = Add(Xor(ShR(xh, 1), ShL(q[19], 5), m[3]), Xor(xl, q[27], q[3]));
+    dh[4] = Add(Xor(ShR(xh, 3), q[20], m[4]), Xor(xl, q[28], q[4]));
+    dh[5] = Add(Xor(ShL(xh, 6), ShR(q[21], 6), m[5]), Xor(xl, q[29], q[5]));
+    dh[6] = Add(Xor(ShR(xh, 4), ShL(q[22], 6), m[6]), Xor(xl, q[30], q[6]));
+    dh[7] = Add(Xor(ShR(xh, 11), ShL(q[23], 2), m[7]), Xor(xl, q[31], q[7]));
+    dh[8] = Add(Add(RotL(dh[4], 9), Xor(xh, q[24], m[8])), Xor(ShL(xl, 8), q[23], q[8]));
+    dh[9] = Add(Add(RotL(dh[5], 10), Xor(xh, q[25], m[9])), Xor(ShR(xl, 6), q[16], q[9]));
+    dh[10] = Add(Add(RotL(dh[6], 11), Xor(xh, q[26], m[10])), Xor(ShL(xl, 6), q[17], q[10]));
+    dh[11] = Add(Add(RotL(dh[7], 12), Xor(xh, q[27], m[11])), Xor(ShL(xl, 4), q[18], q[11]));
+    dh[12] = Add(Add(RotL(dh[0], 13), Xor(xh, q[28], m[12])), Xor(ShR(xl, 3), q[19], q[12]));
+    dh[13] = Add(Add(RotL(dh[1], 14), Xor(xh, q[29], m[13])), Xor(ShR(xl, 4), q[20], q[13]));
+    dh[14] = Add(Add(RotL(dh[2], 15), Xor(xh, q[30], m[14])), Xor(ShR(xl, 7), q[21], q[14]));
+    dh[15] = Add(Add(RotL(dh[3], 16), Xor(xh, q[31], m[15])), Xor(ShR(xl, 2), q[22], q[15]));
+}
+
+} // namespace bmw
+
+/// Keccak-512
+namespace keccak {
+
+const uint64_t RC[24] = {
+    0x0000000000000001ull, 0x0000000000008082ull, 0x800000000000808Aull, 0x8000000080008000ull,
+    0x000000000000808Bull, 0x0000000080000001ull, 0x8000000080008081ull, 0x8000000000008009ull,
+    0x000000000000008Aull, 0x0000000000000088ull, 0x0000000080008009ull, 0x000000008000000Aull,
+    0x000000008000808Bull, 0x800000000000008Bull, 0x8000000000008089ull, 0x8000000000008003ull,
+    0x8000000000008002ull, 0x8000000000000080ull, 0x000000000000800Aull, 0x800000008000000Aull,
+    0x8000000080008081ull, 0x8000000000008080ull, 0x0000000080000001ull, 0x8000000080008008ull};
+
+/** Combined rho and pi steps: rotate lane (x, y) into position (y, 2x + 3y). */
+#define RHOPI(x, y, r) b[(y) + 5 * ((2 * (x) + 3 * (y)) % 5)] = RotL(Xor(a[(x) + 5 * (y)], d[x]), r)
+#define CHI(y) do { \
+    a[(y) + 0] = Xor(b[(y) + 0], AndNot(b[(y) + 1], b[(y) + 2])); \
+    a[(y) + 1] = Xor(b[(y) + 1], AndNot(b[(y) + 2], b[(y) + 3])); \
+    a[(y) + 2] = Xor(b[(y) + 2], AndNot(b[(y) + 3], b[(y) + 4])); \
+    a[(y) + 3] = Xor(b[(y) + 3], AndNot(b[(y) + 4], b[(y) + 0])); \
+    a[(y) + 4] = Xor(b[(y) + 4], AndNot(b[(y) + 0], b[(y) + 1])); } while (0)
+
+void Permute(__m256i a[25])
+{
+    __m256i b[25], c[5], d[5];
+    for (int r = 0; r < 24; r++) {
+        for (int x = 0; x < 5; x++)
+            c[x] = Xor(Xor(a[x], a[x + 5]), Xor(Xor(a[x + 10], a[x + 15]), a[x + 20]));
+        for (int x = 0; x < 5; x++)
+            d[x] = Xor(c[(x + 4) % 5], RotL(c[(x + 1) % 5], 1));
+        RHOPI(0, 0, 0);
+        RHOPI(1, 0, 1);
+        RHOPI(2, 0, 62);
+        RHOPI(3, 0, 28);
+        RHOPI(4, 0, 27);
+        RHOPI(0, 1, 36);
+        RHOPI(1, 1, 44);
+        RHOPI(2, 1, 6);
+        RHOPI(3, 1, 55);
+        RHOPI(4, 1, 20);
+        RHOPI(0, 2, 3);
+        RHOPI(1, 2, 10);
+        RHOPI(2, 2, 43);
+        RHOPI(3, 2, 25);
+        RHOPI(4, 2, 39);
+        RHOPI(0, 3, 41);
+        RHOPI(1, 3, 45);
+        RHOPI(2, 3, 15);
+        RHOPI(3, 3, 21);
+        RHOPI(4, 3, 8);
+        RHOPI(0, 4, 18);
+        RHOPI(1, 4, 2);
+        RHOPI(2, 4, 61);
+        RHOPI(3, 4, 56);
+        RHOPI(4, 4, 14);
+        CHI(0);
+        CHI(5);
+        CHI(10);
+        CHI(15);
+        CHI(20);
+        a[0] = Xor(a[0], K(RC[r]));
+    }
+}
+
+#undef CHI
+#undef RHOPI
+
+} // namespace keccak
+
+/// Skein-512-512
+namespace skein {
+
+const uint64_t IV[8] = {
+    0x4903ADFF749C51CEull, 0x0D95DE399746DF03ull, 0x8FD1934127C79BCEull, 0x9A255629FF352CB1ull,
+    0x5DB62599DF6CA7B0ull, 0xEABE394CA9D5C3F4ull, 0x991112C71A75B523ull, 0xAE18A40B660FCC33ull};
+
+#define MIX(x0, x1, rc) do { x0 = Add(x0, x1); x1 = Xor(RotL(x1, rc), x0); } while (0)
+#define MIX8(w0, w1, w2, w3, w4, w5, w6, w7, rc0, rc1, rc2, rc3) do { \
+    MIX(w0, w1, rc0); MIX(w2, w3, rc1); MIX(w4, w5, rc2); MIX(w6, w7, rc3); } while (0)
+#define ADDKEY(s) do { \
+    p0 = Add(p0, k[(s + 0) % 9]); p1 = Add(p1, k[(s + 1) % 9]); \
+    p2 = Add(p2, k[(s + 2) % 9]); p3 = Add(p3, k[(s + 3) % 9]); \
+    p4 = Add(p4, k[(s + 4) % 9]); p5 = Add(p5, Add(k[(s + 5) % 9], t[(s) % 3])); \
+    p6 = Add(p6, Add(k[(s + 6) % 9], t[(s + 1) % 3])); p7 = Add(p7, Add(k[(s + 7) % 9], K(s))); } while (0)
+
+/** One UBI block: h = E_h,tweak(m) ^ m. */
+void Ubi(__m256i h[8], const __m256i m[8], uint64_t t0, uint64_t t1)
+{
+    __m256i k[9], t[3];
+    k[8] = K(0x1BD11BDAA9FC1A22ull);
+    for (int i = 0; i < 8; i++) {
+        k[i] = h[i];
+        k[8] = Xor(k[8], h[i]);
+    }
+    t[0] = K(t0);
+    t[1] = K(t1);
+    t[2] = K(t0 ^ t1);
+
+    __m256i p0 = m[0], p1 = m[1], p2 = m[2], p3 = m[3], p4 = m[4], p5 = m[5], p6 = m[6], p7 = m[7];
+    for (int s = 0; s < 18; s += 2) {
+        ADDKEY(s);
+        MIX8(p0, p1, p2, p3, p4, p5, p6, p7, 46, 36, 19, 37);
+        MIX8(p2, p1, p4, p7, p6, p5, p0, p3, 33, 27, 14, 42);
+        MIX8(p4, p1, p6, p3, p0, p5, p2, p7, 17, 49, 36, 39);
+        MIX8(p6, p1, p0, p7, p2, p5, p4, p3, 44, 9, 54, 56);
+        ADDKEY(s + 1);
+        MIX8(p0, p1, p2, p3, p4, p5, p6, p7, 39, 30, 34, 24);
+        MIX8(p2, p1, p4, p7, p6, p5, p0, p3, 13, 50, 10, 17);
+        MIX8(p4, p1, p6, p3, p0, p5, p2, p7, 25, 29, 39, 43);
+        MIX8(p6, p1, p0, p7, p2, p5, p4, p3, 8, 35, 56, 22);
+    }
+    ADDKEY(18);
+
+    h[0] = Xor(m[0], p0);
+    h[1] = Xor(m[1], p1);
+    h[2] = Xor(m[2], p2);
+    h[3] = Xor(m[3], p3);
+    h[4] = Xor(m[4], p4);
+    h[5] = Xor(m[5], p5);
+    h[6] = Xor(m[6], p6);
+    h[7] = Xor(m[7], p7);
+}
+
+#undef ADDKEY
+#undef MIX8
+#undef MIX
+
+} // namespace skein
+
+/// JH-512, two lanes per register: each 128-bit half holds one message's bitsliced word.
+namespace jh {
+
+/** 42 rounds of even/odd 128-bit round constants, in the sph byte order. */
+const unsigned char C[42 * 32] = {
+    0x72, 0xd5, 0xde, 0xa2, 0xdf, 0x15, 0xf8, 0x67, 0x7b, 0x84, 0x15, 0x0a, 0xb7, 0x23, 0x15, 0x57,
+    0x81, 0xab, 0xd6, 0x90, 0x4d, 0x5a, 0x87, 0xf6, 0x4e, 0x9f, 0x4f, 0xc5, 0xc3, 0xd1, 0x2b, 0x40,
+    0xea, 0x98, 0x3a, 0xe0, 0x5c, 0x45, 0xfa, 0x9c, 0x03, 0xc5, 0xd2, 0x99, 0x66, 0xb2, 0x99, 0x9a,
+    0x66, 0x02, 0x96, 0xb4, 0xf2, 0xbb, 0x53, 0x8a, 0xb5, 0x56, 0x14, 0x1a, 0x88, 0xdb, 0xa2, 0x31,
+    0x03, 0xa3, 0x5a, 0x5c, 0x9a, 0x19, 0x0e, 0xdb, 0x40, 0x3f, 0xb2, 0x0a, 0x87, 0xc1, 0x44, 0x10,
+    0x1c, 0x05, 0x19, 0x80, 0x84, 0x9e, 0x95, 0x1d, 0x6f, 0x33, 0xeb, 0xad, 0x5e, 0xe7, 0xcd, 0xdc,
+    0x10, 0xba, 0x13, 0x92, 0x02, 0xbf, 0x6b, 0x41, 0xdc, 0x78, 0x65, 0x15, 0xf7, 0xbb, 0x27, 0xd0,
+    0x0a, 0x2c, 0x81, 0x39, 0x37, 0xaa, 0x78, 0x50, 0x3f, 0x1a, 0xbf, 0xd2, 0x41, 0x00, 0x91, 0xd3,
+    0x42, 0x2d, 0x5a, 0x0d, 0xf6, 0xcc, 0x7e, 0x90, 0xdd, 0x62, 0x9f, 0x9c, 0x92, 0xc0, 0x97, 0xce,
+    0x18, 0x5c, 0xa7, 0x0b, 0xc7, 0x2b, 0x44, 0xac, 0xd1, 0xdf, 0x65, 0xd6, 0x63, 0xc6, 0xfc, 0x23,
+    0x97, 0x6e, 0x6c, 0x03, 0x9e, 0xe0, 0xb8, 0x1a, 0x21, 0x05, 0x45, 0x7e, 0x44, 0x6c, 0xec, 0xa8,
+    0xee, 0xf1, 0x03, 0xbb, 0x5d, 0x8e, 0x61, 0xfa, 0xfd, 0x96, 0x97, 0xb2, 0x94, 0x83, 0x81, 0x97,
+    0x4a, 0x8e, 0x85, 0x37, 0xdb, 0x03, 0x30, 0x2f, 0x2a, 0x67, 0x8d, 0x2d, 0xfb, 0x9f, 0x6a, 0x95,
+    0x8a, 0xfe, 0x73, 0x81, 0xf8, 0xb8, 0x69, 0x6c, 0x8a, 0xc7, 0x72, 0x46, 0xc0, 0x7f, 0x42, 0x14,
+    0xc5, 0xf4, 0x15, 0x8f, 0xbd, 0xc7, 0x5e, 0xc4, 0x75, 0x44, 0x6f, 0xa7, 0x8f, 0x11, 0xbb, 0x80,
+    0x52, 0xde, 0x75, 0xb7, 0xae, 0xe4, 0x88, 0xbc, 0x82, 0xb8, 0x00, 0x1e, 0x98, 0xa6, 0xa3, 0xf4,
+    0x8e, 0xf4, 0x8f, 0x33, 0xa9, 0xa3, 0x63, 0x15, 0xaa, 0x5f, 0x56, 0x24, 0xd5, 0xb7, 0xf9, 0x89,
+    0xb6, 0xf1, 0xed, 0x20, 0x7c, 0x5a, 0xe0, 0xfd, 0x36, 0xca, 0xe9, 0x5a, 0x06, 0x42, 0x2c, 0x36,
+    0xce, 0x29, 0x35, 0x43, 0x4e, 0xfe, 0x98, 0x3d, 0x53, 0x3a, 0xf9, 0x74, 0x73, 0x9a, 0x4b, 0xa7,
+    0xd0, 0xf5, 0x1f, 0x59, 0x6f, 0x4e, 0x81, 0x86, 0x0e, 0x9d, 0xad, 0x81, 0xaf, 0xd8, 0x5a, 0x9f,
+    0xa7, 0x05, 0x06, 0x67, 0xee, 0x34, 0x62, 0x6a, 0x8b, 0x0b, 0x28, 0xbe, 0x6e, 0xb9, 0x17, 0x27,
+    0x47, 0x74, 0x07, 0x26, 0xc6, 0x80, 0x10, 0x3f, 0xe0, 0xa0, 0x7e, 0x6f, 0xc6, 0x7e, 0x48, 0x7b,
+    0x0d, 0x55, 0x0a, 0xa5, 0x4a, 0xf8, 0xa4, 0xc0, 0x91, 0xe3, 0xe7, 0x9f, 0x97, 0x8e, 0xf1, 0x9e,
+    0x86, 0x76, 0x72, 0x81, 0x50, 0x60, 0x8d, 0xd4, 0x7e, 0x9e, 0x5a, 0x41, 0xf3, 0xe5, 0xb0, 0x62,
+    0xfc, 0x9f, 0x1f, 0xec, 0x40, 0x54, 0x20, 0x7a, 0xe3, 0xe4, 0x1a, 0x00, 0xce, 0xf4, 0xc9, 0x84,
+    0x4f, 0xd7, 0x94, 0xf5, 0x9d, 0xfa, 0x95, 0xd8, 0x55, 0x2e, 0x7e, 0x11, 0x24, 0xc3, 0x54, 0xa5,
+    0x5b, 0xdf, 0x72, 0x28, 0xbd, 0xfe, 0x6e, 0x28, 0x78, 0xf5, 0x7f, 0xe2, 0x0f, 0xa5, 0xc4, 0xb2,
+    0x05, 0x89, 0x7c, 0xef, 0xee, 0x49, 0xd3, 0x2e, 0x44, 0x7e, 0x93, 0x85, 0xeb, 0x28, 0x59, 0x7f,
+    0x70, 0x5f, 0x69, 0x37, 0xb3, 0x24, 0x31, 0x4a, 0x5e, 0x86, 0x28, 0xf1, 0x1d, 0xd6, 0xe4, 0x65,
+    0xc7, 0x1b, 0x77, 0x04, 0x51, 0xb9, 0x20, 0xe7, 0x74, 0xfe, 0x43, 0xe8, 0x23, 0xd4, 0x87, 0x8a,
+    0x7d, 0x29, 0xe8, 0xa3, 0x92, 0x76, 0x94, 0xf2, 0xdd, 0xcb, 0x7a, 0x09, 0x9b, 0x30, 0xd9, 0xc1,
+    0x1d, 0x1b, 0x30, 0xfb, 0x5b, 0xdc, 0x1b, 0xe0, 0xda, 0x24, 0x49, 0x4f, 0xf2, 0x9c, 0x82, 0xbf,
+    0xa4, 0xe7, 0xba, 0x31, 0xb4, 0x70, 0xbf, 0xff, 0x0d, 0x32, 0x44, 0x05, 0xde, 0xf8, 0xbc, 0x48,
+    0x3b, 0xae, 0xfc, 0x32, 0x53, 0xbb, 0xd3, 0x39, 0x45, 0x9f, 0xc3, 0xc1, 0xe0, 0x29, 0x8b, 0xa0,
+    0xe5, 0xc9, 0x05, 0xfd, 0xf7, 0xae, 0x09, 0x0f, 0x94, 0x70, 0x34, 0x12, 0x42, 0x90, 0xf1, 0x34,
+    0xa2, 0x71, 0xb7, 0x01, 0xe3, 0x44, 0xed, 0x95, 0xe9, 0x3b, 0x8e, 0x36, 0x4f, 0x2f, 0x98, 0x4a,
+    0x88, 0x40, 0x1d, 0x63, 0xa0, 0x6c, 0xf6, 0x15, 0x47, 0xc1, 0x44, 0x4b, 0x87, 0x52, 0xaf, 0xff,
+    0x7e, 0xbb, 0x4a, 0xf1, 0xe2, 0x0a, 0xc6, 0x30, 0x46, 0x70, 0xb6, 0xc5, 0xcc, 0x6e, 0x8c, 0xe6,
+    0xa4, 0xd5, 0xa4, 0x56, 0xbd, 0x4f, 0xca, 0x00, 0xda, 0x9d, 0x84, 0x4b, 0xc8, 0x3e, 0x18, 0xae,
+    0x73, 0x57, 0xce, 0x45, 0x30, 0x64, 0xd1, 0xad, 0xe8, 0xa6, 0xce, 0x68, 0x14, 0x5c, 0x25, 0x67,
+    0xa3, 0xda, 0x8c, 0xf2, 0xcb, 0x0e, 0xe1, 0x16, 0x33, 0xe9, 0x06, 0x58, 0x9a, 0x94, 0x99, 0x9a,
+    0x1f, 0x60, 0xb2, 0x20, 0xc2, 0x6f, 0x84, 0x7b, 0xd1, 0xce, 0xac, 0x7f, 0xa0, 0xd1, 0x85, 0x18,
+    0x32, 0x59, 0x5b, 0xa1, 0x8d, 0xdd, 0x19, 0xd3, 0x50, 0x9a, 0x1c, 0xc0, 0xaa, 0xa5, 0xb4, 0x46,
+    0x9f, 0x3d, 0x63, 0x67, 0xe4, 0x04, 0x6b, 0xba, 0xf6, 0xca, 0x19, 0xab, 0x0b, 0x56, 0xee, 0x7e,
+    0x1f, 0xb1, 0x79, 0xea, 0xa9, 0x28, 0x21, 0x74, 0xe9, 0xbd, 0xf7, 0x35, 0x3b, 0x36, 0x51, 0xee,
+    0x1d, 0x57, 0xac, 0x5a, 0x75, 0x50, 0xd3, 0x76, 0x3a, 0x46, 0xc2, 0xfe, 0xa3, 0x7d, 0x70, 0x01,
+    0xf7, 0x35, 0xc1, 0xaf, 0x98, 0xa4, 0xd8, 0x42, 0x78, 0xed, 0xec, 0x20, 0x9e, 0x6b, 0x67, 0x79,
+    0x41, 0x83, 0x63, 0x15, 0xea, 0x3a, 0xdb, 0xa8, 0xfa, 0xc3, 0x3b, 0x4d, 0x32, 0x83, 0x2c, 0x83,
+    0xa7, 0x40, 0x3b, 0x1f, 0x1c, 0x27, 0x47, 0xf3, 0x59, 0x40, 0xf0, 0x34, 0xb7, 0x2d, 0x76, 0x9a,
+    0xe7, 0x3e, 0x4e, 0x6c, 0xd2, 0x21, 0x4f, 0xfd, 0xb8, 0xfd, 0x8d, 0x39, 0xdc, 0x57, 0x59, 0xef,
+    0x8d, 0x9b, 0x0c, 0x49, 0x2b, 0x49, 0xeb, 0xda, 0x5b, 0xa2, 0xd7, 0x49, 0x68, 0xf3, 0x70, 0x0d,
+    0x7d, 0x3b, 0xae, 0xd0, 0x7a, 0x8d, 0x55, 0x84, 0xf5, 0xa5, 0xe9, 0xf0, 0xe4, 0xf8, 0x8e, 0x65,
+    0xa0, 0xb8, 0xa2, 0xf4, 0x36, 0x10, 0x3b, 0x53, 0x0c, 0xa8, 0x07, 0x9e, 0x75, 0x3e, 0xec, 0x5a,
+    0x91, 0x68, 0x94, 0x92, 0x56, 0xe8, 0x88, 0x4f, 0x5b, 0xb0, 0x5c, 0x55, 0xf8, 0xba, 0xbc, 0x4c,
+    0xe3, 0xbb, 0x3b, 0x99, 0xf3, 0x87, 0x94, 0x7b, 0x75, 0xda, 0xf4, 0xd6, 0x72, 0x6b, 0x1c, 0x5d,
+    0x64, 0xae, 0xac, 0x28, 0xdc, 0x34, 0xb3, 0x6d, 0x6c, 0x34, 0xa5, 0x50, 0xb8, 0x28, 0xdb, 0x71,
+    0xf8, 0x61, 0xe2, 0xf2, 0x10, 0x8d, 0x51, 0x2a, 0xe3, 0xdb, 0x64, 0x33, 0x59, 0xdd, 0x75, 0xfc,
+    0x1c, 0xac, 0xbc, 0xf1, 0x43, 0xce, 0x3f, 0xa2, 0x67, 0xbb, 0xd1, 0x3c, 0x02, 0xe8, 0x43, 0xb0,
+    0x33, 0x0a, 0x5b, 0xca, 0x88, 0x29, 0xa1, 0x75, 0x7f, 0x34, 0x19, 0x4d, 0xb4, 0x16, 0x53, 0x5c,
+    0x92, 0x3b, 0x94, 0xc3, 0x0e, 0x79, 0x4d, 0x1e, 0x79, 0x74, 0x75, 0xd7, 0xb6, 0xee, 0xaf, 0x3f,
+    0xea, 0xa8, 0xd4, 0xf7, 0xbe, 0x1a, 0x39, 0x21, 0x5c, 0xf4, 0x7e, 0x09, 0x4c, 0x23, 0x27, 0x51,
+    0x26, 0xa3, 0x24, 0x53, 0xba, 0x32, 0x3c, 0xd2, 0x44, 0xa3, 0x17, 0x4a, 0x6d, 0xa6, 0xd5, 0xad,
+    0xb5, 0x1d, 0x3e, 0xa6, 0xaf, 0xf2, 0xc9, 0x08, 0x83, 0x59, 0x3d, 0x98, 0x91, 0x6b, 0x3c, 0x56,
+    0x4c, 0xf8, 0x7c, 0xa1, 0x72, 0x86, 0x60, 0x4d, 0x46, 0xe2, 0x3e, 0xcc, 0x08, 0x6e, 0xc7, 0xf6,
+    0x2f, 0x98, 0x33, 0xb3, 0xb1, 0xbc, 0x76, 0x5e, 0x2b, 0xd6, 0x66, 0xa5, 0xef, 0xc4, 0xe6, 0x2a,
+    0x06, 0xf4, 0xb6, 0xe8, 0xbe, 0xc1, 0xd4, 0x36, 0x74, 0xee, 0x82, 0x15, 0xbc, 0xef, 0x21, 0x63,
+    0xfd, 0xc1, 0x4e, 0x0d, 0xf4, 0x53, 0xc9, 0x69, 0xa7, 0x7d, 0x5a, 0xc4, 0x06, 0x58, 0x58, 0x26,
+    0x7e, 0xc1, 0x14, 0x16, 0x06, 0xe0, 0xfa, 0x16, 0x7e, 0x90, 0xaf, 0x3d, 0x28, 0x63, 0x9d, 0x3f,
+    0xd2, 0xc9, 0xf2, 0xe3, 0x00, 0x9b, 0xd2, 0x0c, 0x5f, 0xaa, 0xce, 0x30, 0xb7, 0xd4, 0x0c, 0x30,
+    0x74, 0x2a, 0x51, 0x16, 0xf2, 0xe0, 0x32, 0x98, 0x0d, 0xeb, 0x30, 0xd8, 0xe3, 0xce, 0xf8, 0x9a,
+    0x4b, 0xc5, 0x9e, 0x7b, 0xb5, 0xf1, 0x79, 0x92, 0xff, 0x51, 0xe6, 0x6e, 0x04, 0x86, 0x68, 0xd3,
+    0x9b, 0x23, 0x4d, 0x57, 0xe6, 0x96, 0x67, 0x31, 0xcc, 0xe6, 0xa6, 0xf3, 0x17, 0x0a, 0x75, 0x05,
+    0xb1, 0x76, 0x81, 0xd9, 0x13, 0x32, 0x6c, 0xce, 0x3c, 0x17, 0x52, 0x84, 0xf8, 0x05, 0xa2, 0x62,
+    0xf4, 0x2b, 0xcb, 0xb3, 0x78, 0x47, 0x15, 0x47, 0xff, 0x46, 0x54, 0x82, 0x23, 0x93, 0x6a, 0x48,
+    0x38, 0xdf, 0x58, 0x07, 0x4e, 0x5e, 0x65, 0x65, 0xf2, 0xfc, 0x7c, 0x89, 0xfc, 0x86, 0x50, 0x8e,
+    0x31, 0x70, 0x2e, 0x44, 0xd0, 0x0b, 0xca, 0x86, 0xf0, 0x40, 0x09, 0xa2, 0x30, 0x78, 0x47, 0x4e,
+    0x65, 0xa0, 0xee, 0x39, 0xd1, 0xf7, 0x38, 0x83, 0xf7, 0x5e, 0xe9, 0x37, 0xe4, 0x2c, 0x3a, 0xbd,
+    0x21, 0x97, 0xb2, 0x26, 0x01, 0x13, 0xf8, 0x6f, 0xa3, 0x44, 0xed, 0xd1, 0xef, 0x9f, 0xde, 0xe7,
+    0x8b, 0xa0, 0xdf, 0x15, 0x76, 0x25, 0x92, 0xd9, 0x3c, 0x85, 0xf7, 0xf6, 0x12, 0xdc, 0x42, 0xbe,
+    0xd8, 0xa7, 0xec, 0x7c, 0xab, 0x27, 0xb0, 0x7e, 0x53, 0x8d, 0x7d, 0xda, 0xaa, 0x3e, 0xa8, 0xde,
+    0xaa, 0x25, 0xce, 0x93, 0xbd, 0x02, 0x69, 0xd8, 0x5a, 0xf6, 0x43, 0xfd, 0x1a, 0x73, 0x08, 0xf9,
+    0xc0, 0x5f, 0xef, 0xda, 0x17, 0x4a, 0x19, 0xa5, 0x97, 0x4d, 0x66, 0x33, 0x4c, 0xfd, 0x21, 0x6a,
+    0x35, 0xb4, 0x98, 0x31, 0xdb, 0x41, 0x15, 0x70, 0xea, 0x1e, 0x0f, 0xbb, 0xed, 0xcd, 0x54, 0x9b,
+    0x9a, 0xd0, 0x63, 0xa1, 0x51, 0x97, 0x40, 0x72, 0xf6, 0x75, 0x9d, 0xbf, 0x91, 0x47, 0x6f, 0xe2};
+
+const unsigned char IV[128] = {
+    0x6f, 0xd1, 0x4b, 0x96, 0x3e, 0x00, 0xaa, 0x17, 0x63, 0x6a, 0x2e, 0x05, 0x7a, 0x15, 0xd5, 0x43,
+    0x8a, 0x22, 0x5e, 0x8d, 0x0c, 0x97, 0xef, 0x0b, 0xe9, 0x34, 0x12, 0x59, 0xf2, 0xb3, 0xc3, 0x61,
+    0x89, 0x1d, 0xa0, 0xc1, 0x53, 0x6f, 0x80, 0x1e, 0x2a, 0xa9, 0x05, 0x6b, 0xea, 0x2b, 0x6d, 0x80,
+    0x58, 0x8e, 0xcc, 0xdb, 0x20, 0x75, 0xba, 0xa6, 0xa9, 0x0f, 0x3a, 0x76, 0xba, 0xf8, 0x3b, 0xf7,
+    0x01, 0x69, 0xe6, 0x05, 0x41, 0xe3, 0x4a, 0x69, 0x46, 0xb5, 0x8a, 0x8e, 0x2e, 0x6f, 0xe6, 0x5a,
+    0x10, 0x47, 0xa7, 0xd0, 0xc1, 0x84, 0x3c, 0x24, 0x3b, 0x6e, 0x71, 0xb1, 0x2d, 0x5a, 0xc1, 0x99,
+    0xcf, 0x57, 0xf6, 0xec, 0x9d, 0xb1, 0xf8, 0x56, 0xa7, 0x06, 0x88, 0x7c, 0x57, 0x16, 0xb1, 0x56,
+    0xe3, 0xc2, 0xfc, 0xdf, 0xe6, 0x85, 0x17, 0xfb, 0x54, 0x5a, 0x46, 0x78, 0xcc, 0x8c, 0xdd, 0x4b};
+
+__m256i inline Broadcast(const unsigned char* p) { return _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)p)); }
+__m256i inline Not(__m256i x) { return Xor(x, _mm256_set1_epi64x(-1)); }
+
+void inline Sb(__m256i& x0, __m256i& x1, __m256i& x2, __m256i& x3, __m256i c)
+{
+    x3 = Not(x3);
+    x0 = Xor(x0, AndNot(x2, c));
+    __m256i tmp = Xor(c, _mm256_and_si256(x0, x1));
+    x0 = Xor(x0, _mm256_and_si256(x2, x3));
+    x3 = Xor(x3, AndNot(x1, x2));
+    x1 = Xor(x1, _mm256_and_si256(x0, x2));
+    x2 = Xor(x2, AndNot(x3, x0));
+    x0 = Xor(x0, Or(x1, x3));
+    x3 = Xor(x3, _mm256_and_si256(x1, x2));
+    x1 = Xor(x1, _mm256_and_si256(tmp, x0));
+    x2 = Xor(x2, tmp);
+}
+
+void inline Lb(__m256i& x0, __m256i& x1, __m256i& x2, __m256i& x3, __m256i& x4, __m256i& x5, __m256i& x6, __m256i& x7)
+{
+    x4 = Xor(x4, x1);
+    x5 = Xor(x5, x2);
+    x6 = Xor(x6, x3, x0);
+    x7 = Xor(x7, x0);
+    x0 = Xor(x0, x5);
+    x1 = Xor(x1, x6);
+    x2 = Xor(x2, x7, x4);
+    x3 = Xor(x3, x4);
+}
+
+/** Swap adjacent groups of n bits selected by mask c (W0..W5). */
+__m256i inline Wz(__m256i x, uint64_t c, int n)
+{
+    __m256i m = K(c);
+    return Or(_mm256_and_si256(ShR(x, n), m), ShL(_mm256_and_si256(x, m), n));
+}
+
+/** The E8 round function r: S-boxes, linear layer and the round's permutation. */
+void inline Round(__m256i h[8], int r)
+{
+    Sb(h[0], h[2], h[4], h[6], Broadcast(C + 32 * r));
+    Sb(h[1], h[3], h[5], h[7], Broadcast(C + 32 * r + 16));
+    Lb(h[0], h[2], h[4], h[6], h[1], h[3], h[5], h[7]);
+    for (int i = 1; i < 8; i += 2) {
+        switch (r % 7) {
+        case 0: h[i] = Wz(h[i], 0x5555555555555555ull, 1); break;
+        case 1: h[i] = Wz(h[i], 0x3333333333333333ull, 2); break;
+        case 2: h[i] = Wz(h[i], 0x0F0F0F0F0F0F0F0Full, 4); break;
+        case 3: h[i] = Wz(h[i], 0x00FF00FF00FF00FFull, 8); break;
+        case 4: h[i] = Wz(h[i], 0x0000FFFF0000FFFFull, 16); break;
+        case 5: h[i] = Wz(h[i], 0x00000000FFFFFFFFull, 32); break;
+        default: h[i] = _mm256_shuffle_epi32(h[i], 0x4E); break;
+        }
+    }
+}
+
+/** Absorb one 64-byte block per lane. */
+void Compress(__m256i h[8], const __m256i m[4])
+{
+    for (int i = 0; i < 4; i++)
+        h[i] = Xor(h[i], m[i]);
+    for (int r = 0; r < 42; r++)
+        Round(h, r);
+    for (int i = 0; i < 4; i++)
+        h[i + 4] = Xor(h[i + 4], m[i]);
+}
+
+/** JH-512 of two 64-byte messages, one per 128-bit half. */
+void Hash2(unsigned char* out0, unsigned char* out1, const unsigned char* in0, const unsigned char* in1)
+{
+    __m256i h[8], m[4];
+    for (int i = 0; i < 8; i++)
+        h[i] = Broadcast(IV + 16 * i);
+    for (int i = 0; i < 4; i++)
+        m[i] = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(in0 + 16 * i))),
+                                       _mm_loadu_si128((const __m128i*)(in1 + 16 * i)), 1);
+    Compress(h, m);
+
+    // Padding block: 0x80, zeros, then the 128-bit big-endian bit length (512).
+    m[0] = _mm256_set_epi64x(0, 0x80, 0, 0x80);
+    m[1] = _mm256_setzero_si256();
+    m[2] = _mm256_setzero_si256();
+    m[3] = _mm256_set_epi64x(0x0002000000000000ull, 0, 0x0002000000000000ull, 0);
+    Compress(h, m);
+
+    for (int i = 0; i < 4; i++) {
+        _mm_storeu_si128((__m128i*)(out0 + 16 * i), _mm256_castsi256_si128(h[i + 4]));
+        _mm_storeu_si128((__m128i*)(out1 + 16 * i), _mm256_extracti128_si256(h[i + 4], 1));
+    }
+}
+
+} // namespace jh
+
+} // namespace
+
+void Blake512_4way(unsigned char* out[4], const unsigned char* const in[4], size_t len)
+{
+    __m256i h[8];
+    for (int i = 0; i < 8; i++)
+        h[i] = K(blake::IV[i]);
+
+    size_t off = 0;
+    for (; off + 128 <= len; off += 128) {
+        const unsigned char* blk[4] = {in[0] + off, in[1] + off, in[2] + off, in[3] + off};
+        blake::Compress(h, blk, (uint64_t)(off + 128) << 3);
+    }
+
+    // Pad the tail exactly like sph_blake512_close: 0x80 terminator, final
+    // 0x01 bit at byte 111, 128-bit big-endian bit length.
+    const size_t rem = len - off;
+    const uint64_t bits = (uint64_t)len << 3;
+    unsigned char buf[4][256];
+    const size_t padded = rem <= 111 ? 128 : 256;
+    for (int l = 0; l < 4; l++) {
+        memset(buf[l], 0, padded);
+        memcpy(buf[l], in[l] + off, rem);
+        buf[l][rem] = 0x80;
+        buf[l][padded - 17] |= 0x01;
+        WriteBE64(buf[l] + padded - 8, bits);
+    }
+    const unsigned char* blk[4] = {buf[0], buf[1], buf[2], buf[3]};
+    blake::Compress(h, blk, rem == 0 ? 0 : bits);
+    if (padded == 256) {
+        const unsigned char* blk2[4] = {buf[0] + 128, buf[1] + 128, buf[2] + 128, buf[3] + 128};
+        blake::Compress(h, blk2, 0);
+    }
+
+    for (int i = 0; i < 8; i++)
+        h[i] = ByteSwap(h[i]);
+    Store8(out, h);
+}
+
+void Blake512_64_4way(unsigned char* out[4], const unsigned char* const in[4])
+{
+    Blake512_4way(out, in, 64);
+}
+
+void Bmw512_4way(unsigned char* out[4], const unsigned char* const in[4])
+{
+    static const uint64_t IV[16] = {
+        0x8081828384858687ull, 0x88898A8B8C8D8E8Full, 0x9091929394959697ull, 0x98999A9B9C9D9E9Full,
+        0xA0A1A2A3A4A5A6A7ull, 0xA8A9AAABACADAEAFull, 0xB0B1B2B3B4B5B6B7ull, 0xB8B9BABBBCBDBEBFull,
+        0xC0C1C2C3C4C5C6C7ull, 0xC8C9CACBCCCDCECFull, 0xD0D1D2D3D4D5D6D7ull, 0xD8D9DADBDCDDDEDFull,
+        0xE0E1E2E3E4E5E6E7ull, 0xE8E9EAEBECEDEEEFull, 0xF0F1F2F3F4F5F6F7ull, 0xF8F9FAFBFCFDFEFFull};
+    __m256i m[16], h[16], dh[16];
+    Load8(m, in);
+    m[8] = K(0x80);
+    for (int i = 9; i < 15; i++)
+        m[i] = _mm256_setzero_si256();
+    m[15] = K(512);
+    for (int i = 0; i < 16; i++)
+        h[i] = K(IV[i]);
+    bmw::Compress(m, h, dh);
+
+    // Final compression keyed with the 0xaa..a0+i constants.
+    for (int i = 0; i < 16; i++)
+        h[i] = K(0xaaaaaaaaaaaaaaa0ull + i);
+    bmw::Compress(dh, h, m);
+    Store8(out, m + 8);
+}
+
+void Keccak512_4way(unsigned char* out[4], const unsigned char* const in[4])
+{
+    __m256i st[25];
+    Load8(st, in);
+    st[8] = K(0x8000000000000001ull);
+    for (int i = 9; i < 25; i++)
+        st[i] = _mm256_setzero_si256();
+    keccak::Permute(st);
+    Store8(out, st);
+}
+
+void Jh512_4way(unsigned char* out[4], const unsigned char* const in[4])
+{
+    jh::Hash2(out[0], out[1], in[0], in[1]);
+    jh::Hash2(out[2], out[3], in[2], in[3]);
+}
+
+void Skein512_4way(unsigned char* out[4], const unsigned char* const in[4])
+{
+    __m256i h[8], m[8];
+    for (int i = 0; i < 8; i++)
+        h[i] = K(skein::IV[i]);
+    Load8(m, in);
+    skein::Ubi(h, m, 64, 0xF000000000000000ull);
+    for (int i = 0; i < 8; i++)
+        m[i] = _mm256_setzero_si256();
+    skein::Ubi(h, m, 8, 0xFF00000000000000ull);
+    Store8(out, h);
+}
+
+} // namespace quark_avx2
+
+#endif
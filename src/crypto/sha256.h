@@ -7,6 +7,7 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <string>
 
 /** A hasher class for SHA-256. */
 class CSHA256
@@ -25,4 +26,26 @@ public:
     CSHA256& Reset();
 };
 
+/** SHA-256 implementations SHA256AutoDetect() may choose from */
+enum {
+    SHA256_USE_SHANI = (1U << 0),
+    SHA256_USE_SSE41 = (1U << 1),
+    SHA256_USE_AVX2 = (1U << 2),
+    SHA256_USE_ALL = SHA256_USE_SHANI | SHA256_USE_SSE41 | SHA256_USE_AVX2,
+};
+
+/** Autodetect the best available SHA-256 transforms among those in nUse,
+ *  for CSHA256 and SHA256D64(), and check them against known hashes.
+ *  Call it at startup, before other threads hash anything.
+ *  Returns the name of the implementation. */
+std::string SHA256AutoDetect(unsigned int nUse = SHA256_USE_ALL);
+
+/** Compute the double SHA-256 of blocks consecutive 64-byte inputs.
+ *
+ *  Several inputs are hashed at a time with the SIMD kernels selected by
+ *  SHA256AutoDetect(). output receives 32 bytes per input, in order, and may
+ *  be the same buffer as input.
+ */
+void SHA256D64(unsigned char* output, const unsigned char* input, size_t blocks);
+
 #endif // BITCOIN_CRYPTO_SHA256_H
@@ -0,0 +1,78 @@
+// Copyright (c) 2018 The KoinMudra developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// SHA-256 transform using the x86 SHA extensions (SHA-NI). The state is kept
+// in the ABEF/CDGH register layout the sha256rnds2 instruction works on.
+
+#ifdef ENABLE_SHANI
+
+#include <stdint.h>
+#include <immintrin.h>
+
+namespace sha256_shani {
+namespace {
+
+const uint32_t CK[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+/** Four rounds; wk holds the message words plus round constants. */
+void inline QuadRound(__m128i& abef, __m128i& cdgh, __m128i wk)
+{
+    cdgh = _mm_sha256rnds2_epu32(cdgh, abef, wk);
+    abef = _mm_sha256rnds2_epu32(abef, cdgh, _mm_shuffle_epi32(wk, 0x0e));
+}
+
+} // namespace
+
+/** Process blocks consecutive 64-byte chunks into the state s. */
+void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks)
+{
+    const __m128i byteswap = _mm_set_epi64x(0x0c0d0e0f08090a0bull, 0x0405060700010203ull);
+
+    __m128i dcba = _mm_loadu_si128((const __m128i*)&s[0]);
+    __m128i hgfe = _mm_loadu_si128((const __m128i*)&s[4]);
+    __m128i cdab = _mm_shuffle_epi32(dcba, 0xb1);
+    __m128i efgh = _mm_shuffle_epi32(hgfe, 0x1b);
+    __m128i abef = _mm_alignr_epi8(cdab, efgh, 8);
+    __m128i cdgh = _mm_blend_epi16(efgh, cdab, 0xf0);
+
+    while (blocks--) {
+        const __m128i abefSave = abef, cdghSave = cdgh;
+
+        // The message schedule runs over a window of the last four quads
+        __m128i w[4];
+        for (int i = 0; i < 4; i++) {
+            w[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(chunk + 16 * i)), byteswap);
+            QuadRound(abef, cdgh, _mm_add_epi32(w[i], _mm_loadu_si128((const __m128i*)&CK[4 * i])));
+        }
+        for (int i = 4; i < 16; i++) {
+            __m128i& wi = w[i & 3];
+            const __m128i& w1 = w[(i + 3) & 3];
+            wi = _mm_sha256msg1_epu32(wi, w[(i + 1) & 3]);
+            wi = _mm_add_epi32(wi, _mm_alignr_epi8(w1, w[(i + 2) & 3], 4));
+            wi = _mm_sha256msg2_epu32(wi, w1);
+            QuadRound(abef, cdgh, _mm_add_epi32(wi, _mm_loadu_si128((const __m128i*)&CK[4 * i])));
+        }
+
+        abef = _mm_add_epi32(abef, abefSave);
+        cdgh = _mm_add_epi32(cdgh, cdghSave);
+        chunk += 64;
+    }
+
+    __m128i feba = _mm_shuffle_epi32(abef, 0x1b);
+    __m128i dchg = _mm_shuffle_epi32(cdgh, 0xb1);
+    _mm_storeu_si128((__m128i*)&s[0], _mm_blend_epi16(feba, dchg, 0xf0));
+    _mm_storeu_si128((__m128i*)&s[4], _mm_alignr_epi8(dchg, feba, 8));
+}
+
+} // namespace sha256_shani
+
+#endif // ENABLE_SHANI
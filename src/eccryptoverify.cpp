@@ -5,6 +5,8 @@
 
 #include "eccryptoverify.h"
 
+#include <string.h>
+
 namespace
 {
 int CompareBigEndian(const unsigned char* c1, size_t c1len, const unsigned char* c2, size_t c2len)
@@ -48,6 +50,50 @@ const unsigned char vchMaxModHalfOrder[32] = {
     0xDF, 0xE9, 0x2F, 0x46, 0x68, 0x1B, 0x20, 0xA0};
 
 const unsigned char vchZero[1] = {0};
+
+/** Read a DER length at vchSig[nPos], accepting the long forms OpenSSL accepts */
+bool ReadDERLength(const unsigned char* vchSig, size_t nSigLen, size_t& nPos, size_t& nLenRet)
+{
+    if (nPos == nSigLen)
+        return false;
+    size_t nLenBytes = vchSig[nPos++];
+    if (!(nLenBytes & 0x80)) {
+        nLenRet = nLenBytes;
+        return true;
+    }
+    nLenBytes -= 0x80;
+    if (nLenBytes > nSigLen - nPos)
+        return false;
+    while (nLenBytes > 0 && vchSig[nPos] == 0) {
+        nPos++;
+        nLenBytes--;
+    }
+    if (nLenBytes >= sizeof(size_t))
+        return false;
+    nLenRet = 0;
+    while (nLenBytes > 0) {
+        nLenRet = (nLenRet << 8) + vchSig[nPos++];
+        nLenBytes--;
+    }
+    return true;
+}
+
+/** Read a DER integer at vchSig[nPos] as unsigned, as OpenSSL reads r and s, without its leading zeroes */
+bool ReadDERInteger(const unsigned char* vchSig, size_t nSigLen, size_t& nPos, const unsigned char*& pchRet, size_t& nLenRet)
+{
+    if (nPos == nSigLen || vchSig[nPos] != 0x02)
+        return false;
+    nPos++;
+    if (!ReadDERLength(vchSig, nSigLen, nPos, nLenRet) || nLenRet > nSigLen - nPos)
+        return false;
+    pchRet = vchSig + nPos;
+    nPos += nLenRet;
+    while (nLenRet > 0 && *pchRet == 0) {
+        pchRet++;
+        nLenRet--;
+    }
+    return true;
+}
 } // anon namespace
 
 namespace eccrypto
@@ -66,4 +112,44 @@ bool CheckSignatureElement(const unsigned char* vch, int len, bool half)
            CompareBigEndian(vch, len, half ? vchMaxModHalfOrder : vchMaxModOrder, 32) <= 0;
 }
 
+bool ParseDERSignatureLax(const unsigned char* vchSig, size_t nSigLen, unsigned char vchRS[64])
+{
+    memset(vchRS, 0, 64);
+
+    // The sequence must hold exactly the two integers, as OpenSSL requires; data
+    // after it is ignored. An indefinite length ends at two zero bytes instead.
+    size_t nPos = 0;
+    if (nPos == nSigLen || vchSig[nPos] != 0x30)
+        return false;
+    nPos++;
+    bool fIndefinite = nPos < nSigLen && vchSig[nPos] == 0x80;
+    size_t nSeqLen;
+    if (fIndefinite) {
+        nPos++;
+        nSeqLen = nSigLen - nPos;
+    } else if (!ReadDERLength(vchSig, nSigLen, nPos, nSeqLen) || nSeqLen > nSigLen - nPos) {
+        return false;
+    }
+    size_t nSeqEnd = nPos + nSeqLen;
+
+    const unsigned char* pchR;
+    const unsigned char* pchS;
+    size_t nLenR, nLenS;
+    if (!ReadDERInteger(vchSig, nSeqEnd, nPos, pchR, nLenR) ||
+        !ReadDERInteger(vchSig, nSeqEnd, nPos, pchS, nLenS))
+        return false;
+    if (fIndefinite) {
+        if (nSeqEnd - nPos < 2 || vchSig[nPos] != 0 || vchSig[nPos + 1] != 0)
+            return false;
+    } else if (nPos != nSeqEnd) {
+        return false;
+    }
+
+    if (nLenR <= 32 && nLenS <= 32) {
+        memcpy(vchRS + 32 - nLenR, pchR, nLenR);
+        memcpy(vchRS + 64 - nLenS, pchS, nLenS);
+    }
+    return true;
+}
+
 } // namespace eccrypto
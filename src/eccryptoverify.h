@@ -16,6 +16,18 @@ namespace eccrypto
 bool Check(const unsigned char* vch);
 bool CheckSignatureElement(const unsigned char* vch, int len, bool half);
 
+/**
+ * Parse a DER signature with the leniency of OpenSSL's d2i_ECDSA_SIG, which
+ * signatures in blocks from before BIP66 were checked with: long form and
+ * indefinite lengths, zero padded integers, integers with their high bit set,
+ * which OpenSSL reads as unsigned like libsecp256k1's lax parser, and data
+ * after the signature are accepted. A sequence length that does not match its
+ * contents is not. Writes r and s as 32 byte big endian numbers to vchRS,
+ * both zero if either does not fit in 32 bytes, so that the signature fails
+ * verification. Returns false if vchSig is not a signature OpenSSL would read.
+ */
+bool ParseDERSignatureLax(const unsigned char* vchSig, size_t nSigLen, unsigned char vchRS[64]);
+
 } // eccrypto namespace
 
 #endif // BITCOIN_ECCRYPTOVERIFY_H
@@ -0,0 +1,72 @@
+// Copyright (c) 2018 The KoinMudra developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "jsonstream.h"
+
+#include <assert.h>
+
+void CJSONStreamWriter::BeginValue()
+{
+    if (fAfterKey) {
+        fAfterKey = false;
+        return;
+    }
+    if (!vFirst.empty()) {
+        if (!vFirst.back())
+            strOut += ',';
+        vFirst.back() = false;
+    }
+}
+
+void CJSONStreamWriter::BeginObject()
+{
+    BeginValue();
+    strOut += '{';
+    vFirst.push_back(true);
+}
+
+void CJSONStreamWriter::EndObject()
+{
+    assert(!vFirst.empty() && !fAfterKey);
+    vFirst.pop_back();
+    strOut += '}';
+}
+
+void CJSONStreamWriter::BeginArray()
+{
+    BeginValue();
+    strOut += '[';
+    vFirst.push_back(true);
+}
+
+void CJSONStreamWriter::EndArray()
+{
+    assert(!vFirst.empty() && !fAfterKey);
+    vFirst.pop_back();
+    strOut += ']';
+}
+
+void CJSONStreamWriter::Key(const std::string& strKey)
+{
+    BeginValue();
+    strOut += UniValue(strKey).write();
+    strOut += ':';
+    fAfterKey = true;
+}
+
+void CJSONStreamWriter::Value(const UniValue& value)
+{
+    BeginValue();
+    strOut += value.write();
+}
+
+void CJSONStreamWriter::Members(const UniValue& obj)
+{
+    const std::vector<std::string>& vKeys = obj.getKeys();
+    const std::vector<UniValue>& vValues = obj.getValues();
+    for (unsigned int i = 0; i < vKeys.size(); i++) {
+        Key(vKeys[i]);
+        Value(vValues[i]);
+    }
+}
@@ -0,0 +1,50 @@
+// Copyright (c) 2018 The KoinMudra developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_JSONSTREAM_H
+#define BITCOIN_JSONSTREAM_H
+
+#include <string>
+#include <vector>
+
+#include <univalue.h>
+
+/**
+ * Writes a JSON document piece by piece into a string, in the compact form
+ * of UniValue::write(), so large results do not have to be built as a
+ * UniValue tree first. Leaf values and small sub-objects are passed as
+ * UniValue and written as they are.
+ */
+class CJSONStreamWriter
+{
+private:
+    std::string& strOut;
+    //! per open object or array: whether the next element is the first
+    std::vector<bool> vFirst;
+    bool fAfterKey;
+
+    void BeginValue();
+
+public:
+    CJSONStreamWriter(std::string& strOutIn) : strOut(strOutIn), fAfterKey(false) {}
+
+    void BeginObject();
+    void EndObject();
+    void BeginArray();
+    void EndArray();
+    void Key(const std::string& strKey);
+    void Value(const UniValue& value);
+
+    template <typename T>
+    void Pair(const std::string& strKey, const T& value)
+    {
+        Key(strKey);
+        Value(UniValue(value));
+    }
+
+    //! Write the members of obj into the object being written
+    void Members(const UniValue& obj);
+};
+
+#endif // BITCOIN_JSONSTREAM_H
@@ -7,6 +7,8 @@
 #include <boost/assign/list_of.hpp>
 #include <boost/lexical_cast.hpp>
 
+#include "checkqueue.h"
+#include "crypto/common.h"
 #include "db.h"
 #include "kernel.h"
 #include "script/interpreter.h"
@@ -62,7 +64,7 @@ static int64_t GetStakeModifierSelectionIntervalSection(int nSection)
 }
 
 // Get stake modifier selection interval (in seconds)
-static int64_t GetStakeModifierSelectionInterval()
+int64_t GetStakeModifierSelectionInterval()
 {
     int64_t nSelectionInterval = 0;
     for (int nSection = 0; nSection < 64; nSection++) {
@@ -240,35 +242,111 @@ bool ComputeNextStakeModifier(const CBlockIndex* pindexPrev, uint64_t& nStakeMod
     return true;
 }
 
+namespace {
+
+/**
+ * The blocks of the active chain that generated a stake modifier, in height
+ * order, so that a kernel's modifier can be found by binary search instead
+ * of walking the chain one block at a time. Block times are not monotonic,
+ * so every entry also carries the largest block time up to and including it.
+ */
+class CStakeModifierIndex
+{
+private:
+    struct Entry {
+        const CBlockIndex* pindex;
+        int64_t nMaxTime;
+    };
+
+    std::vector<Entry> vEntries;
+    //! The tip the index was last brought in step with
+    const CBlockIndex* pindexScanned;
+
+    static bool CompareHeight(const Entry& entry, int nHeight) { return entry.pindex->nHeight < nHeight; }
+    static bool CompareMaxTime(const Entry& entry, int64_t nTime) { return entry.nMaxTime < nTime; }
+
+public:
+    CStakeModifierIndex() : pindexScanned(NULL) {}
+
+    /** Drop the entries disconnected since the last update, then index the newly connected blocks. */
+    void Update(const CChain& chain)
+    {
+        if (pindexScanned == chain.Tip())
+            return;
+        if (chain.Tip() == NULL) {
+            // the block index was unloaded
+            vEntries.clear();
+            pindexScanned = NULL;
+            return;
+        }
+        if (pindexScanned && !chain.Contains(pindexScanned)) {
+            pindexScanned = chain.FindFork(pindexScanned);
+            int nForkHeight = pindexScanned ? pindexScanned->nHeight : -1;
+            while (!vEntries.empty() && vEntries.back().pindex->nHeight > nForkHeight)
+                vEntries.pop_back();
+        }
+        for (int nHeight = pindexScanned ? pindexScanned->nHeight + 1 : 0; nHeight <= chain.Height(); nHeight++) {
+            const CBlockIndex* pindex = chain[nHeight];
+            if (!pindex->GeneratedStakeModifier())
+                continue;
+            Entry entry;
+            entry.pindex = pindex;
+            entry.nMaxTime = vEntries.empty() ? pindex->GetBlockTime() : std::max(vEntries.back().nMaxTime, pindex->GetBlockTime());
+            vEntries.push_back(entry);
+        }
+        pindexScanned = chain.Tip();
+    }
+
+    /** Find the first block above nHeight that generated a modifier at or after nTime. */
+    const CBlockIndex* Find(int nHeight, int64_t nTime) const
+    {
+        std::vector<Entry>::const_iterator itBegin = std::lower_bound(vEntries.begin(), vEntries.end(), nHeight + 1, CompareHeight);
+        if (itBegin == vEntries.begin() || (itBegin - 1)->nMaxTime < nTime) {
+            // No earlier block reaches nTime, so the running maximum finds the first one that does
+            std::vector<Entry>::const_iterator it = std::lower_bound(itBegin, vEntries.end(), nTime, CompareMaxTime);
+            return it == vEntries.end() ? NULL : it->pindex;
+        }
+        // Out-of-order timestamps before nHeight: scan the generating blocks only
+        for (std::vector<Entry>::const_iterator it = itBegin; it != vEntries.end(); ++it)
+            if (it->pindex->GetBlockTime() >= nTime)
+                return it->pindex;
+        return NULL;
+    }
+};
+
+CStakeModifierIndex stakeModifierIndex;
+CCriticalSection cs_stakeModifierIndex;
+
+} // anon namespace
+
+void UpdateStakeModifierIndex()
+{
+    LOCK(cs_stakeModifierIndex);
+    stakeModifierIndex.Update(chainActive);
+}
+
 // The stake modifier used to hash for a stake kernel is chosen as the stake
 // modifier about a selection interval later than the coin generating the kernel
 bool GetKernelStakeModifier(uint256 hashBlockFrom, uint64_t& nStakeModifier, int& nStakeModifierHeight, int64_t& nStakeModifierTime, bool fPrintProofOfStake)
 {
     nStakeModifier = 0;
-    if (!mapBlockIndex.count(hashBlockFrom))
+    BlockMap::iterator mi = mapBlockIndex.find(hashBlockFrom);
+    if (mi == mapBlockIndex.end())
         return error("GetKernelStakeModifier() : block not indexed");
-    const CBlockIndex* pindexFrom = mapBlockIndex[hashBlockFrom];
-    nStakeModifierHeight = pindexFrom->nHeight;
-    nStakeModifierTime = pindexFrom->GetBlockTime();
-    int64_t nStakeModifierSelectionInterval = GetStakeModifierSelectionInterval();
-    const CBlockIndex* pindex = pindexFrom;
-    CBlockIndex* pindexNext = chainActive[pindexFrom->nHeight + 1];
-
-    // loop to find the stake modifier later by a selection interval
-    while (nStakeModifierTime < pindexFrom->GetBlockTime() + nStakeModifierSelectionInterval) {
-        if (!pindexNext) {
-            // Should never happen
-            //return error("Null pindexNext\n");
-            return false;
-        }
-
-        pindex = pindexNext;
-        pindexNext = chainActive[pindexNext->nHeight + 1];
-        if (pindex->GeneratedStakeModifier()) {
-            nStakeModifierHeight = pindex->nHeight;
-            nStakeModifierTime = pindex->GetBlockTime();
-        }
+    const CBlockIndex* pindexFrom = mi->second;
+
+    // find the stake modifier later by a selection interval
+    LOCK(cs_stakeModifierIndex);
+    stakeModifierIndex.Update(chainActive);
+    const CBlockIndex* pindex = stakeModifierIndex.Find(pindexFrom->nHeight, pindexFrom->GetBlockTime() + GetStakeModifierSelectionInterval());
+    if (!pindex) {
+        // Should never happen
+        //return error("Null pindexNext\n");
+        return false;
     }
+
+    nStakeModifierHeight = pindex->nHeight;
+    nStakeModifierTime = pindex->GetBlockTime();
     nStakeModifier = pindex->nStakeModifier;
     return true;
 }
@@ -367,6 +445,149 @@ bool CheckStakeKernelHash(unsigned int nBits, const CBlock blockFrom, const CTra
     return fSuccess;
 }
 
+int nStakeSearchThreads = 0;
+
+bool PrepareStakeKernel(unsigned int nBits, const CBlockIndex* pindexFrom, const CTransaction& txPrev, const COutPoint& prevout, CStakeKernel& kernel)
+{
+    uint64_t nStakeModifier = 0;
+    int nStakeModifierHeight = 0;
+    int64_t nStakeModifierTime = 0;
+    if (!GetKernelStakeModifier(pindexFrom->GetBlockHash(), nStakeModifier, nStakeModifierHeight, nStakeModifierTime, false))
+        return false;
+
+    kernel.nTimeBlockFrom = pindexFrom->GetBlockTime();
+    WriteLE64(kernel.vchPrefix, nStakeModifier);
+    WriteLE32(kernel.vchPrefix + 8, kernel.nTimeBlockFrom);
+    WriteLE32(kernel.vchPrefix + 12, prevout.n);
+    memcpy(kernel.vchPrefix + 16, prevout.hash.begin(), 32);
+
+    uint256 bnTargetPerCoinDay;
+    bnTargetPerCoinDay.SetCompact(nBits);
+    kernel.bnTarget = (uint256(txPrev.vout[prevout.n].nValue) / 100) * bnTargetPerCoinDay;
+    return true;
+}
+
+namespace {
+
+/** Where the kernel search threads report a hit. */
+struct CStakeKernelHit {
+    boost::mutex mutex;
+    bool fFound;
+    size_t nKernel;
+    unsigned int nTimeTx;
+    uint256 hashProofOfStake;
+
+    CStakeKernelHit() : fFound(false), nKernel(0), nTimeTx(0) {}
+};
+
+/**
+ * A slice of the coin x timestamp search grid. Returns false when it finds
+ * a kernel, which makes the queue skip all remaining slices.
+ */
+class CStakeKernelCheck
+{
+private:
+    const std::vector<CStakeKernel>* pvKernels;
+    size_t nBegin;
+    size_t nEnd;
+    unsigned int nTimeTx;
+    unsigned int nHashDrift;
+    int nHeightStart;
+    CStakeKernelHit* pHit;
+
+public:
+    CStakeKernelCheck() : pvKernels(NULL), nBegin(0), nEnd(0), nTimeTx(0), nHashDrift(0), nHeightStart(0), pHit(NULL) {}
+    CStakeKernelCheck(const std::vector<CStakeKernel>& vKernelsIn, size_t nBeginIn, size_t nEndIn, unsigned int nTimeTxIn, unsigned int nHashDriftIn, int nHeightStartIn, CStakeKernelHit& hitIn) : pvKernels(&vKernelsIn), nBegin(nBeginIn), nEnd(nEndIn), nTimeTx(nTimeTxIn), nHashDrift(nHashDriftIn), nHeightStart(nHeightStartIn), pHit(&hitIn) {}
+
+    bool operator()()
+    {
+        unsigned char vchData[CStakeKernel::PREFIX_SIZE + 4];
+        for (size_t n = nBegin; n < nEnd; n++) {
+            //new block came in, move on
+            if (chainActive.Height() != nHeightStart)
+                return true;
+
+            const CStakeKernel& kernel = (*pvKernels)[n];
+            if (nTimeTx < kernel.nTimeBlockFrom) // Transaction timestamp violation
+                continue;
+
+            memcpy(vchData, kernel.vchPrefix, CStakeKernel::PREFIX_SIZE);
+            for (unsigned int i = 0; i < nHashDrift; i++) {
+                unsigned int nTryTime = nTimeTx + nHashDrift - i;
+                WriteLE32(vchData + CStakeKernel::PREFIX_SIZE, nTryTime);
+                uint256 hashProofOfStake;
+                CHash256().Write(vchData, sizeof(vchData)).Finalize((unsigned char*)&hashProofOfStake);
+                if (hashProofOfStake < kernel.bnTarget) {
+                    boost::unique_lock<boost::mutex> lock(pHit->mutex);
+                    // prefer the earliest coin, as the sequential search did
+                    if (!pHit->fFound || n < pHit->nKernel) {
+                        pHit->fFound = true;
+                        pHit->nKernel = n;
+                        pHit->nTimeTx = nTryTime;
+                        pHit->hashProofOfStake = hashProofOfStake;
+                    }
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    void swap(CStakeKernelCheck& check)
+    {
+        std::swap(pvKernels, check.pvKernels);
+        std::swap(nBegin, check.nBegin);
+        std::swap(nEnd, check.nEnd);
+        std::swap(nTimeTx, check.nTimeTx);
+        std::swap(nHashDrift, check.nHashDrift);
+        std::swap(nHeightStart, check.nHeightStart);
+        std::swap(pHit, check.pHit);
+    }
+};
+
+/** Number of coins searched by one check */
+static const size_t STAKE_SEARCH_SLICE = 8;
+
+CCheckQueue<CStakeKernelCheck> stakekernelqueue(16);
+CCriticalSection cs_stakesearch;
+
+} // anon namespace
+
+void ThreadStakeKernelSearch()
+{
+    RenameThread("koinmudra-stakesearch");
+    stakekernelqueue.Thread();
+}
+
+bool FindStakeKernel(const std::vector<CStakeKernel>& vKernels, unsigned int nTimeTx, unsigned int nHashDrift, size_t& nKernelRet, unsigned int& nTimeTxRet, uint256& hashProofOfStakeRet)
+{
+    LOCK(cs_stakesearch);
+
+    CStakeKernelHit hit;
+    int nHeightStart = chainActive.Height();
+    std::vector<CStakeKernelCheck> vChecks;
+    vChecks.reserve((vKernels.size() + STAKE_SEARCH_SLICE - 1) / STAKE_SEARCH_SLICE);
+    for (size_t n = 0; n < vKernels.size(); n += STAKE_SEARCH_SLICE)
+        vChecks.push_back(CStakeKernelCheck(vKernels, n, std::min(n + STAKE_SEARCH_SLICE, vKernels.size()), nTimeTx, nHashDrift, nHeightStart, hit));
+
+    if (nStakeSearchThreads) {
+        CCheckQueueControl<CStakeKernelCheck> control(&stakekernelqueue);
+        control.Add(vChecks);
+        control.Wait();
+    } else {
+        BOOST_FOREACH (CStakeKernelCheck& check, vChecks)
+            if (!check())
+                break;
+    }
+
+    if (!hit.fFound)
+        return false;
+    nKernelRet = hit.nKernel;
+    nTimeTxRet = hit.nTimeTx;
+    hashProofOfStakeRet = hit.hashProofOfStake;
+    return true;
+}
+
 // Check kernel hash target and coinstake signature
 bool CheckProofOfStake(const CBlock block, uint256& hashProofOfStake)
 {
@@ -21,12 +21,50 @@ static const int MODIFIER_INTERVAL_RATIO = 3;
 // Compute the hash modifier for proof-of-stake
 bool ComputeNextStakeModifier(const CBlockIndex* pindexPrev, uint64_t& nStakeModifier, bool& fGeneratedStakeModifier);
 
+// Bring the stake modifier index in step with chainActive, after the tip changes
+void UpdateStakeModifierIndex();
+
+// Stake modifier selection interval (in seconds)
+int64_t GetStakeModifierSelectionInterval();
+
+// Find the stake modifier a kernel from hashBlockFrom hashes with: the first one
+// generated a selection interval after that block
+bool GetKernelStakeModifier(uint256 hashBlockFrom, uint64_t& nStakeModifier, int& nStakeModifierHeight, int64_t& nStakeModifierTime, bool fPrintProofOfStake);
+
 // Check whether stake kernel meets hash target
 // Sets hashProofOfStake on success return
 uint256 stakeHash(unsigned int nTimeTx, CDataStream ss, unsigned int prevoutIndex, uint256 prevoutHash, unsigned int nTimeBlockFrom);
 bool stakeTargetHit(uint256 hashProofOfStake, int64_t nValueIn, uint256 bnTargetPerCoinDay);
 bool CheckStakeKernelHash(unsigned int nBits, const CBlock blockFrom, const CTransaction txPrev, const COutPoint prevout, unsigned int& nTimeTx, unsigned int nHashDrift, bool fCheck, uint256& hashProofOfStake, bool fPrintProofOfStake = false);
 
+/** Maximum number of kernel search threads */
+static const int MAX_STAKE_SEARCH_THREADS = 16;
+/** -stakethreads default (number of kernel search threads, 0 = auto) */
+static const int DEFAULT_STAKE_SEARCH_THREADS = 0;
+extern int nStakeSearchThreads;
+
+/** The part of a coin's stake kernel that is fixed for a given chain tip.
+ *  Serialized as in stakeHash(): nStakeModifier, nTimeBlockFrom, prevout.n
+ *  and prevout.hash. Only nTimeTx changes while searching.
+ */
+struct CStakeKernel {
+    static const unsigned int PREFIX_SIZE = 48;
+
+    unsigned char vchPrefix[PREFIX_SIZE];
+    unsigned int nTimeBlockFrom;
+    uint256 bnTarget; // coin day weight times target per coin day
+};
+
+// Precompute the stake kernel of an output, once per chain tip
+bool PrepareStakeKernel(unsigned int nBits, const CBlockIndex* pindexFrom, const CTransaction& txPrev, const COutPoint& prevout, CStakeKernel& kernel);
+
+// Search nHashDrift timestamps above nTimeTx for every kernel, on the kernel search threads.
+// Stops as soon as any kernel meets its target; sets nKernelRet, nTimeTxRet and hashProofOfStakeRet on success
+bool FindStakeKernel(const std::vector<CStakeKernel>& vKernels, unsigned int nTimeTx, unsigned int nHashDrift, size_t& nKernelRet, unsigned int& nTimeTxRet, uint256& hashProofOfStakeRet);
+
+/** Run an instance of the kernel search thread */
+void ThreadStakeKernelSearch();
+
 // Check kernel hash target and coinstake signature
 // Sets hashProofOfStake on success return
 bool CheckProofOfStake(const CBlock block, uint256& hashProofOfStake);
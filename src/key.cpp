@@ -10,12 +10,12 @@
 #include "pubkey.h"
 #include "random.h"
 
-#include "ecwrapper.h"
 #include <secp256k1.h>
 
 //! anonymous namespace
 namespace
 {
+/** Adds the signing tables; pubkey.cpp owns the library state and frees it on exit. */
 class CSecp256k1Init
 {
 public:
@@ -23,10 +23,6 @@ public:
     {
         secp256k1_start(SECP256K1_START_SIGN);
     }
-    ~CSecp256k1Init()
-    {
-        secp256k1_stop();
-    }
 };
 static CSecp256k1Init instance_of_csecp256k1;
 
@@ -238,11 +234,6 @@ void CExtKey::Decode(const unsigned char code[74])
 
 bool ECC_InitSanityCheck()
 {
-#if !defined(USE_SECP256K1)
-    if (!CECKey::SanityCheck()) {
-        return false;
-    }
-#endif
     CKey key;
     key.MakeNewKey(true);
     CPubKey pubkey = key.GetPubKey();
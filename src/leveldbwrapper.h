@@ -31,8 +31,20 @@ class CLevelDBBatch
 
 private:
     leveldb::WriteBatch batch;
+    size_t size_estimate;
 
 public:
+    CLevelDBBatch() : size_estimate(0) {}
+
+    /** Approximate number of bytes queued in this batch */
+    size_t SizeEstimate() const { return size_estimate; }
+
+    void Clear()
+    {
+        batch.Clear();
+        size_estimate = 0;
+    }
+
     template <typename K, typename V>
     void Write(const K& key, const V& value)
     {
@@ -47,6 +59,7 @@ public:
         leveldb::Slice slValue(&ssValue[0], ssValue.size());
 
         batch.Put(slKey, slValue);
+        size_estimate += slKey.size() + slValue.size() + 3;
     }
 
     template <typename K>
@@ -58,6 +71,20 @@ public:
         leveldb::Slice slKey(&ssKey[0], ssKey.size());
 
         batch.Delete(slKey);
+        size_estimate += slKey.size() + 2;
+    }
+
+    /** Queue a key and value that are serialized already */
+    void WriteRaw(const std::string& strKey, const std::string& strValue)
+    {
+        batch.Put(strKey, strValue);
+        size_estimate += strKey.size() + strValue.size() + 3;
+    }
+
+    void EraseRaw(const std::string& strKey)
+    {
+        batch.Delete(strKey);
+        size_estimate += strKey.size() + 2;
     }
 };
 
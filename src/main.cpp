@@ -10,15 +10,18 @@
 
 #include "addrman.h"
 #include "alert.h"
+#include "blockfilemap.h"
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "checkqueue.h"
 #include "init.h"
 #include "kernel.h"
 #include "masternode-budget.h"
+#include "masternode-helpers.h"
 #include "masternode-payments.h"
 #include "masternodeman.h"
 #include "merkleblock.h"
+#include "messagestats.h"
 #include "net.h"
 #include "pow.h"
 #include "spork.h"
@@ -81,9 +84,12 @@ int nScriptCheckThreads = 0;
 bool fImporting = false;
 bool fReindex = false;
 bool fTxIndex = true;
+bool fAddressIndex = DEFAULT_ADDRESSINDEX;
+bool fSpentIndex = DEFAULT_SPENTINDEX;
+bool fTimestampIndex = DEFAULT_TIMESTAMPINDEX;
 bool fIsBareMultisigStd = true;
 bool fCheckBlockIndex = false;
-unsigned int nCoinCacheSize = 5000;
+size_t nCoinCacheUsage = 5000 * 300;
 bool fAlerts = DEFAULT_ALERTS;
 
 unsigned int nStakeMinAge = 60 * 60;
@@ -184,13 +190,13 @@ int nQueuedValidatedHeaders = 0;
 /** Number of preferable block download peers. */
 int nPreferredDownload = 0;
 
-/** Dirty block index entries. */
-set<CBlockIndex*> setDirtyBlockIndex;
-
 /** Dirty block file entries. */
 set<int> setDirtyFileInfo;
 } // anon namespace
 
+/** Dirty block index entries. */
+set<CBlockIndex*> setDirtyBlockIndex;
+
 //////////////////////////////////////////////////////////////////////////////
 //
 // Registration of network node signals.
@@ -237,6 +243,8 @@ struct CNodeState {
     int nBlocksInFlight;
     //! Whether we consider this a preferred download peer.
     bool fPreferredDownload;
+    //! The last header accepted before headers sync with this peer paused on MAX_HEADERS_PENDING, or NULL.
+    CBlockIndex* pindexHeadersPaused;
 
     CNodeState()
     {
@@ -250,12 +258,22 @@ struct CNodeState {
         nStallingSince = 0;
         nBlocksInFlight = 0;
         fPreferredDownload = false;
+        pindexHeadersPaused = NULL;
     }
 };
 
 /** Map maintaining per-node state. Requires cs_main. */
 map<NodeId, CNodeState> mapNodeState;
 
+/**
+ * Headers added to the block index whose blocks we don't have yet, by the network group of
+ * the peer that sent them. Kept across disconnects, so that reconnecting, or connecting from
+ * a neighbouring address, does not renew the budget. Requires cs_main.
+ */
+map<vector<unsigned char>, list<CBlockIndex*> > mapHeadersPending;
+/** Number of headers in mapHeadersPending. Requires cs_main. */
+unsigned int nHeadersPending = 0;
+
 // Requires cs_main.
 CNodeState* State(NodeId pnode)
 {
@@ -400,6 +418,12 @@ CBlockIndex* LastCommonAncestor(CBlockIndex* pa, CBlockIndex* pb)
     return pa;
 }
 
+/** Whether blocks are synced from pnode headers-first: we download headers, then fetch the blocks in parallel. */
+bool IsHeadersFirstPeer(const CNode* pnode)
+{
+    return Params().HeadersFirstSyncingActive() && (pnode->nServices & NODE_HEADERS);
+}
+
 /** Update pindexLastCommonBlock and add not-in-flight missing successors to vBlocks, until it has
  *  at most count entries. */
 void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<CBlockIndex*>& vBlocks, NodeId& nodeStaller)
@@ -506,6 +530,7 @@ void RegisterNodeSignals(CNodeSignals& nodeSignals)
 {
     nodeSignals.GetHeight.connect(&GetHeight);
     nodeSignals.ProcessMessages.connect(&ProcessMessages);
+    nodeSignals.ProcessConcurrentMessages.connect(&ProcessConcurrentMessages);
     nodeSignals.SendMessages.connect(&SendMessages);
     nodeSignals.InitializeNode.connect(&InitializeNode);
     nodeSignals.FinalizeNode.connect(&FinalizeNode);
@@ -515,6 +540,7 @@ void UnregisterNodeSignals(CNodeSignals& nodeSignals)
 {
     nodeSignals.GetHeight.disconnect(&GetHeight);
     nodeSignals.ProcessMessages.disconnect(&ProcessMessages);
+    nodeSignals.ProcessConcurrentMessages.disconnect(&ProcessConcurrentMessages);
     nodeSignals.SendMessages.disconnect(&SendMessages);
     nodeSignals.InitializeNode.disconnect(&InitializeNode);
     nodeSignals.FinalizeNode.disconnect(&FinalizeNode);
@@ -535,6 +561,8 @@ CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& loc
 }
 
 CCoinsViewCache* pcoinsTip = NULL;
+CCoinsViewDB* pcoinsdbview = NULL;
+CBlockFileMap* pblockfilemap = NULL;
 CBlockTreeDB* pblocktree = NULL;
 CSporkDB* pSporkDB = NULL;
 
@@ -736,7 +764,7 @@ bool AreInputsStandard(const CTransaction& tx, const CCoinsViewCache& mapInputs)
         return true; // Coinbases don't use vin normally
 
     for (unsigned int i = 0; i < tx.vin.size(); i++) {
-        const CTxOut& prev = mapInputs.GetOutputFor(tx.vin[i]);
+        const CTxOut& prev = mapInputs.AccessCoin(tx.vin[i].prevout).out;
 
         vector<vector<unsigned char> > vSolutions;
         txnouttype whichType;
@@ -803,7 +831,7 @@ unsigned int GetP2SHSigOpCount(const CTransaction& tx, const CCoinsViewCache& in
 
     unsigned int nSigOps = 0;
     for (unsigned int i = 0; i < tx.vin.size(); i++) {
-        const CTxOut& prevout = inputs.GetOutputFor(tx.vin[i]);
+        const CTxOut& prevout = inputs.AccessCoin(tx.vin[i].prevout).out;
         if (prevout.scriptPubKey.IsPayToScriptHash())
             nSigOps += prevout.scriptPubKey.GetSigOpCount(tx.vin[i].scriptSig);
     }
@@ -819,12 +847,11 @@ int GetInputAge(CTxIn& vin)
         CCoinsViewMemPool viewMempool(pcoinsTip, mempool);
         view.SetBackend(viewMempool); // temporarily switch cache backend to db+mempool view
 
-        const CCoins* coins = view.AccessCoins(vin.prevout.hash);
+        const Coin& coin = view.AccessCoin(vin.prevout);
 
-        if (coins) {
-            if (coins->nHeight < 0) return 0;
-            return (chainActive.Tip()->nHeight + 1) - coins->nHeight;
-        } else
+        if (!coin.IsSpent())
+            return (chainActive.Tip()->nHeight + 1) - (int)coin.nHeight;
+        else
             return -1;
     }
 }
@@ -1098,14 +1125,16 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState& state, const CTransa
             view.SetBackend(viewMemPool);
 
             // do we already have it?
-            if (view.HaveCoins(hash))
-                return false;
+            for (size_t out = 0; out < tx.vout.size(); out++) {
+                if (view.HaveCoin(COutPoint(hash, out)))
+                    return false;
+            }
 
             // do all inputs exist?
-            // Note that this does not check for the presence of actual outputs (see the next check for that),
-            // only helps filling in pfMissingInputs (to determine missing vs spent).
+            // Spent and missing outputs look the same in the per-output coin view, so both
+            // are reported through pfMissingInputs; the check below remains as a safeguard.
             for (const CTxIn txin : tx.vin) {
-                if (!view.HaveCoins(txin.prevout.hash)) {
+                if (!view.HaveCoin(txin.prevout)) {
                     if (pfMissingInputs)
                         *pfMissingInputs = true;
                     return false;
@@ -1281,14 +1310,16 @@ bool AcceptableInputs(CTxMemPool& pool, CValidationState& state, const CTransact
             view.SetBackend(viewMemPool);
 
             // do we already have it?
-            if (view.HaveCoins(hash))
-                return false;
+            for (size_t out = 0; out < tx.vout.size(); out++) {
+                if (view.HaveCoin(COutPoint(hash, out)))
+                    return false;
+            }
 
             // do all inputs exist?
-            // Note that this does not check for the presence of actual outputs (see the next check for that),
-            // only helps filling in pfMissingInputs (to determine missing vs spent).
+            // Spent and missing outputs look the same in the per-output coin view, so both
+            // are reported through pfMissingInputs; the check below remains as a safeguard.
             for (const CTxIn txin : tx.vin) {
-                if (!view.HaveCoins(txin.prevout.hash)) {
+                if (!view.HaveCoin(txin.prevout)) {
                     if (pfMissingInputs)
                         *pfMissingInputs = true;
                     return false;
@@ -1408,59 +1439,62 @@ bool AcceptableInputs(CTxMemPool& pool, CValidationState& state, const CTransact
 /** Return transaction in tx, and if it was found inside a block, its hash is placed in hashBlock */
 bool GetTransaction(const uint256& hash, CTransaction& txOut, uint256& hashBlock, bool fAllowSlow)
 {
-    CBlockIndex* pindexSlow = NULL;
-    {
-        LOCK(cs_main);
-        {
-            if (mempool.lookup(hash, txOut)) {
-                return true;
+    CDiskBlockPos posSlow;
+    uint256 hashSlow;
+
+    // The mempool has its own lock, and reading through the transaction index
+    // needs no cs_main either, so concurrent lookups do not queue behind it.
+    if (mempool.lookup(hash, txOut))
+        return true;
+
+    if (fTxIndex) {
+        CDiskTxPos postx;
+        if (pblocktree->ReadTxIndex(hash, postx)) {
+            CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
+            if (file.IsNull())
+                return error("%s: OpenBlockFile failed", __func__);
+            CBlockHeader header;
+            try {
+                file >> header;
+                fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
+                file >> txOut;
+            } catch (std::exception& e) {
+                return error("%s : Deserialize or I/O error - %s", __func__, e.what());
             }
+            hashBlock = header.GetHash();
+            if (txOut.GetHash() != hash)
+                return error("%s : txid mismatch", __func__);
+            return true;
         }
 
-        if (fTxIndex) {
-            CDiskTxPos postx;
-            if (pblocktree->ReadTxIndex(hash, postx)) {
-                CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
-                if (file.IsNull())
-                    return error("%s: OpenBlockFile failed", __func__);
-                CBlockHeader header;
-                try {
-                    file >> header;
-                    fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
-                    file >> txOut;
-                } catch (std::exception& e) {
-                    return error("%s : Deserialize or I/O error - %s", __func__, e.what());
-                }
-                hashBlock = header.GetHash();
-                if (txOut.GetHash() != hash)
-                    return error("%s : txid mismatch", __func__);
-                return true;
-            }
+        // transaction not found in the index, nothing more can be done
+        return false;
+    }
 
-            // transaction not found in the index, nothing more can be done
-            return false;
+    if (fAllowSlow) { // use coin database to locate block that contains transaction, and scan it
+        LOCK(cs_main);
+        int nHeight = -1;
+        {
+            // The txid may come from a peer, and every output probed can be a
+            // database read under cs_main; only look at the first few
+            const Coin& coin = AccessByTxid(*pcoinsTip, hash, MAX_SLOW_LOOKUP_OUTPUTS);
+            if (!coin.IsSpent())
+                nHeight = coin.nHeight;
         }
-
-        if (fAllowSlow) { // use coin database to locate block that contains transaction, and scan it
-            int nHeight = -1;
-            {
-                CCoinsViewCache& view = *pcoinsTip;
-                const CCoins* coins = view.AccessCoins(hash);
-                if (coins)
-                    nHeight = coins->nHeight;
-            }
-            if (nHeight > 0)
-                pindexSlow = chainActive[nHeight];
+        if (nHeight > 0 && chainActive[nHeight]) {
+            // The block is read without cs_main, so copy what it needs of the index entry
+            posSlow = chainActive[nHeight]->GetBlockPos();
+            hashSlow = chainActive[nHeight]->GetBlockHash();
         }
     }
 
-    if (pindexSlow) {
+    if (!posSlow.IsNull()) {
         CBlock block;
-        if (ReadBlockFromDisk(block, pindexSlow)) {
+        if (ReadBlockFromDisk(block, posSlow) && block.GetHash() == hashSlow) {
             BOOST_FOREACH (const CTransaction& tx, block.vtx) {
                 if (tx.GetHash() == hash) {
                     txOut = tx;
-                    hashBlock = pindexSlow->GetBlockHash();
+                    hashBlock = hashSlow;
                     return true;
                 }
             }
@@ -1496,20 +1530,83 @@ bool WriteBlockToDisk(CBlock& block, CDiskBlockPos& pos)
     return true;
 }
 
+bool GetAddressIndexKey(const CScript& script, uint160& hashBytes, int& type)
+{
+    CTxDestination dest;
+    if (!ExtractDestination(script, dest))
+        return false;
+    if (const CKeyID* keyID = boost::get<CKeyID>(&dest)) {
+        hashBytes = *keyID;
+        type = ADDRESS_INDEX_KEY;
+        return true;
+    }
+    if (const CScriptID* scriptID = boost::get<CScriptID>(&dest)) {
+        hashBytes = *scriptID;
+        type = ADDRESS_INDEX_SCRIPT;
+        return true;
+    }
+    return false;
+}
+
+bool GetAddressIndex(const uint160& addressHash, int type, std::vector<std::pair<CAddressIndexKey, CAmount> >& addressIndex, int nStart, int nEnd)
+{
+    if (!fAddressIndex)
+        return error("%s : address index not enabled", __func__);
+    if (!pblocktree->ReadAddressIndex(addressHash, type, addressIndex, nStart, nEnd))
+        return error("%s : unable to get txids for address", __func__);
+    return true;
+}
+
+bool GetAddressUnspent(const uint160& addressHash, int type, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& unspentOutputs)
+{
+    if (!fAddressIndex)
+        return error("%s : address index not enabled", __func__);
+    if (!pblocktree->ReadAddressUnspentIndex(addressHash, type, unspentOutputs))
+        return error("%s : unable to get unspent outputs for address", __func__);
+    return true;
+}
+
+bool GetSpentIndex(const CSpentIndexKey& key, CSpentIndexValue& value)
+{
+    if (!fSpentIndex)
+        return false;
+    return pblocktree->ReadSpentIndex(key, value);
+}
+
+bool GetTimestampIndex(unsigned int nHigh, unsigned int nLow, std::vector<uint256>& vHashes)
+{
+    if (!fTimestampIndex)
+        return error("%s : timestamp index not enabled", __func__);
+    if (!pblocktree->ReadTimestampIndex(nHigh, nLow, vHashes))
+        return error("%s : unable to get hashes for timestamps", __func__);
+    return true;
+}
+
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos)
 {
     block.SetNull();
 
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("ReadBlockFromDisk : OpenBlockFile failed");
+    CMappedBlock mapped;
+    if (pblockfilemap && pblockfilemap->GetBlock(pos, mapped)) {
+        // Deserialize straight from the mapped block file
+        try {
+            CMemoryReader reader(mapped.pbegin, mapped.pend, SER_DISK, CLIENT_VERSION);
+            reader >> block;
+        } catch (std::exception& e) {
+            return error("%s : Deserialize error - %s", __func__, e.what());
+        }
+    } else {
+        // Open history file to read
+        CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+        if (filein.IsNull())
+            return error("ReadBlockFromDisk : OpenBlockFile failed");
 
-    // Read block
-    try {
-        filein >> block;
-    } catch (std::exception& e) {
-        return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        // Read block
+        try {
+            filein >> block;
+        } catch (std::exception& e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
     }
 
     // Check the header
@@ -1532,6 +1629,43 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex)
     return true;
 }
 
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& vchBlock, const CDiskBlockPos& pos)
+{
+    // Blocks are stored behind the network magic and their size, see WriteBlockToDisk()
+    if (pos.nPos < MESSAGE_START_SIZE + sizeof(unsigned int))
+        return error("%s : invalid block position %d in file %d", __func__, pos.nPos, pos.nFile);
+    CDiskBlockPos posHeader(pos.nFile, pos.nPos - MESSAGE_START_SIZE - sizeof(unsigned int));
+
+    CMappedBlock mapped;
+    if (pblockfilemap && pblockfilemap->GetBlock(pos, mapped)) {
+        if (mapped.pbegin == mapped.pend)
+            return error("%s : empty block at position %d in file %d", __func__, pos.nPos, pos.nFile);
+        vchBlock.assign(mapped.pbegin, mapped.pend);
+        return true;
+    }
+
+    CAutoFile filein(OpenBlockFile(posHeader, true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return error("%s : OpenBlockFile failed", __func__);
+
+    try {
+        MessageStartChars pchMessageStart;
+        unsigned int nSize;
+        filein >> FLATDATA(pchMessageStart) >> nSize;
+        if (memcmp(pchMessageStart, Params().MessageStart(), MESSAGE_START_SIZE) != 0)
+            return error("%s : block magic mismatch at position %d in file %d", __func__, pos.nPos, pos.nFile);
+        if (nSize == 0)
+            return error("%s : empty block at position %d in file %d", __func__, pos.nPos, pos.nFile);
+        if (nSize > MAX_BLOCK_SIZE)
+            return error("%s : block size %u too large at position %d in file %d", __func__, nSize, pos.nPos, pos.nFile);
+        vchBlock.resize(nSize);
+        filein.read((char*)&vchBlock[0], nSize);
+    } catch (std::exception& e) {
+        return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+    }
+    return true;
+}
+
 double ConvertBitsToDouble(unsigned int nBits)
 {
     int nShift = (nBits >> 24) & 0xff;
@@ -1769,6 +1903,68 @@ void Misbehaving(NodeId pnode, int howmuch)
         LogPrintf("Misbehaving: %s (%d -> %d)\n", state->name, state->nMisbehavior - howmuch, state->nMisbehavior);
 }
 
+// Requires cs_main.
+unsigned int CountPendingHeaders()
+{
+    // A header stops counting once its block arrives, or once it is buried too deep
+    // under the tip to ever be downloaded, so stale forks age out
+    int nHeightBuried = chainActive.Height() - (int)BLOCK_DOWNLOAD_WINDOW;
+    map<vector<unsigned char>, list<CBlockIndex*> >::iterator mi = mapHeadersPending.begin();
+    while (mi != mapHeadersPending.end()) {
+        list<CBlockIndex*>::iterator it = mi->second.begin();
+        while (it != mi->second.end()) {
+            if (((*it)->nStatus & BLOCK_HAVE_DATA) || (*it)->nHeight <= nHeightBuried) {
+                it = mi->second.erase(it);
+                nHeadersPending--;
+            } else
+                it++;
+        }
+        if (mi->second.empty())
+            mapHeadersPending.erase(mi++);
+        else
+            mi++;
+    }
+    return nHeadersPending;
+}
+
+// Requires cs_main.
+unsigned int CountPendingHeaders(NodeId nodeid)
+{
+    CNodeState* state = State(nodeid);
+    if (state == NULL)
+        return 0;
+
+    CountPendingHeaders();
+    map<vector<unsigned char>, list<CBlockIndex*> >::iterator mi = mapHeadersPending.find(state->address.GetGroup());
+    return mi == mapHeadersPending.end() ? 0 : mi->second.size();
+}
+
+// Requires cs_main.
+void AddPendingHeader(NodeId nodeid, CBlockIndex* pindex)
+{
+    CNodeState* state = State(nodeid);
+    if (state != NULL) {
+        mapHeadersPending[state->address.GetGroup()].push_back(pindex);
+        nHeadersPending++;
+    }
+}
+
+/** Whether headers[nFirst] and the headers after it, on top of the parent of headers[nFirst], have more work than our tip. */
+bool HeadersHaveMoreWork(const std::vector<CBlockHeader>& headers, unsigned int nFirst)
+{
+    AssertLockHeld(cs_main);
+    BlockMap::iterator mi = mapBlockIndex.find(headers[nFirst].hashPrevBlock);
+    if (mi == mapBlockIndex.end())
+        return true; // AcceptBlockHeader() turns them down
+    uint256 nChainWork = mi->second->nChainWork;
+    CBlockIndex index;
+    for (unsigned int n = nFirst; n < headers.size(); n++) {
+        index.nBits = headers[n].nBits;
+        nChainWork += GetBlockProof(index);
+    }
+    return nChainWork > chainActive.Tip()->nChainWork;
+}
+
 void static InvalidChainFound(CBlockIndex* pindexNew)
 {
     if (!pindexBestInvalid || pindexNew->nChainWork > pindexBestInvalid->nChainWork)
@@ -1810,14 +2006,14 @@ void UpdateCoins(const CTransaction& tx, CValidationState& state, CCoinsViewCach
     if (!tx.IsCoinBase()) {
         txundo.vprevout.reserve(tx.vin.size());
         BOOST_FOREACH (const CTxIn& txin, tx.vin) {
-            txundo.vprevout.push_back(CTxInUndo());
-            bool ret = inputs.ModifyCoins(txin.prevout.hash)->Spend(txin.prevout, txundo.vprevout.back());
+            txundo.vprevout.push_back(Coin());
+            bool ret = inputs.SpendCoin(txin.prevout, &txundo.vprevout.back());
             assert(ret);
         }
     }
 
     // add outputs
-    inputs.ModifyCoins(tx.GetHash())->FromTx(tx, nHeight);
+    AddCoins(inputs, tx, nHeight);
 }
 
 bool CScriptCheck::operator()()
@@ -1848,20 +2044,20 @@ bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsVi
         CAmount nFees = 0;
         for (unsigned int i = 0; i < tx.vin.size(); i++) {
             const COutPoint& prevout = tx.vin[i].prevout;
-            const CCoins* coins = inputs.AccessCoins(prevout.hash);
-            assert(coins);
+            const Coin& coin = inputs.AccessCoin(prevout);
+            assert(!coin.IsSpent());
 
             // If prev is coinbase, check that it's matured
-            if (coins->IsCoinBase() || coins->IsCoinStake()) {
-                if (nSpendHeight - coins->nHeight < Params().COINBASE_MATURITY())
+            if (coin.IsCoinBase() || coin.IsCoinStake()) {
+                if (nSpendHeight - (int)coin.nHeight < Params().COINBASE_MATURITY())
                     return state.Invalid(
-                        error("CheckInputs() : tried to spend coinbase at depth %d, coinstake=%d", nSpendHeight - coins->nHeight, coins->IsCoinStake()),
+                        error("CheckInputs() : tried to spend coinbase at depth %d, coinstake=%d", nSpendHeight - (int)coin.nHeight, coin.IsCoinStake()),
                         REJECT_INVALID, "bad-txns-premature-spend-of-coinbase");
             }
 
             // Check for negative or overflow input values
-            nValueIn += coins->vout[prevout.n].nValue;
-            if (!MoneyRange(coins->vout[prevout.n].nValue) || !MoneyRange(nValueIn))
+            nValueIn += coin.out.nValue;
+            if (!MoneyRange(coin.out.nValue) || !MoneyRange(nValueIn))
                 return state.DoS(100, error("CheckInputs() : txin values out of range"),
                     REJECT_INVALID, "bad-txns-inputvalues-outofrange");
         }
@@ -1892,11 +2088,11 @@ bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsVi
         if (fScriptChecks) {
             for (unsigned int i = 0; i < tx.vin.size(); i++) {
                 const COutPoint& prevout = tx.vin[i].prevout;
-                const CCoins* coins = inputs.AccessCoins(prevout.hash);
-                assert(coins);
+                const Coin& coin = inputs.AccessCoin(prevout);
+                assert(!coin.IsSpent());
 
                 // Verify signature
-                CScriptCheck check(*coins, tx, i, flags, cacheStore);
+                CScriptCheck check(coin.out, tx, i, flags, cacheStore);
                 if (pvChecks) {
                     pvChecks->push_back(CScriptCheck());
                     check.swap(pvChecks->back());
@@ -1908,7 +2104,7 @@ bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsVi
                         // arguments; if so, don't trigger DoS protection to
                         // avoid splitting the network between upgraded and
                         // non-upgraded nodes.
-                        CScriptCheck check(*coins, tx, i,
+                        CScriptCheck check(coin.out, tx, i,
                             flags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, cacheStore);
                         if (check())
                             return state.Invalid(false, REJECT_NONSTANDARD, strprintf("non-mandatory-script-verify-flag (%s)", ScriptErrorString(check.GetScriptError())));
@@ -1929,7 +2125,32 @@ bool CheckInputs(const CTransaction& tx, CValidationState& state, const CCoinsVi
     return true;
 }
 
-bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool* pfClean)
+/**
+ * Restore the output spent by an input from its undo data. Undo data written
+ * before the per-output coin database only carries the height and coinbase
+ * flags for the last spent output of a transaction; for the others they are
+ * taken from an unspent output of the same transaction.
+ * @return false if the coin could not be restored cleanly
+ */
+static bool ApplyTxInUndo(Coin& undo, CCoinsViewCache& view, const COutPoint& out)
+{
+    bool fClean = true;
+
+    if (view.HaveCoin(out))
+        fClean = error("DisconnectBlock() : undo data overwriting existing output");
+    if (undo.nHeight == 0) {
+        const Coin& alternate = AccessByTxid(view, out.hash);
+        if (alternate.IsSpent())
+            return error("DisconnectBlock() : undo data adding output to missing transaction");
+        undo.nHeight = alternate.nHeight;
+        undo.fCoinBase = alternate.fCoinBase;
+        undo.fCoinStake = alternate.fCoinStake;
+    }
+    view.AddCoin(out, undo, !fClean);
+    return fClean;
+}
+
+bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool* pfClean, bool fJustCheck)
 {
     if (pindex->GetBlockHash() != view.GetBestBlock())
         LogPrintf("%s : pindex=%s view=%s\n", __func__, pindex->GetBlockHash().GetHex(), view.GetBestBlock().GetHex());
@@ -1940,6 +2161,12 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
 
     bool fClean = true;
 
+    // Only a disconnect that is committed updates the indexes, not VerifyDB's trial one
+    bool fUpdateIndexes = !fJustCheck;
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
+
     CBlockUndo blockUndo;
     CDiskBlockPos pos = pindex->GetUndoPos();
     if (pos.IsNull())
@@ -1956,25 +2183,26 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
         uint256 hash = tx.GetHash();
 
         // Check that all outputs are available and match the outputs in the block itself
-        // exactly. Note that transactions with only provably unspendable outputs won't
-        // have outputs available even in the block itself, so we handle that case
-        // specially with outsEmpty.
-        {
-            CCoins outsEmpty;
-            CCoinsModifier outs = view.ModifyCoins(hash);
-            outs->ClearUnspendable();
-
-            CCoins outsBlock(tx, pindex->nHeight);
-            // The CCoins serialization does not serialize negative numbers.
-            // No network rules currently depend on the version here, so an inconsistency is harmless
-            // but it must be corrected before txout nversion ever influences a network rule.
-            if (outsBlock.nVersion < 0)
-                outs->nVersion = outsBlock.nVersion;
-            if (*outs != outsBlock)
+        // exactly. Provably unspendable outputs never entered the coin database.
+        for (unsigned int o = 0; o < tx.vout.size(); o++) {
+            if (tx.vout[o].scriptPubKey.IsUnspendable())
+                continue;
+            Coin coin;
+            bool fSpent = view.SpendCoin(COutPoint(hash, o), &coin);
+            if (!fSpent || tx.vout[o] != coin.out || (unsigned int)pindex->nHeight != coin.nHeight ||
+                tx.IsCoinBase() != (bool)coin.fCoinBase || tx.IsCoinStake() != (bool)coin.fCoinStake)
                 fClean = fClean && error("DisconnectBlock() : added transaction mismatch? database corrupted");
+        }
 
-            // remove outputs
-            outs->Clear();
+        if (fAddressIndex && fUpdateIndexes) {
+            for (unsigned int k = tx.vout.size(); k-- > 0;) {
+                uint160 hashBytes;
+                int type;
+                if (!GetAddressIndexKey(tx.vout[k].scriptPubKey, hashBytes, type))
+                    continue;
+                addressIndex.push_back(std::make_pair(CAddressIndexKey(type, hashBytes, pindex->nHeight, i, hash, k, false), tx.vout[k].nValue));
+                addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(type, hashBytes, hash, k), CAddressUnspentValue()));
+            }
         }
 
         // restore inputs
@@ -1984,25 +2212,21 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
                 return error("DisconnectBlock() : transaction and undo data inconsistent - txundo.vprevout.siz=%d tx.vin.siz=%d", txundo.vprevout.size(), tx.vin.size());
             for (unsigned int j = tx.vin.size(); j-- > 0;) {
                 const COutPoint& out = tx.vin[j].prevout;
-                const CTxInUndo& undo = txundo.vprevout[j];
-                CCoinsModifier coins = view.ModifyCoins(out.hash);
-                if (undo.nHeight != 0) {
-                    // undo data contains height: this is the last output of the prevout tx being spent
-                    if (!coins->IsPruned())
-                        fClean = fClean && error("DisconnectBlock() : undo data overwriting existing transaction");
-                    coins->Clear();
-                    coins->fCoinBase = undo.fCoinBase;
-                    coins->nHeight = undo.nHeight;
-                    coins->nVersion = undo.nVersion;
-                } else {
-                    if (coins->IsPruned())
-                        fClean = fClean && error("DisconnectBlock() : undo data adding output to missing transaction");
+                Coin undo = txundo.vprevout[j];
+                if (!ApplyTxInUndo(undo, view, out))
+                    fClean = false;
+
+                if (fUpdateIndexes) {
+                    uint160 hashBytes;
+                    int type;
+                    bool fAddress = GetAddressIndexKey(undo.out.scriptPubKey, hashBytes, type);
+                    if (fAddressIndex && fAddress) {
+                        addressIndex.push_back(std::make_pair(CAddressIndexKey(type, hashBytes, pindex->nHeight, i, hash, j, true), -undo.out.nValue));
+                        addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(type, hashBytes, out.hash, out.n), CAddressUnspentValue(undo.out.nValue, undo.out.scriptPubKey, undo.nHeight)));
+                    }
+                    if (fSpentIndex)
+                        spentIndex.push_back(std::make_pair(CSpentIndexKey(out.hash, out.n), CSpentIndexValue()));
                 }
-                if (coins->IsAvailable(out.n))
-                    fClean = fClean && error("DisconnectBlock() : undo data overwriting existing output");
-                if (coins->vout.size() < out.n + 1)
-                    coins->vout.resize(out.n + 1);
-                coins->vout[out.n] = undo.txout;
 
                 {
                     LOCK(cs_mapstake);
@@ -2013,6 +2237,19 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
         }
     }
 
+    if (fAddressIndex && fUpdateIndexes) {
+        if (!pblocktree->UpdateAddressIndex(addressIndex, true))
+            return state.Abort("Failed to delete address index");
+        if (!pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex))
+            return state.Abort("Failed to write address unspent index");
+    }
+    if (fSpentIndex && fUpdateIndexes)
+        if (!pblocktree->UpdateSpentIndex(spentIndex))
+            return state.Abort("Failed to delete spent index");
+    if (fTimestampIndex && fUpdateIndexes)
+        if (!pblocktree->WriteTimestampIndex(CTimestampIndexKey(pindex->nTime, pindex->GetBlockHash()), true))
+            return state.Abort("Failed to delete timestamp index");
+
     // move best block pointer to prevout block
     view.SetBestBlock(pindex->pprev->GetBlockHash());
 
@@ -2024,6 +2261,85 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
     }
 }
 
+/** Apply the effects of a block on the coin view, tolerating that part of them may already be there. */
+static bool RollforwardBlock(const CBlockIndex* pindex, CCoinsViewCache& view)
+{
+    CBlock block;
+    if (!ReadBlockFromDisk(block, pindex))
+        return error("%s : failed to read block %s at height %d", __func__, pindex->GetBlockHash().GetHex(), pindex->nHeight);
+
+    BOOST_FOREACH (const CTransaction& tx, block.vtx) {
+        if (!tx.IsCoinBase()) {
+            BOOST_FOREACH (const CTxIn& txin, tx.vin)
+                view.SpendCoin(txin.prevout);
+        }
+        // Pass check=true as the outputs may already exist in the database
+        AddCoins(view, tx, pindex->nHeight, true);
+    }
+    return true;
+}
+
+bool ReplayBlocks(CCoinsView* view)
+{
+    LOCK(cs_main);
+
+    std::vector<uint256> vhashHeads = view->GetHeadBlocks();
+    if (vhashHeads.empty())
+        return true; // We're already in a consistent state.
+    if (vhashHeads.size() != 2)
+        return error("%s : unknown inconsistent state", __func__);
+
+    uiInterface.InitMessage(_("Replaying blocks..."));
+    LogPrintf("Replaying blocks\n");
+
+    CCoinsViewCache cache(view);
+    BlockMap::iterator mi = mapBlockIndex.find(vhashHeads[0]);
+    if (mi == mapBlockIndex.end())
+        return error("%s : reorganization to unknown block requested", __func__);
+    const CBlockIndex* pindexNew = mi->second;
+    CBlockIndex* pindexOld = NULL;
+    if (vhashHeads[1] != uint256(0)) { // The old tip is allowed to be 0, indicating it's the first flush.
+        mi = mapBlockIndex.find(vhashHeads[1]);
+        if (mi == mapBlockIndex.end())
+            return error("%s : reorganization from unknown block requested", __func__);
+        pindexOld = mi->second;
+    }
+    const CBlockIndex* pindexFork = pindexOld ? LastCommonAncestor(pindexOld, const_cast<CBlockIndex*>(pindexNew)) : NULL;
+
+    // Rollback along the old branch.
+    while (pindexOld != pindexFork) {
+        if (pindexOld->nHeight > 0) { // Never disconnect the genesis block.
+            CBlock block;
+            if (!ReadBlockFromDisk(block, pindexOld))
+                return error("%s : failed to read block %s at height %d", __func__, pindexOld->GetBlockHash().GetHex(), pindexOld->nHeight);
+            LogPrintf("Rolling back %s (%i)\n", pindexOld->GetBlockHash().GetHex(), pindexOld->nHeight);
+            CValidationState state;
+            bool fClean;
+            cache.SetBestBlock(pindexOld->GetBlockHash());
+            // ConnectBlock() and DisconnectBlock() write the indexes as they go, so they
+            // already match the new tip; only repair the coins (fJustCheck=true)
+            if (!DisconnectBlock(block, state, pindexOld, cache, &fClean, true))
+                return error("%s : failed to disconnect block %s at height %d", __func__, pindexOld->GetBlockHash().GetHex(), pindexOld->nHeight);
+            // If fClean is false the block was partially applied; that is expected here
+        }
+        pindexOld = pindexOld->pprev;
+    }
+
+    // Roll forward from the forking point to the new tip.
+    int nForkHeight = pindexFork ? pindexFork->nHeight : 0;
+    for (int nHeight = nForkHeight + 1; nHeight <= pindexNew->nHeight; ++nHeight) {
+        const CBlockIndex* pindex = pindexNew->GetAncestor(nHeight);
+        LogPrintf("Rolling forward %s (%i)\n", pindex->GetBlockHash().GetHex(), nHeight);
+        if (!RollforwardBlock(pindex, cache))
+            return false;
+    }
+
+    cache.SetBestBlock(pindexNew->GetBlockHash());
+    if (!cache.Flush())
+        return error("%s : failed to write the replayed blocks", __func__);
+    return true;
+}
+
 void static FlushBlockFile(bool fFinalize = false)
 {
     LOCK(cs_LastBlockFile);
@@ -2108,10 +2424,11 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     bool fEnforceBIP30 = !pindex->phashBlock; // Enforce on CreateNewBlock invocations which don't have a hash.
     if (fEnforceBIP30) {
         BOOST_FOREACH (const CTransaction& tx, block.vtx) {
-            const CCoins* coins = view.AccessCoins(tx.GetHash());
-            if (coins && !coins->IsPruned())
-                return state.DoS(100, error("ConnectBlock() : tried to overwrite transaction"),
-                    REJECT_INVALID, "bad-txns-BIP30");
+            for (size_t o = 0; o < tx.vout.size(); o++) {
+                if (view.HaveCoin(COutPoint(tx.GetHash(), o)))
+                    return state.DoS(100, error("ConnectBlock() : tried to overwrite transaction"),
+                        REJECT_INVALID, "bad-txns-BIP30");
+            }
         }
     }
 
@@ -2137,6 +2454,10 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     CDiskTxPos pos(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size()));
     std::vector<std::pair<uint256, CDiskTxPos> > vPos;
     vPos.reserve(block.vtx.size());
+    bool fUpdateIndexes = !fJustCheck && (fAddressIndex || fSpentIndex);
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spentIndex;
     blockundo.vtxundo.reserve(block.vtx.size() - 1);
     CAmount nValueOut = 0;
     CAmount nValueIn = 0;
@@ -2173,9 +2494,41 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             if (!CheckInputs(tx, state, view, fScriptChecks, flags, false, nScriptCheckThreads ? &vChecks : NULL))
                 return false;
             control.Add(vChecks);
+
+            // Record the spent outputs while they are still in the view
+            if (fUpdateIndexes) {
+                const uint256 hash = tx.GetHash();
+                for (unsigned int j = 0; j < tx.vin.size(); j++) {
+                    const COutPoint& prevout = tx.vin[j].prevout;
+                    const CTxOut& txout = view.AccessCoin(prevout).out;
+                    uint160 hashBytes;
+                    int type;
+                    bool fAddress = GetAddressIndexKey(txout.scriptPubKey, hashBytes, type);
+                    if (fAddressIndex && fAddress) {
+                        addressIndex.push_back(std::make_pair(CAddressIndexKey(type, hashBytes, pindex->nHeight, i, hash, j, true), -txout.nValue));
+                        addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(type, hashBytes, prevout.hash, prevout.n), CAddressUnspentValue()));
+                    }
+                    if (fSpentIndex)
+                        spentIndex.push_back(std::make_pair(CSpentIndexKey(prevout.hash, prevout.n),
+                            CSpentIndexValue(hash, j, pindex->nHeight, txout.nValue, fAddress ? type : ADDRESS_INDEX_NONE, fAddress ? hashBytes : uint160(0))));
+                }
+            }
         }
         nValueOut += tx.GetValueOut();
 
+        if (fAddressIndex && fUpdateIndexes) {
+            const uint256 hash = tx.GetHash();
+            for (unsigned int k = 0; k < tx.vout.size(); k++) {
+                const CTxOut& out = tx.vout[k];
+                uint160 hashBytes;
+                int type;
+                if (!GetAddressIndexKey(out.scriptPubKey, hashBytes, type))
+                    continue;
+                addressIndex.push_back(std::make_pair(CAddressIndexKey(type, hashBytes, pindex->nHeight, i, hash, k, false), out.nValue));
+                addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(type, hashBytes, hash, k), CAddressUnspentValue(out.nValue, out.scriptPubKey, pindex->nHeight)));
+            }
+        }
+
         CTxUndo undoDummy;
         if (i > 0) {
             blockundo.vtxundo.push_back(CTxUndo());
@@ -2243,6 +2596,21 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         if (!pblocktree->WriteTxIndex(vPos))
             return state.Abort("Failed to write transaction index");
 
+    if (fAddressIndex) {
+        if (!pblocktree->UpdateAddressIndex(addressIndex, false))
+            return state.Abort("Failed to write address index");
+        if (!pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex))
+            return state.Abort("Failed to write address unspent index");
+    }
+
+    if (fSpentIndex)
+        if (!pblocktree->UpdateSpentIndex(spentIndex))
+            return state.Abort("Failed to write spent index");
+
+    if (fTimestampIndex)
+        if (!pblocktree->WriteTimestampIndex(CTimestampIndexKey(pindex->nTime, pindex->GetBlockHash()), false))
+            return state.Abort("Failed to write timestamp index");
+
     {
         LOCK(cs_mapstake);
 
@@ -2300,15 +2668,17 @@ bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
     LOCK(cs_main);
     static int64_t nLastWrite = 0;
     try {
+        // Changes still queued for the background coin writer count against the cache limit
+        size_t nCoinsUsage = pcoinsTip->DynamicMemoryUsage() + pcoinsdbview->GetUnwrittenUsage();
         if ((mode == FLUSH_STATE_ALWAYS) ||
-            ((mode == FLUSH_STATE_PERIODIC || mode == FLUSH_STATE_IF_NEEDED) && pcoinsTip->GetCacheSize() > nCoinCacheSize) ||
+            ((mode == FLUSH_STATE_PERIODIC || mode == FLUSH_STATE_IF_NEEDED) && nCoinsUsage > nCoinCacheUsage) ||
             (mode == FLUSH_STATE_PERIODIC && GetTimeMicros() > nLastWrite + DATABASE_WRITE_INTERVAL * 1000000)) {
-            // Typical CCoins structures on disk are around 100 bytes in size.
+            // Typical Coin structures on disk are around 50 bytes in size.
             // Pushing a new one to the database can cause it to be written
             // twice (once in the log, and once in the tables). This is already
             // an overestimation, as most will delete an existing entry or
             // overwrite one. Still, use a conservative safety factor of 2.
-            if (!CheckDiskSpace(100 * 2 * 2 * pcoinsTip->GetCacheSize()))
+            if (!CheckDiskSpace(50 * 2 * 2 * pcoinsTip->GetCacheSize()))
                 return state.Error("out of disk space");
             // First make sure all block and undo data is flushed to disk.
             FlushBlockFile();
@@ -2332,8 +2702,20 @@ bool static FlushStateToDisk(CValidationState& state, FlushStateMode mode)
             }
             pblocktree->Sync();
             // Finally flush the chainstate (which may refer to block index entries).
+            // With -dbwritebehind the changes are only handed to the background
+            // writer; wait for the previous write first if that is all that keeps
+            // memory over the limit, so the unwritten changes cannot pile up.
+            int64_t nFlushStart = GetTimeMicros();
+            if (pcoinsdbview->IsWriting() && nCoinsUsage > nCoinCacheUsage) {
+                LogPrint("coindb", "Waiting for the previous coin database write\n");
+                if (!pcoinsdbview->WaitForWrites())
+                    return state.Abort("Failed to write to coin database");
+            }
             if (!pcoinsTip->Flush())
                 return state.Abort("Failed to write to coin database");
+            if (mode == FLUSH_STATE_ALWAYS && !pcoinsdbview->WaitForWrites())
+                return state.Abort("Failed to write to coin database");
+            pcoinsdbview->SetLastFlushTime(GetTimeMicros() - nFlushStart);
             // Update best block in wallet (so we can detect restored wallets).
             if (mode != FLUSH_STATE_IF_NEEDED) {
                 GetMainSignals().SetBestChain(chainActive.GetLocator());
@@ -2356,15 +2738,16 @@ void FlushStateToDisk()
 void static UpdateTip(CBlockIndex* pindexNew)
 {
     chainActive.SetTip(pindexNew);
+    UpdateStakeModifierIndex();
 
     // New best block
     nTimeBestReceived = GetTime();
     mempool.AddTransactionsUpdated(1);
 
-    LogPrintf("UpdateTip: new best=%s  height=%d  log2_work=%.8g  tx=%lu  date=%s progress=%f  cache=%u\n",
+    LogPrintf("UpdateTip: new best=%s  height=%d  log2_work=%.8g  tx=%lu  date=%s progress=%f  cache=%.1fMiB(%utxo)\n",
         chainActive.Tip()->GetBlockHash().ToString(), chainActive.Height(), log(chainActive.Tip()->nChainWork.getdouble()) / log(2.0), (unsigned long)chainActive.Tip()->nChainTx,
         DateTimeStrFormat("%Y-%m-%d %H:%M:%S", chainActive.Tip()->GetBlockTime()),
-        Checkpoints::GuessVerificationProgress(chainActive.Tip()), (unsigned int)pcoinsTip->GetCacheSize());
+        Checkpoints::GuessVerificationProgress(chainActive.Tip()), pcoinsTip->DynamicMemoryUsage() * (1.0 / (1 << 20)), (unsigned int)pcoinsTip->GetCacheSize());
 
     cvBlockChange.notify_all();
 
@@ -2463,6 +2846,20 @@ bool static ConnectTip(CValidationState& state, CBlockIndex* pindexNew, CBlock*
     nTimeReadFromDisk += nTime2 - nTime1;
     int64_t nTime3;
     LogPrint("bench", "  - Load block from disk: %.2fms [%.2fs]\n", (nTime2 - nTime1) * 0.001, nTimeReadFromDisk * 0.000001);
+
+    // Blocks stored ahead of the tip during headers-first sync, and blocks loaded from
+    // disk, may not have had their stake kernel checked yet. The stake is spendable now.
+    if (pblock->IsProofOfStake() && pindexNew->hashProofOfStake == 0) {
+        uint256 hashProofOfStake;
+        if (!CheckProofOfStake(*pblock, hashProofOfStake)) {
+            state.DoS(100, false, REJECT_INVALID, "bad-stake");
+            InvalidBlockFound(pindexNew, state);
+            return error("ConnectTip() : check proof-of-stake failed for block %s", pindexNew->GetBlockHash().ToString());
+        }
+        pindexNew->hashProofOfStake = hashProofOfStake;
+        pindexNew->nStakeModifierChecksum = GetStakeModifierChecksum(pindexNew);
+    }
+
     {
         CInv inv(MSG_BLOCK, pindexNew->GetBlockHash());
         bool rv = ConnectBlock(*pblock, state, pindexNew, view, false, fAlreadyChecked);
@@ -2900,6 +3297,12 @@ CBlockIndex* AddToBlockIndex(const CBlock& block)
         pindexNew->nHeight = pindexNew->pprev->nHeight + 1;
         pindexNew->BuildSkip();
 
+        // A bare header carries no coinstake, but past the proof-of-work phase every block
+        // is proof-of-stake. Knowing that is enough to compute the stake modifier below;
+        // the stake itself is filled in when the block arrives.
+        if (block.vtx.empty() && pindexNew->nHeight > Params().LAST_POW_BLOCK())
+            pindexNew->SetProofOfStake();
+
         //update previous block pointer
         pindexNew->pprev->pnext = pindexNew;
 
@@ -2912,9 +3315,11 @@ CBlockIndex* AddToBlockIndex(const CBlock& block)
 
         // ppcoin: record proof-of-stake hash value
         if (pindexNew->IsProofOfStake()) {
-            if (!mapProofOfStake.count(hash))
+            std::map<uint256, uint256>::const_iterator it = mapProofOfStake.find(hash);
+            if (it != mapProofOfStake.end())
+                pindexNew->hashProofOfStake = it->second;
+            else if (!block.vtx.empty())
                 LogPrintf("AddToBlockIndex() : hashProofOfStake not found in map \n");
-            pindexNew->hashProofOfStake = mapProofOfStake[hash];
         }
 
         // ppcoin: compute stake modifier
@@ -2944,8 +3349,20 @@ CBlockIndex* AddToBlockIndex(const CBlock& block)
 /** Mark a block as having its data received and checked (up to BLOCK_VALID_TRANSACTIONS). */
 bool ReceivedBlockTransactions(const CBlock& block, CValidationState& state, CBlockIndex* pindexNew, const CDiskBlockPos& pos)
 {
-    if (block.IsProofOfStake())
+    if (block.IsProofOfStake()) {
         pindexNew->SetProofOfStake();
+        if (pindexNew->prevoutStake.IsNull()) {
+            // The index was created from the header alone; record the stake now
+            pindexNew->prevoutStake = block.vtx[1].vin[0].prevout;
+            pindexNew->nStakeTime = block.nTime;
+            setStakeSeen.insert(make_pair(pindexNew->prevoutStake, pindexNew->nStakeTime));
+        }
+        if (pindexNew->hashProofOfStake == 0) {
+            std::map<uint256, uint256>::const_iterator it = mapProofOfStake.find(pindexNew->GetBlockHash());
+            if (it != mapProofOfStake.end())
+                pindexNew->hashProofOfStake = it->second;
+        }
+    }
     pindexNew->nTx = block.vtx.size();
     pindexNew->nChainTx = 0;
     pindexNew->nFile = pos.nFile;
@@ -3095,7 +3512,7 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
     // Check the merkle root.
     if (fCheckMerkleRoot) {
         bool mutated;
-        uint256 hashMerkleRoot2 = block.BuildMerkleTree(&mutated);
+        uint256 hashMerkleRoot2 = block.ComputeMerkleRoot(&mutated);
         if (block.hashMerkleRoot != hashMerkleRoot2)
             return state.DoS(100, error("CheckBlock() : hashMerkleRoot mismatch"),
                 REJECT_INVALID, "bad-txnmrklroot", true);
@@ -3207,14 +3624,15 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
     return true;
 }
 
-bool CheckWork(const CBlock block, CBlockIndex* const pindexPrev)
+bool CheckHeaderWork(const CBlockHeader& block, CBlockIndex* const pindexPrev)
 {
     if (pindexPrev == NULL)
         return error("%s : null pindexPrev for block %s", __func__, block.GetHash().ToString().c_str());
 
     unsigned int nBitsRequired = GetNextWorkRequired(pindexPrev, &block);
 
-    if (block.IsProofOfWork() && (pindexPrev->nHeight + 1 <= Params().LAST_POW_BLOCK())) {
+    // Blocks up to LAST_POW_BLOCK are proof-of-work, the rest proof-of-stake
+    if (pindexPrev->nHeight + 1 <= Params().LAST_POW_BLOCK()) {
         double n1 = ConvertBitsToDouble(block.nBits);
         double n2 = ConvertBitsToDouble(nBitsRequired);
 
@@ -3227,6 +3645,14 @@ bool CheckWork(const CBlock block, CBlockIndex* const pindexPrev)
     if (block.nBits != nBitsRequired)
         return error("%s : incorrect proof of work at %d", __func__, pindexPrev->nHeight + 1);
 
+    return true;
+}
+
+bool CheckWork(const CBlock block, CBlockIndex* const pindexPrev)
+{
+    if (!CheckHeaderWork(block, pindexPrev))
+        return false;
+
     if (block.IsProofOfStake()) {
         uint256 hashProofOfStake;
         uint256 hash = block.GetHash();
@@ -3364,6 +3790,10 @@ bool AcceptBlockHeader(const CBlock& block, CValidationState& state, CBlockIndex
 
     }
 
+    if (pindexPrev != NULL && !CheckHeaderWork(block, pindexPrev))
+        return state.DoS(100, error("%s : incorrect difficulty for block %s", __func__, hash.ToString()),
+                         REJECT_INVALID, "bad-diffbits");
+
     if (!ContextualCheckBlockHeader(block, state, pindexPrev))
         return false;
 
@@ -3376,6 +3806,14 @@ bool AcceptBlockHeader(const CBlock& block, CValidationState& state, CBlockIndex
     return true;
 }
 
+/** Whether a block on top of pindexPrev extends the active chain past its tip without connecting to it yet. */
+static bool IsAheadOfTip(const CBlockIndex* pindexPrev)
+{
+    const CBlockIndex* pindexTip = chainActive.Tip();
+    return pindexPrev != NULL && pindexTip != NULL && pindexPrev->nHeight > pindexTip->nHeight &&
+           pindexPrev->GetAncestor(pindexTip->nHeight) == pindexTip;
+}
+
 bool AcceptBlock(CBlock& block, CValidationState& state, CBlockIndex** ppindex, CDiskBlockPos* dbp, bool fAlreadyCheckedBlock)
 {
     AssertLockHeld(cs_main);
@@ -3405,8 +3843,19 @@ bool AcceptBlock(CBlock& block, CValidationState& state, CBlockIndex** ppindex,
         }
     }
 
-    if (block.GetHash() != Params().HashGenesisBlock() && !CheckWork(block, pindexPrev))
-        return false;
+    // Headers-first sync downloads blocks past the tip and stores them out of order.
+    // Such a block may stake an output created by a block in between that is not
+    // connected yet; its kernel is then checked in ConnectTip instead. Outside
+    // headers-first sync every block keeps the full checks below.
+    bool fAhead = Params().HeadersFirstSyncingActive() && IsAheadOfTip(pindexPrev);
+    if (fAhead && dbp == NULL && pindexPrev->nHeight + 1 > chainActive.Height() + (int)BLOCK_DOWNLOAD_WINDOW)
+        return state.DoS(0, error("%s : block %s is too far ahead of the tip", __func__, block.GetHash().ToString()), 0, "too-far-ahead");
+    bool fDeferStake = fAhead && block.IsProofOfStake() && !pcoinsTip->HaveCoin(block.vtx[1].vin[0].prevout);
+
+    if (block.GetHash() != Params().HashGenesisBlock()) {
+        if (fDeferStake ? !CheckHeaderWork(block, pindexPrev) : !CheckWork(block, pindexPrev))
+            return false;
+    }
 
     if (!AcceptBlockHeader(block, state, &pindex))
         return false;
@@ -3432,7 +3881,8 @@ bool AcceptBlock(CBlock& block, CValidationState& state, CBlockIndex** ppindex,
 
         CCoinsViewCache coins(pcoinsTip);
 
-        if (!coins.HaveInputs(block.vtx[1])) {
+        // Past the tip the stake may not exist yet; ConnectBlock checks the inputs in order
+        if (!fAhead && !coins.HaveInputs(block.vtx[1])) {
             LOCK(cs_mapstake);
 
             // the inputs are spent at the chain tip so we should look at the recently spent outputs
@@ -3448,7 +3898,7 @@ bool AcceptBlock(CBlock& block, CValidationState& state, CBlockIndex** ppindex,
         }
 
         // if this is on a fork
-        if (pindexPrev != NULL && !chainActive.Contains(pindexPrev)) {
+        if (pindexPrev != NULL && !fAhead && !chainActive.Contains(pindexPrev)) {
 
             // start at the block we're adding on to
             CBlockIndex *last = pindexPrev;
@@ -3568,6 +4018,7 @@ bool ProcessNewBlock(CValidationState& state, CNode* pfrom, CBlock* pblock, CDis
 {
     // Preliminary checks
     int64_t nStartTime = GetTimeMillis();
+    uint64_t nStartHashes = GetThreadBlockHashCount();
     bool checked = CheckBlock(*pblock, state);
 
     // ppcoin: check proof-of-stake
@@ -3584,7 +4035,10 @@ bool ProcessNewBlock(CValidationState& state, CNode* pfrom, CBlock* pblock, CDis
         //if we get this far, check if the prev block is our prev block, if not then request sync and return false
         BlockMap::iterator mi = mapBlockIndex.find(pblock->hashPrevBlock);
         if (mi == mapBlockIndex.end()) {
-            pfrom->PushMessage("getblocks", chainActive.GetLocator(), uint256(0));
+            if (IsHeadersFirstPeer(pfrom))
+                pfrom->PushMessage("getheaders", chainActive.GetLocator(pindexBestHeader), pblock->GetHash());
+            else
+                pfrom->PushMessage("getblocks", chainActive.GetLocator(), uint256(0));
             return false;
         }
     }
@@ -3628,8 +4082,8 @@ bool ProcessNewBlock(CValidationState& state, CNode* pfrom, CBlock* pblock, CDis
             pwalletMain->AutoCombineDust();
     }
 
-    LogPrintf("%s : ACCEPTED Block %ld in %ld milliseconds with size=%d\n", __func__, GetHeight(), GetTimeMillis() - nStartTime,
-              pblock->GetSerializeSize(SER_DISK, CLIENT_VERSION));
+    LogPrintf("%s : ACCEPTED Block %ld in %ld milliseconds with size=%d, %u Quark hashes\n", __func__, GetHeight(), GetTimeMillis() - nStartTime,
+              pblock->GetSerializeSize(SER_DISK, CLIENT_VERSION), GetThreadBlockHashCount() - nStartHashes);
 
     return true;
 }
@@ -3816,6 +4270,12 @@ bool static LoadBlockIndexDB(string& strError)
         }
     }
 
+    // Finish a coin database write that was interrupted half way
+    if (!ReplayBlocks(pcoinsTip)) {
+        strError = "Unable to replay blocks. You will need to rebuild the database using -reindex.";
+        return false;
+    }
+
     //Check if the shutdown procedure was followed on last client exit
     bool fLastShutdownWasPrepared = true;
     pblocktree->ReadFlag("shutdown", fLastShutdownWasPrepared);
@@ -3896,6 +4356,14 @@ bool static LoadBlockIndexDB(string& strError)
     pblocktree->ReadFlag("txindex", fTxIndex);
     LogPrintf("LoadBlockIndexDB(): transaction index %s\n", fTxIndex ? "enabled" : "disabled");
 
+    // Check whether we have the address, spent and timestamp indexes
+    pblocktree->ReadFlag("addressindex", fAddressIndex);
+    LogPrintf("LoadBlockIndexDB(): address index %s\n", fAddressIndex ? "enabled" : "disabled");
+    pblocktree->ReadFlag("spentindex", fSpentIndex);
+    LogPrintf("LoadBlockIndexDB(): spent index %s\n", fSpentIndex ? "enabled" : "disabled");
+    pblocktree->ReadFlag("timestampindex", fTimestampIndex);
+    LogPrintf("LoadBlockIndexDB(): timestamp index %s\n", fTimestampIndex ? "enabled" : "disabled");
+
     // If this is written true before the next client init, then we know the shutdown process failed
     pblocktree->WriteFlag("shutdown", false);
 
@@ -3904,6 +4372,7 @@ bool static LoadBlockIndexDB(string& strError)
     if (it == mapBlockIndex.end())
         return true;
     chainActive.SetTip(it->second);
+    UpdateStakeModifierIndex();
 
     PruneBlockIndexCandidates();
 
@@ -3965,9 +4434,9 @@ bool CVerifyDB::VerifyDB(CCoinsView* coinsview, int nCheckLevel, int nCheckDepth
             }
         }
         // check level 3: check for inconsistencies during memory-only disconnect of tip blocks
-        if (nCheckLevel >= 3 && pindex == pindexState && (coins.GetCacheSize() + pcoinsTip->GetCacheSize()) <= nCoinCacheSize) {
+        if (nCheckLevel >= 3 && pindex == pindexState && (coins.DynamicMemoryUsage() + pcoinsTip->DynamicMemoryUsage()) <= nCoinCacheUsage) {
             bool fClean = true;
-            if (!DisconnectBlock(block, state, pindex, coins, &fClean))
+            if (!DisconnectBlock(block, state, pindex, coins, &fClean, true))
                 return error("VerifyDB() : *** irrecoverable inconsistency in block data at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
             pindexState = pindex->pprev;
             if (!fClean) {
@@ -4007,6 +4476,7 @@ void UnloadBlockIndex()
     mapBlockIndex.clear();
     setBlockIndexCandidates.clear();
     chainActive.SetTip(NULL);
+    UpdateStakeModifierIndex();
     pindexBestInvalid = NULL;
 }
 
@@ -4028,6 +4498,14 @@ bool InitBlockIndex()
     // Use the provided setting for -txindex in the new database
     fTxIndex = GetBoolArg("-txindex", true);
     pblocktree->WriteFlag("txindex", fTxIndex);
+
+    // Likewise for the address, spent and timestamp indexes
+    fAddressIndex = GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX);
+    pblocktree->WriteFlag("addressindex", fAddressIndex);
+    fSpentIndex = GetBoolArg("-spentindex", DEFAULT_SPENTINDEX);
+    pblocktree->WriteFlag("spentindex", fSpentIndex);
+    fTimestampIndex = GetBoolArg("-timestampindex", DEFAULT_TIMESTAMPINDEX);
+    pblocktree->WriteFlag("timestampindex", fTimestampIndex);
     LogPrintf("Initializing databases...\n");
 
     // Only add the genesis block if not reindexing (in which case we reuse the one already on disk)
@@ -4057,6 +4535,9 @@ bool InitBlockIndex()
     return true;
 }
 
+/** Blocks LoadExternalBlockFile() reads before hashing their headers together */
+static const size_t EXTERNAL_BLOCK_LOAD_BATCH = 16;
+
 bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos* dbp)
 {
     // Map of disk positions for blocks with unknown parent (only used for reindex)
@@ -4068,85 +4549,117 @@ bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos* dbp)
         // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
         CBufferedFile blkdat(fileIn, 2 * MAX_BLOCK_SIZE, MAX_BLOCK_SIZE + 8, SER_DISK, CLIENT_VERSION);
         uint64_t nRewind = blkdat.GetPos();
-        while (!blkdat.eof()) {
-            boost::this_thread::interruption_point();
-
-            blkdat.SetPos(nRewind);
-            nRewind++;         // start one byte further next time, in case of failure
-            blkdat.SetLimit(); // remove former limit
-            unsigned int nSize = 0;
-            try {
-                // locate a header
-                unsigned char buf[MESSAGE_START_SIZE];
-                blkdat.FindByte(Params().MessageStart()[0]);
-                nRewind = blkdat.GetPos() + 1;
-                blkdat >> FLATDATA(buf);
-                if (memcmp(buf, Params().MessageStart(), MESSAGE_START_SIZE))
-                    continue;
-                // read size
-                blkdat >> nSize;
-                if (nSize < 80 || nSize > MAX_BLOCK_SIZE)
-                    continue;
-            } catch (const std::exception&) {
-                // no valid block header found; don't complain
-                break;
+        std::vector<CBlock> vBlocks;
+        vBlocks.reserve(EXTERNAL_BLOCK_LOAD_BATCH);
+        std::vector<uint64_t> vBlockPos;
+        std::vector<const CBlockHeader*> vpHeaders;
+        std::vector<uint256> vHashes;
+        bool fStop = false;
+        while (!blkdat.eof() && !fStop) {
+            // Read a batch of blocks, stopping early once they add up to MAX_BLOCK_SIZE bytes,
+            // so their headers can be hashed together
+            vBlocks.clear();
+            vBlockPos.clear();
+            uint64_t nBatchSize = 0;
+            while (!blkdat.eof() && vBlocks.size() < EXTERNAL_BLOCK_LOAD_BATCH && nBatchSize < MAX_BLOCK_SIZE) {
+                boost::this_thread::interruption_point();
+
+                blkdat.SetPos(nRewind);
+                nRewind++;         // start one byte further next time, in case of failure
+                blkdat.SetLimit(); // remove former limit
+                unsigned int nSize = 0;
+                try {
+                    // locate a header
+                    unsigned char buf[MESSAGE_START_SIZE];
+                    blkdat.FindByte(Params().MessageStart()[0]);
+                    nRewind = blkdat.GetPos() + 1;
+                    blkdat >> FLATDATA(buf);
+                    if (memcmp(buf, Params().MessageStart(), MESSAGE_START_SIZE))
+                        continue;
+                    // read size
+                    blkdat >> nSize;
+                    if (nSize < 80 || nSize > MAX_BLOCK_SIZE)
+                        continue;
+                } catch (const std::exception&) {
+                    // no valid block header found; don't complain
+                    fStop = true;
+                    break;
+                }
+                try {
+                    // read block
+                    uint64_t nBlockPos = blkdat.GetPos();
+                    blkdat.SetLimit(nBlockPos + nSize);
+                    blkdat.SetPos(nBlockPos);
+                    vBlocks.push_back(CBlock());
+                    blkdat >> vBlocks.back();
+                    vBlockPos.push_back(nBlockPos);
+                    nBatchSize += nSize;
+                    nRewind = blkdat.GetPos();
+                } catch (std::exception& e) {
+                    vBlocks.resize(vBlockPos.size());
+                    LogPrintf("%s : Deserialize or I/O error - %s", __func__, e.what());
+                }
             }
-            try {
-                // read block
-                uint64_t nBlockPos = blkdat.GetPos();
+
+            vpHeaders.resize(vBlocks.size());
+            for (size_t i = 0; i < vBlocks.size(); i++)
+                vpHeaders[i] = &vBlocks[i];
+            GetBlockHeaderHashes(vpHeaders, vHashes);
+
+            for (size_t i = 0; i < vBlocks.size(); i++) {
+                CBlock& block = vBlocks[i];
+                const uint256& hash = vHashes[i];
                 if (dbp)
-                    dbp->nPos = nBlockPos;
-                blkdat.SetLimit(nBlockPos + nSize);
-                blkdat.SetPos(nBlockPos);
-                CBlock block;
-                blkdat >> block;
-                nRewind = blkdat.GetPos();
-
-                // detect out of order blocks, and store them for later
-                uint256 hash = block.GetHash();
-                if (hash != Params().HashGenesisBlock() && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
-                    LogPrint("reindex", "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
-                        block.hashPrevBlock.ToString());
-                    if (dbp)
-                        mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
-                    continue;
-                }
+                    dbp->nPos = vBlockPos[i];
+                try {
+                    // detect out of order blocks, and store them for later
+                    if (hash != Params().HashGenesisBlock() && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
+                        LogPrint("reindex", "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
+                            block.hashPrevBlock.ToString());
+                        if (dbp)
+                            mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
+                        continue;
+                    }
 
-                // process in case the block isn't known yet
-                if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
-                    CValidationState state;
-                    if (ProcessNewBlock(state, NULL, &block, dbp))
-                        nLoaded++;
-                    if (state.IsError())
-                        break;
-                } else if (hash != Params().HashGenesisBlock() && mapBlockIndex[hash]->nHeight % 1000 == 0) {
-                    LogPrintf("Block Import: already had block %s at height %d\n", hash.ToString(), mapBlockIndex[hash]->nHeight);
-                }
+                    // process in case the block isn't known yet
+                    if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
+                        CValidationState state;
+                        if (ProcessNewBlock(state, NULL, &block, dbp))
+                            nLoaded++;
+                        if (state.IsError()) {
+                            fStop = true;
+                            break;
+                        }
+                    } else if (hash != Params().HashGenesisBlock() && mapBlockIndex[hash]->nHeight % 1000 == 0) {
+                        LogPrintf("Block Import: already had block %s at height %d\n", hash.ToString(), mapBlockIndex[hash]->nHeight);
+                    }
 
-                // Recursively process earlier encountered successors of this block
-                deque<uint256> queue;
-                queue.push_back(hash);
-                while (!queue.empty()) {
-                    uint256 head = queue.front();
-                    queue.pop_front();
-                    std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
-                    while (range.first != range.second) {
-                        std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
-                        if (ReadBlockFromDisk(block, it->second)) {
-                            LogPrintf("%s: Processing out of order child %s of %s\n", __func__, block.GetHash().ToString(),
-                                head.ToString());
-                            CValidationState dummy;
-                            if (ProcessNewBlock(dummy, NULL, &block, &it->second)) {
-                                nLoaded++;
-                                queue.push_back(block.GetHash());
+                    // Recursively process earlier encountered successors of this block
+                    deque<uint256> queue;
+                    queue.push_back(hash);
+                    while (!queue.empty()) {
+                        uint256 head = queue.front();
+                        queue.pop_front();
+                        std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
+                        while (range.first != range.second) {
+                            std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
+                            CBlock blockChild;
+                            if (ReadBlockFromDisk(blockChild, it->second)) {
+                                LogPrintf("%s: Processing out of order child %s of %s\n", __func__, blockChild.GetHash().ToString(),
+                                    head.ToString());
+                                CValidationState dummy;
+                                if (ProcessNewBlock(dummy, NULL, &blockChild, &it->second)) {
+                                    nLoaded++;
+                                    queue.push_back(blockChild.GetHash());
+                                }
                             }
+                            range.first++;
+                            mapBlocksUnknownParent.erase(it);
                         }
-                        range.first++;
-                        mapBlocksUnknownParent.erase(it);
                     }
+                } catch (std::exception& e) {
+                    LogPrintf("%s : Deserialize or I/O error - %s", __func__, e.what());
                 }
-            } catch (std::exception& e) {
-                LogPrintf("%s : Deserialize or I/O error - %s", __func__, e.what());
             }
         }
     } catch (std::runtime_error& e) {
@@ -4362,8 +4875,11 @@ bool static AlreadyHave(const CInv& inv)
     case MSG_TX: {
         bool txInMap = false;
         txInMap = mempool.exists(inv.hash);
+        // Only look at the first two outputs in the coins cache; this catches
+        // most recently confirmed transactions without touching the database
         return txInMap || mapOrphanTransactions.count(inv.hash) ||
-               pcoinsTip->HaveCoins(inv.hash);
+               pcoinsTip->HaveCoinInCache(COutPoint(inv.hash, 0)) ||
+               pcoinsTip->HaveCoinInCache(COutPoint(inv.hash, 1));
     }
     case MSG_BLOCK:
         return mapBlockIndex.count(inv.hash);
@@ -4455,13 +4971,28 @@ void static ProcessGetData(CNode* pfrom)
                 // Don't send not-validated blocks
                 if (send && (mi->second->nStatus & BLOCK_HAVE_DATA)) {
                     // Send block from disk
-                    CBlock block;
-                    if (!ReadBlockFromDisk(block, (*mi).second))
-                        assert(!"cannot load block from disk");
-                    if (inv.type == MSG_BLOCK)
-                        pfrom->PushMessage("block", block);
-                    else // MSG_FILTERED_BLOCK)
+                    if (inv.type == MSG_BLOCK) {
+                        // Block serialization does not depend on the stream type or version, so the
+                        // stored bytes are already what goes on the wire and need no round trip
+                        // through CBlock. Only the header is parsed, to check it against the index.
+                        vector<unsigned char> vchBlock;
+                        CBlockHeader header;
+                        if (!ReadRawBlockFromDisk(vchBlock, mi->second->GetBlockPos()))
+                            assert(!"cannot load block from disk");
+                        try {
+                            CMemoryReader reader((const char*)begin_ptr(vchBlock), (const char*)end_ptr(vchBlock), SER_NETWORK, PROTOCOL_VERSION);
+                            reader >> header;
+                        } catch (const std::exception&) {
+                            assert(!"cannot parse block from disk");
+                        }
+                        if (header.GetHash() != mi->second->GetBlockHash())
+                            assert(!"block on disk doesn't match index");
+                        pfrom->PushMessage("block", CFlatData(vchBlock));
+                    } else // MSG_FILTERED_BLOCK)
                     {
+                        CBlock block;
+                        if (!ReadBlockFromDisk(block, (*mi).second))
+                            assert(!"cannot load block from disk");
                         LOCK(pfrom->cs_filter);
                         if (pfrom->pfilter) {
                             CMerkleBlock merkleBlock(block, *pfrom->pfilter);
@@ -4638,6 +5169,19 @@ void static ProcessGetData(CNode* pfrom)
 }
 
 bool fRequestedSporksIDB = false;
+
+/**
+ * Whether strCommand can be handled by a message worker thread while the message
+ * handler thread works through messages that need cs_main. These only touch
+ * per-peer state and addrman. Spork and masternode gossip stay on the message
+ * handler thread: they read mapBlockIndex and chainActive without cs_main, and
+ * sporks change what IsSporkActive() reports to block validation.
+ */
+static bool IsConcurrentMessage(const std::string& strCommand)
+{
+    return strCommand == "ping" || strCommand == "addr" || strCommand == "getaddr";
+}
+
 bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv, int64_t nTimeReceived)
 {
     RandAddSeedPerfmon();
@@ -4814,9 +5358,8 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                     LOCK(cs_vNodes);
                     // Use deterministic randomness to send to the same nodes for 24 hours
                     // at a time so the setAddrKnowns of the chosen nodes prevent repeats
-                    static uint256 hashSalt;
-                    if (hashSalt == 0)
-                        hashSalt = GetRandHash();
+                    // Initialized once, even when several handler threads get here first
+                    static const uint256 hashSalt = GetRandHash();
                     uint64_t hashAddr = addr.GetHash();
                     uint256 hashRand = hashSalt ^ (hashAddr << 32) ^ ((GetTime() + hashAddr) / (24 * 60 * 60));
                     hashRand = Hash(BEGIN(hashRand), END(hashRand));
@@ -4871,7 +5414,21 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             if (!fAlreadyHave && !fImporting && !fReindex && inv.type != MSG_BLOCK)
                 pfrom->AskFor(inv);
 
-            if (inv.type == MSG_BLOCK) {
+            if (inv.type == MSG_BLOCK && IsHeadersFirstPeer(pfrom)) {
+                UpdateBlockAvailability(pfrom->GetId(), inv.hash);
+                if (!fAlreadyHave && !fImporting && !fReindex && !mapBlocksInFlight.count(inv.hash)) {
+                    // Fetch the headers leading up to the announced block first; the block
+                    // itself is then scheduled by FindNextBlocksToDownload along with the
+                    // rest of the chain, spread over every peer that has it.
+                    pfrom->PushMessage("getheaders", chainActive.GetLocator(pindexBestHeader), inv.hash);
+                    LogPrint("net", "getheaders (%d) %s to peer=%d\n", pindexBestHeader->nHeight, inv.hash.ToString(), pfrom->id);
+                    // Close to the tip the block most likely connects right away, so ask for it too
+                    if (chainActive.Tip()->GetBlockTime() > GetAdjustedTime() - Params().TargetSpacing() * 20) {
+                        vToFetch.push_back(inv);
+                        MarkBlockAsInFlight(pfrom->GetId(), inv.hash);
+                    }
+                }
+            } else if (inv.type == MSG_BLOCK) {
                 UpdateBlockAvailability(pfrom->GetId(), inv.hash);
                 if (!fAlreadyHave && !fImporting && !fReindex && !mapBlocksInFlight.count(inv.hash)) {
                     // Add this to the list of blocks to request
@@ -4912,7 +5469,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         ProcessGetData(pfrom);
     }
 
-    else if (strCommand == "getblocks" || strCommand == "getheaders") {
+    else if (strCommand == "getblocks") {
         CBlockLocator locator;
         uint256 hashStop;
         vRecv >> locator >> hashStop;
@@ -4943,7 +5500,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         }
     }
 
-    else if (strCommand == "headers" && Params().HeadersFirstSyncingActive()) {
+    else if (strCommand == "getheaders") {
         CBlockLocator locator;
         uint256 hashStop;
         vRecv >> locator >> hashStop;
@@ -5100,6 +5657,10 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             ReadCompactSize(vRecv); // ignore tx count; assume it is 0.
         }
 
+        // Hash the whole batch up front, outside cs_main, with the multi-buffer Quark engine.
+        std::vector<uint256> vHashes;
+        GetBlockHeaderHashes(headers, vHashes);
+
         LOCK(cs_main);
 
         if (nCount == 0) {
@@ -5107,31 +5668,63 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             return true;
         }
         CBlockIndex* pindexLast = NULL;
-        BOOST_FOREACH (const CBlockHeader& header, headers) {
+        unsigned int nPendingTotal = CountPendingHeaders();
+        unsigned int nPending = CountPendingHeaders(pfrom->GetId());
+        bool fPaused = false, fEnoughWork = false, fStale = false;
+        for (unsigned int n = 0; n < nCount; n++) {
+            const CBlockHeader& header = headers[n];
             CValidationState state;
             if (pindexLast != NULL && header.hashPrevBlock != pindexLast->GetBlockHash()) {
                 Misbehaving(pfrom->GetId(), 20);
                 return error("non-continuous headers sequence");
             }
 
-            /*TODO: this has a CBlock cast on it so that it will compile. There should be a solution for this
-             * before headers are reimplemented on mainnet
-             */
+            // Already known and not marked invalid: no need to rehash it in AcceptBlockHeader.
+            BlockMap::iterator mi = mapBlockIndex.find(vHashes[n]);
+            if (mi != mapBlockIndex.end() && !(mi->second->nStatus & BLOCK_FAILED_MASK)) {
+                pindexLast = mi->second;
+                continue;
+            }
+
+            // Headers carry no verifiable stake, so a peer can make them for free, and the block
+            // index never forgets them. Only store a fork that would overtake our tip...
+            if (!fEnoughWork && !(fEnoughWork = HeadersHaveMoreWork(headers, n))) {
+                LogPrint("net", "ignoring %u headers with no more work than our tip from peer=%d\n", nCount - n, pfrom->id);
+                fStale = true;
+                break;
+            }
+
+            // ... and only as many headers as the peer's network group and all peers together
+            // may have waiting for their blocks.
+            if (nPending >= MAX_HEADERS_PENDING || nPendingTotal >= MAX_HEADERS_PENDING_TOTAL) {
+                fPaused = true;
+                break;
+            }
+
             if (!AcceptBlockHeader((CBlock)header, state, &pindexLast)) {
                 int nDoS;
                 if (state.IsInvalid(nDoS)) {
                     if (nDoS > 0)
                         Misbehaving(pfrom->GetId(), nDoS);
-                    std::string strError = "invalid header received " + header.GetHash().ToString();
+                    std::string strError = "invalid header received " + vHashes[n].ToString();
                     return error(strError.c_str());
                 }
+            } else {
+                AddPendingHeader(pfrom->GetId(), pindexLast);
+                nPending++;
+                nPendingTotal++;
             }
         }
 
         if (pindexLast)
             UpdateBlockAvailability(pfrom->GetId(), pindexLast->GetBlockHash());
 
-        if (nCount == MAX_HEADERS_RESULTS && pindexLast) {
+        if (fPaused) {
+            // SendMessages asks for more once blocks have arrived for these headers
+            State(pfrom->GetId())->pindexHeadersPaused = pindexLast ? pindexLast : pindexBestHeader;
+            LogPrint("net", "headers sync paused at %d peer=%d, %u headers wait for their blocks\n",
+                State(pfrom->GetId())->pindexHeadersPaused->nHeight, pfrom->id, nPending);
+        } else if (nCount == MAX_HEADERS_RESULTS && pindexLast && !fStale) {
             // Headers message had its maximum size; the peer may have more headers.
             // TODO: optimize: if pindexLast is an ancestor of chainActive.Tip or pindexBestHeader, continue
             // from there instead.
@@ -5190,8 +5783,9 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
     // Making users (which are behind NAT and can only make outgoing connections) ignore
     // getaddr message mitigates the attack.
     else if ((strCommand == "getaddr") && (pfrom->fInbound)) {
-        pfrom->vAddrToSend.clear();
         vector<CAddress> vAddr = addrman.GetAddr();
+        LOCK(pfrom->cs_vAddrToSend);
+        pfrom->vAddrToSend.clear();
         BOOST_FOREACH (const CAddress& addr, vAddr)
             pfrom->PushAddress(addr);
     }
@@ -5447,7 +6041,7 @@ int ActiveProtocol()
 }
 
 // requires LOCK(cs_vRecvMsg)
-bool ProcessMessages(CNode* pfrom)
+static bool ProcessNextMessage(CNode* pfrom, bool fConcurrentOnly)
 {
     //if (fDebug)
     //    LogPrintf("ProcessMessages(%u messages)\n", pfrom->vRecvMsg.size());
@@ -5462,6 +6056,11 @@ bool ProcessMessages(CNode* pfrom)
     //
     bool fOk = true;
 
+    // Until the version handshake is done, and while getdata replies are pending,
+    // everything goes through the message handler thread in order
+    if (fConcurrentOnly && (pfrom->nVersion == 0 || !pfrom->vRecvGetData.empty()))
+        return fOk;
+
     if (!pfrom->vRecvGetData.empty())
         ProcessGetData(pfrom);
 
@@ -5486,6 +6085,10 @@ bool ProcessMessages(CNode* pfrom)
         if (!msg.complete())
             break;
 
+        // leave the rest to the message handler thread, to keep this peer's messages in order
+        if (fConcurrentOnly && !IsConcurrentMessage(msg.hdr.GetCommand()))
+            break;
+
         // at this point, any failure means we can delete the current message
         it++;
 
@@ -5518,9 +6121,15 @@ bool ProcessMessages(CNode* pfrom)
             continue;
         }
 
+        // Recover the signers of a run of masternode messages on the check threads,
+        // before handling them one at a time under the locks
+        if (nScriptCheckThreads && !fLiteMode && IsMasternodeSignedMessage(strCommand))
+            masternodeSigner.PreVerifyMessages(it - 1, pfrom->vRecvMsg.end());
+
         // Process message
         bool fRet = false;
         try {
+            CMessageTimer timer(strCommand, nMessageSize, msg.nTime, &cs_main);
             fRet = ProcessMessage(pfrom, strCommand, vRecv, msg.nTime);
             boost::this_thread::interruption_point();
         } catch (std::ios_base::failure& e) {
@@ -5545,6 +6154,10 @@ bool ProcessMessages(CNode* pfrom)
         if (!fRet)
             LogPrintf("ProcessMessage(%s, %u bytes) FAILED peer=%d\n", SanitizeString(strCommand), nMessageSize, pfrom->id);
 
+        // Whether it was verified or dropped, the signers recovered for it are not needed anymore
+        if (nScriptCheckThreads && !fLiteMode && IsMasternodeSignedMessage(strCommand))
+            masternodeSigner.ForgetMessage(hash);
+
         break;
     }
 
@@ -5555,6 +6168,18 @@ bool ProcessMessages(CNode* pfrom)
     return fOk;
 }
 
+// requires LOCK(cs_vRecvMsg)
+bool ProcessMessages(CNode* pfrom)
+{
+    return ProcessNextMessage(pfrom, false);
+}
+
+// requires LOCK(cs_vRecvMsg)
+bool ProcessConcurrentMessages(CNode* pfrom)
+{
+    return ProcessNextMessage(pfrom, true);
+}
+
 bool SendMessages(CNode* pto, bool fSendTrickle)
 {
     {
@@ -5601,8 +6226,10 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
             LOCK(cs_vNodes);
             BOOST_FOREACH (CNode* pnode, vNodes) {
                 // Periodically clear setAddrKnown to allow refresh broadcasts
-                if (nLastRebroadcast)
+                if (nLastRebroadcast) {
+                    LOCK(pnode->cs_vAddrToSend);
                     pnode->setAddrKnown.clear();
+                }
 
                 // Rebroadcast our address
                 AdvertizeLocal(pnode);
@@ -5615,11 +6242,16 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
         // Message: addr
         //
         if (fSendTrickle) {
+            vector<CAddress> vAddrToSend;
+            {
+                LOCK(pto->cs_vAddrToSend);
+                vAddrToSend.swap(pto->vAddrToSend);
+            }
             vector<CAddress> vAddr;
-            vAddr.reserve(pto->vAddrToSend.size());
-            BOOST_FOREACH (const CAddress& addr, pto->vAddrToSend) {
+            vAddr.reserve(vAddrToSend.size());
+            BOOST_FOREACH (const CAddress& addr, vAddrToSend) {
                 // returns true if wasn't already contained in the set
-                if (pto->setAddrKnown.insert(addr).second) {
+                if (pto->AddAddressKnown(addr)) {
                     vAddr.push_back(addr);
                     // receiver rejects addr messages larger than 1000
                     if (vAddr.size() >= 1000) {
@@ -5628,7 +6260,6 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
                     }
                 }
             }
-            pto->vAddrToSend.clear();
             if (!vAddr.empty())
                 pto->PushMessage("addr", vAddr);
         }
@@ -5661,13 +6292,24 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
             if (nSyncStarted == 0 || pindexBestHeader->GetBlockTime() > GetAdjustedTime() - 6 * 60 * 60) { // NOTE: was "close to today" and 24h in Bitcoin
                 state.fSyncStarted = true;
                 nSyncStarted++;
-                //CBlockIndex *pindexStart = pindexBestHeader->pprev ? pindexBestHeader->pprev : pindexBestHeader;
-                //LogPrint("net", "initial getheaders (%d) to peer=%d (startheight:%d)\n", pindexStart->nHeight, pto->id, pto->nStartingHeight);
-                //pto->PushMessage("getheaders", chainActive.GetLocator(pindexStart), uint256(0));
-                pto->PushMessage("getblocks", chainActive.GetLocator(chainActive.Tip()), uint256(0));
+                if (IsHeadersFirstPeer(pto)) {
+                    CBlockIndex* pindexStart = pindexBestHeader->pprev ? pindexBestHeader->pprev : pindexBestHeader;
+                    LogPrint("net", "initial getheaders (%d) to peer=%d (startheight:%d)\n", pindexStart->nHeight, pto->id, pto->nStartingHeight);
+                    pto->PushMessage("getheaders", chainActive.GetLocator(pindexStart), uint256(0));
+                } else {
+                    pto->PushMessage("getblocks", chainActive.GetLocator(chainActive.Tip()), uint256(0));
+                }
             }
         }
 
+        // Resume headers sync once blocks have arrived for enough of the pending headers
+        if (state.pindexHeadersPaused && CountPendingHeaders() + MAX_HEADERS_RESULTS <= MAX_HEADERS_PENDING_TOTAL &&
+            CountPendingHeaders(pto->GetId()) + MAX_HEADERS_RESULTS <= MAX_HEADERS_PENDING) {
+            LogPrint("net", "resume getheaders (%d) to peer=%d\n", state.pindexHeadersPaused->nHeight, pto->id);
+            pto->PushMessage("getheaders", chainActive.GetLocator(state.pindexHeadersPaused), uint256(0));
+            state.pindexHeadersPaused = NULL;
+        }
+
         // Resend wallet transactions that haven't gotten in a block yet
         // Except during reindex, importing and IBD, when old wallet
         // transactions become unconfirmed and spams other nodes.
@@ -5691,9 +6333,7 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
                 // trickle out tx inv to protect privacy
                 if (inv.type == MSG_TX && !fSendTrickle) {
                     // 1/4 of tx invs kmi to all immediately
-                    static uint256 hashSalt;
-                    if (hashSalt == 0)
-                        hashSalt = GetRandHash();
+                    static const uint256 hashSalt = GetRandHash();
                     uint256 hashRand = inv.hash ^ hashSalt;
                     hashRand = Hash(BEGIN(hashRand), END(hashRand));
                     bool fTrickleWait = ((hashRand & 3) != 0);
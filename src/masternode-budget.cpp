@@ -249,154 +249,72 @@ void CBudgetManager::SubmitFinalBudget()
 // CBudgetDB
 //
 
-CBudgetDB::CBudgetDB()
+CBudgetDB* pBudgetDB = NULL;
+
+CBudgetDB::CBudgetDB(size_t nCacheSize, bool fWipe) : CCacheDB("budget", nCacheSize, fWipe)
 {
-    pathDB = GetDataDir() / "budget.dat";
-    strMagicMessage = "MasternodeBudget";
 }
 
 bool CBudgetDB::Write(const CBudgetManager& objToSave)
 {
-    LOCK(objToSave.cs);
-
     int64_t nStart = GetTimeMillis();
 
-    // serialize, checksum data up to that point, then append checksum
-    CDataStream ssObj(SER_DISK, CLIENT_VERSION);
-    ssObj << strMagicMessage;                   // masternode cache file specific magic message
-    ssObj << FLATDATA(Params().MessageStart()); // network specific magic number
-    ssObj << objToSave;
-    uint256 hash = Hash(ssObj.begin(), ssObj.end());
-    ssObj << hash;
-
-    // open output file, and associate with CAutoFile
-    FILE* file = fopen(pathDB.string().c_str(), "wb");
-    CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
-    if (fileout.IsNull())
-        return error("%s : Failed to open file %s", __func__, pathDB.string());
-
-    // Write and commit header, data
-    try {
-        fileout << ssObj;
-    } catch (std::exception& e) {
-        return error("%s : Serialize or I/O error - %s", __func__, e.what());
+    {
+        LOCK(objToSave.cs);
+        WriteMap('P', objToSave.mapSeenMasternodeBudgetProposals);
+        WriteMap('V', objToSave.mapSeenMasternodeBudgetVotes);
+        WriteMap('F', objToSave.mapSeenFinalizedBudgets);
+        WriteMap('W', objToSave.mapSeenFinalizedBudgetVotes);
+        WriteMap('o', objToSave.mapOrphanMasternodeBudgetVotes);
+        WriteMap('q', objToSave.mapOrphanFinalizedBudgetVotes);
+        WriteMap('p', objToSave.mapProposals);
+        WriteMap('f', objToSave.mapFinalizedBudgets);
     }
-    fileout.fclose();
 
-    LogPrint("masternode","Written info to budget.dat  %dms\n", GetTimeMillis() - nStart);
+    if (!Commit())
+        return error("%s : Failed to write budgets", __func__);
+
+    LogPrint("masternode","Written info to budget  %dms\n", GetTimeMillis() - nStart);
 
     return true;
 }
 
-CBudgetDB::ReadResult CBudgetDB::Read(CBudgetManager& objToLoad, bool fDryRun)
+bool CBudgetDB::Read(CBudgetManager& objToLoad)
 {
     LOCK(objToLoad.cs);
 
     int64_t nStart = GetTimeMillis();
-    // open input file, and associate with CAutoFile
-    FILE* file = fopen(pathDB.string().c_str(), "rb");
-    CAutoFile filein(file, SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull()) {
-        error("%s : Failed to open file %s", __func__, pathDB.string());
-        return FileError;
-    }
-
-    // use file size to size memory buffer
-    int fileSize = boost::filesystem::file_size(pathDB);
-    int dataSize = fileSize - sizeof(uint256);
-    // Don't try to resize to a negative number if file is small
-    if (dataSize < 0)
-        dataSize = 0;
-    vector<unsigned char> vchData;
-    vchData.resize(dataSize);
-    uint256 hashIn;
-
-    // read data and checksum from file
-    try {
-        filein.read((char*)&vchData[0], dataSize);
-        filein >> hashIn;
-    } catch (std::exception& e) {
-        error("%s : Deserialize or I/O error - %s", __func__, e.what());
-        return HashReadError;
-    }
-    filein.fclose();
-
-    CDataStream ssObj(vchData, SER_DISK, CLIENT_VERSION);
-
-    // verify stored checksum matches input data
-    uint256 hashTmp = Hash(ssObj.begin(), ssObj.end());
-    if (hashIn != hashTmp) {
-        error("%s : Checksum mismatch, data corrupted", __func__);
-        return IncorrectHash;
-    }
-
-
-    unsigned char pchMsgTmp[4];
-    std::string strMagicMessageTmp;
-    try {
-        // de-serialize file header (masternode cache file specific magic message) and ..
-        ssObj >> strMagicMessageTmp;
-
-        // ... verify the message matches predefined one
-        if (strMagicMessage != strMagicMessageTmp) {
-            error("%s : Invalid masternode cache magic message", __func__);
-            return IncorrectMagicMessage;
-        }
 
-
-        // de-serialize file header (network specific magic number) and ..
-        ssObj >> FLATDATA(pchMsgTmp);
-
-        // ... verify the network matches ours
-        if (memcmp(pchMsgTmp, Params().MessageStart(), sizeof(pchMsgTmp))) {
-            error("%s : Invalid network magic number", __func__);
-            return IncorrectMagicNumber;
-        }
-
-        // de-serialize data into CBudgetManager object
-        ssObj >> objToLoad;
-    } catch (std::exception& e) {
+    if (!ReadMap('P', objToLoad.mapSeenMasternodeBudgetProposals) ||
+        !ReadMap('V', objToLoad.mapSeenMasternodeBudgetVotes) ||
+        !ReadMap('F', objToLoad.mapSeenFinalizedBudgets) ||
+        !ReadMap('W', objToLoad.mapSeenFinalizedBudgetVotes) ||
+        !ReadMap('o', objToLoad.mapOrphanMasternodeBudgetVotes) ||
+        !ReadMap('q', objToLoad.mapOrphanFinalizedBudgetVotes) ||
+        !ReadMap('p', objToLoad.mapProposals) ||
+        !ReadMap('f', objToLoad.mapFinalizedBudgets)) {
         objToLoad.Clear();
-        error("%s : Deserialize or I/O error - %s", __func__, e.what());
-        return IncorrectFormat;
+        Wipe();
+        return false;
     }
 
-    LogPrint("masternode","Loaded info from budget.dat  %dms\n", GetTimeMillis() - nStart);
+    LogPrint("masternode","Loaded info from budget  %dms\n", GetTimeMillis() - nStart);
+    LogPrint("masternode","  %s\n", objToLoad.ToString());
+    LogPrint("masternode","Budget manager - cleaning....\n");
+    objToLoad.CheckAndRemove();
+    LogPrint("masternode","Budget manager - result:\n");
     LogPrint("masternode","  %s\n", objToLoad.ToString());
-    if (!fDryRun) {
-        LogPrint("masternode","Budget manager - cleaning....\n");
-        objToLoad.CheckAndRemove();
-        LogPrint("masternode","Budget manager - result:\n");
-        LogPrint("masternode","  %s\n", objToLoad.ToString());
-    }
 
-    return Ok;
+    return true;
 }
 
 void DumpBudgets()
 {
-    int64_t nStart = GetTimeMillis();
-
-    CBudgetDB budgetdb;
-    CBudgetManager tempBudget;
-
-    LogPrint("masternode","Verifying budget.dat format...\n");
-    CBudgetDB::ReadResult readResult = budgetdb.Read(tempBudget, true);
-    // there was an error and it was not an error on file opening => do not proceed
-    if (readResult == CBudgetDB::FileError)
-        LogPrint("masternode","Missing budgets file - budget.dat, will try to recreate\n");
-    else if (readResult != CBudgetDB::Ok) {
-        LogPrint("masternode","Error reading budget.dat: ");
-        if (readResult == CBudgetDB::IncorrectFormat)
-            LogPrint("masternode","magic is ok but data has invalid format, will try to recreate\n");
-        else {
-            LogPrint("masternode","file format is unknown or invalid, please fix it manually\n");
-            return;
-        }
-    }
-    LogPrint("masternode","Writting info to budget.dat...\n");
-    budgetdb.Write(budget);
+    if (pBudgetDB == NULL)
+        return;
 
+    int64_t nStart = GetTimeMillis();
+    pBudgetDB->Write(budget);
     LogPrint("masternode","Budget dump finished  %dms\n", GetTimeMillis() - nStart);
 }
 
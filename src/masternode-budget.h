@@ -7,6 +7,7 @@
 #define MASTERNODE_BUDGET_H
 
 #include "base58.h"
+#include "cachedb.h"
 #include "init.h"
 #include "key.h"
 #include "main.h"
@@ -142,30 +143,18 @@ public:
     }
 };
 
-/** Save Budget Manager (budget.dat)
+/** Save Budget Manager (budget)
  */
-class CBudgetDB
+class CBudgetDB : public CCacheDB
 {
-private:
-    boost::filesystem::path pathDB;
-    std::string strMagicMessage;
-
 public:
-    enum ReadResult {
-        Ok,
-        FileError,
-        HashReadError,
-        IncorrectHash,
-        IncorrectMagicMessage,
-        IncorrectMagicNumber,
-        IncorrectFormat
-    };
-
-    CBudgetDB();
+    CBudgetDB(size_t nCacheSize, bool fWipe = false);
     bool Write(const CBudgetManager& objToSave);
-    ReadResult Read(CBudgetManager& objToLoad, bool fDryRun = false);
+    bool Read(CBudgetManager& objToLoad);
 };
 
+extern CBudgetDB* pBudgetDB;
+
 
 //
 // Budget Manager : Contains all proposals for the budget
@@ -6,6 +6,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "masternode-helpers.h"
+#include "checkqueue.h"
 #include "init.h"
 #include "main.h"
 #include "masternodeman.h"
@@ -108,22 +109,222 @@ bool CMasternodeSigner::SignMessage(std::string strMessage, std::string& errorMe
     return true;
 }
 
+static uint256 RecoveredKeyHash(const uint256& hashMessage, const std::vector<unsigned char>& vchSig)
+{
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << hashMessage << vchSig;
+    return ss.GetHash();
+}
+
 bool CMasternodeSigner::VerifyMessage(CPubKey pubkey, vector<unsigned char>& vchSig, std::string strMessage, std::string& errorMessage)
+{
+    uint256 hashMessage = GetMessageHash(strMessage);
+
+    // use the signer recovered by PreVerifyMessages() if there is one
+    CKeyID keyID;
+    bool fRecovered = false;
+    {
+        LOCK(cs_recovered);
+        std::map<uint256, CKeyID>::iterator it = mapRecoveredKeys.find(RecoveredKeyHash(hashMessage, vchSig));
+        if (it != mapRecoveredKeys.end()) {
+            keyID = it->second;
+            fRecovered = true;
+            mapRecoveredKeys.erase(it);
+        }
+    }
+
+    if (!fRecovered) {
+        CPubKey pubkey2;
+        if (pubkey2.RecoverCompact(hashMessage, vchSig))
+            keyID = pubkey2.GetID();
+    }
+
+    if (keyID.IsNull()) {
+        errorMessage = _("Error recovering public key.");
+        return false;
+    }
+
+    if (fDebug && keyID != pubkey.GetID())
+        LogPrintf("CMasternodeSigner::VerifyMessage -- keys don't match: %s %s\n", keyID.ToString(), pubkey.GetID().ToString());
+
+    return (keyID == pubkey.GetID());
+}
+
+uint256 CMasternodeSigner::GetMessageHash(const std::string& strMessage)
 {
     CHashWriter ss(SER_GETHASH, 0);
     ss << strMessageMagic;
     ss << strMessage;
+    return ss.GetHash();
+}
 
-    CPubKey pubkey2;
-    if (!pubkey2.RecoverCompact(ss.GetHash(), vchSig)) {
-        errorMessage = _("Error recovering public key.");
-        return false;
+void CMasternodeSigner::AddRecoveredKey(const uint256& hashMessage, const std::vector<unsigned char>& vchSig, const CKeyID& keyID)
+{
+    uint256 hash = RecoveredKeyHash(hashMessage, vchSig);
+
+    LOCK(cs_recovered);
+    mapRecoveredKeys[hash] = keyID;
+}
+
+bool CMasternodeSigner::HaveRecoveredKey(const uint256& hashMessage, const std::vector<unsigned char>& vchSig)
+{
+    uint256 hash = RecoveredKeyHash(hashMessage, vchSig);
+
+    LOCK(cs_recovered);
+    return mapRecoveredKeys.count(hash) > 0;
+}
+
+uint256 CMasternodeSigner::GetPayloadHash(const CNetMessage& msg)
+{
+    return Hash(msg.vRecv.begin(), msg.vRecv.begin() + msg.hdr.nMessageSize);
+}
+
+void CMasternodeSigner::ForgetMessage(const uint256& hashPayload)
+{
+    LOCK(cs_recovered);
+    std::map<uint256, std::vector<uint256> >::iterator it = mapMessageKeys.find(hashPayload);
+    if (it == mapMessageKeys.end())
+        return;
+    BOOST_FOREACH (const uint256& hash, it->second)
+        mapRecoveredKeys.erase(hash);
+    mapMessageKeys.erase(it);
+}
+
+namespace {
+
+/** Recovers the key behind one masternode message signature. */
+class CMasternodeSigCheck
+{
+private:
+    uint256 hashMessage;
+    std::vector<unsigned char> vchSig;
+
+public:
+    CMasternodeSigCheck() {}
+    CMasternodeSigCheck(const std::string& strMessage, const std::vector<unsigned char>& vchSigIn) : hashMessage(CMasternodeSigner::GetMessageHash(strMessage)), vchSig(vchSigIn) {}
+
+    uint256 GetKeyHash() const
+    {
+        return RecoveredKeyHash(hashMessage, vchSig);
+    }
+
+    bool operator()()
+    {
+        CPubKey pubkey;
+        CKeyID keyID;
+        if (pubkey.RecoverCompact(hashMessage, vchSig))
+            keyID = pubkey.GetID();
+        masternodeSigner.AddRecoveredKey(hashMessage, vchSig, keyID);
+        return true;
+    }
+
+    void swap(CMasternodeSigCheck& check)
+    {
+        std::swap(hashMessage, check.hashMessage);
+        vchSig.swap(check.vchSig);
     }
+};
 
-    if (fDebug && pubkey2.GetID() != pubkey.GetID())
-        LogPrintf("CMasternodeSigner::VerifyMessage -- keys don't match: %s %s\n", pubkey2.GetID().ToString(), pubkey.GetID().ToString());
+CCheckQueue<CMasternodeSigCheck> mnsigcheckqueue(128);
 
-    return (pubkey2.GetID() == pubkey.GetID());
+} // anon namespace
+
+bool IsMasternodeSignedMessage(const std::string& strCommand)
+{
+    return strCommand == "mnb" || strCommand == "mnp" || strCommand == "mnw";
+}
+
+void ThreadMasternodeSigCheck()
+{
+    RenameThread("koinmudra-mnsigch");
+    mnsigcheckqueue.Thread();
+}
+
+void CMasternodeSigner::PreVerifyMessages(std::deque<CNetMessage>::iterator itBegin, std::deque<CNetMessage>::iterator itEnd)
+{
+    std::vector<CMasternodeSigCheck> vChecks;
+    // payload hash of each message and the number of its checks
+    std::vector<std::pair<uint256, size_t> > vMessages;
+    for (std::deque<CNetMessage>::iterator it = itBegin; it != itEnd && vChecks.size() < MAX_MASTERNODE_VERIFY_BATCH; ++it) {
+        CNetMessage& msg = *it;
+        if (!msg.complete() || !msg.hdr.IsValid())
+            break;
+        std::string strCommand = msg.hdr.GetCommand();
+        if (!IsMasternodeSignedMessage(strCommand))
+            break;
+
+        // if the first message is known, so is the run an earlier call verified with it
+        uint256 hashPayload = GetPayloadHash(msg);
+        if (it == itBegin) {
+            LOCK(cs_recovered);
+            if (mapMessageKeys.count(hashPayload))
+                return;
+        }
+
+        // work on a copy, the message is still to be processed
+        size_t nChecks = vChecks.size();
+        CDataStream vRecv(msg.vRecv.begin(), msg.vRecv.end(), msg.vRecv.GetType(), msg.vRecv.GetVersion());
+        try {
+            if (strCommand == "mnb") {
+                CMasternodeBroadcast mnb;
+                vRecv >> mnb;
+                vChecks.push_back(CMasternodeSigCheck(mnb.GetStrMessage(), mnb.sig));
+                if (mnb.lastPing != CMasternodePing())
+                    vChecks.push_back(CMasternodeSigCheck(mnb.lastPing.GetStrMessage(), mnb.lastPing.vchSig));
+            } else if (strCommand == "mnp") {
+                CMasternodePing mnp;
+                vRecv >> mnp;
+                vChecks.push_back(CMasternodeSigCheck(mnp.GetStrMessage(), mnp.vchSig));
+            } else {
+                CMasternodePaymentWinner winner;
+                vRecv >> winner;
+                vChecks.push_back(CMasternodeSigCheck(winner.GetStrMessage(), winner.vchSig));
+            }
+        } catch (std::exception& e) {
+            // malformed, let ProcessMessage deal with it
+            continue;
+        }
+        vMessages.push_back(std::make_pair(hashPayload, vChecks.size() - nChecks));
+    }
+
+    // the first message is processed right away, so a batch of one gains nothing
+    if (vChecks.size() < 2)
+        return;
+
+    // The check queue takes a single controller. Concurrent callers wait here
+    // for each other, and then find runs verified meanwhile already known.
+    LOCK(cs_preverify);
+
+    // if its first message is known this run was already verified by an earlier call
+    {
+        LOCK(cs_recovered);
+        if (mapMessageKeys.count(vMessages[0].first))
+            return;
+
+        // Entries go as their messages are processed; those of messages that never
+        // are, as when their peer disconnects, go all at once past the limit
+        if (mapRecoveredKeys.size() + vChecks.size() > MAX_MASTERNODE_RECOVERED_KEYS) {
+            mapRecoveredKeys.clear();
+            mapMessageKeys.clear();
+        }
+    }
+
+    // the checks are consumed by the queue
+    std::vector<std::vector<uint256> > vKeys(vMessages.size());
+    std::vector<CMasternodeSigCheck>::const_iterator itCheck = vChecks.begin();
+    for (unsigned int i = 0; i < vMessages.size(); i++)
+        for (size_t n = 0; n < vMessages[i].second; n++, itCheck++)
+            vKeys[i].push_back(itCheck->GetKeyHash());
+
+    CCheckQueueControl<CMasternodeSigCheck> control(&mnsigcheckqueue);
+    control.Add(vChecks);
+    control.Wait();
+
+    {
+        LOCK(cs_recovered);
+        for (unsigned int i = 0; i < vMessages.size(); i++)
+            mapMessageKeys[vMessages[i].first].swap(vKeys[i]);
+    }
 }
 
 bool CMasternodeSigner::SetCollateralAddress(std::string strAddress)
@@ -9,13 +9,31 @@
 #define MASTERNODEHELPERS_H
 
 #include "main.h"
+#include "net.h"
 #include "sync.h"
 #include "base58.h"
 
+#include <deque>
+
+/** Most signers kept from PreVerifyMessages() before the cache is reset */
+static const unsigned int MAX_MASTERNODE_RECOVERED_KEYS = 50000;
+/** Most queued masternode messages verified in one batch */
+static const unsigned int MAX_MASTERNODE_VERIFY_BATCH = 1000;
+
 /** Helper object for signing and checking signatures
  */
 class CMasternodeSigner
 {
+private:
+    // critical section to protect the recovered keys
+    CCriticalSection cs_recovered;
+    // signers recovered ahead of processing, by hash of (message hash, signature)
+    std::map<uint256, CKeyID> mapRecoveredKeys;
+    // the mapRecoveredKeys entries of each pre-verified network message, by payload hash
+    std::map<uint256, std::vector<uint256> > mapMessageKeys;
+    // one batch at a time on the shared signature check queue
+    CCriticalSection cs_preverify;
+
 public:
     CScript collateralPubKey;
 
@@ -30,6 +48,25 @@ public:
     /// Verify the message, returns true if succcessful
     bool VerifyMessage(CPubKey pubkey, std::vector<unsigned char>& vchSig, std::string strMessage, std::string& errorMessage);
 
+    /// Hash a message the way it is signed
+    static uint256 GetMessageHash(const std::string& strMessage);
+    /// Remember the key recovered from a signature (a null key if recovery failed)
+    void AddRecoveredKey(const uint256& hashMessage, const std::vector<unsigned char>& vchSig, const CKeyID& keyID);
+    bool HaveRecoveredKey(const uint256& hashMessage, const std::vector<unsigned char>& vchSig);
+    /// Hash of a received message's payload, as its checksum is computed
+    static uint256 GetPayloadHash(const CNetMessage& msg);
+    /// Drop what PreVerifyMessages() recovered for a message once it was processed or dropped
+    void ForgetMessage(const uint256& hashPayload);
+    /**
+     * Recover the signers of the run of mnb/mnp/mnw messages starting at itBegin
+     * on the signature check threads, so that VerifyMessage finds them without
+     * doing the EC work while the masternode and chain locks are held.
+     * Returns right away if the message at itBegin was part of an earlier run.
+     * Safe to call from several message threads; their batches run one after
+     * the other.
+     */
+    void PreVerifyMessages(std::deque<CNetMessage>::iterator itBegin, std::deque<CNetMessage>::iterator itEnd);
+
     bool SetCollateralAddress(std::string strAddress);
 
     void InitCollateralAddress()
@@ -41,6 +78,12 @@ public:
 
 void ThreadMasternodePool();
 
+/** Is this a masternode message whose signature PreVerifyMessages() can check? */
+bool IsMasternodeSignedMessage(const std::string& strCommand);
+
+/** Run an instance of the masternode signature check thread */
+void ThreadMasternodeSigCheck();
+
 extern CMasternodeSigner masternodeSigner;
 
 
@@ -6,6 +6,7 @@
 #ifndef MASTERNODE_PAYMENTS_H
 #define MASTERNODE_PAYMENTS_H
 
+#include "cachedb.h"
 #include "key.h"
 #include "main.h"
 #include "masternode.h"
@@ -36,30 +37,18 @@ void FillBlockPayee(CMutableTransaction& txNew, CAmount nFees, bool fProofOfStak
 
 void DumpMasternodePayments();
 
-/** Save Masternode Payment Data (mnpayments.dat)
+/** Save Masternode Payment Data (mnpayments)
  */
-class CMasternodePaymentDB
+class CMasternodePaymentDB : public CCacheDB
 {
-private:
-    boost::filesystem::path pathDB;
-    std::string strMagicMessage;
-
 public:
-    enum ReadResult {
-        Ok,
-        FileError,
-        HashReadError,
-        IncorrectHash,
-        IncorrectMagicMessage,
-        IncorrectMagicNumber,
-        IncorrectFormat
-    };
-
-    CMasternodePaymentDB();
+    CMasternodePaymentDB(size_t nCacheSize, bool fWipe = false);
     bool Write(const CMasternodePayments& objToSave);
-    ReadResult Read(CMasternodePayments& objToLoad, bool fDryRun = false);
+    bool Read(CMasternodePayments& objToLoad);
 };
 
+extern CMasternodePaymentDB* pMasternodePaymentDB;
+
 class CMasternodePayee
 {
 public:
@@ -198,6 +187,8 @@ public:
     bool IsValid(CNode* pnode, std::string& strError);
     bool SignatureValid();
     void Relay();
+    /// The message covered by vchSig
+    std::string GetStrMessage() const;
 
     void AddPayee(CScript payeeIn)
     {
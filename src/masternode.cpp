@@ -18,48 +18,78 @@
 
 // keep track of the scanning errors I've seen
 map<uint256, int> mapSeenMasternodeScanningErrors;
-// cache block hashes as we calculate them
-std::map<int64_t, uint256> mapCacheBlockHashes;
+CMasternodeHeightContext masternodeHeights;
 
-//Get the last hash that matches the modulus given. Processed in reverse order
-bool GetBlockHash(uint256& hash, int nBlockHeight)
+/** The active chain block that scores for nBlockHeight are calculated against, or NULL */
+static const CBlockIndex* GetScoreBlockIndex(int64_t nBlockHeight)
 {
-    if (chainActive.Tip() == NULL) return false;
+    // Callers often hold masternode locks, which are taken after cs_main elsewhere;
+    // without cs_main, search back from the tip instead of indexing chainActive
+    TRY_LOCK(cs_main, lockMain);
+    const CBlockIndex* pindexTip = chainActive.Tip();
+    if (pindexTip == NULL || pindexTip->nHeight == 0) return NULL;
 
+    if (nBlockHeight < 0) return NULL;
     if (nBlockHeight == 0)
-        nBlockHeight = chainActive.Tip()->nHeight;
+        nBlockHeight = pindexTip->nHeight;
+    if (nBlockHeight > pindexTip->nHeight + 1) return NULL;
 
-    if (mapCacheBlockHashes.count(nBlockHeight)) {
-        hash = mapCacheBlockHashes[nBlockHeight];
-        return true;
-    }
+    // a height is scored against the block below it, the genesis block never counts
+    int nHeight = nBlockHeight - 1;
+    if (nHeight <= 0) return NULL;
 
-    const CBlockIndex* BlockLastSolved = chainActive.Tip();
-    const CBlockIndex* BlockReading = chainActive.Tip();
+    return lockMain ? chainActive[nHeight] : pindexTip->GetAncestor(nHeight);
+}
 
-    if (BlockLastSolved == NULL || BlockLastSolved->nHeight == 0 || chainActive.Tip()->nHeight + 1 < nBlockHeight) return false;
+bool GetBlockHash(uint256& hash, int nBlockHeight)
+{
+    return masternodeHeights.GetBlockHash(hash, nBlockHeight);
+}
 
-    int nBlocksAgo = 0;
-    if (nBlockHeight > 0) nBlocksAgo = (chainActive.Tip()->nHeight + 1) - nBlockHeight;
-    assert(nBlocksAgo >= 0);
+CMasternodeScoreContext::CMasternodeScoreContext() : hashBlock(0), hashBlockScore(0), ssBlock(SER_GETHASH, PROTOCOL_VERSION)
+{
+}
 
-    int n = 0;
-    for (unsigned int i = 1; BlockReading && BlockReading->nHeight > 0; i++) {
-        if (n >= nBlocksAgo) {
-            hash = BlockReading->GetBlockHash();
-            mapCacheBlockHashes[nBlockHeight] = hash;
-            return true;
-        }
-        n++;
+CMasternodeScoreContext::CMasternodeScoreContext(const uint256& hashBlockIn) : hashBlock(hashBlockIn), ssBlock(SER_GETHASH, PROTOCOL_VERSION)
+{
+    ssBlock << hashBlock;
+    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    ss << hashBlock;
+    hashBlockScore = ss.GetHash();
+}
 
-        if (BlockReading->pprev == NULL) {
-            assert(BlockReading);
-            break;
-        }
-        BlockReading = BlockReading->pprev;
-    }
+bool CMasternodeHeightContext::GetBlockHash(uint256& hash, int64_t nBlockHeight) const
+{
+    const CBlockIndex* pindex = GetScoreBlockIndex(nBlockHeight);
+    if (pindex == NULL) return false;
+    hash = pindex->GetBlockHash();
+    return true;
+}
 
-    return false;
+bool CMasternodeHeightContext::GetScoreContext(CMasternodeScoreContext& context, int64_t nBlockHeight)
+{
+    uint256 hash;
+    if (!GetBlockHash(hash, nBlockHeight)) return false;
+
+    LOCK(cs);
+    std::map<int64_t, CMasternodeScoreContext>::iterator it = mapContexts.find(nBlockHeight);
+    if (it == mapContexts.end()) {
+        // make room by dropping the lowest height, the one least likely to be asked for again
+        if (mapContexts.size() >= MASTERNODE_HEIGHT_CONTEXT_HEIGHTS)
+            mapContexts.erase(mapContexts.begin());
+        it = mapContexts.insert(std::make_pair(nBlockHeight, CMasternodeScoreContext(hash))).first;
+    } else if (it->second.hashBlock != hash) {
+        // the block at this height was reorganised away
+        it->second = CMasternodeScoreContext(hash);
+    }
+    context = it->second;
+    return true;
+}
+
+void CMasternodeHeightContext::Clear()
+{
+    LOCK(cs);
+    mapContexts.clear();
 }
 
 CMasternode::CMasternode()
@@ -167,25 +197,29 @@ bool CMasternode::UpdateFromNewBroadcast(CMasternodeBroadcast& mnb)
 //
 uint256 CMasternode::CalculateScore(int mod, int64_t nBlockHeight)
 {
-    if (chainActive.Tip() == NULL) return 0;
-
-    uint256 hash = 0;
-    uint256 aux = vin.prevout.hash + vin.prevout.n;
-
-    if (!GetBlockHash(hash, nBlockHeight)) {
+    CMasternodeScoreContext context;
+    if (!masternodeHeights.GetScoreContext(context, nBlockHeight)) {
         LogPrint("masternode","CalculateScore ERROR - nHeight %d - Returned 0\n", nBlockHeight);
         return 0;
     }
 
-    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
-    ss << hash;
-    uint256 hash2 = ss.GetHash();
+    return CalculateScore(context);
+}
+
+uint256 CMasternode::CalculateScore(const uint256& hash) const
+{
+    return CalculateScore(CMasternodeScoreContext(hash));
+}
 
-    CHashWriter ss2(SER_GETHASH, PROTOCOL_VERSION);
-    ss2 << hash;
-    ss2 << aux;
-    uint256 hash3 = ss2.GetHash();
+uint256 CMasternode::CalculateScore(const CMasternodeScoreContext& context) const
+{
+    uint256 aux = vin.prevout.hash + vin.prevout.n;
 
+    CHashWriter ss(context.ssBlock);
+    ss << aux;
+    uint256 hash3 = ss.GetHash();
+
+    const uint256& hash2 = context.hashBlockScore;
     uint256 r = (hash3 > hash2 ? hash3 - hash2 : hash2 - hash3);
 
     return r;
@@ -480,9 +514,7 @@ bool CMasternodeBroadcast::CheckAndUpdate(int& nDos)
         return false;
     }
 
-    std::string vchPubKey(pubKeyCollateralAddress.begin(), pubKeyCollateralAddress.end());
-    std::string vchPubKey2(pubKeyMasternode.begin(), pubKeyMasternode.end());
-    std::string strMessage = addr.ToString() + boost::lexical_cast<std::string>(sigTime) + vchPubKey + vchPubKey2 + boost::lexical_cast<std::string>(protocolVersion);
+    std::string strMessage = GetStrMessage();
 
     if (protocolVersion < masternodePayments.GetMinMasternodePaymentsProto()) {
         LogPrint("masternode","mnb - ignoring outdated Masternode %s protocol version %d\n", vin.prevout.hash.ToString(), protocolVersion);
@@ -645,16 +677,21 @@ void CMasternodeBroadcast::Relay()
     RelayInv(inv);
 }
 
-bool CMasternodeBroadcast::Sign(CKey& keyCollateralAddress)
+std::string CMasternodeBroadcast::GetStrMessage() const
 {
-    std::string errorMessage;
-
     std::string vchPubKey(pubKeyCollateralAddress.begin(), pubKeyCollateralAddress.end());
     std::string vchPubKey2(pubKeyMasternode.begin(), pubKeyMasternode.end());
 
+    return addr.ToString() + boost::lexical_cast<std::string>(sigTime) + vchPubKey + vchPubKey2 + boost::lexical_cast<std::string>(protocolVersion);
+}
+
+bool CMasternodeBroadcast::Sign(CKey& keyCollateralAddress)
+{
+    std::string errorMessage;
+
     sigTime = GetAdjustedTime();
 
-    std::string strMessage = addr.ToString() + boost::lexical_cast<std::string>(sigTime) + vchPubKey + vchPubKey2 + boost::lexical_cast<std::string>(protocolVersion);
+    std::string strMessage = GetStrMessage();
 
     if (!masternodeSigner.SignMessage(strMessage, errorMessage, sig, keyCollateralAddress)) {
         LogPrint("masternode","CMasternodeBroadcast::Sign() - Error: %s\n", errorMessage);
@@ -692,7 +729,7 @@ bool CMasternodePing::Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode)
     std::string strMasterNodeSignMessage;
 
     sigTime = GetAdjustedTime();
-    std::string strMessage = vin.ToString() + blockHash.ToString() + boost::lexical_cast<std::string>(sigTime);
+    std::string strMessage = GetStrMessage();
 
     if (!masternodeSigner.SignMessage(strMessage, errorMessage, vchSig, keyMasternode)) {
         LogPrint("masternode","CMasternodePing::Sign() - Error: %s\n", errorMessage);
@@ -732,7 +769,7 @@ bool CMasternodePing::CheckAndUpdate(int& nDos, bool fRequireEnabled)
         // update only if there is no known ping for this masternode or
         // last ping was more then MASTERNODE_MIN_MNP_SECONDS-60 ago comparing to this one
         if (!pmn->IsPingedWithin(MASTERNODE_MIN_MNP_SECONDS - 60, sigTime)) {
-            std::string strMessage = vin.ToString() + blockHash.ToString() + boost::lexical_cast<std::string>(sigTime);
+            std::string strMessage = GetStrMessage();
 
             std::string errorMessage = "";
             if (!masternodeSigner.VerifyMessage(pmn->pubKeyMasternode, vchSig, strMessage, errorMessage)) {
@@ -789,3 +826,8 @@ void CMasternodePing::Relay()
     CInv inv(MSG_MASTERNODE_PING, GetHash());
     RelayInv(inv);
 }
+
+std::string CMasternodePing::GetStrMessage() const
+{
+    return vin.ToString() + blockHash.ToString() + boost::lexical_cast<std::string>(sigTime);
+}
@@ -7,6 +7,7 @@
 #define MASTERNODE_H
 
 #include "base58.h"
+#include "hash.h"
 #include "key.h"
 #include "main.h"
 #include "net.h"
@@ -21,6 +22,7 @@
 #define MASTERNODE_EXPIRATION_SECONDS (120 * 60)
 #define MASTERNODE_REMOVAL_SECONDS (130 * 60)
 #define MASTERNODE_CHECK_SECONDS 5
+#define MASTERNODE_HEIGHT_CONTEXT_HEIGHTS 64
 
 #define MASTERNODE_COLLATERAL 5000
 
@@ -29,7 +31,47 @@ using namespace std;
 class CMasternode;
 class CMasternodeBroadcast;
 class CMasternodePing;
-extern map<int64_t, uint256> mapCacheBlockHashes;
+
+/**
+ * The part of a masternode score that only depends on the block it is
+ * calculated against, shared by all masternodes scored for that block
+ */
+class CMasternodeScoreContext
+{
+public:
+    uint256 hashBlock;
+    /// Hash(hashBlock), the value every masternode's hash is compared to
+    uint256 hashBlockScore;
+    /// Hash writer with hashBlock already written, to be continued per masternode
+    CHashWriter ssBlock;
+
+    CMasternodeScoreContext();
+    explicit CMasternodeScoreContext(const uint256& hashBlockIn);
+};
+
+/**
+ * Block hashes and score contexts by height for the masternode elections.
+ *
+ * A height resolves to the active chain block just below it; negative heights
+ * and heights past the next block resolve to nothing. Cached score contexts
+ * are checked against the block currently at their height, so they follow
+ * reorganisations, and only the MASTERNODE_HEIGHT_CONTEXT_HEIGHTS highest
+ * heights are kept.
+ */
+class CMasternodeHeightContext
+{
+private:
+    mutable CCriticalSection cs;
+    std::map<int64_t, CMasternodeScoreContext> mapContexts;
+
+public:
+    /// Hash of the block scores for nBlockHeight are based on (0 = the tip height)
+    bool GetBlockHash(uint256& hash, int64_t nBlockHeight) const;
+    bool GetScoreContext(CMasternodeScoreContext& context, int64_t nBlockHeight);
+    void Clear();
+};
+
+extern CMasternodeHeightContext masternodeHeights;
 
 bool GetBlockHash(uint256& hash, int nBlockHeight);
 
@@ -64,6 +106,8 @@ public:
     bool CheckAndUpdate(int& nDos, bool fRequireEnabled = true);
     bool Sign(CKey& keyMasternode, CPubKey& pubKeyMasternode);
     void Relay();
+    /// The message covered by vchSig
+    std::string GetStrMessage() const;
 
     uint256 GetHash()
     {
@@ -193,6 +237,9 @@ public:
     }
 
     uint256 CalculateScore(int mod = 1, int64_t nBlockHeight = 0);
+    /// Score against an already looked up block hash
+    uint256 CalculateScore(const uint256& hashBlock) const;
+    uint256 CalculateScore(const CMasternodeScoreContext& context) const;
 
     ADD_SERIALIZE_METHODS;
 
@@ -302,6 +349,8 @@ public:
     bool CheckInputsAndAdd(int& nDos);
     bool Sign(CKey& keyCollateralAddress);
     void Relay();
+    /// The message covered by sig
+    std::string GetStrMessage() const;
 
     ADD_SERIALIZE_METHODS;
 
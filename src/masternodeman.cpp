@@ -25,19 +25,12 @@ struct CompareLastPaid {
     }
 };
 
-struct CompareScoreTxIn {
-    bool operator()(const pair<int64_t, CTxIn>& t1,
-        const pair<int64_t, CTxIn>& t2) const
-    {
-        return t1.first < t2.first;
-    }
-};
-
-struct CompareScoreMN {
-    bool operator()(const pair<int64_t, CMasternode>& t1,
-        const pair<int64_t, CMasternode>& t2) const
+struct CompareScoreIndex {
+    bool operator()(const pair<int64_t, unsigned int>& t1,
+        const pair<int64_t, unsigned int>& t2) const
     {
-        return t1.first < t2.first;
+        // highest score first
+        return t1.first > t2.first;
     }
 };
 
@@ -45,150 +38,77 @@ struct CompareScoreMN {
 // CMasternodeDB
 //
 
-CMasternodeDB::CMasternodeDB()
+CMasternodeDB* pMasternodeDB = NULL;
+
+CMasternodeDB::CMasternodeDB(size_t nCacheSize, bool fWipe) : CCacheDB("mncache", nCacheSize, fWipe)
 {
-    pathMN = GetDataDir() / "mncache.dat";
-    strMagicMessage = "MasternodeCache";
 }
 
 bool CMasternodeDB::Write(const CMasternodeMan& mnodemanToSave)
 {
     int64_t nStart = GetTimeMillis();
 
-    // serialize, checksum data up to that point, then append checksum
-    CDataStream ssMasternodes(SER_DISK, CLIENT_VERSION);
-    ssMasternodes << strMagicMessage;                   // masternode cache file specific magic message
-    ssMasternodes << FLATDATA(Params().MessageStart()); // network specific magic number
-    ssMasternodes << mnodemanToSave;
-    uint256 hash = Hash(ssMasternodes.begin(), ssMasternodes.end());
-    ssMasternodes << hash;
-
-    // open output file, and associate with CAutoFile
-    FILE* file = fopen(pathMN.string().c_str(), "wb");
-    CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
-    if (fileout.IsNull())
-        return error("%s : Failed to open file %s", __func__, pathMN.string());
-
-    // Write and commit header, data
-    try {
-        fileout << ssMasternodes;
-    } catch (std::exception& e) {
-        return error("%s : Serialize or I/O error - %s", __func__, e.what());
+    {
+        LOCK(mnodemanToSave.cs);
+        BOOST_FOREACH (const CMasternode& mn, mnodemanToSave.vMasternodes)
+            WriteRecord('m', mn.vin.prevout, mn);
+        WriteMap('a', mnodemanToSave.mAskedUsForMasternodeList);
+        WriteMap('w', mnodemanToSave.mWeAskedForMasternodeList);
+        WriteMap('e', mnodemanToSave.mWeAskedForMasternodeListEntry);
+        WriteMap('b', mnodemanToSave.mapSeenMasternodeBroadcast);
+        WriteMap('p', mnodemanToSave.mapSeenMasternodePing);
     }
-    //    FileCommit(fileout);
-    fileout.fclose();
 
-    LogPrint("masternode","Written info to mncache.dat  %dms\n", GetTimeMillis() - nStart);
-    LogPrint("masternode","  %s\n", mnodemanToSave.ToString());
+    if (!Commit())
+        return error("%s : Failed to write masternode cache", __func__);
+
+    LogPrint("masternode","Written info to mncache  %dms\n", GetTimeMillis() - nStart);
 
     return true;
 }
 
-CMasternodeDB::ReadResult CMasternodeDB::Read(CMasternodeMan& mnodemanToLoad, bool fDryRun)
+bool CMasternodeDB::Read(CMasternodeMan& mnodemanToLoad)
 {
     int64_t nStart = GetTimeMillis();
-    // open input file, and associate with CAutoFile
-    FILE* file = fopen(pathMN.string().c_str(), "rb");
-    CAutoFile filein(file, SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull()) {
-        error("%s : Failed to open file %s", __func__, pathMN.string());
-        return FileError;
-    }
-
-    // use file size to size memory buffer
-    int fileSize = boost::filesystem::file_size(pathMN);
-    int dataSize = fileSize - sizeof(uint256);
-    // Don't try to resize to a negative number if file is small
-    if (dataSize < 0)
-        dataSize = 0;
-    vector<unsigned char> vchData;
-    vchData.resize(dataSize);
-    uint256 hashIn;
-
-    // read data and checksum from file
-    try {
-        filein.read((char*)&vchData[0], dataSize);
-        filein >> hashIn;
-    } catch (std::exception& e) {
-        error("%s : Deserialize or I/O error - %s", __func__, e.what());
-        return HashReadError;
-    }
-    filein.fclose();
-
-    CDataStream ssMasternodes(vchData, SER_DISK, CLIENT_VERSION);
 
-    // verify stored checksum matches input data
-    uint256 hashTmp = Hash(ssMasternodes.begin(), ssMasternodes.end());
-    if (hashIn != hashTmp) {
-        error("%s : Checksum mismatch, data corrupted", __func__);
-        return IncorrectHash;
-    }
-
-    unsigned char pchMsgTmp[4];
-    std::string strMagicMessageTmp;
-    try {
-        // de-serialize file header (masternode cache file specific magic message) and ..
-
-        ssMasternodes >> strMagicMessageTmp;
-
-        // ... verify the message matches predefined one
-        if (strMagicMessage != strMagicMessageTmp) {
-            error("%s : Invalid masternode cache magic message", __func__);
-            return IncorrectMagicMessage;
-        }
-
-        // de-serialize file header (network specific magic number) and ..
-        ssMasternodes >> FLATDATA(pchMsgTmp);
-
-        // ... verify the network matches ours
-        if (memcmp(pchMsgTmp, Params().MessageStart(), sizeof(pchMsgTmp))) {
-            error("%s : Invalid network magic number", __func__);
-            return IncorrectMagicNumber;
-        }
-        // de-serialize data into CMasternodeMan object
-        ssMasternodes >> mnodemanToLoad;
-    } catch (std::exception& e) {
-        mnodemanToLoad.Clear();
-        error("%s : Deserialize or I/O error - %s", __func__, e.what());
-        return IncorrectFormat;
-    }
-
-    LogPrint("masternode","Loaded info from mncache.dat  %dms\n", GetTimeMillis() - nStart);
+    {
+        LOCK(mnodemanToLoad.cs);
+        std::map<COutPoint, CMasternode> mapMasternodes;
+        if (!ReadMap('m', mapMasternodes) ||
+            !ReadMap('a', mnodemanToLoad.mAskedUsForMasternodeList) ||
+            !ReadMap('w', mnodemanToLoad.mWeAskedForMasternodeList) ||
+            !ReadMap('e', mnodemanToLoad.mWeAskedForMasternodeListEntry) ||
+            !ReadMap('b', mnodemanToLoad.mapSeenMasternodeBroadcast) ||
+            !ReadMap('p', mnodemanToLoad.mapSeenMasternodePing)) {
+            mnodemanToLoad.Clear();
+            Wipe();
+            return false;
+        }
+
+        mnodemanToLoad.vMasternodes.clear();
+        mnodemanToLoad.vMasternodes.reserve(mapMasternodes.size());
+        for (std::map<COutPoint, CMasternode>::iterator it = mapMasternodes.begin(); it != mapMasternodes.end(); ++it)
+            mnodemanToLoad.vMasternodes.push_back(it->second);
+        mnodemanToLoad.mapScoreCache.clear();
+    }
+
+    LogPrint("masternode","Loaded info from mncache  %dms\n", GetTimeMillis() - nStart);
+    LogPrint("masternode","  %s\n", mnodemanToLoad.ToString());
+    LogPrint("masternode","Masternode manager - cleaning....\n");
+    mnodemanToLoad.CheckAndRemove(true);
+    LogPrint("masternode","Masternode manager - result:\n");
     LogPrint("masternode","  %s\n", mnodemanToLoad.ToString());
-    if (!fDryRun) {
-        LogPrint("masternode","Masternode manager - cleaning....\n");
-        mnodemanToLoad.CheckAndRemove(true);
-        LogPrint("masternode","Masternode manager - result:\n");
-        LogPrint("masternode","  %s\n", mnodemanToLoad.ToString());
-    }
 
-    return Ok;
+    return true;
 }
 
 void DumpMasternodes()
 {
-    int64_t nStart = GetTimeMillis();
-
-    CMasternodeDB mndb;
-    CMasternodeMan tempMnodeman;
-
-    LogPrint("masternode","Verifying mncache.dat format...\n");
-    CMasternodeDB::ReadResult readResult = mndb.Read(tempMnodeman, true);
-    // there was an error and it was not an error on file opening => do not proceed
-    if (readResult == CMasternodeDB::FileError)
-        LogPrint("masternode","Missing masternode cache file - mncache.dat, will try to recreate\n");
-    else if (readResult != CMasternodeDB::Ok) {
-        LogPrint("masternode","Error reading mncache.dat: ");
-        if (readResult == CMasternodeDB::IncorrectFormat)
-            LogPrint("masternode","magic is ok but data has invalid format, will try to recreate\n");
-        else {
-            LogPrint("masternode","file format is unknown or invalid, please fix it manually\n");
-            return;
-        }
-    }
-    LogPrint("masternode","Writting info to mncache.dat...\n");
-    mndb.Write(mnodeman);
+    if (pMasternodeDB == NULL)
+        return;
 
+    int64_t nStart = GetTimeMillis();
+    pMasternodeDB->Write(mnodeman);
     LogPrint("masternode","Masternode dump finished  %dms\n", GetTimeMillis() - nStart);
 }
 
@@ -207,6 +127,7 @@ bool CMasternodeMan::Add(CMasternode& mn)
     if (pmn == NULL) {
         LogPrint("masternode", "CMasternodeMan: Adding new Masternode %s - %i now\n", mn.vin.prevout.hash.ToString(), size() + 1);
         vMasternodes.push_back(mn);
+        ScoreCacheAdd(vMasternodes.size() - 1);
         return true;
     }
 
@@ -276,6 +197,7 @@ void CMasternodeMan::CheckAndRemove(bool forceExpiredRemoval)
                 }
             }
 
+            ScoreCacheRemove(it - vMasternodes.begin());
             it = vMasternodes.erase(it);
         } else {
             ++it;
@@ -338,6 +260,7 @@ void CMasternodeMan::Clear()
 {
     LOCK(cs);
     vMasternodes.clear();
+    mapScoreCache.clear();
     mAskedUsForMasternodeList.clear();
     mWeAskedForMasternodeList.clear();
     mWeAskedForMasternodeListEntry.clear();
@@ -517,11 +440,13 @@ CMasternode* CMasternodeMan::GetNextMasternodeInQueueForPayment(int nBlockHeight
     int nTenthNetwork = CountEnabled() / 10;
     int nCountTenth = 0;
     uint256 nHigh = 0;
+    CMasternodeScoreContext context;
+    if (!masternodeHeights.GetScoreContext(context, nBlockHeight - 100)) return NULL;
     BOOST_FOREACH (PAIRTYPE(int64_t, CTxIn) & s, vecMasternodeLastPaid) {
         CMasternode* pmn = Find(s.second);
         if (!pmn) break;
 
-        uint256 n = pmn->CalculateScore(1, nBlockHeight - 100);
+        uint256 n = pmn->CalculateScore(context);
         if (n > nHigh) {
             nHigh = n;
             pBestMasternode = pmn;
@@ -569,13 +494,16 @@ CMasternode* CMasternodeMan::GetCurrentMasterNode(int mod, int64_t nBlockHeight,
     int64_t score = 0;
     CMasternode* winner = NULL;
 
+    CMasternodeScoreContext context;
+    if (!masternodeHeights.GetScoreContext(context, nBlockHeight)) return NULL;
+
     // scan for winner
     BOOST_FOREACH (CMasternode& mn, vMasternodes) {
         mn.Check();
         if (mn.protocolVersion < minProtocol || !mn.IsEnabled()) continue;
 
         // calculate the score for each Masternode
-        uint256 n = mn.CalculateScore(mod, nBlockHeight);
+        uint256 n = mn.CalculateScore(context);
         int64_t n2 = n.GetCompact(false);
 
         // determine the winner
@@ -588,24 +516,86 @@ CMasternode* CMasternodeMan::GetCurrentMasterNode(int mod, int64_t nBlockHeight,
     return winner;
 }
 
+const std::vector<pair<int64_t, unsigned int> >* CMasternodeMan::GetScores(int64_t nBlockHeight)
+{
+    AssertLockHeld(cs);
+
+    //make sure we know about this block
+    CMasternodeScoreContext context;
+    if (!masternodeHeights.GetScoreContext(context, nBlockHeight)) return NULL;
+
+    std::map<int64_t, CMasternodeScores>::iterator it = mapScoreCache.find(nBlockHeight);
+    if (it != mapScoreCache.end() && it->second.context.hashBlock == context.hashBlock)
+        return &it->second.vScores;
+
+    if (it == mapScoreCache.end()) {
+        // make room by dropping the lowest height
+        if (mapScoreCache.size() >= MASTERNODES_RANK_CACHE_HEIGHTS)
+            mapScoreCache.erase(mapScoreCache.begin());
+        it = mapScoreCache.insert(std::make_pair(nBlockHeight, CMasternodeScores())).first;
+    }
+
+    CMasternodeScores& scores = it->second;
+    scores.context = context;
+    scores.vScores.clear();
+    scores.vScores.reserve(vMasternodes.size());
+    for (unsigned int i = 0; i < vMasternodes.size(); i++)
+        scores.vScores.push_back(make_pair(vMasternodes[i].CalculateScore(context).GetCompact(false), i));
+    stable_sort(scores.vScores.begin(), scores.vScores.end(), CompareScoreIndex());
+    return &scores.vScores;
+}
+
+void CMasternodeMan::ScoreCacheAdd(unsigned int nIndex)
+{
+    AssertLockHeld(cs);
+
+    for (std::map<int64_t, CMasternodeScores>::iterator it = mapScoreCache.begin(); it != mapScoreCache.end(); ++it) {
+        std::vector<pair<int64_t, unsigned int> >& vScores = it->second.vScores;
+        pair<int64_t, unsigned int> score = make_pair(vMasternodes[nIndex].CalculateScore(it->second.context).GetCompact(false), nIndex);
+        vScores.insert(upper_bound(vScores.begin(), vScores.end(), score, CompareScoreIndex()), score);
+    }
+}
+
+void CMasternodeMan::ScoreCacheRemove(unsigned int nIndex)
+{
+    AssertLockHeld(cs);
+
+    for (std::map<int64_t, CMasternodeScores>::iterator it = mapScoreCache.begin(); it != mapScoreCache.end(); ++it) {
+        std::vector<pair<int64_t, unsigned int> >& vScores = it->second.vScores;
+        std::vector<pair<int64_t, unsigned int> >::iterator itScore = vScores.begin();
+        while (itScore != vScores.end()) {
+            if (itScore->second == nIndex) {
+                itScore = vScores.erase(itScore);
+                continue;
+            }
+            // entries behind the erased one move down by one
+            if (itScore->second > nIndex)
+                itScore->second--;
+            ++itScore;
+        }
+    }
+}
+
 int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
 {
-    std::vector<pair<int64_t, CTxIn> > vecMasternodeScores;
+    LOCK(cs);
+
     int64_t nMasternode_Min_Age = GetSporkValue(SPORK_14_MN_WINNER_MINIMUM_AGE);
     int64_t nMasternode_Age = 0;
+    bool fCheckAge = IsSporkActive(SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT);
 
-    //make sure we know about this block
-    uint256 hash = 0;
-    if (!GetBlockHash(hash, nBlockHeight)) return -1;
+    const std::vector<pair<int64_t, unsigned int> >* pvScores = GetScores(nBlockHeight);
+    if (!pvScores) return -1;
 
-    // scan for winner
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
+    int rank = 0;
+    BOOST_FOREACH (const PAIRTYPE(int64_t, unsigned int) & s, *pvScores) {
+        CMasternode& mn = vMasternodes[s.second];
         if (mn.protocolVersion < minProtocol) {
             LogPrint("masternode","Skipping Masternode with obsolete version %d\n", mn.protocolVersion);
             continue;                                                       // Skip obsolete versions
         }
 
-        if (IsSporkActive(SPORK_8_MASTERNODE_PAYMENT_ENFORCEMENT)) {
+        if (fCheckAge) {
             nMasternode_Age = GetAdjustedTime() - mn.sigTime;
             if ((nMasternode_Age) < nMasternode_Min_Age) {
                 if (fDebug) LogPrint("masternode","Skipping just activated Masternode. Age: %ld\n", nMasternode_Age);
@@ -616,18 +606,9 @@ int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, in
             mn.Check();
             if (!mn.IsEnabled()) continue;
         }
-        uint256 n = mn.CalculateScore(1, nBlockHeight);
-        int64_t n2 = n.GetCompact(false);
 
-        vecMasternodeScores.push_back(make_pair(n2, mn.vin));
-    }
-
-    sort(vecMasternodeScores.rbegin(), vecMasternodeScores.rend(), CompareScoreTxIn());
-
-    int rank = 0;
-    BOOST_FOREACH (PAIRTYPE(int64_t, CTxIn) & s, vecMasternodeScores) {
         rank++;
-        if (s.second.prevout == vin.prevout) {
+        if (mn.vin.prevout == vin.prevout) {
             return rank;
         }
     }
@@ -637,36 +618,33 @@ int CMasternodeMan::GetMasternodeRank(const CTxIn& vin, int64_t nBlockHeight, in
 
 std::vector<pair<int, CMasternode> > CMasternodeMan::GetMasternodeRanks(int64_t nBlockHeight, int minProtocol)
 {
-    std::vector<pair<int64_t, CMasternode> > vecMasternodeScores;
+    LOCK(cs);
+
     std::vector<pair<int, CMasternode> > vecMasternodeRanks;
 
-    //make sure we know about this block
-    uint256 hash = 0;
-    if (!GetBlockHash(hash, nBlockHeight)) return vecMasternodeRanks;
+    const std::vector<pair<int64_t, unsigned int> >* pvScores = GetScores(nBlockHeight);
+    if (!pvScores) return vecMasternodeRanks;
 
-    // scan for winner
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
+    // enabled Masternodes in score order, then the disabled ones
+    std::vector<unsigned int> vDisabled;
+    int rank = 0;
+    BOOST_FOREACH (const PAIRTYPE(int64_t, unsigned int) & s, *pvScores) {
+        CMasternode& mn = vMasternodes[s.second];
         mn.Check();
 
         if (mn.protocolVersion < minProtocol) continue;
 
         if (!mn.IsEnabled()) {
-            vecMasternodeScores.push_back(make_pair(9999, mn));
+            vDisabled.push_back(s.second);
             continue;
         }
 
-        uint256 n = mn.CalculateScore(1, nBlockHeight);
-        int64_t n2 = n.GetCompact(false);
-
-        vecMasternodeScores.push_back(make_pair(n2, mn));
+        rank++;
+        vecMasternodeRanks.push_back(make_pair(rank, mn));
     }
-
-    sort(vecMasternodeScores.rbegin(), vecMasternodeScores.rend(), CompareScoreMN());
-
-    int rank = 0;
-    BOOST_FOREACH (PAIRTYPE(int64_t, CMasternode) & s, vecMasternodeScores) {
+    BOOST_FOREACH (unsigned int i, vDisabled) {
         rank++;
-        vecMasternodeRanks.push_back(make_pair(rank, s.second));
+        vecMasternodeRanks.push_back(make_pair(rank, vMasternodes[i]));
     }
 
     return vecMasternodeRanks;
@@ -674,29 +652,23 @@ std::vector<pair<int, CMasternode> > CMasternodeMan::GetMasternodeRanks(int64_t
 
 CMasternode* CMasternodeMan::GetMasternodeByRank(int nRank, int64_t nBlockHeight, int minProtocol, bool fOnlyActive)
 {
-    std::vector<pair<int64_t, CTxIn> > vecMasternodeScores;
+    LOCK(cs);
 
-    // scan for winner
-    BOOST_FOREACH (CMasternode& mn, vMasternodes) {
+    const std::vector<pair<int64_t, unsigned int> >* pvScores = GetScores(nBlockHeight);
+    if (!pvScores) return NULL;
+
+    int rank = 0;
+    BOOST_FOREACH (const PAIRTYPE(int64_t, unsigned int) & s, *pvScores) {
+        CMasternode& mn = vMasternodes[s.second];
         if (mn.protocolVersion < minProtocol) continue;
         if (fOnlyActive) {
             mn.Check();
             if (!mn.IsEnabled()) continue;
         }
 
-        uint256 n = mn.CalculateScore(1, nBlockHeight);
-        int64_t n2 = n.GetCompact(false);
-
-        vecMasternodeScores.push_back(make_pair(n2, mn.vin));
-    }
-
-    sort(vecMasternodeScores.rbegin(), vecMasternodeScores.rend(), CompareScoreTxIn());
-
-    int rank = 0;
-    BOOST_FOREACH (PAIRTYPE(int64_t, CTxIn) & s, vecMasternodeScores) {
         rank++;
         if (rank == nRank) {
-            return Find(s.second);
+            return &mn;
         }
     }
 
@@ -854,6 +826,7 @@ void CMasternodeMan::Remove(CTxIn vin)
     while (it != vMasternodes.end()) {
         if ((*it).vin == vin) {
             LogPrint("masternode", "CMasternodeMan: Removing Masternode %s - %i now\n", (*it).vin.prevout.hash.ToString(), size() - 1);
+            ScoreCacheRemove(it - vMasternodes.begin());
             vMasternodes.erase(it);
             break;
         }
@@ -7,6 +7,7 @@
 #define MASTERNODEMAN_H
 
 #include "base58.h"
+#include "cachedb.h"
 #include "key.h"
 #include "main.h"
 #include "masternode.h"
@@ -16,6 +17,7 @@
 
 #define MASTERNODES_DUMP_SECONDS (15 * 60)
 #define MASTERNODES_DSEG_SECONDS (3 * 60 * 60)
+#define MASTERNODES_RANK_CACHE_HEIGHTS 32
 
 using namespace std;
 
@@ -24,33 +26,23 @@ class CMasternodeMan;
 extern CMasternodeMan mnodeman;
 void DumpMasternodes();
 
-/** Access to the MN database (mncache.dat)
+/** Access to the MN database (mncache)
  */
-class CMasternodeDB
+class CMasternodeDB : public CCacheDB
 {
-private:
-    boost::filesystem::path pathMN;
-    std::string strMagicMessage;
-
 public:
-    enum ReadResult {
-        Ok,
-        FileError,
-        HashReadError,
-        IncorrectHash,
-        IncorrectMagicMessage,
-        IncorrectMagicNumber,
-        IncorrectFormat
-    };
-
-    CMasternodeDB();
+    CMasternodeDB(size_t nCacheSize, bool fWipe = false);
     bool Write(const CMasternodeMan& mnodemanToSave);
-    ReadResult Read(CMasternodeMan& mnodemanToLoad, bool fDryRun = false);
+    bool Read(CMasternodeMan& mnodemanToLoad);
 };
 
+extern CMasternodeDB* pMasternodeDB;
+
 class CMasternodeMan
 {
 private:
+    friend class CMasternodeDB;
+
     // critical section to protect the inner data structures
     mutable CCriticalSection cs;
 
@@ -66,6 +58,21 @@ private:
     // which Masternodes we've asked for
     std::map<COutPoint, int64_t> mWeAskedForMasternodeListEntry;
 
+    /// Scores of all MNs against one block, highest first, as (score, index into vMasternodes)
+    struct CMasternodeScores {
+        CMasternodeScoreContext context;
+        std::vector<pair<int64_t, unsigned int> > vScores;
+    };
+    // score caches by block height, kept in step with vMasternodes
+    std::map<int64_t, CMasternodeScores> mapScoreCache;
+
+    /// Get the cached scores for a height, computing them once per block hash
+    const std::vector<pair<int64_t, unsigned int> >* GetScores(int64_t nBlockHeight);
+    /// Score a newly appended entry into every cached height
+    void ScoreCacheAdd(unsigned int nIndex);
+    /// Drop an entry about to be erased from vMasternodes
+    void ScoreCacheRemove(unsigned int nIndex);
+
 public:
     // Keep track of all broadcasts I've seen
     map<uint256, CMasternodeBroadcast> mapSeenMasternodeBroadcast;
@@ -78,6 +85,8 @@ public:
     inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
     {
         LOCK(cs);
+        if (ser_action.ForRead())
+            mapScoreCache.clear();
         READWRITE(vMasternodes);
         READWRITE(mAskedUsForMasternodeList);
         READWRITE(mWeAskedForMasternodeList);
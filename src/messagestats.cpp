@@ -0,0 +1,139 @@
+// Copyright (c) 2018 The KoinMudra developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "messagestats.h"
+
+#include "protocol.h"
+#include "util.h"
+#include "utilstrencodings.h"
+#include "utiltime.h"
+
+#include <algorithm>
+#include <vector>
+
+#include <time.h>
+
+CMessageStats messageStats;
+
+/** Command under which messages of unknown types are counted */
+static const std::string MESSAGE_STATS_OTHER_COMMAND = "*other*";
+
+/** CPU time consumed by the calling thread, in microseconds, or 0 if unavailable. */
+static int64_t GetThreadCPUTimeMicros()
+{
+#ifdef CLOCK_THREAD_CPUTIME_ID
+    struct timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0)
+        return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+    return 0;
+}
+
+CMessageTypeStats::CMessageTypeStats()
+    : nCount(0), nBytes(0), nTimeMicros(0), nCPUMicros(0), nLockWaitMicros(0), nQueueMicros(0), nMaxTimeMicros(0)
+{
+    for (unsigned int n = 0; n < MESSAGE_LATENCY_BUCKETS; n++)
+        vLatency[n] = 0;
+}
+
+int64_t CMessageTypeStats::GetBucketLimit(unsigned int n)
+{
+    if (n + 1 >= MESSAGE_LATENCY_BUCKETS)
+        return -1;
+    int64_t nLimit = 10;
+    while (n-- > 0)
+        nLimit *= 10;
+    return nLimit;
+}
+
+void CMessageTypeStats::Add(unsigned int nBytesIn, int64_t nTime, int64_t nCPU, int64_t nLockWait, int64_t nQueue)
+{
+    nCount++;
+    nBytes += nBytesIn;
+    nTimeMicros += nTime;
+    nCPUMicros += nCPU;
+    nLockWaitMicros += nLockWait;
+    nQueueMicros += nQueue;
+    nMaxTimeMicros = std::max(nMaxTimeMicros, nTime);
+
+    unsigned int nBucket = 0;
+    for (int64_t nLimit = 10; nBucket + 1 < MESSAGE_LATENCY_BUCKETS && nTime >= nLimit; nLimit *= 10)
+        nBucket++;
+    vLatency[nBucket]++;
+}
+
+CMessageStats::CMessageStats() : nStartTime(GetTime())
+{
+}
+
+void CMessageStats::Record(const std::string& strCommand, unsigned int nBytes, int64_t nTime, int64_t nCPU, int64_t nLockWait, int64_t nQueue)
+{
+    // Commands are chosen by the peer; don't let them grow the map
+    const std::string& strKey = IsKnownCommand(strCommand) ? strCommand : MESSAGE_STATS_OTHER_COMMAND;
+    LOCK(cs);
+    mapStats[strKey].Add(nBytes, nTime, nCPU, nLockWait, nQueue);
+}
+
+void CMessageStats::GetStats(std::map<std::string, CMessageTypeStats>& mapStatsOut, int64_t& nSince) const
+{
+    LOCK(cs);
+    mapStatsOut = mapStats;
+    nSince = nStartTime;
+}
+
+void CMessageStats::GetStatsAndReset(std::map<std::string, CMessageTypeStats>& mapStatsOut, int64_t& nSince)
+{
+    LOCK(cs);
+    mapStatsOut.clear();
+    mapStatsOut.swap(mapStats);
+    nSince = nStartTime;
+    nStartTime = GetTime();
+}
+
+void CMessageStats::Reset()
+{
+    LOCK(cs);
+    mapStats.clear();
+    nStartTime = GetTime();
+}
+
+static bool CompareTimeDescending(const std::pair<std::string, CMessageTypeStats>& a, const std::pair<std::string, CMessageTypeStats>& b)
+{
+    return a.second.nTimeMicros > b.second.nTimeMicros;
+}
+
+void CMessageStats::LogStats() const
+{
+    std::vector<std::pair<std::string, CMessageTypeStats> > vStats;
+    int64_t nSince;
+    {
+        LOCK(cs);
+        vStats.assign(mapStats.begin(), mapStats.end());
+        nSince = nStartTime;
+    }
+    std::sort(vStats.begin(), vStats.end(), CompareTimeDescending);
+
+    LogPrintf("Message statistics over the last %d seconds:\n", GetTime() - nSince);
+    for (std::vector<std::pair<std::string, CMessageTypeStats> >::const_iterator it = vStats.begin(); it != vStats.end(); it++) {
+        const CMessageTypeStats& stats = it->second;
+        LogPrintf("  %-12s count=%d bytes=%d time=%.3fms cpu=%.3fms cs_main wait=%.3fms queue=%.3fms avg=%.3fms max=%.3fms\n",
+            SanitizeString(it->first), stats.nCount, stats.nBytes, stats.nTimeMicros * 0.001, stats.nCPUMicros * 0.001,
+            stats.nLockWaitMicros * 0.001, stats.nQueueMicros * 0.001, stats.nTimeMicros * 0.001 / stats.nCount, stats.nMaxTimeMicros * 0.001);
+    }
+}
+
+CMessageTimer::CMessageTimer(const std::string& strCommandIn, unsigned int nBytesIn, int64_t nReceived, void* csWait)
+    : strCommand(strCommandIn), nBytes(nBytesIn), lockWait(csWait)
+{
+    nStart = GetTimeMicros();
+    nStartCPU = GetThreadCPUTimeMicros();
+    nQueue = std::max(nStart - nReceived, (int64_t)0);
+}
+
+CMessageTimer::~CMessageTimer()
+{
+    int64_t nTime = GetTimeMicros() - nStart;
+    int64_t nCPU = GetThreadCPUTimeMicros() - nStartCPU;
+    messageStats.Record(strCommand, nBytes, nTime, nCPU, lockWait.nWaitMicros, nQueue);
+}
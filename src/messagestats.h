@@ -0,0 +1,86 @@
+// Copyright (c) 2018 The KoinMudra developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_MESSAGESTATS_H
+#define BITCOIN_MESSAGESTATS_H
+
+#include "sync.h"
+
+#include <map>
+#include <stdint.h>
+#include <string>
+
+/** Number of buckets in the per-message latency histograms */
+static const unsigned int MESSAGE_LATENCY_BUCKETS = 8;
+/** Default for -messagestatsinterval: seconds between message statistics log dumps, 0 = never */
+static const int DEFAULT_MESSAGESTATS_INTERVAL = 0;
+
+/** Accumulated processing cost of one P2P message type */
+struct CMessageTypeStats {
+    uint64_t nCount;
+    uint64_t nBytes;
+    int64_t nTimeMicros;     //! wall clock time spent in ProcessMessage
+    int64_t nCPUMicros;      //! CPU time of the processing thread, where the platform reports it
+    int64_t nLockWaitMicros; //! part of nTimeMicros spent blocked on cs_main
+    int64_t nQueueMicros;    //! time between receiving a message and starting to process it
+    int64_t nMaxTimeMicros;
+    uint64_t vLatency[MESSAGE_LATENCY_BUCKETS]; //! processing times: <10us, <100us, ... <10s, >=10s
+
+    CMessageTypeStats();
+
+    void Add(unsigned int nBytesIn, int64_t nTime, int64_t nCPU, int64_t nLockWait, int64_t nQueue);
+
+    /** Upper bound in microseconds of histogram bucket n, or -1 for the last, open ended one. */
+    static int64_t GetBucketLimit(unsigned int n);
+};
+
+/** Per-message-type processing statistics, shared by all message handler threads */
+class CMessageStats
+{
+private:
+    mutable CCriticalSection cs;
+    std::map<std::string, CMessageTypeStats> mapStats;
+    int64_t nStartTime;
+
+public:
+    CMessageStats();
+
+    /** Commands the node doesn't know are counted together under "*other*". */
+    void Record(const std::string& strCommand, unsigned int nBytes, int64_t nTime, int64_t nCPU, int64_t nLockWait, int64_t nQueue);
+
+    /** Copy the statistics, and the time they have been collected since. */
+    void GetStats(std::map<std::string, CMessageTypeStats>& mapStatsOut, int64_t& nSince) const;
+
+    /** GetStats() and Reset() in one step, so no message recorded in between is lost. */
+    void GetStatsAndReset(std::map<std::string, CMessageTypeStats>& mapStatsOut, int64_t& nSince);
+
+    void Reset();
+
+    /** Write a summary line per message type to the debug log, most expensive first. */
+    void LogStats() const;
+};
+
+extern CMessageStats messageStats;
+
+/**
+ * Measures the processing of one message on the calling thread, from
+ * construction to destruction, and records it in messageStats.
+ */
+class CMessageTimer
+{
+private:
+    std::string strCommand;
+    unsigned int nBytes;
+    int64_t nQueue;
+    int64_t nStart;
+    int64_t nStartCPU;
+    CLockWaitCounter lockWait;
+
+public:
+    /** csWait is the lock whose contention is accounted, nReceived the time the message arrived */
+    CMessageTimer(const std::string& strCommandIn, unsigned int nBytesIn, int64_t nReceived, void* csWait);
+    ~CMessageTimer();
+};
+
+#endif // BITCOIN_MESSAGESTATS_H
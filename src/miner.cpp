@@ -35,53 +35,277 @@ using namespace std;
 // KoinmudraMiner
 //
 
-//
-// Unconfirmed transactions in the memory pool often depend on other
-// transactions in the memory pool. When we select transactions from the
-// pool, we select by highest priority or fee rate, so we might consider
-// transactions that depend on transactions that aren't yet in the block.
-// The COrphan class keeps track of these 'temporary orphans' while
-// CreateBlock is figuring out which transactions to include.
-//
-class COrphan
-{
-public:
-    const CTransaction* ptx;
-    set<uint256> setDependsOn;
-    CFeeRate feeRate;
-    double dPriority;
+uint64_t nLastBlockTx = 0;
+uint64_t nLastBlockSize = 0;
+int64_t nLastCoinStakeSearchInterval = 0;
+
+/** Packages tried in a row without success before a nearly full block is given up on */
+static const int MAX_CONSECUTIVE_FAILURES = 1000;
+
+/** Fee and size of a transaction package, for ordering candidates by fee rate */
+struct CPackageScore {
+    uint256 hash;
+    CAmount nFees;
+    uint64_t nSize;
+};
 
-    COrphan(const CTransaction* ptxIn) : ptx(ptxIn), feeRate(0), dPriority(0)
+struct ComparePackageScore {
+    bool operator()(const CPackageScore& a, const CPackageScore& b) const
     {
+        double f1 = (double)a.nFees * b.nSize;
+        double f2 = (double)b.nFees * a.nSize;
+        if (f1 == f2)
+            return a.hash < b.hash;
+        return f1 > f2;
     }
 };
 
-uint64_t nLastBlockTx = 0;
-uint64_t nLastBlockSize = 0;
-int64_t nLastCoinStakeSearchInterval = 0;
+struct CompareEntryByAncestorCount {
+    bool operator()(const CTxMemPoolEntry* a, const CTxMemPoolEntry* b) const
+    {
+        return a->GetCountWithAncestors() < b->GetCountWithAncestors();
+    }
+};
 
-// We want to sort transactions by priority and fee rate, so:
-typedef boost::tuple<double, CFeeRate, const CTransaction*> TxPriority;
-class TxPriorityCompare
+CBlockAssembler::CBlockAssembler(CBlockTemplate& blocktemplateIn, CCoinsViewCache& viewIn, int nHeightIn)
+    : blocktemplate(blocktemplateIn), view(viewIn), nHeight(nHeightIn), nBlockSize(1000), nBlockTx(0), nBlockSigOps(100), nFees(0)
 {
-    bool byFee;
+    // Largest block you're willing to create:
+    nBlockMaxSize = GetArg("-blockmaxsize", DEFAULT_BLOCK_MAX_SIZE);
+    // Limit to betweeen 1K and MAX_BLOCK_SIZE-1K for sanity:
+    nBlockMaxSize = std::max((unsigned int)1000, std::min((unsigned int)(MAX_BLOCK_SIZE - 1000), nBlockMaxSize));
 
-public:
-    TxPriorityCompare(bool _byFee) : byFee(_byFee) {}
+    // How much of the block should be dedicated to high-priority transactions,
+    // included regardless of the fees they pay
+    nBlockPrioritySize = GetArg("-blockprioritysize", DEFAULT_BLOCK_PRIORITY_SIZE);
+    nBlockPrioritySize = std::min(nBlockMaxSize, nBlockPrioritySize);
 
-    bool operator()(const TxPriority& a, const TxPriority& b)
-    {
-        if (byFee) {
-            if (a.get<1>() == b.get<1>())
-                return a.get<0>() < b.get<0>();
-            return a.get<1>() < b.get<1>();
+    // Minimum block size you want to create; block will be filled with free transactions
+    // until there are no more or the block reaches this size:
+    nBlockMinSize = GetArg("-blockminsize", DEFAULT_BLOCK_MIN_SIZE);
+    nBlockMinSize = std::min(nBlockMaxSize, nBlockMinSize);
+
+    fPrintPriority = GetBoolArg("-printpriority", false);
+}
+
+bool CBlockAssembler::TestTransaction(const CTransaction& tx, CCoinsViewCache& viewCheck, CAmount& nTxFees, unsigned int& nTxSigOps) const
+{
+    if (tx.IsCoinBase() || tx.IsCoinStake() || !IsFinalTx(tx, nHeight))
+        return false;
+
+    if (!viewCheck.HaveInputs(tx))
+        return false;
+
+    nTxFees = viewCheck.GetValueIn(tx) - tx.GetValueOut();
+    nTxSigOps = GetLegacySigOpCount(tx) + GetP2SHSigOpCount(tx, viewCheck);
+
+    // Note that flags: we don't want to set mempool/IsStandard()
+    // policy here, but we still have to ensure that the block we
+    // create only contains transactions that are valid in new blocks.
+    CValidationState state;
+    if (!CheckInputs(tx, state, viewCheck, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true))
+        return false;
+
+    CTxUndo txundo;
+    UpdateCoins(tx, state, viewCheck, txundo, nHeight);
+    return true;
+}
+
+void CBlockAssembler::AddToBlock(const CTxMemPoolEntry& entry, CAmount nTxFees, unsigned int nTxSigOps)
+{
+    blocktemplate.block.vtx.push_back(entry.GetTx());
+    blocktemplate.vTxFees.push_back(nTxFees);
+    blocktemplate.vTxSigOps.push_back(nTxSigOps);
+    nBlockSize += entry.GetTxSize();
+    ++nBlockTx;
+    nBlockSigOps += nTxSigOps;
+    nFees += nTxFees;
+    setInBlock.insert(entry.GetTx().GetHash());
+}
+
+void CBlockAssembler::AddPriorityTxs()
+{
+    if (nBlockPrioritySize <= nBlockSize)
+        return;
+
+    // Priority keeps growing with the age of the inputs, so it can't be indexed;
+    // it is cheap to work out from the entries though, without looking up coins
+    std::vector<std::pair<double, const CTxMemPoolEntry*> > vecPriority;
+    for (std::map<uint256, CTxMemPoolEntry>::const_iterator mi = mempool.mapTx.begin(); mi != mempool.mapTx.end(); ++mi) {
+        double dPriority = mi->second.GetPriority(nHeight);
+        CAmount nFeeDelta = 0;
+        mempool.ApplyDeltas(mi->first, dPriority, nFeeDelta);
+        if (AllowFree(dPriority))
+            vecPriority.push_back(std::make_pair(dPriority, &mi->second));
+    }
+    std::make_heap(vecPriority.begin(), vecPriority.end());
+
+    while (!vecPriority.empty()) {
+        double dPriority = vecPriority.front().first;
+        const CTxMemPoolEntry& entry = *vecPriority.front().second;
+        std::pop_heap(vecPriority.begin(), vecPriority.end());
+        vecPriority.pop_back();
+
+        if (nBlockSize + entry.GetTxSize() >= nBlockPrioritySize)
+            break;
+
+        // Transactions with unconfirmed parents are left to the package selection
+        const uint256& hash = entry.GetTx().GetHash();
+        if (entry.GetCountWithAncestors() > 1) {
+            std::set<uint256> setAncestors;
+            mempool.CalculateAncestors(hash, setAncestors);
+            bool fMissingParent = false;
+            BOOST_FOREACH (const uint256& hashAncestor, setAncestors)
+                fMissingParent |= !setInBlock.count(hashAncestor);
+            if (fMissingParent)
+                continue;
+        }
+
+        CCoinsViewCache viewTx(&view);
+        CAmount nTxFees;
+        unsigned int nTxSigOps;
+        if (!TestTransaction(entry.GetTx(), viewTx, nTxFees, nTxSigOps) || nBlockSigOps + nTxSigOps >= MAX_BLOCK_SIGOPS)
+            continue;
+        viewTx.Flush();
+        AddToBlock(entry, nTxFees, nTxSigOps);
+
+        if (fPrintPriority)
+            LogPrintf("priority %.1f fee %s txid %s\n", dPriority, CFeeRate(nTxFees, entry.GetTxSize()).ToString(), hash.ToString());
+    }
+}
+
+void CBlockAssembler::AddPackageTxs()
+{
+    // Descendants of transactions in the block, with their packages shrunk to what is left out
+    std::map<uint256, CPackageScore> mapModified;
+    std::set<CPackageScore, ComparePackageScore> setModified;
+    std::set<uint256> setFailed;
+
+    // Transactions included by the priority pass leave modified packages behind as well
+    BOOST_FOREACH (const uint256& hashInBlock, setInBlock) {
+        std::set<uint256> setDescendants;
+        mempool.CalculateDescendants(hashInBlock, setDescendants);
+        const CTxMemPoolEntry& entryInBlock = mempool.mapTx.find(hashInBlock)->second;
+        BOOST_FOREACH (const uint256& hashDescendant, setDescendants) {
+            if (setInBlock.count(hashDescendant))
+                continue;
+            std::map<uint256, CPackageScore>::iterator it = mapModified.find(hashDescendant);
+            if (it == mapModified.end()) {
+                const CTxMemPoolEntry& entry = mempool.mapTx.find(hashDescendant)->second;
+                CPackageScore score = {hashDescendant, entry.GetModFeesWithAncestors(), entry.GetSizeWithAncestors()};
+                it = mapModified.insert(std::make_pair(hashDescendant, score)).first;
+            }
+            it->second.nFees -= entryInBlock.GetModifiedFee();
+            it->second.nSize -= entryInBlock.GetTxSize();
+        }
+    }
+    for (std::map<uint256, CPackageScore>::const_iterator it = mapModified.begin(); it != mapModified.end(); ++it)
+        setModified.insert(it->second);
+
+    CTxMemPool::setEntriesByAncestorFee::const_iterator mi = mempool.setTxByAncestorFee.begin();
+    int nConsecutiveFailed = 0;
+    while (mi != mempool.setTxByAncestorFee.end() || !setModified.empty()) {
+        if (mi != mempool.setTxByAncestorFee.end()) {
+            const uint256& hashIndexed = (*mi)->GetTx().GetHash();
+            if (setInBlock.count(hashIndexed) || setFailed.count(hashIndexed) || mapModified.count(hashIndexed)) {
+                ++mi;
+                continue;
+            }
+        }
+
+        // Take the better of the next indexed entry and the best modified package
+        CPackageScore candidate;
+        if (mi != mempool.setTxByAncestorFee.end()) {
+            candidate.hash = (*mi)->GetTx().GetHash();
+            CompareTxMemPoolEntryByAncestorFee::GetScore(**mi, candidate.nFees, candidate.nSize);
+        }
+        if (mi == mempool.setTxByAncestorFee.end() || (!setModified.empty() && ComparePackageScore()(*setModified.begin(), candidate))) {
+            candidate = *setModified.begin();
+            setModified.erase(setModified.begin());
+            mapModified.erase(candidate.hash);
         } else {
-            if (a.get<0>() == b.get<0>())
-                return a.get<1>() < b.get<1>();
-            return a.get<0>() < b.get<0>();
+            ++mi;
+        }
+
+        // The rest only pays less; stop once past the minimum size
+        if (CFeeRate(candidate.nFees, candidate.nSize) < ::minRelayTxFee && nBlockSize >= nBlockMinSize)
+            break;
+
+        // The candidate goes in with its ancestors that are not in the block yet, parents first
+        const CTxMemPoolEntry& entry = mempool.mapTx.find(candidate.hash)->second;
+        std::set<uint256> setAncestors;
+        mempool.CalculateAncestors(candidate.hash, setAncestors);
+        std::vector<const CTxMemPoolEntry*> vPackage;
+        uint64_t nPackageSize = entry.GetTxSize();
+        bool fOk = true;
+        BOOST_FOREACH (const uint256& hashAncestor, setAncestors) {
+            if (setInBlock.count(hashAncestor))
+                continue;
+            fOk &= !setFailed.count(hashAncestor);
+            const CTxMemPoolEntry& ancestor = mempool.mapTx.find(hashAncestor)->second;
+            vPackage.push_back(&ancestor);
+            nPackageSize += ancestor.GetTxSize();
+        }
+        vPackage.push_back(&entry);
+        std::sort(vPackage.begin(), vPackage.end(), CompareEntryByAncestorCount());
+
+        if (nBlockSize + nPackageSize >= nBlockMaxSize)
+            fOk = false;
+
+        CCoinsViewCache viewPackage(&view);
+        std::vector<CAmount> vTxFees(vPackage.size());
+        std::vector<unsigned int> vTxSigOps(vPackage.size());
+        unsigned int nPackageSigOps = 0;
+        for (unsigned int i = 0; fOk && i < vPackage.size(); i++) {
+            fOk = TestTransaction(vPackage[i]->GetTx(), viewPackage, vTxFees[i], vTxSigOps[i]);
+            nPackageSigOps += vTxSigOps[i];
+        }
+        if (fOk && nBlockSigOps + nPackageSigOps >= MAX_BLOCK_SIGOPS)
+            fOk = false;
+
+        if (!fOk) {
+            setFailed.insert(candidate.hash);
+            if (++nConsecutiveFailed > MAX_CONSECUTIVE_FAILURES && nBlockSize > nBlockMaxSize - 4000)
+                break;
+            continue;
+        }
+        nConsecutiveFailed = 0;
+
+        viewPackage.Flush();
+        for (unsigned int i = 0; i < vPackage.size(); i++) {
+            const CTxMemPoolEntry& entryAdded = *vPackage[i];
+            const uint256& hashAdded = entryAdded.GetTx().GetHash();
+            AddToBlock(entryAdded, vTxFees[i], vTxSigOps[i]);
+
+            if (fPrintPriority)
+                LogPrintf("fee %s txid %s\n", CFeeRate(vTxFees[i], entryAdded.GetTxSize()).ToString(), hashAdded.ToString());
+
+            // Descendants now carry one ancestor less in their packages
+            std::map<uint256, CPackageScore>::iterator itAdded = mapModified.find(hashAdded);
+            if (itAdded != mapModified.end()) {
+                setModified.erase(itAdded->second);
+                mapModified.erase(itAdded);
+            }
+            std::set<uint256> setDescendants;
+            mempool.CalculateDescendants(hashAdded, setDescendants);
+            BOOST_FOREACH (const uint256& hashDescendant, setDescendants) {
+                if (setInBlock.count(hashDescendant) || setFailed.count(hashDescendant))
+                    continue;
+                std::map<uint256, CPackageScore>::iterator it = mapModified.find(hashDescendant);
+                if (it == mapModified.end()) {
+                    const CTxMemPoolEntry& entryDescendant = mempool.mapTx.find(hashDescendant)->second;
+                    CPackageScore score = {hashDescendant, entryDescendant.GetModFeesWithAncestors(), entryDescendant.GetSizeWithAncestors()};
+                    it = mapModified.insert(std::make_pair(hashDescendant, score)).first;
+                } else {
+                    setModified.erase(it->second);
+                }
+                it->second.nFees -= entryAdded.GetModifiedFee();
+                it->second.nSize -= entryAdded.GetTxSize();
+                setModified.insert(it->second);
+            }
         }
     }
-};
+}
 
 void UpdateTime(CBlockHeader* pblock, const CBlockIndex* pindexPrev)
 {
@@ -150,21 +374,6 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet,
             return NULL;
     }
 
-    // Largest block you're willing to create:
-    unsigned int nBlockMaxSize = GetArg("-blockmaxsize", DEFAULT_BLOCK_MAX_SIZE);
-    // Limit to betweeen 1K and MAX_BLOCK_SIZE-1K for sanity:
-    nBlockMaxSize = std::max((unsigned int)1000, std::min((unsigned int)(MAX_BLOCK_SIZE - 1000), nBlockMaxSize));
-
-    // How much of the block should be dedicated to high-priority transactions,
-    // included regardless of the fees they pay
-    unsigned int nBlockPrioritySize = GetArg("-blockprioritysize", DEFAULT_BLOCK_PRIORITY_SIZE);
-    nBlockPrioritySize = std::min(nBlockMaxSize, nBlockPrioritySize);
-
-    // Minimum block size you want to create; block will be filled with free transactions
-    // until there are no more or the block reaches this size:
-    unsigned int nBlockMinSize = GetArg("-blockminsize", DEFAULT_BLOCK_MIN_SIZE);
-    nBlockMinSize = std::min(nBlockMaxSize, nBlockMinSize);
-
     // Collect memory pool transactions into the block
     CAmount nFees = 0;
 
@@ -175,175 +384,14 @@ CBlockTemplate* CreateNewBlock(const CScript& scriptPubKeyIn, CWallet* pwallet,
         const int nHeight = pindexPrev->nHeight + 1;
         CCoinsViewCache view(pcoinsTip);
 
-        // Priority order to process transactions
-        list<COrphan> vOrphan; // list memory doesn't move
-        map<uint256, vector<COrphan*> > mapDependers;
-        bool fPrintPriority = GetBoolArg("-printpriority", false);
-
-        // This vector will be sorted into a priority queue:
-        vector<TxPriority> vecPriority;
-        vecPriority.reserve(mempool.mapTx.size());
-        for (map<uint256, CTxMemPoolEntry>::iterator mi = mempool.mapTx.begin();
-             mi != mempool.mapTx.end(); ++mi) {
-            const CTransaction& tx = mi->second.GetTx();
-            if (tx.IsCoinBase() || tx.IsCoinStake() || !IsFinalTx(tx, nHeight))
-                continue;
-
-            COrphan* porphan = NULL;
-            double dPriority = 0;
-            CAmount nTotalIn = 0;
-            bool fMissingInputs = false;
-            for (const CTxIn& txin : tx.vin) {
-                // Read prev transaction
-                if (!view.HaveCoins(txin.prevout.hash)) {
-                    // This should never happen; all transactions in the memory
-                    // pool should connect to either transactions in the chain
-                    // or other transactions in the memory pool.
-                    if (!mempool.mapTx.count(txin.prevout.hash)) {
-                        LogPrintf("ERROR: mempool transaction missing input\n");
-                        if (fDebug) assert("mempool transaction missing input" == 0);
-                        fMissingInputs = true;
-                        if (porphan)
-                            vOrphan.pop_back();
-                        break;
-                    }
-
-                    // Has to wait for dependencies
-                    if (!porphan) {
-                        // Use list for automatic deletion
-                        vOrphan.push_back(COrphan(&tx));
-                        porphan = &vOrphan.back();
-                    }
-                    mapDependers[txin.prevout.hash].push_back(porphan);
-                    porphan->setDependsOn.insert(txin.prevout.hash);
-                    nTotalIn += mempool.mapTx[txin.prevout.hash].GetTx().vout[txin.prevout.n].nValue;
-                    continue;
-                }
-                const CCoins* coins = view.AccessCoins(txin.prevout.hash);
-                assert(coins);
-
-                CAmount nValueIn = coins->vout[txin.prevout.n].nValue;
-                nTotalIn += nValueIn;
+        // High priority transactions first, then packages by ancestor fee rate
+        CBlockAssembler assembler(*pblocktemplate, view, nHeight);
+        assembler.AddPriorityTxs();
+        assembler.AddPackageTxs();
 
-                int nConf = nHeight - coins->nHeight;
-
-                dPriority += (double)nValueIn * nConf;
-            }
-            if (fMissingInputs) continue;
-
-            // Priority is sum(valuein * age) / modified_txsize
-            unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
-            dPriority = tx.ComputePriority(dPriority, nTxSize);
-
-            uint256 hash = tx.GetHash();
-            mempool.ApplyDeltas(hash, dPriority, nTotalIn);
-
-            CFeeRate feeRate(nTotalIn - tx.GetValueOut(), nTxSize);
-
-            if (porphan) {
-                porphan->dPriority = dPriority;
-                porphan->feeRate = feeRate;
-            } else
-                vecPriority.push_back(TxPriority(dPriority, feeRate, &mi->second.GetTx()));
-        }
-
-        // Collect transactions into block
-        uint64_t nBlockSize = 1000;
-        uint64_t nBlockTx = 0;
-        int nBlockSigOps = 100;
-        bool fSortedByFee = (nBlockPrioritySize <= 0);
-
-        TxPriorityCompare comparer(fSortedByFee);
-        std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
-
-        vector<CBigNum> vBlockSerials;
-        vector<CBigNum> vTxSerials;
-        while (!vecPriority.empty()) {
-            // Take highest priority transaction off the priority queue:
-            double dPriority = vecPriority.front().get<0>();
-            CFeeRate feeRate = vecPriority.front().get<1>();
-            const CTransaction& tx = *(vecPriority.front().get<2>());
-
-            std::pop_heap(vecPriority.begin(), vecPriority.end(), comparer);
-            vecPriority.pop_back();
-
-            // Size limits
-            unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
-            if (nBlockSize + nTxSize >= nBlockMaxSize)
-                continue;
-
-            // Legacy limits on sigOps:
-            unsigned int nMaxBlockSigOps = MAX_BLOCK_SIGOPS;
-            unsigned int nTxSigOps = GetLegacySigOpCount(tx);
-            if (nBlockSigOps + nTxSigOps >= nMaxBlockSigOps)
-                continue;
-
-            // Skip free transactions if we're past the minimum block size:
-            const uint256& hash = tx.GetHash();
-            double dPriorityDelta = 0;
-            CAmount nFeeDelta = 0;
-            mempool.ApplyDeltas(hash, dPriorityDelta, nFeeDelta);
-            if (fSortedByFee && (dPriorityDelta <= 0) && (nFeeDelta <= 0) && (feeRate < ::minRelayTxFee) && (nBlockSize + nTxSize >= nBlockMinSize))
-                continue;
-
-            // Prioritise by fee once past the priority size or we run out of high-priority
-            // transactions:
-            if (!fSortedByFee &&
-                ((nBlockSize + nTxSize >= nBlockPrioritySize) || !AllowFree(dPriority))) {
-                fSortedByFee = true;
-                comparer = TxPriorityCompare(fSortedByFee);
-                std::make_heap(vecPriority.begin(), vecPriority.end(), comparer);
-            }
-
-            if (!view.HaveInputs(tx))
-                continue;
-
-            CAmount nTxFees = view.GetValueIn(tx) - tx.GetValueOut();
-
-            nTxSigOps += GetP2SHSigOpCount(tx, view);
-            if (nBlockSigOps + nTxSigOps >= nMaxBlockSigOps)
-                continue;
-
-            // Note that flags: we don't want to set mempool/IsStandard()
-            // policy here, but we still have to ensure that the block we
-            // create only contains transactions that are valid in new blocks.
-            CValidationState state;
-            if (!CheckInputs(tx, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true))
-                continue;
-
-            CTxUndo txundo;
-            UpdateCoins(tx, state, view, txundo, nHeight);
-
-            // Added
-            pblock->vtx.push_back(tx);
-            pblocktemplate->vTxFees.push_back(nTxFees);
-            pblocktemplate->vTxSigOps.push_back(nTxSigOps);
-            nBlockSize += nTxSize;
-            ++nBlockTx;
-            nBlockSigOps += nTxSigOps;
-            nFees += nTxFees;
-
-            for (const CBigNum bnSerial : vTxSerials)
-                vBlockSerials.emplace_back(bnSerial);
-
-            if (fPrintPriority) {
-                LogPrintf("priority %.1f fee %s txid %s\n",
-                    dPriority, feeRate.ToString(), tx.GetHash().ToString());
-            }
-
-            // Add transactions that depend on this one to the priority queue
-            if (mapDependers.count(hash)) {
-                BOOST_FOREACH (COrphan* porphan, mapDependers[hash]) {
-                    if (!porphan->setDependsOn.empty()) {
-                        porphan->setDependsOn.erase(hash);
-                        if (porphan->setDependsOn.empty()) {
-                            vecPriority.push_back(TxPriority(porphan->dPriority, porphan->feeRate, porphan->ptx));
-                            std::push_heap(vecPriority.begin(), vecPriority.end(), comparer);
-                        }
-                    }
-                }
-            }
-        }
+        nFees = assembler.GetFees();
+        uint64_t nBlockTx = assembler.GetBlockTx();
+        uint64_t nBlockSize = assembler.GetBlockSize();
 
         if (!fProofOfStake) {
             //Masternode and general budget payments
@@ -400,7 +448,7 @@ void IncrementExtraNonce(CBlock* pblock, CBlockIndex* pindexPrev, unsigned int&
     assert(txCoinbase.vin[0].scriptSig.size() <= 100);
 
     pblock->vtx[0] = txCoinbase;
-    pblock->hashMerkleRoot = pblock->BuildMerkleTree();
+    pblock->hashMerkleRoot = pblock->ComputeMerkleRoot();
 }
 
 #ifdef ENABLE_WALLET
@@ -6,17 +6,72 @@
 #ifndef BITCOIN_MINER_H
 #define BITCOIN_MINER_H
 
+#include "amount.h"
+#include "uint256.h"
+
+#include <set>
 #include <stdint.h>
 
 class CBlock;
 class CBlockHeader;
 class CBlockIndex;
+class CCoinsViewCache;
 class CReserveKey;
 class CScript;
+class CTransaction;
+class CTxMemPoolEntry;
 class CWallet;
 
 struct CBlockTemplate;
 
+/**
+ * Fills a block template with memory pool transactions on top of a coins view.
+ *
+ * A high-priority area comes first, if -blockprioritysize asks for one. The
+ * rest of the block is filled from the mempool's ancestor fee rate index: a
+ * transaction is taken together with those of its unconfirmed ancestors that
+ * are not in the block yet, and the packages of its descendants are rescored
+ * as it goes in. Walking the index stops once the block is full or the fee
+ * rate drops below the relay minimum, so the work follows the size of the
+ * block rather than that of the mempool.
+ *
+ * cs_main and mempool.cs must be held for the lifetime of the assembler.
+ */
+class CBlockAssembler
+{
+private:
+    CBlockTemplate& blocktemplate;
+    CCoinsViewCache& view;
+    int nHeight;
+
+    unsigned int nBlockMaxSize;
+    unsigned int nBlockPrioritySize;
+    unsigned int nBlockMinSize;
+    bool fPrintPriority;
+
+    uint64_t nBlockSize;
+    uint64_t nBlockTx;
+    unsigned int nBlockSigOps;
+    CAmount nFees;
+    std::set<uint256> setInBlock;
+
+    /** Check a transaction against viewCheck and apply it there; nTxFees and nTxSigOps are filled in. */
+    bool TestTransaction(const CTransaction& tx, CCoinsViewCache& viewCheck, CAmount& nTxFees, unsigned int& nTxSigOps) const;
+    void AddToBlock(const CTxMemPoolEntry& entry, CAmount nTxFees, unsigned int nTxSigOps);
+
+public:
+    CBlockAssembler(CBlockTemplate& blocktemplateIn, CCoinsViewCache& viewIn, int nHeightIn);
+
+    /** Add transactions by coin age priority, up to -blockprioritysize. */
+    void AddPriorityTxs();
+    /** Add ancestor packages by fee rate until the block is full. */
+    void AddPackageTxs();
+
+    uint64_t GetBlockSize() const { return nBlockSize; }
+    uint64_t GetBlockTx() const { return nBlockTx; }
+    CAmount GetFees() const { return nFees; }
+};
+
 /** Run the miner threads */
 void GenerateBitcoins(bool fGenerate, CWallet* pwallet, int nThreads);
 /** Generate a new block, without valid proof-of-work */
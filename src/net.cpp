@@ -19,6 +19,7 @@
 #include "miner.h"
 #include "primitives/transaction.h"
 #include "scheduler.h"
+#include "socketevents.h"
 #include "ui_interface.h"
 
 #ifdef ENABLE_WALLET
@@ -87,6 +88,7 @@ static bool vfLimited[NET_MAX] = {};
 static CNode* pnodeLocalHost = NULL;
 uint64_t nLocalHostNonce = 0;
 static std::vector<ListenSocket> vhListenSocket;
+static CSocketEvents* pSocketEvents = NULL;
 CAddrMan addrman;
 int nMaxConnections = 125;
 bool fAddressesInitialized = false;
@@ -113,6 +115,10 @@ CCriticalSection cs_nLastNodeId;
 static CSemaphore* semOutbound = NULL;
 boost::condition_variable messageHandlerCondition;
 
+int nMessageHandlerThreads = 0;
+static boost::mutex messageWorkerMutex;
+static boost::condition_variable messageWorkerCondition;
+
 // Signals for message handling
 static CNodeSignals g_signals;
 CNodeSignals& GetNodeSignals() { return g_signals; }
@@ -399,6 +405,12 @@ CNode* FindNode(const CService& addr)
     return NULL;
 }
 
+/** Whether the socket handler thread can wait on hSocket */
+static bool IsWatchableSocket(SOCKET hSocket)
+{
+    return pSocketEvents ? pSocketEvents->CanWatch(hSocket) : IsSelectableSocket(hSocket);
+}
+
 CNode* ConnectNode(CAddress addrConnect, const char* pszDest)
 {
     if (pszDest == NULL) {
@@ -425,7 +437,7 @@ CNode* ConnectNode(CAddress addrConnect, const char* pszDest)
     bool proxyConnectionFailed = false;
     if (pszDest ? ConnectSocketByName(addrConnect, hSocket, pszDest, Params().GetDefaultPort(), nConnectTimeout, &proxyConnectionFailed) :
                   ConnectSocket(addrConnect, hSocket, nConnectTimeout, &proxyConnectionFailed)) {
-        if (!IsSelectableSocket(hSocket)) {
+        if (!IsWatchableSocket(hSocket)) {
             LogPrintf("Cannot create connection: non-selectable socket created (fd >= FD_SETSIZE ?)\n");
             CloseSocket(hSocket);
             return NULL;
@@ -747,6 +759,8 @@ bool CNode::ReceiveMsgBytes(const char* pch, unsigned int nBytes)
         if (msg.complete()) {
             msg.nTime = GetTimeMicros();
             messageHandlerCondition.notify_one();
+            if (nMessageHandlerThreads)
+                messageWorkerCondition.notify_one();
         }
     }
 
@@ -845,9 +859,21 @@ void SocketSendData(CNode* pnode)
 
 static list<CNode*> vNodesDisconnected;
 
+/** Stop watching the socket of pnode, if it is watched. */
+static void UnwatchNode(CNode* pnode)
+{
+    if (pnode->hSocketWatched != INVALID_SOCKET) {
+        pSocketEvents->Unwatch(pnode->hSocketWatched, pnode);
+        pnode->hSocketWatched = INVALID_SOCKET;
+    }
+}
+
 void ThreadSocketHandler()
 {
     unsigned int nPrevNodeCount = 0;
+    BOOST_FOREACH (const ListenSocket& hListenSocket, vhListenSocket)
+        pSocketEvents->Watch(hListenSocket.socket, &hListenSocket, true, false);
+
     while (true) {
         //
         // Disconnect nodes
@@ -866,6 +892,7 @@ void ThreadSocketHandler()
                     pnode->grantOutbound.Release();
 
                     // close socket and cleanup
+                    UnwatchNode(pnode);
                     pnode->CloseSocketDisconnect();
 
                     // hold in disconnected pool until all refs are released
@@ -913,33 +940,14 @@ void ThreadSocketHandler()
         //
         // Find which sockets have data to receive
         //
-        struct timeval timeout;
-        timeout.tv_sec = 0;
-        timeout.tv_usec = 50000; // frequency to poll pnode->vSend
-
-        fd_set fdsetRecv;
-        fd_set fdsetSend;
-        fd_set fdsetError;
-        FD_ZERO(&fdsetRecv);
-        FD_ZERO(&fdsetSend);
-        FD_ZERO(&fdsetError);
-        SOCKET hSocketMax = 0;
-        bool have_fds = false;
-
-        BOOST_FOREACH (const ListenSocket& hListenSocket, vhListenSocket) {
-            FD_SET(hListenSocket.socket, &fdsetRecv);
-            hSocketMax = max(hSocketMax, hListenSocket.socket);
-            have_fds = true;
-        }
-
         {
             LOCK(cs_vNodes);
             BOOST_FOREACH (CNode* pnode, vNodes) {
-                if (pnode->hSocket == INVALID_SOCKET)
+                if (pnode->hSocket == INVALID_SOCKET) {
+                    // closed by another thread; select() would fail on it
+                    UnwatchNode(pnode);
                     continue;
-                FD_SET(pnode->hSocket, &fdsetError);
-                hSocketMax = max(hSocketMax, pnode->hSocket);
-                have_fds = true;
+                }
 
                 // Implement the following logic:
                 // * If there is data to send, select() for sending data. As this only
@@ -956,43 +964,39 @@ void ThreadSocketHandler()
                 // * We send some data.
                 // * We wait for data to be received (and disconnect after timeout).
                 // * We process a message in the buffer (message handler thread).
+                bool fSend = false;
+                bool fRecv = false;
                 {
                     TRY_LOCK(pnode->cs_vSend, lockSend);
-                    if (lockSend && !pnode->vSendMsg.empty()) {
-                        FD_SET(pnode->hSocket, &fdsetSend);
-                        continue;
-                    }
+                    if (lockSend && !pnode->vSendMsg.empty())
+                        fSend = true;
                 }
-                {
+                if (!fSend) {
                     TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
                     if (lockRecv && (pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
                                         pnode->GetTotalRecvSize() <= ReceiveFloodSize()))
-                        FD_SET(pnode->hSocket, &fdsetRecv);
+                        fRecv = true;
+                }
+                // Tell the backend only what changed, such as the send queue filling up
+                if (pnode->hSocketWatched != pnode->hSocket || pnode->fWatchRecv != fRecv || pnode->fWatchSend != fSend) {
+                    if (pnode->hSocketWatched != pnode->hSocket)
+                        UnwatchNode(pnode);
+                    pSocketEvents->Watch(pnode->hSocket, pnode, fRecv, fSend);
+                    pnode->hSocketWatched = pnode->hSocket;
+                    pnode->fWatchRecv = fRecv;
+                    pnode->fWatchSend = fSend;
                 }
             }
         }
 
-        int nSelect = select(have_fds ? hSocketMax + 1 : 0,
-            &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+        pSocketEvents->Wait(50); // frequency to poll pnode->vSend
         boost::this_thread::interruption_point();
 
-        if (nSelect == SOCKET_ERROR) {
-            if (have_fds) {
-                int nErr = WSAGetLastError();
-                LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
-                for (unsigned int i = 0; i <= hSocketMax; i++)
-                    FD_SET(i, &fdsetRecv);
-            }
-            FD_ZERO(&fdsetSend);
-            FD_ZERO(&fdsetError);
-            MilliSleep(timeout.tv_usec / 1000);
-        }
-
         //
         // Accept new connections
         //
         BOOST_FOREACH (const ListenSocket& hListenSocket, vhListenSocket) {
-            if (hListenSocket.socket != INVALID_SOCKET && FD_ISSET(hListenSocket.socket, &fdsetRecv)) {
+            if (hListenSocket.socket != INVALID_SOCKET && pSocketEvents->IsRecvReady(hListenSocket.socket)) {
                 struct sockaddr_storage sockaddr;
                 socklen_t len = sizeof(sockaddr);
                 SOCKET hSocket = accept(hListenSocket.socket, (struct sockaddr*)&sockaddr, &len);
@@ -1015,7 +1019,8 @@ void ThreadSocketHandler()
                     int nErr = WSAGetLastError();
                     if (nErr != WSAEWOULDBLOCK)
                         LogPrintf("socket error accept failed: %s\n", NetworkErrorString(nErr));
-                } else if (!IsSelectableSocket(hSocket)) {
+                    pSocketEvents->RecvDrained(hListenSocket.socket);
+                } else if (!pSocketEvents->CanWatch(hSocket)) {
                     LogPrintf("connection from %s dropped: non-selectable socket\n", addr.ToString());
                     CloseSocket(hSocket);
                 } else if (nInbound >= nMaxConnections - MAX_OUTBOUND_CONNECTIONS) {
@@ -1055,13 +1060,16 @@ void ThreadSocketHandler()
             //
             if (pnode->hSocket == INVALID_SOCKET)
                 continue;
-            if (FD_ISSET(pnode->hSocket, &fdsetRecv) || FD_ISSET(pnode->hSocket, &fdsetError)) {
+            if (pSocketEvents->IsRecvReady(pnode->hSocket)) {
                 TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
                 if (lockRecv) {
                     {
                         // typical socket buffer is 8K-64K
                         char pchBuf[0x10000];
-                        int nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
+                        SOCKET hSocket = pnode->hSocket;
+                        int nBytes = recv(hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
+                        if (nBytes < (int)sizeof(pchBuf))
+                            pSocketEvents->RecvDrained(hSocket);
                         if (nBytes > 0) {
                             if (!pnode->ReceiveMsgBytes(pchBuf, nBytes))
                                 pnode->CloseSocketDisconnect();
@@ -1091,10 +1099,14 @@ void ThreadSocketHandler()
             //
             if (pnode->hSocket == INVALID_SOCKET)
                 continue;
-            if (FD_ISSET(pnode->hSocket, &fdsetSend)) {
+            if (pSocketEvents->IsSendReady(pnode->hSocket)) {
                 TRY_LOCK(pnode->cs_vSend, lockSend);
-                if (lockSend)
+                if (lockSend) {
+                    SOCKET hSocket = pnode->hSocket;
                     SocketSendData(pnode);
+                    if (!pnode->vSendMsg.empty())
+                        pSocketEvents->SendBlocked(hSocket);
+                }
             }
 
             //
@@ -1566,6 +1578,59 @@ void ThreadMessageHandler()
     }
 }
 
+// Handle the messages that do not need cs_main, while ThreadMessageHandler works
+// through the rest. A peer is only ever served by the thread holding its cs_vRecvMsg,
+// and a worker stops at the first message it may not handle, so each peer's
+// messages are still processed in order.
+void ThreadMessageWorker()
+{
+    SetThreadPriority(THREAD_PRIORITY_BELOW_NORMAL);
+    while (true) {
+        vector<CNode*> vNodesCopy;
+        {
+            LOCK(cs_vNodes);
+            vNodesCopy = vNodes;
+            BOOST_FOREACH (CNode* pnode, vNodesCopy) {
+                pnode->AddRef();
+            }
+        }
+
+        bool fSleep = true;
+
+        // Start at a random peer so the workers spread out over the connections
+        size_t nStart = vNodesCopy.empty() ? 0 : GetRand(vNodesCopy.size());
+        for (size_t i = 0; i < vNodesCopy.size(); i++) {
+            CNode* pnode = vNodesCopy[(nStart + i) % vNodesCopy.size()];
+            if (pnode->fDisconnect)
+                continue;
+
+            {
+                TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
+                if (lockRecv) {
+                    size_t nRecvMsg = pnode->vRecvMsg.size();
+                    if (!g_signals.ProcessConcurrentMessages(pnode))
+                        pnode->CloseSocketDisconnect();
+
+                    if (pnode->vRecvMsg.size() != nRecvMsg)
+                        fSleep = false;
+                }
+            }
+            boost::this_thread::interruption_point();
+        }
+
+        {
+            LOCK(cs_vNodes);
+            BOOST_FOREACH (CNode* pnode, vNodesCopy)
+                pnode->Release();
+        }
+
+        if (fSleep) {
+            boost::unique_lock<boost::mutex> lock(messageWorkerMutex);
+            messageWorkerCondition.timed_wait(lock, boost::posix_time::microsec_clock::universal_time() + boost::posix_time::milliseconds(100));
+        }
+    }
+}
+
 // ppcoin: stake minter thread
 void static ThreadStakeMinter()
 {
@@ -1767,6 +1832,13 @@ void StartNode(boost::thread_group& threadGroup, CScheduler& scheduler)
     MapPort(GetBoolArg("-upnp", DEFAULT_UPNP));
 
     // Send and receive from sockets, accept connections
+    if (pSocketEvents == NULL) {
+        std::string strSocketEvents = GetArg("-socketevents", DEFAULT_SOCKETEVENTS);
+        pSocketEvents = CreateSocketEvents(strSocketEvents);
+        if (pSocketEvents == NULL)
+            pSocketEvents = CreateSocketEvents("select");
+        LogPrintf("Using %s for socket events\n", pSocketEvents->GetName());
+    }
     threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "net", &ThreadSocketHandler));
 
     // Initiate outbound connections from -addnode
@@ -1777,6 +1849,8 @@ void StartNode(boost::thread_group& threadGroup, CScheduler& scheduler)
 
     // Process messages
     threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "msghand", &ThreadMessageHandler));
+    for (int i = 0; i < nMessageHandlerThreads; i++)
+        threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "msgwork", &ThreadMessageWorker));
 
     // Dump network addresses
     scheduler.scheduleEvery(&DumpData, DUMP_ADDRESSES_INTERVAL);
@@ -1830,6 +1904,8 @@ public:
         semOutbound = NULL;
         delete pnodeLocalHost;
         pnodeLocalHost = NULL;
+        delete pSocketEvents;
+        pSocketEvents = NULL;
 
 #ifdef WIN32
         // Shutdown Windows Sockets
@@ -2066,6 +2142,9 @@ CNode::CNode(SOCKET hSocketIn, CAddress addrIn, std::string addrNameIn, bool fIn
 {
     nServices = 0;
     hSocket = hSocketIn;
+    hSocketWatched = INVALID_SOCKET;
+    fWatchRecv = false;
+    fWatchSend = false;
     nRecvVersion = INIT_PROTO_VERSION;
     nLastSend = 0;
     nLastRecv = 0;
@@ -22,6 +22,7 @@
 #include "uint256.h"
 #include "utilstrencodings.h"
 
+#include <atomic>
 #include <deque>
 #include <stdint.h>
 
@@ -63,6 +64,10 @@ static const bool DEFAULT_UPNP = false;
 #endif
 /** The maximum number of entries in mapAskFor */
 static const size_t MAPASKFOR_MAX_SZ = MAX_INV_SZ;
+/** Maximum number of message worker threads */
+static const int MAX_MESSAGEHANDLER_THREADS = 16;
+/** -msghandlerthreads default (number of message worker threads, 0 = none) */
+static const int DEFAULT_MESSAGEHANDLER_THREADS = 0;
 
 unsigned int ReceiveFloodSize();
 unsigned int SendBufferSize();
@@ -89,6 +94,7 @@ typedef int NodeId;
 struct CNodeSignals {
     boost::signals2::signal<int()> GetHeight;
     boost::signals2::signal<bool(CNode*)> ProcessMessages;
+    boost::signals2::signal<bool(CNode*)> ProcessConcurrentMessages;
     boost::signals2::signal<bool(CNode*, bool)> SendMessages;
     boost::signals2::signal<void(NodeId, const CNode*)> InitializeNode;
     boost::signals2::signal<void(NodeId)> FinalizeNode;
@@ -131,6 +137,7 @@ extern uint64_t nLocalServices;
 extern uint64_t nLocalHostNonce;
 extern CAddrMan addrman;
 extern int nMaxConnections;
+extern int nMessageHandlerThreads;
 
 extern std::vector<CNode*> vNodes;
 extern CCriticalSection cs_vNodes;
@@ -286,6 +293,10 @@ public:
     // socket
     uint64_t nServices;
     SOCKET hSocket;
+    // the socket and directions registered with the socket events backend, by the socket handler thread only
+    SOCKET hSocketWatched;
+    bool fWatchRecv;
+    bool fWatchSend;
     CDataStream ssSend;
     size_t nSendSize;   // total size of all vSendMsg entries
     size_t nSendOffset; // offset inside the first vSendMsg already sent
@@ -354,7 +365,8 @@ public:
     // flood relay
     std::vector<CAddress> vAddrToSend;
     mruset<CAddress> setAddrKnown;
-    bool fGetAddr;
+    CCriticalSection cs_vAddrToSend; // protects vAddrToSend and setAddrKnown
+    std::atomic<bool> fGetAddr; //! set and cleared by whichever message handler thread serves the node
     std::set<uint256> setKnown;
 
     // inventory based relay
@@ -431,13 +443,15 @@ public:
     }
 
 
-    void AddAddressKnown(const CAddress& addr)
+    bool AddAddressKnown(const CAddress& addr)
     {
-        setAddrKnown.insert(addr);
+        LOCK(cs_vAddrToSend);
+        return setAddrKnown.insert(addr).second;
     }
 
     void PushAddress(const CAddress& addr)
     {
+        LOCK(cs_vAddrToSend);
         // Known checking here is only to save space from duplicates.
         // SendMessages will filter it again for knowns that were added
         // after addresses were pushed.
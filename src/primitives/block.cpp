@@ -6,6 +6,8 @@
 
 #include "primitives/block.h"
 
+#include "crypto/quark.h"
+#include "crypto/sha256.h"
 #include "hash.h"
 #include "script/standard.h"
 #include "script/sign.h"
@@ -13,9 +15,116 @@
 #include "utilstrencodings.h"
 #include "util.h"
 
+#include <atomic>
+
+static std::atomic<uint64_t> nBlockHashes(0);
+static thread_local uint64_t nThreadBlockHashes = 0;
+
+uint64_t GetBlockHashCount()
+{
+    return nBlockHashes;
+}
+
+uint64_t GetThreadBlockHashCount()
+{
+    return nThreadBlockHashes;
+}
+
+static void CountBlockHashes(uint64_t n)
+{
+    nBlockHashes += n;
+    nThreadBlockHashes += n;
+}
+
+CBlockHeader& CBlockHeader::operator=(const CBlockHeader& other)
+{
+    nVersion = other.nVersion;
+    hashPrevBlock = other.hashPrevBlock;
+    hashMerkleRoot = other.hashMerkleRoot;
+    nTime = other.nTime;
+    nBits = other.nBits;
+    nNonce = other.nNonce;
+    std::atomic_store(&pHashMemo, std::atomic_load(&other.pHashMemo));
+    return *this;
+}
+
+void CBlockHeader::SetHashMemo(const uint256& hash) const
+{
+    std::shared_ptr<CHashMemo> pMemo = std::make_shared<CHashMemo>();
+    memcpy(pMemo->vchFields, BEGIN(nVersion), sizeof(pMemo->vchFields));
+    pMemo->hash = hash;
+    std::atomic_store(&pHashMemo, std::shared_ptr<const CHashMemo>(pMemo));
+}
+
 uint256 CBlockHeader::GetHash() const
 {
-    return HashQuark(BEGIN(nVersion), END(nNonce));
+    static_assert(sizeof(CHashMemo::vchFields) == sizeof(nVersion) + sizeof(hashPrevBlock) + sizeof(hashMerkleRoot) + sizeof(nTime) + sizeof(nBits) + sizeof(nNonce),
+        "CHashMemo must hold the hashed header fields");
+    std::shared_ptr<const CHashMemo> pMemo = std::atomic_load(&pHashMemo);
+    if (pMemo && memcmp(pMemo->vchFields, BEGIN(nVersion), sizeof(pMemo->vchFields)) == 0)
+        return pMemo->hash;
+
+    uint256 hash = HashQuark(BEGIN(nVersion), END(nNonce));
+    SetHashMemo(hash);
+    CountBlockHashes(1);
+    return hash;
+}
+
+void GetBlockHeaderHashes(const std::vector<CBlockHeader>& vHeaders, std::vector<uint256>& vHashesRet)
+{
+    std::vector<const CBlockHeader*> vpHeaders(vHeaders.size());
+    for (size_t i = 0; i < vHeaders.size(); i++)
+        vpHeaders[i] = &vHeaders[i];
+    GetBlockHeaderHashes(vpHeaders, vHashesRet);
+}
+
+void GetBlockHeaderHashes(const std::vector<const CBlockHeader*>& vpHeaders, std::vector<uint256>& vHashesRet)
+{
+    vHashesRet.resize(vpHeaders.size());
+    if (vpHeaders.empty())
+        return;
+
+    std::vector<const unsigned char*> vIn(vpHeaders.size());
+    for (size_t i = 0; i < vpHeaders.size(); i++)
+        vIn[i] = (const unsigned char*)BEGIN(vpHeaders[i]->nVersion);
+    const size_t nLen = END(vpHeaders[0]->nNonce) - BEGIN(vpHeaders[0]->nVersion);
+    std::vector<unsigned char> vOut(32 * vpHeaders.size());
+    QuarkHashBatch(&vOut[0], &vIn[0], nLen, vpHeaders.size());
+    for (size_t i = 0; i < vpHeaders.size(); i++) {
+        memcpy(vHashesRet[i].begin(), &vOut[32 * i], 32);
+        // Later GetHash() calls on these headers need not hash them again
+        vpHeaders[i]->SetHashMemo(vHashesRet[i]);
+    }
+    CountBlockHashes(vpHeaders.size());
+}
+
+/** Number of nodes in the merkle tree of nLeaves transactions, including the leaves */
+static size_t MerkleTreeSize(size_t nLeaves)
+{
+    size_t nNodes = nLeaves;
+    for (size_t nSize = nLeaves; nSize > 1; nSize = (nSize + 1) / 2)
+        nNodes += (nSize + 1) / 2;
+    return nNodes;
+}
+
+/**
+ * Hash the nSize nodes of one merkle tree level at pin into the level above
+ * at pout, which may be pin itself. Adjacent hashes are contiguous, so every
+ * pair is one 64-byte input to SHA256D64(). An odd last node is paired with
+ * itself. mutated is set when the last two nodes are identical.
+ */
+static void HashMerkleLevel(uint256* pout, const uint256* pin, size_t nSize, bool& mutated)
+{
+    static_assert(sizeof(uint256) == 32, "merkle tree nodes must be packed");
+    const size_t nPairs = nSize / 2;
+    if (nSize % 2 == 0 && pin[nSize - 2] == pin[nSize - 1]) {
+        // Two identical hashes at the end of the list at a particular level.
+        mutated = true;
+    }
+    uint256 last = pin[nSize - 1];
+    SHA256D64(pout->begin(), pin->begin(), nPairs);
+    if (nSize % 2 == 1)
+        pout[nPairs] = Hash(BEGIN(last), END(last), BEGIN(last), END(last));
 }
 
 uint256 CBlock::BuildMerkleTree(bool* fMutated) const
@@ -55,24 +164,13 @@ uint256 CBlock::BuildMerkleTree(bool* fMutated) const
        known ways of changing the transactions without affecting the merkle
        root.
     */
-    vMerkleTree.clear();
-    vMerkleTree.reserve(vtx.size() * 2 + 16); // Safe upper bound for the number of total nodes.
-    for (std::vector<CTransaction>::const_iterator it(vtx.begin()); it != vtx.end(); ++it)
-        vMerkleTree.push_back(it->GetHash());
+    vMerkleTree.resize(MerkleTreeSize(vtx.size()));
+    for (unsigned int i = 0; i < vtx.size(); i++)
+        vMerkleTree[i] = vtx[i].GetHash();
     int j = 0;
     bool mutated = false;
-    for (int nSize = vtx.size(); nSize > 1; nSize = (nSize + 1) / 2)
-    {
-        for (int i = 0; i < nSize; i += 2)
-        {
-            int i2 = std::min(i+1, nSize-1);
-            if (i2 == i + 1 && i2 + 1 == nSize && vMerkleTree[j+i] == vMerkleTree[j+i2]) {
-                // Two identical hashes at the end of the list at a particular level.
-                mutated = true;
-            }
-            vMerkleTree.push_back(Hash(BEGIN(vMerkleTree[j+i]),  END(vMerkleTree[j+i]),
-                                       BEGIN(vMerkleTree[j+i2]), END(vMerkleTree[j+i2])));
-        }
+    for (int nSize = vtx.size(); nSize > 1; nSize = (nSize + 1) / 2) {
+        HashMerkleLevel(&vMerkleTree[j + nSize], &vMerkleTree[j], nSize, mutated);
         j += nSize;
     }
     if (fMutated) {
@@ -81,6 +179,21 @@ uint256 CBlock::BuildMerkleTree(bool* fMutated) const
     return (vMerkleTree.empty() ? uint256() : vMerkleTree.back());
 }
 
+uint256 CBlock::ComputeMerkleRoot(bool* fMutated) const
+{
+    // Same result as BuildMerkleTree(), but each level overwrites the one below
+    std::vector<uint256> vHashes(vtx.size());
+    for (unsigned int i = 0; i < vtx.size(); i++)
+        vHashes[i] = vtx[i].GetHash();
+    bool mutated = false;
+    for (int nSize = vtx.size(); nSize > 1; nSize = (nSize + 1) / 2)
+        HashMerkleLevel(&vHashes[0], &vHashes[0], nSize, mutated);
+    if (fMutated) {
+        *fMutated = mutated;
+    }
+    return (vHashes.empty() ? uint256() : vHashes[0]);
+}
+
 std::vector<uint256> CBlock::GetMerkleBranch(int nIndex) const
 {
     if (vMerkleTree.empty())
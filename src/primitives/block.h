@@ -14,6 +14,8 @@
 #include "serialize.h"
 #include "uint256.h"
 
+#include <memory>
+
 /** The maximum allowed size for a serialized block, in bytes (network rule) */
 static const unsigned int MAX_BLOCK_SIZE = 2000000;
 
@@ -26,6 +28,25 @@ static const unsigned int MAX_BLOCK_SIZE = 2000000;
  */
 class CBlockHeader
 {
+private:
+    //! The header fields last hashed and their hash
+    struct CHashMemo {
+        unsigned char vchFields[sizeof(int32_t) + 2 * sizeof(uint256) + 3 * sizeof(uint32_t)];
+        uint256 hash;
+    };
+
+    //! Memo of GetHash(). Comparing the fields costs far less than Quark and
+    //! notices any change to them, so the public fields can still be assigned
+    //! directly. A memo is never modified once made: const GetHash() calls,
+    //! which may run on several threads at once, replace the pointer with
+    //! std::atomic_store, and copies of the header share the memo. Assigning
+    //! the fields of a header other threads read needs locking as usual.
+    mutable std::shared_ptr<const CHashMemo> pHashMemo;
+
+    void SetHashMemo(const uint256& hash) const;
+
+    friend void GetBlockHeaderHashes(const std::vector<const CBlockHeader*>& vpHeaders, std::vector<uint256>& vHashesRet);
+
 public:
     // header
     static const int32_t CURRENT_VERSION=4;
@@ -41,6 +62,13 @@ public:
         SetNull();
     }
 
+    CBlockHeader(const CBlockHeader& other)
+    {
+        *this = other;
+    }
+
+    CBlockHeader& operator=(const CBlockHeader& other);
+
     ADD_SERIALIZE_METHODS;
 
     template <typename Stream, typename Operation>
@@ -69,6 +97,7 @@ public:
         return (nBits == 0);
     }
 
+    /** Quark hash of the header, computed again only when a header field has changed since the last call */
     uint256 GetHash() const;
 
     int64_t GetBlockTime() const
@@ -123,14 +152,8 @@ public:
 
     CBlockHeader GetBlockHeader() const
     {
-        CBlockHeader block;
-        block.nVersion       = nVersion;
-        block.hashPrevBlock  = hashPrevBlock;
-        block.hashMerkleRoot = hashMerkleRoot;
-        block.nTime          = nTime;
-        block.nBits          = nBits;
-        block.nNonce         = nNonce;
-        return block;
+        // Shares the hash memo along with copying the fields
+        return *this;
     }
 
     // ppcoin: two types of block: proof-of-work or proof-of-stake
@@ -158,6 +181,10 @@ public:
     // merkle root).
     uint256 BuildMerkleTree(bool* mutated = NULL) const;
 
+    // Return the merkle root without keeping the tree, for callers that need
+    // no merkle branches. *mutated is set as by BuildMerkleTree().
+    uint256 ComputeMerkleRoot(bool* mutated = NULL) const;
+
     std::vector<uint256> GetMerkleBranch(int nIndex) const;
     static uint256 CheckMerkleBranch(uint256 hash, const std::vector<uint256>& vMerkleBranch, int nIndex);
     std::string ToString() const;
@@ -165,6 +192,17 @@ public:
 };
 
 
+/** Compute the hashes of a batch of block headers, several at a time.
+ *  Equivalent to calling GetHash() on each header. */
+void GetBlockHeaderHashes(const std::vector<CBlockHeader>& vHeaders, std::vector<uint256>& vHashesRet);
+/** As above, for headers that are not stored together, such as those of whole blocks */
+void GetBlockHeaderHashes(const std::vector<const CBlockHeader*>& vpHeaders, std::vector<uint256>& vHashesRet);
+
+/** Number of block header Quark hashes computed, by all threads since startup */
+uint64_t GetBlockHashCount();
+/** Number of block header Quark hashes computed by the calling thread */
+uint64_t GetThreadBlockHashCount();
+
 /** Describes a place in the block chain to another node such that if the
  * other node doesn't have the same branch, it can find a recent common trunk.
  * The further back it is, the further before the fork it may be.
@@ -32,6 +32,23 @@ static const char* ppszTypeName[] =
         "mn announce",
         "mn ping"};
 
+/** Commands of the P2P messages this node sends or handles */
+static const char* ppszMessageCommand[] =
+    {
+        "addr", "alert", "block", "dseg", "fbs", "fbvote", "filteradd", "filterclear",
+        "filterload", "getaddr", "getblocks", "getdata", "getheaders", "getsporks", "headers", "inv",
+        "ix", "mempool", "merkleblock", "mnb", "mnget", "mnp", "mnvs", "mnw",
+        "mprop", "mvote", "notfound", "ping", "pong", "reject", "spork", "ssc",
+        "tx", "txlvote", "verack", "version"};
+
+bool IsKnownCommand(const std::string& strCommand)
+{
+    for (unsigned int i = 0; i < ARRAYLEN(ppszMessageCommand); i++)
+        if (strCommand == ppszMessageCommand[i])
+            return true;
+    return false;
+}
+
 CMessageHeader::CMessageHeader()
 {
     memcpy(pchMessageStart, Params().MessageStart(), MESSAGE_START_SIZE);
@@ -63,6 +63,9 @@ public:
     unsigned int nChecksum;
 };
 
+/** Whether strCommand names a P2P message this node sends or handles */
+bool IsKnownCommand(const std::string& strCommand);
+
 /** nServices flags */
 enum {
     NODE_NETWORK = (1 << 0),
@@ -77,6 +80,10 @@ enum {
 
 	 NODE_BLOOM_WITHOUT_MN = (1 << 4),
 
+    // NODE_HEADERS means the node answers getheaders with a headers message, so it can
+    // serve headers-first sync. Older nodes treat getheaders like getblocks.
+    NODE_HEADERS = (1 << 5),
+
     // Bits 24-31 are reserved for temporary experiments. Just pick a bit that
     // isn't getting used, or one not being used much, and notify the
     // bitcoin-development mailing list. Remember that service bits are just
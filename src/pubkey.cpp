@@ -6,27 +6,73 @@
 
 #include "eccryptoverify.h"
 
-#ifdef USE_SECP256K1
 #include <secp256k1.h>
-#else
-#include "ecwrapper.h"
-#endif
+
+//! anonymous namespace
+namespace
+{
+/**
+ * Builds the precomputed multiplication tables all verification shares once,
+ * when the process starts, rather than on first use. This is the one owner of
+ * the library state: stopping it also frees the signing tables key.cpp adds.
+ */
+class CSecp256k1VerifyInit
+{
+public:
+    CSecp256k1VerifyInit()
+    {
+        secp256k1_start(SECP256K1_START_VERIFY);
+    }
+    ~CSecp256k1VerifyInit()
+    {
+        secp256k1_stop();
+    }
+};
+static CSecp256k1VerifyInit instance_of_csecp256k1verify;
+
+/** Encode a 32 byte big endian number as a minimal DER integer */
+unsigned char* WriteDERInteger(unsigned char* pch, const unsigned char* vchNum)
+{
+    int nLen = 32;
+    while (nLen > 1 && *vchNum == 0) {
+        vchNum++;
+        nLen--;
+    }
+    *pch++ = 0x02;
+    *pch++ = nLen + (*vchNum >= 0x80);
+    if (*vchNum >= 0x80)
+        *pch++ = 0;
+    memcpy(pch, vchNum, nLen);
+    return pch + nLen;
+}
+
+/**
+ * Re-encode a signature in the strict DER libsecp256k1 parses, so that
+ * signatures OpenSSL used to accept keep verifying.
+ */
+bool NormalizeDERSignature(const std::vector<unsigned char>& vchSig, unsigned char vchDER[72], int& nDERLen)
+{
+    unsigned char vchRS[64];
+    if (vchSig.empty() || !eccrypto::ParseDERSignatureLax(&vchSig[0], vchSig.size(), vchRS))
+        return false;
+    unsigned char* pch = WriteDERInteger(vchDER + 2, vchRS);
+    pch = WriteDERInteger(pch, vchRS + 32);
+    vchDER[0] = 0x30;
+    vchDER[1] = pch - vchDER - 2;
+    nDERLen = pch - vchDER;
+    return true;
+}
+} // anon namespace
 
 bool CPubKey::Verify(const uint256& hash, const std::vector<unsigned char>& vchSig) const
 {
     if (!IsValid())
         return false;
-#ifdef USE_SECP256K1
-    if (secp256k1_ecdsa_verify((const unsigned char*)&hash, 32, &vchSig[0], vchSig.size(), begin(), size()) != 1)
-        return false;
-#else
-    CECKey key;
-    if (!key.SetPubKey(begin(), size()))
+    unsigned char vchDER[72];
+    int nDERLen;
+    if (!NormalizeDERSignature(vchSig, vchDER, nDERLen))
         return false;
-    if (!key.Verify(hash, vchSig))
-        return false;
-#endif
-    return true;
+    return secp256k1_ecdsa_verify((const unsigned char*)&hash, 32, vchDER, nDERLen, begin(), size()) == 1;
 }
 
 bool CPubKey::RecoverCompact(const uint256& hash, const std::vector<unsigned char>& vchSig)
@@ -35,19 +81,11 @@ bool CPubKey::RecoverCompact(const uint256& hash, const std::vector<unsigned cha
         return false;
     int recid = (vchSig[0] - 27) & 3;
     bool fComp = ((vchSig[0] - 27) & 4) != 0;
-#ifdef USE_SECP256K1
+    unsigned char pubkey[65];
     int pubkeylen = 65;
-    if (!secp256k1_ecdsa_recover_compact((const unsigned char*)&hash, 32, &vchSig[1], (unsigned char*)begin(), &pubkeylen, fComp, recid))
+    if (!secp256k1_ecdsa_recover_compact((const unsigned char*)&hash, 32, &vchSig[1], pubkey, &pubkeylen, fComp, recid))
         return false;
-    assert((int)size() == pubkeylen);
-#else
-    CECKey key;
-    if (!key.Recover(hash, &vchSig[1], recid))
-        return false;
-    std::vector<unsigned char> pubkey;
-    key.GetPubKey(pubkey, fComp);
-    Set(pubkey.begin(), pubkey.end());
-#endif
+    Set(pubkey, pubkey + pubkeylen);
     return true;
 }
 
@@ -55,34 +93,19 @@ bool CPubKey::IsFullyValid() const
 {
     if (!IsValid())
         return false;
-#ifdef USE_SECP256K1
-    if (!secp256k1_ecdsa_pubkey_verify(begin(), size()))
-        return false;
-#else
-    CECKey key;
-    if (!key.SetPubKey(begin(), size()))
-        return false;
-#endif
-    return true;
+    return secp256k1_ec_pubkey_verify(begin(), size()) == 1;
 }
 
 bool CPubKey::Decompress()
 {
     if (!IsValid())
         return false;
-#ifdef USE_SECP256K1
-    int clen = size();
-    int ret = secp256k1_ecdsa_pubkey_decompress((unsigned char*)begin(), &clen);
-    assert(ret);
-    assert(clen == (int)size());
-#else
-    CECKey key;
-    if (!key.SetPubKey(begin(), size()))
+    unsigned char pubkey[65];
+    int pubkeylen = size();
+    memcpy(pubkey, begin(), pubkeylen);
+    if (!secp256k1_ec_pubkey_decompress(pubkey, &pubkeylen))
         return false;
-    std::vector<unsigned char> pubkey;
-    key.GetPubKey(pubkey, false);
-    Set(pubkey.begin(), pubkey.end());
-#endif
+    Set(pubkey, pubkey + pubkeylen);
     return true;
 }
 
@@ -94,18 +117,8 @@ bool CPubKey::Derive(CPubKey& pubkeyChild, unsigned char ccChild[32], unsigned i
     unsigned char out[64];
     BIP32Hash(cc, nChild, *begin(), begin() + 1, out);
     memcpy(ccChild, out + 32, 32);
-#ifdef USE_SECP256K1
     pubkeyChild = *this;
-    bool ret = secp256k1_ecdsa_pubkey_tweak_add((unsigned char*)pubkeyChild.begin(), pubkeyChild.size(), out);
-#else
-    CECKey key;
-    bool ret = key.SetPubKey(begin(), size());
-    ret &= key.TweakPublic(out);
-    std::vector<unsigned char> pubkey;
-    key.GetPubKey(pubkey, true);
-    pubkeyChild.Set(pubkey.begin(), pubkey.end());
-#endif
-    return ret;
+    return secp256k1_ec_pubkey_tweak_add((unsigned char*)pubkeyChild.begin(), pubkeyChild.size(), out) == 1;
 }
 
 void CExtPubKey::Encode(unsigned char code[74]) const
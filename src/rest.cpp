@@ -3,6 +3,8 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "base58.h"
+#include "jsonstream.h"
 #include "main.h"
 #include "primitives/block.h"
 #include "primitives/transaction.h"
@@ -18,6 +20,13 @@
 
 using namespace std;
 
+//! Most headers returned by one /rest/headers/ request
+static const unsigned int MAX_REST_HEADERS_RESULTS = 2000;
+//! Most blocks returned by one /rest/blocks/ request
+static const unsigned int MAX_REST_BLOCKS_RESULTS = 1000;
+//! /rest/blocks/ stops adding blocks once the reply reaches this many bytes
+static const size_t MAX_REST_BLOCKS_SIZE = 16 * 1000 * 1000;
+
 enum RetFormat {
     RF_UNDEF,
     RF_BINARY,
@@ -44,6 +53,9 @@ public:
 
 extern void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry);
 extern UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false);
+extern UniValue blockHeaderToJSON(const CBlock& block, const CBlockIndex* blockindex);
+extern UniValue AddressUnspentToJSON(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& unspentOutputs);
+extern UniValue SpentInfoToJSON(const CSpentIndexValue& value);
 
 static RestErr RESTERR(enum HTTPStatusCode status, string message)
 {
@@ -90,6 +102,41 @@ static bool ParseHashStr(const string& strReq, uint256& v)
     return true;
 }
 
+/**
+ * Write the JSON of blockToJSON() for a block. The transaction details are
+ * written one transaction at a time instead of as one UniValue tree. The
+ * reply still needs its length up front, so it is written out in full
+ * before being sent.
+ */
+static void WriteBlockJSON(string& strOut, const CBlock& block, const CBlockIndex* pblockindex, bool txDetails)
+{
+    UniValue objBlock;
+    {
+        LOCK(cs_main);
+        objBlock = blockToJSON(block, pblockindex, false);
+    }
+
+    CJSONStreamWriter writer(strOut);
+    writer.BeginObject();
+    const vector<string>& vKeys = objBlock.getKeys();
+    const vector<UniValue>& vValues = objBlock.getValues();
+    for (unsigned int i = 0; i < vKeys.size(); i++) {
+        writer.Key(vKeys[i]);
+        if (!txDetails || vKeys[i] != "tx") {
+            writer.Value(vValues[i]);
+            continue;
+        }
+        writer.BeginArray();
+        BOOST_FOREACH (const CTransaction& tx, block.vtx) {
+            UniValue objTx(UniValue::VOBJ);
+            TxToJSON(tx, uint256(0), objTx);
+            writer.Value(objTx);
+        }
+        writer.EndArray();
+    }
+    writer.EndObject();
+}
+
 static bool rest_block(AcceptedConnection* conn,
     string& strReq,
     map<string, string>& mapHeaders,
@@ -104,38 +151,46 @@ static bool rest_block(AcceptedConnection* conn,
     if (!ParseHashStr(hashStr, hash))
         throw RESTERR(HTTP_BAD_REQUEST, "Invalid hash: " + hashStr);
 
-    CBlock block;
     CBlockIndex* pblockindex = NULL;
+    CDiskBlockPos pos;
     {
         LOCK(cs_main);
-        if (mapBlockIndex.count(hash) == 0)
-            throw RESTERR(HTTP_NOT_FOUND, hashStr + " not found");
-
-        pblockindex = mapBlockIndex[hash];
-        if (!ReadBlockFromDisk(block, pblockindex))
+        BlockMap::iterator mi = mapBlockIndex.find(hash);
+        if (mi == mapBlockIndex.end() || !(mi->second->nStatus & BLOCK_HAVE_DATA))
             throw RESTERR(HTTP_NOT_FOUND, hashStr + " not found");
+        pblockindex = mi->second;
+        pos = pblockindex->GetBlockPos();
     }
 
-    CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
-    ssBlock << block;
-
     switch (rf) {
     case RF_BINARY: {
-        string binaryBlock = ssBlock.str();
-        conn->stream() << HTTPReplyHeader(HTTP_OK, fRun, binaryBlock.size(), "application/octet-stream") << binaryBlock << std::flush;
+        // The block file already holds the serialized block
+        vector<unsigned char> vchBlock;
+        if (!ReadRawBlockFromDisk(vchBlock, pos))
+            throw RESTERR(HTTP_NOT_FOUND, hashStr + " not found");
+        conn->stream() << HTTPReplyHeader(HTTP_OK, fRun, vchBlock.size(), "application/octet-stream");
+        conn->stream().write((const char*)begin_ptr(vchBlock), vchBlock.size());
+        conn->stream() << std::flush;
         return true;
     }
 
     case RF_HEX: {
-        string strHex = HexStr(ssBlock.begin(), ssBlock.end()) + "\n";
-        conn->stream() << HTTPReply(HTTP_OK, strHex, fRun, false, "text/plain") << std::flush;
+        vector<unsigned char> vchBlock;
+        if (!ReadRawBlockFromDisk(vchBlock, pos))
+            throw RESTERR(HTTP_NOT_FOUND, hashStr + " not found");
+        string strHex = HexStr(vchBlock.begin(), vchBlock.end()) + "\n";
+        conn->stream() << HTTPReplyHeader(HTTP_OK, fRun, strHex.size(), "text/plain") << strHex << std::flush;
         return true;
     }
 
     case RF_JSON: {
-        UniValue objBlock = blockToJSON(block, pblockindex, showTxDetails);
-        string strJSON = objBlock.write() + "\n";
-        conn->stream() << HTTPReply(HTTP_OK, strJSON, fRun) << std::flush;
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pblockindex))
+            throw RESTERR(HTTP_NOT_FOUND, hashStr + " not found");
+        string strJSON;
+        WriteBlockJSON(strJSON, block, pblockindex, showTxDetails);
+        strJSON += "\n";
+        conn->stream() << HTTPReplyHeader(HTTP_OK, fRun, strJSON.size()) << strJSON << std::flush;
         return true;
     }
 
@@ -194,15 +249,100 @@ static bool rest_tx(AcceptedConnection* conn,
 
     case RF_HEX: {
         string strHex = HexStr(ssTx.begin(), ssTx.end()) + "\n";
-        conn->stream() << HTTPReply(HTTP_OK, strHex, fRun, false, "text/plain") << std::flush;
+        conn->stream() << HTTPReplyHeader(HTTP_OK, fRun, strHex.size(), "text/plain") << strHex << std::flush;
         return true;
     }
 
     case RF_JSON: {
         UniValue objTx(UniValue::VOBJ);
-        TxToJSON(tx, hashBlock, objTx);
+        {
+            LOCK(cs_main);
+            TxToJSON(tx, hashBlock, objTx);
+        }
         string strJSON = objTx.write() + "\n";
-        conn->stream() << HTTPReply(HTTP_OK, strJSON, fRun) << std::flush;
+        conn->stream() << HTTPReplyHeader(HTTP_OK, fRun, strJSON.size()) << strJSON << std::flush;
+        return true;
+    }
+
+    default: {
+        throw RESTERR(HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+    }
+    }
+
+    // not reached
+    return true; // continue to process further HTTP reqs on this cxn
+}
+
+/**
+ * Parse "<count>/<hash>" and collect the block index entries of up to count
+ * blocks of the active chain, starting at hash. A block that is not in the
+ * active chain only yields itself.
+ */
+static void ParseBlockRange(const string& strPath, unsigned int nMaxCount, vector<const CBlockIndex*>& vIndex)
+{
+    vector<string> path;
+    boost::split(path, strPath, boost::is_any_of("/"));
+    int32_t nCount;
+    if (path.size() != 2 || !ParseInt32(path[0], &nCount) || nCount < 1 || (unsigned int)nCount > nMaxCount)
+        throw RESTERR(HTTP_BAD_REQUEST, strprintf("Invalid request, expected <count>/<hash> with a count between 1 and %u", nMaxCount));
+
+    uint256 hash;
+    if (!ParseHashStr(path[1], hash))
+        throw RESTERR(HTTP_BAD_REQUEST, "Invalid hash: " + path[1]);
+
+    LOCK(cs_main);
+    BlockMap::iterator mi = mapBlockIndex.find(hash);
+    if (mi == mapBlockIndex.end())
+        throw RESTERR(HTTP_NOT_FOUND, path[1] + " not found");
+    for (const CBlockIndex* pindex = mi->second; pindex != NULL; pindex = chainActive.Next(pindex)) {
+        vIndex.push_back(pindex);
+        if (vIndex.size() == (unsigned int)nCount)
+            break;
+    }
+}
+
+static bool rest_headers(AcceptedConnection* conn,
+    string& strReq,
+    map<string, string>& mapHeaders,
+    bool fRun)
+{
+    vector<string> params;
+    enum RetFormat rf = ParseDataFormat(params, strReq);
+
+    vector<const CBlockIndex*> vIndex;
+    ParseBlockRange(params[0], MAX_REST_HEADERS_RESULTS, vIndex);
+
+    // Headers come from the block index, no block file is read
+    switch (rf) {
+    case RF_BINARY:
+    case RF_HEX: {
+        CDataStream ssHeaders(SER_NETWORK, PROTOCOL_VERSION);
+        BOOST_FOREACH (const CBlockIndex* pindex, vIndex)
+            ssHeaders << pindex->GetBlockHeader();
+        if (rf == RF_BINARY) {
+            string binaryHeaders = ssHeaders.str();
+            conn->stream() << HTTPReplyHeader(HTTP_OK, fRun, binaryHeaders.size(), "application/octet-stream") << binaryHeaders << std::flush;
+        } else {
+            string strHex = HexStr(ssHeaders.begin(), ssHeaders.end()) + "\n";
+            conn->stream() << HTTPReplyHeader(HTTP_OK, fRun, strHex.size(), "text/plain") << strHex << std::flush;
+        }
+        return true;
+    }
+
+    case RF_JSON: {
+        string strJSON;
+        CJSONStreamWriter writer(strJSON);
+        writer.BeginArray();
+        BOOST_FOREACH (const CBlockIndex* pindex, vIndex) {
+            writer.BeginObject();
+            writer.Pair("hash", pindex->GetBlockHash().GetHex());
+            writer.Pair("height", pindex->nHeight);
+            writer.Members(blockHeaderToJSON(CBlock(pindex->GetBlockHeader()), pindex));
+            writer.EndObject();
+        }
+        writer.EndArray();
+        strJSON += "\n";
+        conn->stream() << HTTPReplyHeader(HTTP_OK, fRun, strJSON.size()) << strJSON << std::flush;
         return true;
     }
 
@@ -215,6 +355,140 @@ static bool rest_tx(AcceptedConnection* conn,
     return true; // continue to process further HTTP reqs on this cxn
 }
 
+static bool rest_blocks(AcceptedConnection* conn,
+    string& strReq,
+    map<string, string>& mapHeaders,
+    bool fRun)
+{
+    vector<string> params;
+    enum RetFormat rf = ParseDataFormat(params, strReq);
+    if (rf != RF_BINARY && rf != RF_HEX)
+        throw RESTERR(HTTP_NOT_FOUND, "output format not found (available: .bin, .hex)");
+
+    vector<const CBlockIndex*> vIndex;
+    ParseBlockRange(params[0], MAX_REST_BLOCKS_RESULTS, vIndex);
+
+    vector<CDiskBlockPos> vPos;
+    {
+        LOCK(cs_main);
+        BOOST_FOREACH (const CBlockIndex* pindex, vIndex) {
+            if (!(pindex->nStatus & BLOCK_HAVE_DATA))
+                break;
+            vPos.push_back(pindex->GetBlockPos());
+        }
+    }
+    if (vPos.empty())
+        throw RESTERR(HTTP_NOT_FOUND, params[0] + " not found");
+
+    // Copy the blocks as they are stored; a long range is cut short once the
+    // reply is large enough, the client continues after the last block it got
+    vector<unsigned char> vchBlocks;
+    vector<unsigned char> vchBlock;
+    BOOST_FOREACH (const CDiskBlockPos& pos, vPos) {
+        if (!ReadRawBlockFromDisk(vchBlock, pos))
+            throw RESTERR(HTTP_INTERNAL_SERVER_ERROR, "Can't read block from disk");
+        vchBlocks.insert(vchBlocks.end(), vchBlock.begin(), vchBlock.end());
+        if (vchBlocks.size() >= MAX_REST_BLOCKS_SIZE)
+            break;
+    }
+
+    if (rf == RF_BINARY) {
+        conn->stream() << HTTPReplyHeader(HTTP_OK, fRun, vchBlocks.size(), "application/octet-stream");
+        conn->stream().write((const char*)begin_ptr(vchBlocks), vchBlocks.size());
+        conn->stream() << std::flush;
+    } else {
+        string strHex = HexStr(vchBlocks.begin(), vchBlocks.end()) + "\n";
+        conn->stream() << HTTPReplyHeader(HTTP_OK, fRun, strHex.size(), "text/plain") << strHex << std::flush;
+    }
+    return true;
+}
+
+static bool rest_addressutxos(AcceptedConnection* conn,
+    string& strReq,
+    map<string, string>& mapHeaders,
+    bool fRun)
+{
+    vector<string> params;
+    enum RetFormat rf = ParseDataFormat(params, strReq);
+
+    string addressStr = params[0];
+    CBitcoinAddress address(addressStr);
+    uint160 hashBytes;
+    int type = ADDRESS_INDEX_NONE;
+    if (!address.IsValid() || !GetAddressIndexKey(GetScriptForDestination(address.Get()), hashBytes, type))
+        throw RESTERR(HTTP_BAD_REQUEST, "Invalid address: " + addressStr);
+
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
+    if (!GetAddressUnspent(hashBytes, type, unspentOutputs))
+        throw RESTERR(HTTP_NOT_FOUND, addressStr + " not found");
+
+    CDataStream ssUnspent(SER_NETWORK, PROTOCOL_VERSION);
+    ssUnspent << unspentOutputs;
+
+    switch (rf) {
+    case RF_BINARY: {
+        string binaryUnspent = ssUnspent.str();
+        conn->stream() << HTTPReplyHeader(HTTP_OK, fRun, binaryUnspent.size(), "application/octet-stream") << binaryUnspent << std::flush;
+        return true;
+    }
+
+    case RF_HEX: {
+        string strHex = HexStr(ssUnspent.begin(), ssUnspent.end()) + "\n";
+        conn->stream() << HTTPReplyHeader(HTTP_OK, fRun, strHex.size(), "text/plain") << strHex << std::flush;
+        return true;
+    }
+
+    case RF_JSON: {
+        string strJSON = AddressUnspentToJSON(unspentOutputs).write() + "\n";
+        conn->stream() << HTTPReplyHeader(HTTP_OK, fRun, strJSON.size()) << strJSON << std::flush;
+        return true;
+    }
+
+    default: {
+        throw RESTERR(HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+    }
+    }
+
+    // not reached
+    return true; // continue to process further HTTP reqs on this cxn
+}
+
+static bool rest_spentinfo(AcceptedConnection* conn,
+    string& strReq,
+    map<string, string>& mapHeaders,
+    bool fRun)
+{
+    vector<string> params;
+    enum RetFormat rf = ParseDataFormat(params, strReq);
+
+    // <txid>-<n>
+    vector<string> outpoint;
+    boost::split(outpoint, params[0], boost::is_any_of("-"));
+    uint256 hash;
+    int32_t nOutput;
+    if (outpoint.size() != 2 || !ParseHashStr(outpoint[0], hash) || !ParseInt32(outpoint[1], &nOutput) || nOutput < 0)
+        throw RESTERR(HTTP_BAD_REQUEST, "Invalid outpoint: " + params[0]);
+
+    CSpentIndexValue value;
+    if (!GetSpentIndex(CSpentIndexKey(hash, nOutput), value))
+        throw RESTERR(HTTP_NOT_FOUND, params[0] + " not found");
+
+    switch (rf) {
+    case RF_JSON: {
+        string strJSON = SpentInfoToJSON(value).write() + "\n";
+        conn->stream() << HTTPReplyHeader(HTTP_OK, fRun, strJSON.size()) << strJSON << std::flush;
+        return true;
+    }
+
+    default: {
+        throw RESTERR(HTTP_NOT_FOUND, "output format not found (available: json)");
+    }
+    }
+
+    // not reached
+    return true; // continue to process further HTTP reqs on this cxn
+}
+
 static const struct {
     const char* prefix;
     bool (*handler)(AcceptedConnection* conn,
@@ -225,6 +499,10 @@ static const struct {
     {"/rest/tx/", rest_tx},
     {"/rest/block/notxdetails/", rest_block_notxdetails},
     {"/rest/block/", rest_block_extended},
+    {"/rest/blocks/", rest_blocks},
+    {"/rest/headers/", rest_headers},
+    {"/rest/getaddressutxos/", rest_addressutxos},
+    {"/rest/getspentinfo/", rest_spentinfo},
 };
 
 bool HTTPReq_REST(AcceptedConnection* conn,
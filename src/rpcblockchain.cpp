@@ -243,6 +243,81 @@ UniValue getblockhash(const UniValue& params, bool fHelp)
     return pblockindex->GetBlockHash().GetHex();
 }
 
+UniValue getblockhashes(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 2)
+        throw runtime_error(
+            "getblockhashes high low\n"
+            "\nReturns the hashes of the blocks with a timestamp in the given range (requires -timestampindex).\n"
+            "\nArguments:\n"
+            "1. high         (numeric, required) The newer block timestamp\n"
+            "2. low          (numeric, required) The older block timestamp\n"
+            "\nResult:\n"
+            "[\n"
+            "  \"hash\"       (string) The block hash\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getblockhashes", "1231614698 1231024505") + HelpExampleRpc("getblockhashes", "1231614698, 1231024505"));
+
+    unsigned int nHigh = params[0].get_int();
+    unsigned int nLow = params[1].get_int();
+    if (nHigh < nLow)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "High is expected to be at least low");
+
+    std::vector<uint256> vHashes;
+    if (!GetTimestampIndex(nHigh, nLow, vHashes))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for block hashes");
+
+    UniValue result(UniValue::VARR);
+    for (std::vector<uint256>::const_iterator it = vHashes.begin(); it != vHashes.end(); it++)
+        result.push_back(it->GetHex());
+    return result;
+}
+
+UniValue SpentInfoToJSON(const CSpentIndexValue& value)
+{
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("txid", value.txid.GetHex()));
+    obj.push_back(Pair("index", (int)value.inputIndex));
+    obj.push_back(Pair("height", value.blockHeight));
+    return obj;
+}
+
+UniValue getspentinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1 || !params[0].isObject())
+        throw runtime_error(
+            "getspentinfo {\"txid\":\"hash\",\"index\":n}\n"
+            "\nReturns the txid and input index spending an output (requires -spentindex).\n"
+            "\nArguments:\n"
+            "{\n"
+            "  \"txid\": \"hash\",  (string) The hex string of the txid\n"
+            "  \"index\": n       (numeric) The output index\n"
+            "}\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"txid\": \"hash\",  (string) The spending transaction id\n"
+            "  \"index\": n,      (numeric) The spending input index\n"
+            "  \"height\": n      (numeric) The height of the spending block\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getspentinfo", "'{\"txid\": \"0437cd7f8525ceed2324359c2d0ba26006d92d856a9c20fa0241106ee5a597c9\", \"index\": 0}'") +
+            HelpExampleRpc("getspentinfo", "{\"txid\": \"0437cd7f8525ceed2324359c2d0ba26006d92d856a9c20fa0241106ee5a597c9\", \"index\": 0}"));
+
+    UniValue txidValue = find_value(params[0].get_obj(), "txid");
+    UniValue indexValue = find_value(params[0].get_obj(), "index");
+    if (!txidValue.isStr() || !indexValue.isNum())
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid txid or index");
+
+    CSpentIndexKey key(ParseHashV(txidValue, "txid"), indexValue.get_int());
+    CSpentIndexValue value;
+    if (!GetSpentIndex(key, value))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unable to get spent info");
+
+    return SpentInfoToJSON(value);
+}
+
 UniValue getblock(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() < 1 || params.size() > 2)
@@ -285,13 +360,21 @@ UniValue getblock(const UniValue& params, bool fHelp)
     if (params.size() > 1)
         fVerbose = params[1].get_bool();
 
-    if (mapBlockIndex.count(hash) == 0)
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+    CBlockIndex* pblockindex;
+    CDiskBlockPos pos;
+    {
+        LOCK(cs_main);
+        BlockMap::iterator mi = mapBlockIndex.find(hash);
+        if (mi == mapBlockIndex.end())
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+        pblockindex = mi->second;
+        pos = pblockindex->GetBlockPos();
+    }
 
+    // Reading and encoding the block does not need cs_main, but the index entry's
+    // position may change under it, so read from the copy taken above
     CBlock block;
-    CBlockIndex* pblockindex = mapBlockIndex[hash];
-
-    if (!ReadBlockFromDisk(block, pblockindex))
+    if (!ReadBlockFromDisk(block, pos) || block.GetHash() != hash)
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
 
     if (!fVerbose) {
@@ -301,6 +384,7 @@ UniValue getblock(const UniValue& params, bool fHelp)
         return strHex;
     }
 
+    LOCK(cs_main);
     return blockToJSON(block, pblockindex);
 }
 
@@ -415,7 +499,6 @@ UniValue gettxout(const UniValue& params, bool fHelp)
             "        ,...\n"
             "     ]\n"
             "  },\n"
-            "  \"version\" : n,            (numeric) The version\n"
             "  \"coinbase\" : true|false   (boolean) Coinbase or not\n"
             "}\n"
 
@@ -434,33 +517,33 @@ UniValue gettxout(const UniValue& params, bool fHelp)
     if (params.size() > 2)
         fMempool = params[2].get_bool();
 
-    CCoins coins;
+    if (n < 0)
+        return NullUniValue;
+    COutPoint out(hash, n);
+
+    Coin coin;
     if (fMempool) {
         LOCK(mempool.cs);
         CCoinsViewMemPool view(pcoinsTip, mempool);
-        if (!view.GetCoins(hash, coins))
+        if (!view.GetCoin(out, coin) || mempool.isSpent(out))
             return NullUniValue;
-        mempool.pruneSpent(hash, coins); // TODO: this should be done by the CCoinsViewMemPool
     } else {
-        if (!pcoinsTip->GetCoins(hash, coins))
+        if (!pcoinsTip->GetCoin(out, coin))
             return NullUniValue;
     }
-    if (n < 0 || (unsigned int)n >= coins.vout.size() || coins.vout[n].IsNull())
-        return NullUniValue;
 
     BlockMap::iterator it = mapBlockIndex.find(pcoinsTip->GetBestBlock());
     CBlockIndex* pindex = it->second;
     ret.push_back(Pair("bestblock", pindex->GetBlockHash().GetHex()));
-    if ((unsigned int)coins.nHeight == MEMPOOL_HEIGHT)
+    if (coin.nHeight == MEMPOOL_HEIGHT)
         ret.push_back(Pair("confirmations", 0));
     else
-        ret.push_back(Pair("confirmations", pindex->nHeight - coins.nHeight + 1));
-    ret.push_back(Pair("value", ValueFromAmount(coins.vout[n].nValue)));
+        ret.push_back(Pair("confirmations", pindex->nHeight - (int)coin.nHeight + 1));
+    ret.push_back(Pair("value", ValueFromAmount(coin.out.nValue)));
     UniValue o(UniValue::VOBJ);
-    ScriptPubKeyToJSON(coins.vout[n].scriptPubKey, o, true);
+    ScriptPubKeyToJSON(coin.out.scriptPubKey, o, true);
     ret.push_back(Pair("scriptPubKey", o));
-    ret.push_back(Pair("version", coins.nVersion));
-    ret.push_back(Pair("coinbase", coins.fCoinBase));
+    ret.push_back(Pair("coinbase", (bool)coin.fCoinBase));
 
     return ret;
 }
@@ -503,7 +586,20 @@ UniValue getblockchaininfo(const UniValue& params, bool fHelp)
             "  \"bestblockhash\": \"...\", (string) the hash of the currently best block\n"
             "  \"difficulty\": xxxxxx,     (numeric) the current difficulty\n"
             "  \"verificationprogress\": xxxx, (numeric) estimate of verification progress [0..1]\n"
-            "  \"chainwork\": \"xxxx\"     (string) total amount of work in active chain, in hexadecimal\n"
+            "  \"chainwork\": \"xxxx\",    (string) total amount of work in active chain, in hexadecimal\n"
+            "  \"coinscache\": {           (json object) in-memory UTXO cache\n"
+            "     \"entries\": xxxx,       (numeric) number of cached transaction outputs\n"
+            "     \"usage\": xxxx,         (numeric) memory used by the cache, in bytes\n"
+            "     \"limit\": xxxx,         (numeric) usage above which the cache is flushed, in bytes (set by -dbcache)\n"
+            "     \"writebehind\": true|false, (boolean) whether the database is written on a background thread (-dbwritebehind)\n"
+            "     \"unwritten\": xxxx,     (numeric) memory held by flushed changes not yet on disk, in bytes\n"
+            "     \"flushes\": xxxx,       (numeric) number of completed database writes\n"
+            "     \"lastentries\": xxxx,   (numeric) outputs written or erased by the last write\n"
+            "     \"lastwritems\": xxxx,   (numeric) duration of the last write, in milliseconds\n"
+            "     \"maxwritems\": xxxx,    (numeric) longest write, in milliseconds\n"
+            "     \"totalwritems\": xxxx,  (numeric) time spent writing, in milliseconds\n"
+            "     \"lastflushms\": x.xxx   (numeric) time the last flush held up block validation, in milliseconds\n"
+            "  }\n"
             "}\n"
             "\nExamples:\n" +
             HelpExampleCli("getblockchaininfo", "") + HelpExampleRpc("getblockchaininfo", ""));
@@ -516,6 +612,20 @@ UniValue getblockchaininfo(const UniValue& params, bool fHelp)
     obj.push_back(Pair("difficulty", (double)GetDifficulty()));
     obj.push_back(Pair("verificationprogress", Checkpoints::GuessVerificationProgress(chainActive.Tip())));
     obj.push_back(Pair("chainwork", chainActive.Tip()->nChainWork.GetHex()));
+    UniValue cache(UniValue::VOBJ);
+    cache.push_back(Pair("entries", (int64_t)pcoinsTip->GetCacheSize()));
+    cache.push_back(Pair("usage", (int64_t)pcoinsTip->DynamicMemoryUsage()));
+    cache.push_back(Pair("limit", (int64_t)nCoinCacheUsage));
+    CCoinsWriteStats writeStats = pcoinsdbview->GetWriteStats();
+    cache.push_back(Pair("writebehind", pcoinsdbview->IsWriteBehind()));
+    cache.push_back(Pair("unwritten", (int64_t)pcoinsdbview->GetUnwrittenUsage()));
+    cache.push_back(Pair("flushes", (int64_t)writeStats.nFlushes));
+    cache.push_back(Pair("lastentries", (int64_t)writeStats.nLastEntries));
+    cache.push_back(Pair("lastwritems", writeStats.nLastWriteMillis));
+    cache.push_back(Pair("maxwritems", writeStats.nMaxWriteMillis));
+    cache.push_back(Pair("totalwritems", writeStats.nTotalWriteMillis));
+    cache.push_back(Pair("lastflushms", writeStats.nLastFlushMicros * 0.001));
+    obj.push_back(Pair("coinscache", cache));
     return obj;
 }
 
@@ -713,6 +823,41 @@ UniValue getmempoolinfo(const UniValue& params, bool fHelp)
     return ret;
 }
 
+UniValue getsigcacheinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getsigcacheinfo\n"
+            "\nReturns details on the signature cache.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"slots\": xxxxx               (numeric) Number of entries the cache can hold\n"
+            "  \"bytes\": xxxxx               (numeric) Memory allocated for the cache\n"
+            "  \"hits\": xxxxx                (numeric) Lookups that found a verified signature\n"
+            "  \"misses\": xxxxx              (numeric) Lookups that had to verify the signature\n"
+            "  \"hitrate\": x.xxx             (numeric) Fraction of lookups that were hits\n"
+            "  \"inserts\": xxxxx             (numeric) Signatures added to the cache\n"
+            "  \"evictions\": xxxxx           (numeric) Entries dropped to make room for new ones\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getsigcacheinfo", "") + HelpExampleRpc("getsigcacheinfo", ""));
+
+    const CSignatureCache& signatureCache = GetSignatureCache();
+    uint64_t nHits, nMisses, nInserts, nEvictions;
+    signatureCache.GetStats(nHits, nMisses, nInserts, nEvictions);
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("slots", (uint64_t)signatureCache.GetSlots()));
+    ret.push_back(Pair("bytes", (uint64_t)signatureCache.GetMemoryUsage()));
+    ret.push_back(Pair("hits", nHits));
+    ret.push_back(Pair("misses", nMisses));
+    ret.push_back(Pair("hitrate", nHits + nMisses > 0 ? (double)nHits / (nHits + nMisses) : 0.0));
+    ret.push_back(Pair("inserts", nInserts));
+    ret.push_back(Pair("evictions", nEvictions));
+
+    return ret;
+}
+
 UniValue invalidateblock(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() != 1)
@@ -49,6 +49,13 @@ static const CRPCConvertParam vRPCConvertParams[] =
         {"getbalance", 1},
         {"getbalance", 2},
         {"getblockhash", 0},
+        {"getblockhashes", 0},
+        {"getblockhashes", 1},
+        {"getspentinfo", 0},
+        {"getaddressbalance", 0},
+        {"getaddressdeltas", 0},
+        {"getaddresstxids", 0},
+        {"getaddressutxos", 0},
         {"move", 2},
         {"move", 3},
         {"sendfrom", 2},
@@ -96,6 +103,7 @@ static const CRPCConvertParam vRPCConvertParams[] =
         {"estimatepriority", 0},
         {"prioritisetransaction", 1},
         {"prioritisetransaction", 2},
+        {"getmessagestats", 0},
         {"setban", 2},
         {"setban", 3},
         {"spork", 1},
@@ -851,8 +851,10 @@ UniValue getmasternodescores (const UniValue& params, bool fHelp)
     for (int nHeight = chainActive.Tip()->nHeight - nLast; nHeight < chainActive.Tip()->nHeight + 20; nHeight++) {
         uint256 nHigh = 0;
         CMasternode* pBestMasternode = NULL;
+        CMasternodeScoreContext context;
+        if (!masternodeHeights.GetScoreContext(context, nHeight - 100)) continue;
         BOOST_FOREACH (CMasternode& mn, vMasternodes) {
-            uint256 n = mn.CalculateScore(1, nHeight - 100);
+            uint256 n = mn.CalculateScore(context);
             if (n > nHigh) {
                 nHigh = n;
                 pBestMasternode = &mn;
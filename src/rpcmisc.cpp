@@ -576,3 +576,285 @@ UniValue makekeypair(const UniValue& params, bool fHelp)
 
     return result;
 }
+
+static std::string AddressIndexToString(const uint160& hashBytes, int type)
+{
+    if (type == ADDRESS_INDEX_SCRIPT)
+        return CBitcoinAddress(CScriptID(hashBytes)).ToString();
+    return CBitcoinAddress(CKeyID(hashBytes)).ToString();
+}
+
+/** Accept either a single address string or an {"addresses": [...]} object */
+static void ParseIndexAddresses(const UniValue& param, std::vector<std::pair<uint160, int> >& vAddresses)
+{
+    std::vector<std::string> vStrings;
+    if (param.isStr()) {
+        vStrings.push_back(param.get_str());
+    } else if (param.isObject()) {
+        UniValue addresses = find_value(param.get_obj(), "addresses");
+        if (!addresses.isArray())
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Addresses is expected to be an array");
+        for (unsigned int i = 0; i < addresses.size(); i++)
+            vStrings.push_back(addresses[i].get_str());
+    } else {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
+    }
+
+    BOOST_FOREACH (const std::string& strAddress, vStrings) {
+        CBitcoinAddress address(strAddress);
+        uint160 hashBytes;
+        int type = ADDRESS_INDEX_NONE;
+        if (!address.IsValid() || !GetAddressIndexKey(GetScriptForDestination(address.Get()), hashBytes, type))
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
+        vAddresses.push_back(std::make_pair(hashBytes, type));
+    }
+}
+
+static void ParseIndexHeightRange(const UniValue& param, int& nStart, int& nEnd)
+{
+    nStart = 0;
+    nEnd = 0;
+    if (!param.isObject())
+        return;
+    UniValue start = find_value(param.get_obj(), "start");
+    UniValue end = find_value(param.get_obj(), "end");
+    if (start.isNum() && end.isNum()) {
+        nStart = start.get_int();
+        nEnd = end.get_int();
+        if (nStart <= 0 || nEnd <= 0 || nEnd < nStart)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Start and end are expected to be positive heights with end >= start");
+    }
+}
+
+static bool HeightSort(const std::pair<CAddressUnspentKey, CAddressUnspentValue>& a,
+    const std::pair<CAddressUnspentKey, CAddressUnspentValue>& b)
+{
+    return a.second.blockHeight < b.second.blockHeight;
+}
+
+UniValue AddressUnspentToJSON(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& unspentOutputs)
+{
+    UniValue result(UniValue::VARR);
+    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it = unspentOutputs.begin(); it != unspentOutputs.end(); it++) {
+        UniValue output(UniValue::VOBJ);
+        output.push_back(Pair("address", AddressIndexToString(it->first.hashBytes, it->first.type)));
+        output.push_back(Pair("txid", it->first.txhash.GetHex()));
+        output.push_back(Pair("outputIndex", (int)it->first.index));
+        output.push_back(Pair("script", HexStr(it->second.script.begin(), it->second.script.end())));
+        output.push_back(Pair("satoshis", it->second.satoshis));
+        output.push_back(Pair("height", it->second.blockHeight));
+        result.push_back(output);
+    }
+    return result;
+}
+
+UniValue getaddressbalance(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getaddressbalance \"address\"|{\"addresses\":[\"address\",...]}\n"
+            "\nReturns the balance for one or more addresses (requires -addressindex).\n"
+
+            "\nArguments:\n"
+            "1. \"address\"        (string) The base58check encoded address, or\n"
+            "   {\n"
+            "     \"addresses\": [ (array) The base58check encoded addresses\n"
+            "       \"address\"    (string)\n"
+            "       ,...\n"
+            "     ]\n"
+            "   }\n"
+
+            "\nResult:\n"
+            "{\n"
+            "  \"balance\": n,   (numeric) The current balance in satoshis\n"
+            "  \"received\": n,  (numeric) The total number of satoshis received, including change\n"
+            "}\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getaddressbalance", "'{\"addresses\": [\"1PSSGeFHDnKNxiEyFrD1wcEaHr9hrQDDWc\"]}'") +
+            HelpExampleRpc("getaddressbalance", "{\"addresses\": [\"1PSSGeFHDnKNxiEyFrD1wcEaHr9hrQDDWc\"]}"));
+
+    std::vector<std::pair<uint160, int> > vAddresses;
+    ParseIndexAddresses(params[0], vAddresses);
+
+    CAmount nBalance = 0;
+    CAmount nReceived = 0;
+    for (std::vector<std::pair<uint160, int> >::const_iterator it = vAddresses.begin(); it != vAddresses.end(); it++) {
+        std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+        if (!GetAddressIndex(it->first, it->second, addressIndex))
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+
+        for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator jt = addressIndex.begin(); jt != addressIndex.end(); jt++) {
+            if (jt->second > 0)
+                nReceived += jt->second;
+            nBalance += jt->second;
+        }
+    }
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("balance", nBalance));
+    result.push_back(Pair("received", nReceived));
+    return result;
+}
+
+UniValue getaddressutxos(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getaddressutxos \"address\"|{\"addresses\":[\"address\",...]}\n"
+            "\nReturns all unspent outputs for one or more addresses (requires -addressindex).\n"
+
+            "\nArguments:\n"
+            "1. \"address\"        (string) The base58check encoded address, or\n"
+            "   {\n"
+            "     \"addresses\": [ (array) The base58check encoded addresses\n"
+            "       \"address\"    (string)\n"
+            "       ,...\n"
+            "     ]\n"
+            "   }\n"
+
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"address\": \"address\",  (string) The address base58check encoded\n"
+            "    \"txid\": \"hash\",        (string) The output txid\n"
+            "    \"outputIndex\": n,      (numeric) The output index\n"
+            "    \"script\": \"hex\",       (string) The script hex encoded\n"
+            "    \"satoshis\": n,         (numeric) The number of satoshis of the output\n"
+            "    \"height\": n            (numeric) The block height\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getaddressutxos", "'{\"addresses\": [\"1PSSGeFHDnKNxiEyFrD1wcEaHr9hrQDDWc\"]}'") +
+            HelpExampleRpc("getaddressutxos", "{\"addresses\": [\"1PSSGeFHDnKNxiEyFrD1wcEaHr9hrQDDWc\"]}"));
+
+    std::vector<std::pair<uint160, int> > vAddresses;
+    ParseIndexAddresses(params[0], vAddresses);
+
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
+    for (std::vector<std::pair<uint160, int> >::const_iterator it = vAddresses.begin(); it != vAddresses.end(); it++) {
+        if (!GetAddressUnspent(it->first, it->second, unspentOutputs))
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+    }
+    std::sort(unspentOutputs.begin(), unspentOutputs.end(), HeightSort);
+
+    return AddressUnspentToJSON(unspentOutputs);
+}
+
+UniValue getaddressdeltas(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getaddressdeltas {\"addresses\":[\"address\",...],\"start\":n,\"end\":n}\n"
+            "\nReturns all changes for one or more addresses (requires -addressindex).\n"
+
+            "\nArguments:\n"
+            "1. \"address\"        (string) The base58check encoded address, or\n"
+            "   {\n"
+            "     \"addresses\": [ (array) The base58check encoded addresses\n"
+            "       \"address\"    (string)\n"
+            "       ,...\n"
+            "     ],\n"
+            "     \"start\": n,    (numeric, optional) The start block height\n"
+            "     \"end\": n       (numeric, optional) The end block height\n"
+            "   }\n"
+
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"satoshis\": n,   (numeric) The difference of satoshis\n"
+            "    \"txid\": \"hash\",  (string) The related txid\n"
+            "    \"index\": n,      (numeric) The related input or output index\n"
+            "    \"blockindex\": n, (numeric) The position of the transaction in its block\n"
+            "    \"height\": n,     (numeric) The block height\n"
+            "    \"address\": \"address\" (string) The base58check encoded address\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getaddressdeltas", "'{\"addresses\": [\"1PSSGeFHDnKNxiEyFrD1wcEaHr9hrQDDWc\"]}'") +
+            HelpExampleRpc("getaddressdeltas", "{\"addresses\": [\"1PSSGeFHDnKNxiEyFrD1wcEaHr9hrQDDWc\"]}"));
+
+    std::vector<std::pair<uint160, int> > vAddresses;
+    ParseIndexAddresses(params[0], vAddresses);
+    int nStart, nEnd;
+    ParseIndexHeightRange(params[0], nStart, nEnd);
+
+    UniValue result(UniValue::VARR);
+    for (std::vector<std::pair<uint160, int> >::const_iterator it = vAddresses.begin(); it != vAddresses.end(); it++) {
+        std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+        if (!GetAddressIndex(it->first, it->second, addressIndex, nStart, nEnd))
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+
+        std::string strAddress = AddressIndexToString(it->first, it->second);
+        for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator jt = addressIndex.begin(); jt != addressIndex.end(); jt++) {
+            UniValue delta(UniValue::VOBJ);
+            delta.push_back(Pair("satoshis", jt->second));
+            delta.push_back(Pair("txid", jt->first.txhash.GetHex()));
+            delta.push_back(Pair("index", (int)jt->first.index));
+            delta.push_back(Pair("blockindex", (int)jt->first.txindex));
+            delta.push_back(Pair("height", jt->first.blockHeight));
+            delta.push_back(Pair("address", strAddress));
+            result.push_back(delta);
+        }
+    }
+
+    return result;
+}
+
+UniValue getaddresstxids(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getaddresstxids \"address\"|{\"addresses\":[\"address\",...],\"start\":n,\"end\":n}\n"
+            "\nReturns the txids for one or more addresses, ordered by height (requires -addressindex).\n"
+
+            "\nArguments:\n"
+            "1. \"address\"        (string) The base58check encoded address, or\n"
+            "   {\n"
+            "     \"addresses\": [ (array) The base58check encoded addresses\n"
+            "       \"address\"    (string)\n"
+            "       ,...\n"
+            "     ],\n"
+            "     \"start\": n,    (numeric, optional) The start block height\n"
+            "     \"end\": n       (numeric, optional) The end block height\n"
+            "   }\n"
+
+            "\nResult:\n"
+            "[\n"
+            "  \"transactionid\"  (string) The transaction id\n"
+            "  ,...\n"
+            "]\n"
+
+            "\nExamples:\n" +
+            HelpExampleCli("getaddresstxids", "'{\"addresses\": [\"1PSSGeFHDnKNxiEyFrD1wcEaHr9hrQDDWc\"]}'") +
+            HelpExampleRpc("getaddresstxids", "{\"addresses\": [\"1PSSGeFHDnKNxiEyFrD1wcEaHr9hrQDDWc\"]}"));
+
+    std::vector<std::pair<uint160, int> > vAddresses;
+    ParseIndexAddresses(params[0], vAddresses);
+    int nStart, nEnd;
+    ParseIndexHeightRange(params[0], nStart, nEnd);
+
+    // Height first, so that the result comes out in chain order across all addresses
+    std::set<std::pair<int, uint256> > setTxids;
+    for (std::vector<std::pair<uint160, int> >::const_iterator it = vAddresses.begin(); it != vAddresses.end(); it++) {
+        std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+        if (!GetAddressIndex(it->first, it->second, addressIndex, nStart, nEnd))
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+
+        for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator jt = addressIndex.begin(); jt != addressIndex.end(); jt++)
+            setTxids.insert(std::make_pair(jt->first.blockHeight, jt->first.txhash));
+    }
+
+    UniValue result(UniValue::VARR);
+    std::set<uint256> setSeen;
+    for (std::set<std::pair<int, uint256> >::const_iterator it = setTxids.begin(); it != setTxids.end(); it++) {
+        if (setSeen.insert(it->second).second)
+            result.push_back(it->second.GetHex());
+    }
+
+    return result;
+}
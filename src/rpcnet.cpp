@@ -8,6 +8,7 @@
 
 #include "clientversion.h"
 #include "main.h"
+#include "messagestats.h"
 #include "net.h"
 #include "netbase.h"
 #include "protocol.h"
@@ -346,6 +347,72 @@ UniValue getnettotals(const UniValue& params, bool fHelp)
     return obj;
 }
 
+UniValue getmessagestats(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() > 1)
+        throw runtime_error(
+            "getmessagestats ( reset )\n"
+            "\nReturns how much time the node spent processing each type of P2P message.\n"
+            "\nArguments:\n"
+            "1. reset          (boolean, optional, default=false) Clear the statistics after returning them\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"since\": ttt,                  (numeric) The time the statistics were started or reset\n"
+            "  \"messages\": {\n"
+            "    \"command\": {                 (string) The message type\n"
+            "      \"count\": n,                (numeric) Number of messages processed\n"
+            "      \"bytes\": n,                (numeric) Total payload size\n"
+            "      \"timeusec\": n,             (numeric) Total processing time in microseconds\n"
+            "      \"cpuusec\": n,              (numeric) Total CPU time of the processing thread in microseconds\n"
+            "      \"cs_mainwaitusec\": n,      (numeric) Part of timeusec spent waiting for cs_main\n"
+            "      \"queueusec\": n,            (numeric) Total time messages waited before processing started\n"
+            "      \"maxtimeusec\": n,          (numeric) Longest processing time of a single message\n"
+            "      \"latency\": {               (json object) Number of messages by processing time\n"
+            "        \"<10us\": n,\n"
+            "        ...\n"
+            "        \">=10000000us\": n\n"
+            "      }\n"
+            "    }, ...\n"
+            "  }\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getmessagestats", "") + HelpExampleRpc("getmessagestats", "true"));
+
+    std::map<std::string, CMessageTypeStats> mapStats;
+    int64_t nSince;
+    if (params.size() > 0 && params[0].get_bool())
+        messageStats.GetStatsAndReset(mapStats, nSince);
+    else
+        messageStats.GetStats(mapStats, nSince);
+
+    UniValue messages(UniValue::VOBJ);
+    for (std::map<std::string, CMessageTypeStats>::const_iterator it = mapStats.begin(); it != mapStats.end(); it++) {
+        const CMessageTypeStats& stats = it->second;
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("count", (uint64_t)stats.nCount));
+        obj.push_back(Pair("bytes", (uint64_t)stats.nBytes));
+        obj.push_back(Pair("timeusec", stats.nTimeMicros));
+        obj.push_back(Pair("cpuusec", stats.nCPUMicros));
+        obj.push_back(Pair("cs_mainwaitusec", stats.nLockWaitMicros));
+        obj.push_back(Pair("queueusec", stats.nQueueMicros));
+        obj.push_back(Pair("maxtimeusec", stats.nMaxTimeMicros));
+
+        UniValue latency(UniValue::VOBJ);
+        for (unsigned int n = 0; n < MESSAGE_LATENCY_BUCKETS; n++) {
+            int64_t nLimit = CMessageTypeStats::GetBucketLimit(n);
+            std::string strBucket = nLimit < 0 ? strprintf(">=%dus", CMessageTypeStats::GetBucketLimit(n - 1)) : strprintf("<%dus", nLimit);
+            latency.push_back(Pair(strBucket, (uint64_t)stats.vLatency[n]));
+        }
+        obj.push_back(Pair("latency", latency));
+        messages.push_back(Pair(SanitizeString(it->first), obj));
+    }
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("since", nSince));
+    result.push_back(Pair("messages", messages));
+    return result;
+}
+
 static UniValue GetNetworksInfo()
 {
     UniValue networks(UniValue::VARR);
@@ -18,14 +18,16 @@
 #include "wallet.h"
 #endif
 
+#include <deque>
+#include <sstream>
+
 #include <boost/algorithm/string.hpp>
 #include <boost/asio.hpp>
 #include <boost/asio/ssl.hpp>
 #include <boost/bind.hpp>
+#include <boost/enable_shared_from_this.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/foreach.hpp>
-#include <boost/iostreams/concepts.hpp>
-#include <boost/iostreams/stream.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/signals2/signal.hpp>
 #include <boost/thread.hpp>
@@ -285,6 +287,7 @@ static const CRPCCommand vRPCCommands[] =
         {"network", "disconnectnode", &disconnectnode, true, true, false},
         {"network", "getaddednodeinfo", &getaddednodeinfo, true, true, false},
         {"network", "getconnectioncount", &getconnectioncount, true, false, false},
+        {"network", "getmessagestats", &getmessagestats, true, true, false},
         {"network", "getnettotals", &getnettotals, true, true, false},
         {"network", "getpeerinfo", &getpeerinfo, true, false, false},
         {"network", "ping", &ping, true, false, false},
@@ -296,20 +299,29 @@ static const CRPCCommand vRPCCommands[] =
         {"blockchain", "getblockchaininfo", &getblockchaininfo, true, false, false},
         {"blockchain", "getbestblockhash", &getbestblockhash, true, false, false},
         {"blockchain", "getblockcount", &getblockcount, true, false, false},
-        {"blockchain", "getblock", &getblock, true, false, false},
+        {"blockchain", "getblock", &getblock, true, true, false},
         {"blockchain", "getblockhash", &getblockhash, true, false, false},
+        {"blockchain", "getblockhashes", &getblockhashes, true, false, false},
         {"blockchain", "getblockheader", &getblockheader, false, false, false},
         {"blockchain", "getchaintips", &getchaintips, true, false, false},
         {"blockchain", "getdifficulty", &getdifficulty, true, false, false},
         {"blockchain", "getfeeinfo", &getfeeinfo, true, false, false},
         {"blockchain", "getmempoolinfo", &getmempoolinfo, true, true, false},
         {"blockchain", "getrawmempool", &getrawmempool, true, false, false},
+        {"blockchain", "getsigcacheinfo", &getsigcacheinfo, true, false, false},
+        {"blockchain", "getspentinfo", &getspentinfo, true, false, false},
         {"blockchain", "gettxout", &gettxout, true, false, false},
         {"blockchain", "gettxoutsetinfo", &gettxoutsetinfo, true, false, false},
         {"blockchain", "invalidateblock", &invalidateblock, true, true, false},
         {"blockchain", "reconsiderblock", &reconsiderblock, true, true, false},
         {"blockchain", "verifychain", &verifychain, true, false, false},
 
+        /* Address index */
+        {"addressindex", "getaddressbalance", &getaddressbalance, true, false, false},
+        {"addressindex", "getaddressdeltas", &getaddressdeltas, true, false, false},
+        {"addressindex", "getaddresstxids", &getaddresstxids, true, false, false},
+        {"addressindex", "getaddressutxos", &getaddressutxos, true, false, false},
+
         /* Mining */
         {"mining", "getblocktemplate", &getblocktemplate, true, false, false},
         {"mining", "getmininginfo", &getmininginfo, true, false, false},
@@ -329,7 +341,7 @@ static const CRPCCommand vRPCCommands[] =
         {"rawtransactions", "createrawtransaction", &createrawtransaction, true, false, false},
         {"rawtransactions", "decoderawtransaction", &decoderawtransaction, true, false, false},
         {"rawtransactions", "decodescript", &decodescript, true, false, false},
-        {"rawtransactions", "getrawtransaction", &getrawtransaction, true, false, false},
+        {"rawtransactions", "getrawtransaction", &getrawtransaction, true, true, false},
         {"rawtransactions", "sendrawtransaction", &sendrawtransaction, false, false, false},
         {"rawtransactions", "signrawtransaction", &signrawtransaction, false, false, false}, /* uses wallet if enabled */
 
@@ -496,19 +508,78 @@ bool ClientAllowed(const boost::asio::ip::address& address)
     return false;
 }
 
-template <typename Protocol>
-class AcceptedConnectionImpl : public AcceptedConnection
+/**
+ * Bounded queue of HTTP requests, executed by the -rpcthreads worker threads.
+ * The I/O thread only parses requests and sends replies, so a slow call does
+ * not hold up the connections of other clients.
+ */
+class CRPCWorkQueue
 {
+private:
+    boost::mutex cs;
+    boost::condition_variable cond;
+    std::deque<boost::function<void(void)> > queue;
+    size_t nMaxDepth;
+    bool fRunning;
+
 public:
-    AcceptedConnectionImpl(
-        asio::io_service& io_service,
-        ssl::context& context,
-        bool fUseSSL) : sslStream(io_service, context),
-                        _d(sslStream, fUseSSL),
-                        _stream(_d)
+    CRPCWorkQueue(size_t nMaxDepthIn) : nMaxDepth(nMaxDepthIn), fRunning(true) {}
+
+    /** Queue a request; false if the queue is full or shutting down. */
+    bool Enqueue(const boost::function<void(void)>& func)
+    {
+        boost::mutex::scoped_lock lock(cs);
+        if (!fRunning || queue.size() >= nMaxDepth)
+            return false;
+        queue.push_back(func);
+        cond.notify_one();
+        return true;
+    }
+
+    void Run()
     {
+        while (true) {
+            boost::function<void(void)> func;
+            {
+                boost::mutex::scoped_lock lock(cs);
+                while (fRunning && queue.empty())
+                    cond.wait(lock);
+                if (!fRunning)
+                    break;
+                func = queue.front();
+                queue.pop_front();
+            }
+            func();
+        }
     }
 
+    /** Let Run() return; requests still queued are dropped. */
+    void Interrupt()
+    {
+        boost::mutex::scoped_lock lock(cs);
+        fRunning = false;
+        cond.notify_all();
+    }
+};
+
+static CRPCWorkQueue* rpc_work_queue = NULL;
+
+static void RPCWorkerThread(CRPCWorkQueue* queue)
+{
+    RenameThread("koinmudra-rpcworker");
+    queue->Run();
+}
+
+/**
+ * Takes the place of the connection while a worker handles a request: the
+ * handlers write their complete HTTP reply to stream(), which the I/O thread
+ * sends once they return.
+ */
+class RPCReplyBuffer : public AcceptedConnection
+{
+public:
+    RPCReplyBuffer(const std::string& strPeerIn) : strPeer(strPeerIn) {}
+
     virtual std::iostream& stream()
     {
         return _stream;
@@ -516,30 +587,239 @@ public:
 
     virtual std::string peer_address_to_string() const
     {
-        return peer.address().to_string();
+        return strPeer;
     }
 
     virtual void close()
     {
-        _stream.close();
+    }
+
+    std::string str() const
+    {
+        return _stream.str();
+    }
+
+private:
+    std::string strPeer;
+    std::stringstream _stream;
+};
+
+static bool HTTPReq_JSONRPC(AcceptedConnection* conn,
+    string& strRequest,
+    map<string, string>& mapHeaders,
+    bool fRun);
+
+/** Handle one HTTP request; false if the connection must be closed after the reply. */
+static bool HTTPReq(AcceptedConnection* conn,
+    string& strURI,
+    string& strRequest,
+    map<string, string>& mapHeaders,
+    bool fRun)
+{
+    // Process via JSON-RPC API
+    if (strURI == "/")
+        return HTTPReq_JSONRPC(conn, strRequest, mapHeaders, fRun);
+
+    // Process via HTTP REST API
+    if (strURI.substr(0, 6) == "/rest/" && GetBoolArg("-rest", false))
+        return HTTPReq_REST(conn, strURI, mapHeaders, fRun);
+
+    conn->stream() << HTTPError(HTTP_NOT_FOUND, false) << std::flush;
+    return false;
+}
+
+/**
+ * One client connection, driven by asynchronous reads and writes on the RPC
+ * I/O thread. Requests are read one at a time and handed to the work queue;
+ * requests a client pipelines behind it wait in the input buffer until the
+ * reply has been sent, so replies keep the order of the requests.
+ */
+template <typename Protocol>
+class RPCSession : public boost::enable_shared_from_this<RPCSession<Protocol> >
+{
+public:
+    RPCSession(asio::io_service& io_service, ssl::context& context, bool fUseSSLIn)
+        : sslStream(io_service, context), fUseSSL(fUseSSLIn), bufIn(MAX_SIZE), timer(io_service), nContentLength(0)
+    {
     }
 
     typename Protocol::endpoint peer;
     asio::ssl::stream<typename Protocol::socket> sslStream;
 
+    void Start()
+    {
+        if (fUseSSL) {
+            StartTimer();
+            sslStream.async_handshake(ssl::stream_base::server,
+                boost::bind(&RPCSession::HandleHandshake, this->shared_from_this(), _1));
+        } else {
+            ReadRequest();
+        }
+    }
+
+    /** Refuse a client that is not in -rpcallowip. */
+    void Reject()
+    {
+        // Only send a 403 if we're not using SSL to prevent a DoS during the SSL handshake.
+        if (fUseSSL)
+            Close();
+        else
+            Write(HTTPError(HTTP_FORBIDDEN, false), false);
+    }
+
 private:
-    SSLIOStreamDevice<Protocol> _d;
-    iostreams::stream<SSLIOStreamDevice<Protocol> > _stream;
-};
+    bool fUseSSL;
+    asio::streambuf bufIn;
+    deadline_timer timer;
+    std::string strReply;
+
+    // Request being handled
+    int nProto;
+    string strMethod;
+    string strURI;
+    map<string, string> mapHeaders;
+    size_t nContentLength;
+
+    void Close()
+    {
+        boost::system::error_code ec;
+        timer.cancel(ec);
+        sslStream.lowest_layer().close(ec);
+    }
 
-void ServiceConnection(AcceptedConnection* conn);
+    /** Close connections that stay idle, or stall mid-request, for -rpcservertimeout seconds. */
+    void StartTimer()
+    {
+        timer.expires_from_now(posix_time::seconds(GetArg("-rpcservertimeout", DEFAULT_RPC_SERVER_TIMEOUT)));
+        timer.async_wait(boost::bind(&RPCSession::HandleTimeout, this->shared_from_this(), _1));
+    }
+
+    void HandleTimeout(const boost::system::error_code& error)
+    {
+        if (error != asio::error::operation_aborted && timer.expires_at() <= deadline_timer::traits_type::now())
+            Close();
+    }
+
+    void HandleHandshake(const boost::system::error_code& error)
+    {
+        timer.cancel();
+        if (error) {
+            LogPrint("rpc", "%s: SSL handshake with %s failed: %s\n", __func__, peer.address().to_string(), error.message());
+            Close();
+            return;
+        }
+        ReadRequest();
+    }
+
+    void ReadRequest()
+    {
+        StartTimer();
+        if (fUseSSL)
+            asio::async_read_until(sslStream, bufIn, "\r\n\r\n",
+                boost::bind(&RPCSession::HandleHeaders, this->shared_from_this(), _1));
+        else
+            asio::async_read_until(sslStream.next_layer(), bufIn, "\r\n\r\n",
+                boost::bind(&RPCSession::HandleHeaders, this->shared_from_this(), _1));
+    }
+
+    void HandleHeaders(const boost::system::error_code& error)
+    {
+        timer.cancel();
+        if (error) {
+            Close();
+            return;
+        }
+
+        std::istream stream(&bufIn);
+        mapHeaders.clear();
+        if (!ReadHTTPRequestLine(stream, nProto, strMethod, strURI)) {
+            Close();
+            return;
+        }
+        int nLen = ReadHTTPHeaders(stream, mapHeaders);
+        if (nLen < 0 || (size_t)nLen > MAX_SIZE) {
+            Write(HTTPError(HTTP_BAD_REQUEST, false), false);
+            return;
+        }
+        nContentLength = nLen;
+
+        // Part of the body, or all of it, may have arrived with the headers
+        if (bufIn.size() >= nContentLength) {
+            HandleBody(boost::system::error_code());
+            return;
+        }
+        StartTimer();
+        if (fUseSSL)
+            asio::async_read(sslStream, bufIn, asio::transfer_at_least(nContentLength - bufIn.size()),
+                boost::bind(&RPCSession::HandleBody, this->shared_from_this(), _1));
+        else
+            asio::async_read(sslStream.next_layer(), bufIn, asio::transfer_at_least(nContentLength - bufIn.size()),
+                boost::bind(&RPCSession::HandleBody, this->shared_from_this(), _1));
+    }
+
+    void HandleBody(const boost::system::error_code& error)
+    {
+        timer.cancel();
+        if (error) {
+            Close();
+            return;
+        }
+
+        string strRequest(nContentLength, '\0');
+        if (nContentLength > 0) {
+            std::istream stream(&bufIn);
+            stream.read(&strRequest[0], nContentLength);
+        }
+
+        // HTTP/1.1 connections persist unless the client asks to close them, HTTP/1.0
+        // ones only if it asks to keep them
+        string strConnection = mapHeaders["connection"];
+        boost::to_lower(strConnection);
+        bool fKeepAlive = GetBoolArg("-rpckeepalive", true) && strConnection != "close" &&
+                          (nProto > 0 || strConnection == "keep-alive");
+
+        if (!rpc_work_queue->Enqueue(boost::bind(&RPCSession::Execute, this->shared_from_this(), strRequest, fKeepAlive))) {
+            LogPrintf("WARNING: request rejected because RPC work queue depth exceeded, it can be increased with the -rpcworkqueue= setting\n");
+            Write(HTTPError(HTTP_SERVICE_UNAVAILABLE, false), false);
+        }
+    }
+
+    /** Runs on a worker thread; no I/O on this session is outstanding meanwhile. */
+    void Execute(string strRequest, bool fKeepAlive)
+    {
+        RPCReplyBuffer reply(peer.address().to_string());
+        bool fContinue = HTTPReq(&reply, strURI, strRequest, mapHeaders, fKeepAlive) && fKeepAlive;
+        sslStream.get_io_service().post(boost::bind(&RPCSession::Write, this->shared_from_this(), reply.str(), fContinue));
+    }
+
+    void Write(const std::string& strReplyIn, bool fContinue)
+    {
+        strReply = strReplyIn;
+        if (fUseSSL)
+            asio::async_write(sslStream, asio::buffer(strReply),
+                boost::bind(&RPCSession::HandleWrite, this->shared_from_this(), _1, fContinue));
+        else
+            asio::async_write(sslStream.next_layer(), asio::buffer(strReply),
+                boost::bind(&RPCSession::HandleWrite, this->shared_from_this(), _1, fContinue));
+    }
+
+    void HandleWrite(const boost::system::error_code& error, bool fContinue)
+    {
+        if (error || !fContinue || !fRPCRunning || ShutdownRequested()) {
+            Close();
+            return;
+        }
+        // Picks up a pipelined request straight from bufIn if there is one
+        ReadRequest();
+    }
+};
 
 //! Forward declaration required for RPCListen
 template <typename Protocol, typename SocketAcceptorService>
 static void RPCAcceptHandler(boost::shared_ptr<basic_socket_acceptor<Protocol, SocketAcceptorService> > acceptor,
     ssl::context& context,
     bool fUseSSL,
-    boost::shared_ptr<AcceptedConnection> conn,
+    boost::shared_ptr<RPCSession<Protocol> > session,
     const boost::system::error_code& error);
 
 /**
@@ -551,16 +831,16 @@ static void RPCListen(boost::shared_ptr<basic_socket_acceptor<Protocol, SocketAc
     const bool fUseSSL)
 {
     // Accept connection
-    boost::shared_ptr<AcceptedConnectionImpl<Protocol> > conn(new AcceptedConnectionImpl<Protocol>(acceptor->get_io_service(), context, fUseSSL));
+    boost::shared_ptr<RPCSession<Protocol> > session(new RPCSession<Protocol>(acceptor->get_io_service(), context, fUseSSL));
 
     acceptor->async_accept(
-        conn->sslStream.lowest_layer(),
-        conn->peer,
+        session->sslStream.lowest_layer(),
+        session->peer,
         boost::bind(&RPCAcceptHandler<Protocol, SocketAcceptorService>,
             acceptor,
             boost::ref(context),
             fUseSSL,
-            conn,
+            session,
             _1));
 }
 
@@ -572,30 +852,24 @@ template <typename Protocol, typename SocketAcceptorService>
 static void RPCAcceptHandler(boost::shared_ptr<basic_socket_acceptor<Protocol, SocketAcceptorService> > acceptor,
     ssl::context& context,
     const bool fUseSSL,
-    boost::shared_ptr<AcceptedConnection> conn,
+    boost::shared_ptr<RPCSession<Protocol> > session,
     const boost::system::error_code& error)
 {
     // Immediately start accepting new connections, except when we're cancelled or our socket is closed.
     if (error != asio::error::operation_aborted && acceptor->is_open())
         RPCListen(acceptor, context, fUseSSL);
 
-    AcceptedConnectionImpl<ip::tcp>* tcp_conn = dynamic_cast<AcceptedConnectionImpl<ip::tcp>*>(conn.get());
-
     if (error) {
         // TODO: Actually handle errors
         LogPrintf("%s: Error: %s\n", __func__, error.message());
     }
     // Restrict callers by IP.  It is important to
-    // do this before starting client thread, to filter out
+    // do this before reading the request, to filter out
     // certain DoS and misbehaving clients.
-    else if (tcp_conn && !ClientAllowed(tcp_conn->peer.address())) {
-        // Only send a 403 if we're not using SSL to prevent a DoS during the SSL handshake.
-        if (!fUseSSL)
-            conn->stream() << HTTPError(HTTP_FORBIDDEN, false) << std::flush;
-        conn->close();
+    else if (!ClientAllowed(session->peer.address())) {
+        session->Reject();
     } else {
-        ServiceConnection(conn.get());
-        conn->close();
+        session->Start();
     }
 }
 
@@ -744,9 +1018,16 @@ void StartRPCThreads()
         return;
     }
 
+    int nWorkers = std::max((int)GetArg("-rpcthreads", DEFAULT_RPC_THREADS), 1);
+    int nWorkQueueDepth = std::max((int)GetArg("-rpcworkqueue", DEFAULT_RPC_WORKQUEUE), 1);
+    LogPrintf("RPC server: %d worker threads, work queue depth %d\n", nWorkers, nWorkQueueDepth);
+    rpc_work_queue = new CRPCWorkQueue(nWorkQueueDepth);
+
+    // A single thread does all socket I/O; the workers execute the requests
     rpc_worker_group = new boost::thread_group();
-    for (int i = 0; i < GetArg("-rpcthreads", 4); i++)
-        rpc_worker_group->create_thread(boost::bind(&asio::io_service::run, rpc_io_service));
+    rpc_worker_group->create_thread(boost::bind(&asio::io_service::run, rpc_io_service));
+    for (int i = 0; i < nWorkers; i++)
+        rpc_worker_group->create_thread(boost::bind(&RPCWorkerThread, rpc_work_queue));
     fRPCRunning = true;
 }
 
@@ -790,10 +1071,14 @@ void StopRPCThreads()
 
     DeleteAuthCookie();
 
+    if (rpc_work_queue != NULL)
+        rpc_work_queue->Interrupt();
     rpc_io_service->stop();
     cvBlockChange.notify_all();
     if (rpc_worker_group != NULL)
         rpc_worker_group->join_all();
+    delete rpc_work_queue;
+    rpc_work_queue = NULL;
     delete rpc_dummy_work;
     rpc_dummy_work = NULL;
     delete rpc_worker_group;
@@ -971,42 +1256,6 @@ static bool HTTPReq_JSONRPC(AcceptedConnection* conn,
     return true;
 }
 
-void ServiceConnection(AcceptedConnection* conn)
-{
-    bool fRun = true;
-    while (fRun && !ShutdownRequested()) {
-        int nProto = 0;
-        map<string, string> mapHeaders;
-        string strRequest, strMethod, strURI;
-
-        // Read HTTP request line
-        if (!ReadHTTPRequestLine(conn->stream(), nProto, strMethod, strURI))
-            break;
-
-        // Read HTTP message headers and body
-        ReadHTTPMessage(conn->stream(), mapHeaders, strRequest, nProto, MAX_SIZE);
-
-        // HTTP Keep-Alive is false; close connection immediately
-        if ((mapHeaders["connection"] == "close") || (!GetBoolArg("-rpckeepalive", true)))
-            fRun = false;
-
-        // Process via JSON-RPC API
-        if (strURI == "/") {
-            if (!HTTPReq_JSONRPC(conn, strRequest, mapHeaders, fRun))
-                break;
-
-            // Process via HTTP REST API
-        } else if (strURI.substr(0, 6) == "/rest/" && GetBoolArg("-rest", false)) {
-            if (!HTTPReq_REST(conn, strURI, mapHeaders, fRun))
-                break;
-
-        } else {
-            conn->stream() << HTTPError(HTTP_NOT_FOUND, false) << std::flush;
-            break;
-        }
-    }
-}
-
 UniValue CRPCTable::execute(const std::string &strMethod, const UniValue &params) const
 {
     // Find method
@@ -1043,7 +1292,7 @@ UniValue CRPCTable::execute(const std::string &strMethod, const UniValue &params
                     }
                     while (true) {
                         TRY_LOCK(pwalletMain->cs_wallet, lockWallet);
-                        if (!lockMain) {
+                        if (!lockWallet) {
                             MilliSleep(50);
                             continue;
                         }
@@ -5,80 +5,183 @@
 
 #include "sigcache.h"
 
+#include "crypto/sha256.h"
 #include "pubkey.h"
 #include "random.h"
-#include "uint256.h"
 #include "util.h"
 
-#include <boost/thread.hpp>
-#include <boost/tuple/tuple_comparison.hpp>
+#include <algorithm>
 
-namespace {
+#include <string.h>
 
-/**
- * Valid signature cache, to avoid doing expensive ECDSA signature checking
- * twice for every transaction (once when accepted into memory pool, and
- * again when accepted into the block chain)
- */
-class CSignatureCache
+CSignatureCache::CSignatureCache(size_t nBytes) : nHits(0), nMisses(0), nInserts(0), nEvictions(0)
 {
-private:
-     //! sigdata_type is (signature hash, signature, public key):
-    typedef boost::tuple<uint256, std::vector<unsigned char>, CPubKey> sigdata_type;
-    std::set< sigdata_type> setValid;
-    boost::shared_mutex cs_sigcache;
-
-public:
-    bool
-    Get(const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey)
-    {
-        boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
-
-        sigdata_type k(hash, vchSig, pubKey);
-        std::set<sigdata_type>::iterator mi = setValid.find(k);
-        if (mi != setValid.end())
-            return true;
+    nonce = GetRandHash();
+    nSlots = std::min(nBytes / GetSlotSize(), (size_t)0xffffffff);
+
+    // Enough displacement steps to reach a free slot in a well filled table,
+    // few enough to keep an insertion into a full one cheap
+    nMaxDepth = 1;
+    while (nMaxDepth < 32 && ((uint64_t)1 << nMaxDepth) < nSlots)
+        nMaxDepth++;
+
+    if (nSlots == 0)
+        return;
+    vSlots.reset(new CSlot[nSlots]);
+    vCollectable.reset(new std::atomic<bool>[nSlots]);
+    for (uint32_t i = 0; i < nSlots; i++) {
+        for (int j = 0; j < 4; j++)
+            vSlots[i].vWords[j].store(0, std::memory_order_relaxed);
+        vCollectable[i].store(true, std::memory_order_relaxed);
+    }
+}
+
+void CSignatureCache::ComputeEntry(uint256& entry, const uint256& hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey) const
+{
+    CSHA256()
+        .Write(nonce.begin(), 32)
+        .Write(hash.begin(), 32)
+        .Write(pubKey.begin(), pubKey.size())
+        .Write(vchSig.empty() ? NULL : &vchSig[0], vchSig.size())
+        .Finalize(entry.begin());
+}
+
+void CSignatureCache::ComputeSlots(uint32_t vPos[8], const uint256& entry) const
+{
+    // The entry is a uniformly distributed hash; each of its words picks a slot
+    for (int i = 0; i < 8; i++) {
+        uint32_t nWord;
+        memcpy(&nWord, entry.begin() + 4 * i, 4);
+        vPos[i] = ((uint64_t)nWord * nSlots) >> 32;
+    }
+}
+
+bool CSignatureCache::Matches(uint32_t nPos, const uint256& entry) const
+{
+    for (int j = 0; j < 4; j++) {
+        uint64_t nWord;
+        memcpy(&nWord, entry.begin() + 8 * j, 8);
+        if (vSlots[nPos].vWords[j].load(std::memory_order_relaxed) != nWord)
+            return false;
+    }
+    return true;
+}
+
+void CSignatureCache::Load(uint32_t nPos, uint256& entry) const
+{
+    for (int j = 0; j < 4; j++) {
+        uint64_t nWord = vSlots[nPos].vWords[j].load(std::memory_order_relaxed);
+        memcpy(entry.begin() + 8 * j, &nWord, 8);
+    }
+}
+
+void CSignatureCache::Store(uint32_t nPos, const uint256& entry)
+{
+    for (int j = 0; j < 4; j++) {
+        uint64_t nWord;
+        memcpy(&nWord, entry.begin() + 8 * j, 8);
+        vSlots[nPos].vWords[j].store(nWord, std::memory_order_relaxed);
+    }
+}
+
+bool CSignatureCache::Get(const uint256& hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey, bool fErase)
+{
+    if (nSlots == 0)
         return false;
+
+    uint256 entry;
+    ComputeEntry(entry, hash, vchSig, pubKey);
+    uint32_t vPos[8];
+    ComputeSlots(vPos, entry);
+    for (int i = 0; i < 8; i++) {
+        if (Matches(vPos[i], entry)) {
+            if (fErase)
+                vCollectable[vPos[i]].store(true, std::memory_order_relaxed);
+            nHits.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
     }
+    nMisses.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
 
-    void Set(const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey)
-    {
-        // DoS prevention: limit cache size to less than 10MB
-        // (~200 bytes per cache entry times 50,000 entries)
-        // Since there are a maximum of 20,000 signature operations per block
-        // 50,000 is a reasonable default.
-        int64_t nMaxCacheSize = GetArg("-maxsigcachesize", 50000);
-        if (nMaxCacheSize <= 0) return;
-
-        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
-
-        while (static_cast<int64_t>(setValid.size()) > nMaxCacheSize)
-        {
-            // Evict a random entry. Random because that helps
-            // foil would-be DoS attackers who might try to pre-generate
-            // and re-use a set of valid signatures just-slightly-greater
-            // than our cache size.
-            uint256 randomHash = GetRandHash();
-            std::vector<unsigned char> unused;
-            std::set<sigdata_type>::iterator it =
-                setValid.lower_bound(sigdata_type(randomHash, unused, unused));
-            if (it == setValid.end())
-                it = setValid.begin();
-            setValid.erase(*it);
+void CSignatureCache::Set(const uint256& hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey)
+{
+    if (nSlots == 0)
+        return;
+
+    uint256 entry;
+    ComputeEntry(entry, hash, vchSig, pubKey);
+    uint32_t vPos[8];
+    ComputeSlots(vPos, entry);
+
+    boost::mutex::scoped_lock lock(cs_insert);
+    for (int i = 0; i < 8; i++) {
+        if (Matches(vPos[i], entry)) {
+            vCollectable[vPos[i]].store(false, std::memory_order_relaxed);
+            return;
+        }
+    }
+    nInserts.fetch_add(1, std::memory_order_relaxed);
+
+    // Move occupants to their other slots until one of them lands on a free
+    // one. Which entry falls out when the depth runs out depends on the
+    // secret nonce, so attackers can't pick what gets evicted.
+    int nLast = 7;
+    for (unsigned int nDepth = 0; nDepth < nMaxDepth; nDepth++) {
+        for (int i = 0; i < 8; i++) {
+            if (vCollectable[vPos[i]].load(std::memory_order_relaxed)) {
+                Store(vPos[i], entry);
+                vCollectable[vPos[i]].store(false, std::memory_order_relaxed);
+                return;
+            }
         }
 
-        sigdata_type k(hash, vchSig, pubKey);
-        setValid.insert(k);
+        uint32_t nPos = vPos[(nLast + 1) & 7];
+        uint256 displaced;
+        Load(nPos, displaced);
+        Store(nPos, entry);
+        entry = displaced;
+
+        ComputeSlots(vPos, entry);
+        for (nLast = 0; nLast < 7 && vPos[nLast] != nPos; nLast++) {
+        }
     }
-};
+    nEvictions.fetch_add(1, std::memory_order_relaxed);
+}
+
+void CSignatureCache::GetStats(uint64_t& nHitsOut, uint64_t& nMissesOut, uint64_t& nInsertsOut, uint64_t& nEvictionsOut) const
+{
+    nHitsOut = nHits.load(std::memory_order_relaxed);
+    nMissesOut = nMisses.load(std::memory_order_relaxed);
+    nInsertsOut = nInserts.load(std::memory_order_relaxed);
+    nEvictionsOut = nEvictions.load(std::memory_order_relaxed);
+}
 
+size_t GetSignatureCacheBytes(int64_t nSize, bool& fEntryCount)
+{
+    fEntryCount = nSize > (int64_t)MAX_MAX_SIG_CACHE_SIZE;
+    if (nSize <= 0)
+        return 0;
+    size_t nMaxBytes = (size_t)MAX_MAX_SIG_CACHE_SIZE << 20;
+    if (fEntryCount)
+        return (size_t)std::min(nSize, (int64_t)(nMaxBytes / CSignatureCache::GetSlotSize())) * CSignatureCache::GetSlotSize();
+    return (size_t)nSize << 20;
+}
+
+CSignatureCache& GetSignatureCache()
+{
+    bool fEntryCount;
+    static CSignatureCache signatureCache(GetSignatureCacheBytes(GetArg("-maxsigcachesize", DEFAULT_MAX_SIG_CACHE_SIZE), fEntryCount));
+    return signatureCache;
 }
 
 bool CachingTransactionSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
 {
-    static CSignatureCache signatureCache;
+    CSignatureCache& signatureCache = GetSignatureCache();
 
-    if (signatureCache.Get(sighash, vchSig, pubkey))
+    // Signatures checked without storing are those of blocks, which won't be checked again
+    if (signatureCache.Get(sighash, vchSig, pubkey, !store))
         return true;
 
     if (!TransactionSignatureChecker::VerifySignature(vchSig, pubkey, sighash))
@@ -7,11 +7,94 @@
 #define BITCOIN_SCRIPT_SIGCACHE_H
 
 #include "script/interpreter.h"
+#include "uint256.h"
 
+#include <atomic>
+#include <memory>
+#include <stdint.h>
 #include <vector>
 
+#include <boost/thread/mutex.hpp>
+
 class CPubKey;
 
+/** Default for -maxsigcachesize, in MiB */
+static const unsigned int DEFAULT_MAX_SIG_CACHE_SIZE = 32;
+/** Upper limit for -maxsigcachesize; larger values are read as the entry count it used to be */
+static const unsigned int MAX_MAX_SIG_CACHE_SIZE = 1024;
+
+/**
+ * Valid signature cache, to avoid doing expensive ECDSA signature checking
+ * twice for every transaction (once when accepted into memory pool, and
+ * again when accepted into the block chain).
+ *
+ * Entries are salted hashes of (signature hash, public key, signature), kept
+ * in a fixed table of 32 byte slots that is allocated once. Each entry has
+ * eight candidate slots derived from its hash (cuckoo hashing): a lookup
+ * reads those eight slots without taking any lock, an insertion takes a
+ * writer lock and, if none of them is free, moves occupants to one of their
+ * other slots for a bounded number of steps before dropping the last one.
+ * Entries that block validation has used are marked collectable, so that
+ * insertions reuse their slots first.
+ *
+ * Slots are read and written word by word through relaxed atomics, so a
+ * reader racing an insertion may see a mix of two entries. That can only
+ * cause a miss: matching a lookup would require finding a partial collision
+ * of the salted hash.
+ */
+class CSignatureCache
+{
+private:
+    struct CSlot {
+        std::atomic<uint64_t> vWords[4];
+    };
+
+    uint256 nonce;
+    uint32_t nSlots;
+    std::unique_ptr<CSlot[]> vSlots;
+    std::unique_ptr<std::atomic<bool>[]> vCollectable;
+    unsigned int nMaxDepth;
+    boost::mutex cs_insert;
+
+    std::atomic<uint64_t> nHits;
+    std::atomic<uint64_t> nMisses;
+    std::atomic<uint64_t> nInserts;
+    std::atomic<uint64_t> nEvictions;
+
+    CSignatureCache(const CSignatureCache&);
+    void operator=(const CSignatureCache&);
+
+    void ComputeEntry(uint256& entry, const uint256& hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey) const;
+    void ComputeSlots(uint32_t vPos[8], const uint256& entry) const;
+    bool Matches(uint32_t nPos, const uint256& entry) const;
+    void Load(uint32_t nPos, uint256& entry) const;
+    void Store(uint32_t nPos, const uint256& entry);
+
+public:
+    /** Allocate a table of at most nBytes; a budget too small for any slot disables the cache. */
+    explicit CSignatureCache(size_t nBytes);
+
+    /** Look a signature up; fErase marks a hit collectable as it is not expected to be needed again. */
+    bool Get(const uint256& hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey, bool fErase);
+    void Set(const uint256& hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey);
+
+    /** Memory one entry takes in the table */
+    static size_t GetSlotSize() { return sizeof(CSlot) + sizeof(std::atomic<bool>); }
+    size_t GetSlots() const { return nSlots; }
+    size_t GetMemoryUsage() const { return (size_t)nSlots * GetSlotSize(); }
+    void GetStats(uint64_t& nHitsOut, uint64_t& nMissesOut, uint64_t& nInsertsOut, uint64_t& nEvictionsOut) const;
+};
+
+/**
+ * Bytes of signature cache for a -maxsigcachesize value in MiB. The option used
+ * to count entries, so a value above MAX_MAX_SIG_CACHE_SIZE is read as a number
+ * of entries, setting fEntryCount, and sized to hold that many.
+ */
+size_t GetSignatureCacheBytes(int64_t nSize, bool& fEntryCount);
+
+/** The cache shared by all CachingTransactionSignatureCheckers, sized by -maxsigcachesize on first use */
+CSignatureCache& GetSignatureCache();
+
 class CachingTransactionSignatureChecker : public TransactionSignatureChecker
 {
 private:
@@ -0,0 +1,295 @@
+// Copyright (c) 2018 The KoinMudra developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "socketevents.h"
+
+#include "netbase.h"
+#include "util.h"
+#include "utiltime.h"
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <vector>
+
+#include <string.h>
+
+#ifdef HAVE_SYS_EPOLL_H
+#include <errno.h>
+#include <sys/epoll.h>
+#endif
+
+namespace
+{
+/** Portable backend: rebuild the fd_sets from the watched sockets and select() on every round. */
+class CSocketEventsSelect : public CSocketEvents
+{
+private:
+    struct CEntry {
+        const void* pOwner;
+        bool fWantRecv;
+        bool fWantSend;
+    };
+
+    std::map<SOCKET, CEntry> mapSockets;
+    fd_set fdsetRecv;
+    fd_set fdsetSend;
+    fd_set fdsetError;
+
+public:
+    CSocketEventsSelect()
+    {
+        FD_ZERO(&fdsetRecv);
+        FD_ZERO(&fdsetSend);
+        FD_ZERO(&fdsetError);
+    }
+
+    const char* GetName() const { return "select"; }
+
+    bool CanWatch(SOCKET hSocket) const
+    {
+        return IsSelectableSocket(hSocket);
+    }
+
+    void Watch(SOCKET hSocket, const void* pOwner, bool fRecv, bool fSend)
+    {
+        CEntry& entry = mapSockets[hSocket];
+        entry.pOwner = pOwner;
+        entry.fWantRecv = fRecv;
+        entry.fWantSend = fSend;
+    }
+
+    void Unwatch(SOCKET hSocket, const void* pOwner)
+    {
+        std::map<SOCKET, CEntry>::iterator it = mapSockets.find(hSocket);
+        if (it != mapSockets.end() && it->second.pOwner == pOwner)
+            mapSockets.erase(it);
+    }
+
+    void Wait(int64_t nTimeout)
+    {
+        FD_ZERO(&fdsetRecv);
+        FD_ZERO(&fdsetSend);
+        FD_ZERO(&fdsetError);
+        SOCKET hSocketMax = 0;
+        bool fHaveFds = !mapSockets.empty();
+        for (std::map<SOCKET, CEntry>::const_iterator it = mapSockets.begin(); it != mapSockets.end(); ++it) {
+            FD_SET(it->first, &fdsetError);
+            if (it->second.fWantRecv)
+                FD_SET(it->first, &fdsetRecv);
+            if (it->second.fWantSend)
+                FD_SET(it->first, &fdsetSend);
+            hSocketMax = std::max(hSocketMax, it->first);
+        }
+
+        struct timeval timeout = MillisToTimeval(nTimeout);
+        int nSelect = select(fHaveFds ? hSocketMax + 1 : 0,
+            &fdsetRecv, &fdsetSend, &fdsetError, &timeout);
+
+        if (nSelect == SOCKET_ERROR) {
+            if (fHaveFds) {
+                int nErr = WSAGetLastError();
+                LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
+                for (unsigned int i = 0; i <= hSocketMax; i++)
+                    FD_SET(i, &fdsetRecv);
+            }
+            FD_ZERO(&fdsetSend);
+            FD_ZERO(&fdsetError);
+            MilliSleep(nTimeout);
+        }
+    }
+
+    bool IsRecvReady(SOCKET hSocket) const
+    {
+        return FD_ISSET(hSocket, &fdsetRecv) || FD_ISSET(hSocket, &fdsetError);
+    }
+
+    bool IsSendReady(SOCKET hSocket) const
+    {
+        return FD_ISSET(hSocket, &fdsetSend);
+    }
+};
+
+#ifdef HAVE_SYS_EPOLL_H
+/** Number of events collected per epoll_wait() call. */
+static const int EPOLL_MAX_EVENTS = 256;
+
+/**
+ * Linux backend: sockets stay registered with an edge-triggered epoll set for
+ * as long as they are watched, so a round only costs work for the sockets that
+ * actually changed state. Readiness is remembered per socket until the caller
+ * reports that it drained the socket.
+ */
+class CSocketEventsEpoll : public CSocketEvents
+{
+private:
+    struct CEntry {
+        const void* pOwner;
+        bool fWantRecv;
+        bool fWantSend;
+        bool fRecvReady;
+        bool fSendReady;
+        bool fError;
+
+        CEntry(const void* pOwnerIn) : pOwner(pOwnerIn), fWantRecv(false), fWantSend(false),
+                                       fRecvReady(false), fSendReady(false), fError(false) {}
+    };
+
+    int hEpoll;
+    std::map<SOCKET, CEntry> mapSockets;
+    //! sockets with readiness the caller wants and has not used up yet
+    std::set<SOCKET> setPending;
+    std::vector<struct epoll_event> vEvents;
+
+    void UpdatePending(const std::map<SOCKET, CEntry>::iterator& it)
+    {
+        const CEntry& entry = it->second;
+        if (entry.fError || (entry.fWantRecv && entry.fRecvReady) || (entry.fWantSend && entry.fSendReady))
+            setPending.insert(it->first);
+        else
+            setPending.erase(it->first);
+    }
+
+    void Erase(const std::map<SOCKET, CEntry>::iterator& it)
+    {
+        // Closed descriptors have left the epoll set already
+        epoll_ctl(hEpoll, EPOLL_CTL_DEL, it->first, NULL);
+        setPending.erase(it->first);
+        mapSockets.erase(it);
+    }
+
+public:
+    CSocketEventsEpoll(int hEpollIn) : hEpoll(hEpollIn), vEvents(EPOLL_MAX_EVENTS) {}
+
+    ~CSocketEventsEpoll()
+    {
+        close(hEpoll);
+    }
+
+    const char* GetName() const { return "epoll"; }
+
+    bool CanWatch(SOCKET hSocket) const
+    {
+        return true;
+    }
+
+    void Watch(SOCKET hSocket, const void* pOwner, bool fRecv, bool fSend)
+    {
+        std::map<SOCKET, CEntry>::iterator it = mapSockets.find(hSocket);
+        if (it == mapSockets.end() || it->second.pOwner != pOwner) {
+            // The descriptor was closed and reused; the old registration may already be gone
+            if (it != mapSockets.end())
+                Erase(it);
+            struct epoll_event event;
+            memset(&event, 0, sizeof(event));
+            event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+            event.data.fd = hSocket;
+            if (epoll_ctl(hEpoll, EPOLL_CTL_ADD, hSocket, &event) != 0 &&
+                (errno != EEXIST || epoll_ctl(hEpoll, EPOLL_CTL_MOD, hSocket, &event) != 0)) {
+                LogPrintf("socket epoll_ctl error %s\n", NetworkErrorString(errno));
+                return;
+            }
+            it = mapSockets.insert(std::make_pair(hSocket, CEntry(pOwner))).first;
+        }
+        it->second.fWantRecv = fRecv;
+        it->second.fWantSend = fSend;
+        UpdatePending(it);
+    }
+
+    void Unwatch(SOCKET hSocket, const void* pOwner)
+    {
+        std::map<SOCKET, CEntry>::iterator it = mapSockets.find(hSocket);
+        if (it != mapSockets.end() && it->second.pOwner == pOwner)
+            Erase(it);
+    }
+
+    void Wait(int64_t nTimeout)
+    {
+        // Sockets that are still ready from an earlier edge must not wait for a new one
+        int nEvents = epoll_wait(hEpoll, &vEvents[0], vEvents.size(), setPending.empty() ? nTimeout : 0);
+        if (nEvents < 0) {
+            if (errno != EINTR) {
+                LogPrintf("socket epoll_wait error %s\n", NetworkErrorString(errno));
+                MilliSleep(nTimeout);
+            }
+            return;
+        }
+
+        for (int i = 0; i < nEvents; i++) {
+            std::map<SOCKET, CEntry>::iterator it = mapSockets.find(vEvents[i].data.fd);
+            if (it == mapSockets.end())
+                continue;
+            uint32_t events = vEvents[i].events;
+            if (events & (EPOLLIN | EPOLLRDHUP))
+                it->second.fRecvReady = true;
+            if (events & EPOLLOUT)
+                it->second.fSendReady = true;
+            if (events & (EPOLLERR | EPOLLHUP))
+                it->second.fError = true;
+            UpdatePending(it);
+        }
+    }
+
+    bool IsRecvReady(SOCKET hSocket) const
+    {
+        std::map<SOCKET, CEntry>::const_iterator it = mapSockets.find(hSocket);
+        if (it == mapSockets.end())
+            return false;
+        return it->second.fError || (it->second.fWantRecv && it->second.fRecvReady);
+    }
+
+    bool IsSendReady(SOCKET hSocket) const
+    {
+        std::map<SOCKET, CEntry>::const_iterator it = mapSockets.find(hSocket);
+        if (it == mapSockets.end())
+            return false;
+        return it->second.fWantSend && it->second.fSendReady;
+    }
+
+    void RecvDrained(SOCKET hSocket)
+    {
+        std::map<SOCKET, CEntry>::iterator it = mapSockets.find(hSocket);
+        if (it != mapSockets.end()) {
+            it->second.fRecvReady = false;
+            UpdatePending(it);
+        }
+    }
+
+    void SendBlocked(SOCKET hSocket)
+    {
+        std::map<SOCKET, CEntry>::iterator it = mapSockets.find(hSocket);
+        if (it != mapSockets.end()) {
+            it->second.fSendReady = false;
+            UpdatePending(it);
+        }
+    }
+};
+#endif // HAVE_SYS_EPOLL_H
+
+} // namespace
+
+bool IsSocketEventsModeSupported(const std::string& strMode)
+{
+#ifdef HAVE_SYS_EPOLL_H
+    if (strMode == "epoll")
+        return true;
+#endif
+    return strMode == "select";
+}
+
+CSocketEvents* CreateSocketEvents(const std::string& strMode)
+{
+#ifdef HAVE_SYS_EPOLL_H
+    if (strMode == "epoll") {
+        int hEpoll = epoll_create1(EPOLL_CLOEXEC);
+        if (hEpoll != -1)
+            return new CSocketEventsEpoll(hEpoll);
+        LogPrintf("epoll_create1 failed: %s, falling back to select\n", NetworkErrorString(errno));
+        return new CSocketEventsSelect();
+    }
+#endif
+    if (strMode == "select")
+        return new CSocketEventsSelect();
+    return NULL;
+}
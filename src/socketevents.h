@@ -0,0 +1,71 @@
+// Copyright (c) 2018 The KoinMudra developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SOCKETEVENTS_H
+#define BITCOIN_SOCKETEVENTS_H
+
+#include "compat.h"
+
+#include <stdint.h>
+#include <string>
+
+/** Default socket readiness backend: epoll where the platform has it, select() everywhere else */
+#ifdef HAVE_SYS_EPOLL_H
+static const char* const DEFAULT_SOCKETEVENTS = "epoll";
+#else
+static const char* const DEFAULT_SOCKETEVENTS = "select";
+#endif
+
+/**
+ * Readiness backend for the socket handler thread.
+ *
+ * A socket is watched from Watch() until Unwatch(), in the directions last
+ * given to Watch(), so the caller only calls Watch() again when its interest
+ * changes. Every loop iteration the caller blocks in Wait() and then asks
+ * which sockets can be read from or written to.
+ *
+ * Edge-triggered backends only report a socket once when it becomes ready, so
+ * the caller must report back with RecvDrained() and SendBlocked() once a
+ * socket stops being readable or writable.
+ */
+class CSocketEvents
+{
+public:
+    virtual ~CSocketEvents() {}
+
+    virtual const char* GetName() const = 0;
+
+    /** Whether hSocket can be handled by this backend at all. */
+    virtual bool CanWatch(SOCKET hSocket) const = 0;
+
+    /**
+     * Watch hSocket in the given directions. pOwner identifies the object holding
+     * the socket, so that a descriptor reused by a new connection is not mistaken
+     * for the one that was closed.
+     */
+    virtual void Watch(SOCKET hSocket, const void* pOwner, bool fRecv, bool fSend) = 0;
+
+    /** Stop watching hSocket, unless it was watched for another owner since. It may be closed already. */
+    virtual void Unwatch(SOCKET hSocket, const void* pOwner) = 0;
+
+    /** Wait up to nTimeout milliseconds for any watched socket to become ready. */
+    virtual void Wait(int64_t nTimeout) = 0;
+
+    virtual bool IsRecvReady(SOCKET hSocket) const = 0;
+    virtual bool IsSendReady(SOCKET hSocket) const = 0;
+
+    /** recv() on hSocket returned less than was asked for. */
+    virtual void RecvDrained(SOCKET hSocket) {}
+
+    /** send() on hSocket could not take all queued data. */
+    virtual void SendBlocked(SOCKET hSocket) {}
+};
+
+/** Whether strMode names a socket events backend available on this platform. */
+bool IsSocketEventsModeSupported(const std::string& strMode);
+
+/** Create the socket events backend named by strMode, or NULL if it is not supported. */
+CSocketEvents* CreateSocketEvents(const std::string& strMode);
+
+#endif // BITCOIN_SOCKETEVENTS_H
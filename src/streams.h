@@ -564,4 +564,44 @@ public:
     }
 };
 
+/** Read-only stream over memory owned by someone else, such as a memory mapped
+ *  block file. Objects are deserialized straight from that memory without
+ *  copying it into a buffer first. The memory must outlive the reader.
+ */
+class CMemoryReader
+{
+private:
+    int nType;
+    int nVersion;
+
+    const char* pcur;
+    const char* pend;
+
+public:
+    CMemoryReader(const char* pbeginIn, const char* pendIn, int nTypeIn, int nVersionIn) : nType(nTypeIn), nVersion(nVersionIn), pcur(pbeginIn), pend(pendIn) {}
+
+    int GetType() { return nType; }
+    int GetVersion() { return nVersion; }
+
+    size_t size() const { return pend - pcur; }
+    bool empty() const { return pcur == pend; }
+
+    CMemoryReader& read(char* pch, size_t nSize)
+    {
+        if (nSize > size())
+            throw std::ios_base::failure("CMemoryReader::read : end of data");
+        memcpy(pch, pcur, nSize);
+        pcur += nSize;
+        return (*this);
+    }
+
+    template <typename T>
+    CMemoryReader& operator>>(T& obj)
+    {
+        // Unserialize from this stream
+        ::Unserialize(*this, obj, nType, nVersion);
+        return (*this);
+    }
+};
+
 #endif // BITCOIN_STREAMS_H
@@ -20,6 +20,27 @@ void PrintLockContention(const char* pszName, const char* pszFile, int nLine)
 }
 #endif /* DEBUG_LOCKCONTENTION */
 
+static void LockWaitCounterNoCleanup(CLockWaitCounter* pcounter) {}
+
+//! Innermost lock wait counter of each thread; the counters live on the stack of their thread
+static boost::thread_specific_ptr<CLockWaitCounter> lockwaitcounter(LockWaitCounterNoCleanup);
+
+CLockWaitCounter::CLockWaitCounter(void* csIn) : cs(csIn), pprev(lockwaitcounter.get()), nWaitMicros(0)
+{
+    lockwaitcounter.reset(this);
+}
+
+CLockWaitCounter::~CLockWaitCounter()
+{
+    lockwaitcounter.reset(pprev);
+}
+
+CLockWaitCounter* CLockWaitCounter::Get(void* cs)
+{
+    CLockWaitCounter* pcounter = lockwaitcounter.get();
+    return (pcounter && pcounter->cs == cs) ? pcounter : NULL;
+}
+
 #ifdef DEBUG_LOCKORDER
 //
 // Early deadlock detection.
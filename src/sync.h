@@ -7,6 +7,7 @@
 #define BITCOIN_SYNC_H
 
 #include "threadsafety.h"
+#include "utiltime.h"
 
 #include <boost/thread/condition_variable.hpp>
 #include <boost/thread/locks.hpp>
@@ -104,6 +105,27 @@ void static inline AssertLockHeldInternal(const char* pszName, const char* pszFi
 void PrintLockContention(const char* pszName, const char* pszFile, int nLine);
 #endif
 
+/**
+ * Lock wait accounting. While a CLockWaitCounter is alive, the time its thread
+ * spends blocked on the one critical section it watches is added to nWaitMicros.
+ * Counters nest; only the innermost one on a thread is updated.
+ */
+class CLockWaitCounter
+{
+private:
+    void* cs;
+    CLockWaitCounter* pprev;
+
+public:
+    int64_t nWaitMicros;
+
+    CLockWaitCounter(void* csIn);
+    ~CLockWaitCounter();
+
+    /** The counter of the calling thread that watches cs, or NULL. Only called on contention. */
+    static CLockWaitCounter* Get(void* cs);
+};
+
 /** Wrapper around boost::unique_lock<Mutex> */
 template <typename Mutex>
 class CMutexLock
@@ -114,14 +136,16 @@ private:
     void Enter(const char* pszName, const char* pszFile, int nLine)
     {
         EnterCritical(pszName, pszFile, nLine, (void*)(lock.mutex()));
-#ifdef DEBUG_LOCKCONTENTION
         if (!lock.try_lock()) {
+#ifdef DEBUG_LOCKCONTENTION
             PrintLockContention(pszName, pszFile, nLine);
 #endif
+            CLockWaitCounter* pcounter = CLockWaitCounter::Get((void*)(lock.mutex()));
+            int64_t nStart = pcounter ? GetTimeMicros() : 0;
             lock.lock();
-#ifdef DEBUG_LOCKCONTENTION
+            if (pcounter)
+                pcounter->nWaitMicros += GetTimeMicros() - nStart;
         }
-#endif
     }
 
     bool TryEnter(const char* pszName, const char* pszFile, int nLine)
@@ -0,0 +1,150 @@
+// Copyright (c) 2018 The KoinMudra developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilemap.h"
+#include "chainparams.h"
+#include "main.h"
+
+#include <string.h>
+#include <string>
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(blockfilemap_tests)
+
+#ifndef WIN32
+
+/** Append a block record as WriteBlockToDisk() does; returns the position of its payload. */
+static unsigned int AppendRecord(int nFile, const std::string& strPayload, unsigned int nSize, const unsigned char* pchMagic)
+{
+    boost::filesystem::path path = GetBlockPosFilename(CDiskBlockPos(nFile, 0), "blk");
+    boost::filesystem::create_directories(path.parent_path());
+    FILE* file = fopen(path.string().c_str(), "ab");
+    BOOST_REQUIRE(file != NULL);
+    fwrite(pchMagic, 1, MESSAGE_START_SIZE, file);
+    fwrite(&nSize, 1, sizeof(nSize), file);
+    unsigned int nPos = ftell(file);
+    fwrite(strPayload.data(), 1, strPayload.size(), file);
+    fclose(file);
+    return nPos;
+}
+
+static unsigned int AppendBlock(int nFile, const std::string& strPayload)
+{
+    return AppendRecord(nFile, strPayload, strPayload.size(), Params().MessageStart());
+}
+
+static std::string GetPayload(const CMappedBlock& block)
+{
+    return std::string(block.pbegin, block.pend);
+}
+
+static void RemoveFiles(int nFirst, int nLast)
+{
+    for (int nFile = nFirst; nFile <= nLast; nFile++)
+        boost::filesystem::remove(GetBlockPosFilename(CDiskBlockPos(nFile, 0), "blk"));
+}
+
+BOOST_AUTO_TEST_CASE(blockfilemap_growth)
+{
+    CBlockFileMap map(4);
+    unsigned int nPos1 = AppendBlock(900, "first block");
+    CMappedBlock block1;
+    BOOST_REQUIRE(map.GetBlock(CDiskBlockPos(900, nPos1), block1));
+    BOOST_CHECK_EQUAL(GetPayload(block1), "first block");
+
+    // A block appended after the file was mapped is found through a new mapping
+    unsigned int nPos2 = AppendBlock(900, "second block");
+    CMappedBlock block2;
+    BOOST_REQUIRE(map.GetBlock(CDiskBlockPos(900, nPos2), block2));
+    BOOST_CHECK_EQUAL(GetPayload(block2), "second block");
+    BOOST_CHECK(block2.file != block1.file);
+    BOOST_CHECK(block2.file->nSize > block1.file->nSize);
+
+    // The old mapping stays readable while held; the new one serves both blocks
+    BOOST_CHECK_EQUAL(GetPayload(block1), "first block");
+    CMappedBlock block1Again;
+    BOOST_REQUIRE(map.GetBlock(CDiskBlockPos(900, nPos1), block1Again));
+    BOOST_CHECK(block1Again.file == block2.file);
+    BOOST_CHECK_EQUAL(GetPayload(block1Again), "first block");
+
+    RemoveFiles(900, 900);
+}
+
+BOOST_AUTO_TEST_CASE(blockfilemap_lru)
+{
+    CBlockFileMap map(2);
+    unsigned int nPos[3];
+    CMappedBlock blocks[3];
+    for (int i = 0; i < 3; i++)
+        nPos[i] = AppendBlock(910 + i, "block " + std::string(1, '0' + i));
+
+    BOOST_REQUIRE(map.GetBlock(CDiskBlockPos(910, nPos[0]), blocks[0]));
+    BOOST_REQUIRE(map.GetBlock(CDiskBlockPos(911, nPos[1]), blocks[1]));
+
+    // Within the limit the mappings are reused
+    CMappedBlock block;
+    BOOST_REQUIRE(map.GetBlock(CDiskBlockPos(910, nPos[0]), block));
+    BOOST_CHECK(block.file == blocks[0].file);
+
+    // A third file evicts the least recently used one, 911
+    BOOST_REQUIRE(map.GetBlock(CDiskBlockPos(912, nPos[2]), blocks[2]));
+    BOOST_REQUIRE(map.GetBlock(CDiskBlockPos(910, nPos[0]), block));
+    BOOST_CHECK(block.file == blocks[0].file);
+    BOOST_REQUIRE(map.GetBlock(CDiskBlockPos(911, nPos[1]), block));
+    BOOST_CHECK(block.file != blocks[1].file);
+    BOOST_CHECK_EQUAL(GetPayload(block), "block 1");
+
+    // Evicted mappings held by a caller stay valid
+    BOOST_CHECK_EQUAL(GetPayload(blocks[1]), "block 1");
+
+    // After Clear() every file is mapped again
+    map.Clear();
+    BOOST_REQUIRE(map.GetBlock(CDiskBlockPos(912, nPos[2]), block));
+    BOOST_CHECK(block.file != blocks[2].file);
+    BOOST_CHECK_EQUAL(GetPayload(blocks[2]), "block 2");
+
+    RemoveFiles(910, 912);
+}
+
+BOOST_AUTO_TEST_CASE(blockfilemap_reject)
+{
+    CBlockFileMap map(4);
+    CMappedBlock block;
+    unsigned int nPos = AppendBlock(920, "good block");
+    BOOST_CHECK(map.GetBlock(CDiskBlockPos(920, nPos), block));
+
+    // Positions that leave no room for the header, or lie past the end of the file
+    BOOST_CHECK(!map.GetBlock(CDiskBlockPos(), block));
+    BOOST_CHECK(!map.GetBlock(CDiskBlockPos(920, 0), block));
+    BOOST_CHECK(!map.GetBlock(CDiskBlockPos(920, MESSAGE_START_SIZE + sizeof(unsigned int) - 1), block));
+    BOOST_CHECK(!map.GetBlock(CDiskBlockPos(920, nPos + 1000), block));
+    BOOST_CHECK(!map.GetBlock(CDiskBlockPos(929, nPos), block));
+
+    // A size field running past the end of the file
+    unsigned int nPosTruncated = AppendRecord(920, "short", 1000, Params().MessageStart());
+    BOOST_CHECK(!map.GetBlock(CDiskBlockPos(920, nPosTruncated), block));
+
+    // A record behind another network's magic
+    unsigned char pchMagic[MESSAGE_START_SIZE];
+    memcpy(pchMagic, Params().MessageStart(), MESSAGE_START_SIZE);
+    pchMagic[0] ^= 0xff;
+    unsigned int nPosMagic = AppendRecord(920, "foreign block", 13, pchMagic);
+    BOOST_CHECK(!map.GetBlock(CDiskBlockPos(920, nPosMagic), block));
+
+    // A size above the block size limit, even where the file is long enough
+    unsigned int nPosLarge = AppendRecord(920, std::string(MAX_BLOCK_SIZE + 1, 'x'), MAX_BLOCK_SIZE + 1, Params().MessageStart());
+    BOOST_CHECK(!map.GetBlock(CDiskBlockPos(920, nPosLarge), block));
+
+    // The good block is still served from the grown file
+    BOOST_CHECK(map.GetBlock(CDiskBlockPos(920, nPos), block));
+    BOOST_CHECK_EQUAL(GetPayload(block), "good block");
+
+    RemoveFiles(920, 920);
+}
+
+#endif
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,64 @@
+// Copyright (c) 2018 The KoinMudra developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "cachedb.h"
+
+#include <map>
+#include <string>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(cachedb_tests)
+
+BOOST_AUTO_TEST_CASE(cachedb_roundtrip)
+{
+    std::map<int, std::string> mapA, mapB;
+    mapA[1] = "one";
+    mapA[2] = "two";
+    mapB[1] = "other table";
+
+    {
+        CCacheDB db("cachedb_test", 0, true);
+        db.WriteMap('a', mapA);
+        db.WriteMap('b', mapB);
+        BOOST_CHECK(db.Commit());
+
+        // a pass that leaves out a record erases it
+        mapA.erase(1);
+        mapA[2] = "changed";
+        mapA[3] = "three";
+        db.WriteMap('a', mapA);
+        db.WriteMap('b', mapB);
+        BOOST_CHECK(db.Commit());
+    }
+
+    {
+        CCacheDB db("cachedb_test", 0);
+        std::map<int, std::string> mapReadA, mapReadB;
+        BOOST_CHECK(db.ReadMap('a', mapReadA));
+        BOOST_CHECK(db.ReadMap('b', mapReadB));
+        BOOST_CHECK(mapReadA == mapA);
+        BOOST_CHECK(mapReadB == mapB);
+
+        // records loaded but not written again are erased by the next pass
+        db.WriteMap('a', mapA);
+        BOOST_CHECK(db.Commit());
+    }
+
+    {
+        CCacheDB db("cachedb_test", 0);
+        std::map<int, std::string> mapReadA, mapReadB;
+        BOOST_CHECK(db.ReadMap('a', mapReadA));
+        BOOST_CHECK(db.ReadMap('b', mapReadB));
+        BOOST_CHECK(mapReadA == mapA);
+        BOOST_CHECK(mapReadB.empty());
+
+        BOOST_CHECK(db.Wipe());
+        mapReadA.clear();
+        BOOST_CHECK(db.ReadMap('a', mapReadA));
+        BOOST_CHECK(mapReadA.empty());
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
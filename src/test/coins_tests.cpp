@@ -2,9 +2,13 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "clientversion.h"
 #include "coins.h"
 #include "random.h"
+#include "streams.h"
 #include "uint256.h"
+#include "undo.h"
+#include "utilstrencodings.h"
 
 #include <vector>
 #include <map>
@@ -16,27 +20,27 @@ namespace
 class CCoinsViewTest : public CCoinsView
 {
     uint256 hashBestBlock_;
-    std::map<uint256, CCoins> map_;
+    std::map<COutPoint, Coin> map_;
 
 public:
-    bool GetCoins(const uint256& txid, CCoins& coins) const
+    bool GetCoin(const COutPoint& outpoint, Coin& coin) const
     {
-        std::map<uint256, CCoins>::const_iterator it = map_.find(txid);
+        std::map<COutPoint, Coin>::const_iterator it = map_.find(outpoint);
         if (it == map_.end()) {
             return false;
         }
-        coins = it->second;
-        if (coins.IsPruned() && insecure_rand() % 2 == 0) {
+        coin = it->second;
+        if (coin.IsSpent() && insecure_rand() % 2 == 0) {
             // Randomly return false in case of an empty entry.
             return false;
         }
-        return true;
+        return !coin.IsSpent();
     }
 
-    bool HaveCoins(const uint256& txid) const
+    bool HaveCoin(const COutPoint& outpoint) const
     {
-        CCoins coins;
-        return GetCoins(txid, coins);
+        Coin coin;
+        return GetCoin(outpoint, coin);
     }
 
     uint256 GetBestBlock() const { return hashBestBlock_; }
@@ -44,10 +48,13 @@ public:
     bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock)
     {
         for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); ) {
-            map_[it->first] = it->second.coins;
-            if (it->second.coins.IsPruned() && insecure_rand() % 3 == 0) {
-                // Randomly delete empty entries on write.
-                map_.erase(it->first);
+            if (it->second.flags & CCoinsCacheEntry::DIRTY) {
+                // Same optimization used in CCoinsViewDB is to only write dirty entries.
+                map_[it->first] = it->second.coin;
+                if (it->second.coin.IsSpent() && insecure_rand() % 3 == 0) {
+                    // Randomly delete empty entries on write.
+                    map_.erase(it->first);
+                }
             }
             mapCoins.erase(it++);
         }
@@ -58,6 +65,40 @@ public:
 
     bool GetStats(CCoinsStats& stats) const { return false; }
 };
+
+/** An empty view that counts the lookups reaching it. */
+class CCoinsViewCounting : public CCoinsView
+{
+public:
+    mutable unsigned int nLookups;
+
+    CCoinsViewCounting() : nLookups(0) {}
+
+    bool GetCoin(const COutPoint& outpoint, Coin& coin) const
+    {
+        nLookups++;
+        return false;
+    }
+};
+
+class CCoinsViewCacheTest : public CCoinsViewCache
+{
+public:
+    CCoinsViewCacheTest(CCoinsView* base) : CCoinsViewCache(base) {}
+
+    void SelfTest() const
+    {
+        // Manually recompute the dynamic usage of the whole data, and compare it.
+        size_t ret = memusage::DynamicUsage(cacheCoins);
+        size_t count = 0;
+        for (CCoinsMap::iterator it = cacheCoins.begin(); it != cacheCoins.end(); it++) {
+            ret += it->second.coin.DynamicMemoryUsage();
+            count++;
+        }
+        BOOST_CHECK_EQUAL(GetCacheSize(), count);
+        BOOST_CHECK_EQUAL(DynamicMemoryUsage(), ret);
+    }
+};
 }
 
 BOOST_AUTO_TEST_SUITE(coins_tests)
@@ -67,8 +108,8 @@ static const unsigned int NUM_SIMULATION_ITERATIONS = 40000;
 // This is a large randomized insert/remove simulation test on a variable-size
 // stack of caches on top of CCoinsViewTest.
 //
-// It will randomly create/update/delete CCoins entries to a tip of caches, with
-// txids picked from a limited list of random 256-bit hashes. Occasionally, a
+// It will randomly create/update/delete Coin entries to a tip of caches, with
+// outpoints picked from a limited list of random 256-bit hashes. Occasionally, a
 // new tip is added to the stack of caches, or the tip is flushed and removed.
 //
 // During the process, booleans are kept to make sure that the randomized
@@ -83,14 +124,15 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
     bool updated_an_entry = false;
     bool found_an_entry = false;
     bool missed_an_entry = false;
+    bool uncached_an_entry = false;
 
     // A simple map to track what we expect the cache stack to represent.
-    std::map<uint256, CCoins> result;
+    std::map<COutPoint, Coin> result;
 
     // The cache stack.
     CCoinsViewTest base; // A CCoinsViewTest at the bottom.
-    std::vector<CCoinsViewCache*> stack; // A stack of CCoinsViewCaches on top.
-    stack.push_back(new CCoinsViewCache(&base)); // Start with one cache.
+    std::vector<CCoinsViewCacheTest*> stack; // A stack of CCoinsViewCaches on top.
+    stack.push_back(new CCoinsViewCacheTest(&base)); // Start with one cache.
 
     // Use a limited set of random transaction ids, so we do test overwriting entries.
     std::vector<uint256> txids;
@@ -102,41 +144,61 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
     for (unsigned int i = 0; i < NUM_SIMULATION_ITERATIONS; i++) {
         // Do a random modification.
         {
-            uint256 txid = txids[insecure_rand() % txids.size()]; // txid we're going to modify in this iteration.
-            CCoins& coins = result[txid];
-            CCoinsModifier entry = stack.back()->ModifyCoins(txid);
-            BOOST_CHECK(coins == *entry);
-            if (insecure_rand() % 5 == 0 || coins.IsPruned()) {
-                if (coins.IsPruned()) {
+            COutPoint outpoint(txids[insecure_rand() % txids.size()], insecure_rand() % 3); // outpoint we're going to modify in this iteration.
+            Coin& coin = result[outpoint];
+            const Coin& entry = stack.back()->AccessCoin(outpoint);
+            BOOST_CHECK(coin == entry);
+            if (insecure_rand() % 5 == 0 || coin.IsSpent()) {
+                Coin newcoin;
+                newcoin.out.nValue = insecure_rand();
+                newcoin.nHeight = 1;
+                if (coin.IsSpent()) {
                     added_an_entry = true;
                 } else {
                     updated_an_entry = true;
                 }
-                coins.nVersion = insecure_rand();
-                coins.vout.resize(1);
-                coins.vout[0].nValue = insecure_rand();
-                *entry = coins;
+                stack.back()->AddCoin(outpoint, newcoin, !coin.IsSpent() || insecure_rand() & 1);
+                coin = newcoin;
             } else {
-                coins.Clear();
-                entry->Clear();
                 removed_an_entry = true;
+                coin.Clear();
+                stack.back()->SpendCoin(outpoint);
             }
         }
 
+        // One every 10 iterations, remove a random entry from the cache
+        if (insecure_rand() % 10 == 0) {
+            COutPoint outpoint(txids[insecure_rand() % txids.size()], insecure_rand() % 3);
+            int cacheid = insecure_rand() % stack.size();
+            stack[cacheid]->Uncache(outpoint);
+            uncached_an_entry |= !stack[cacheid]->HaveCoinInCache(outpoint);
+        }
+
         // Once every 1000 iterations and at the end, verify the full cache.
         if (insecure_rand() % 1000 == 1 || i == NUM_SIMULATION_ITERATIONS - 1) {
-            for (std::map<uint256, CCoins>::iterator it = result.begin(); it != result.end(); it++) {
-                const CCoins* coins = stack.back()->AccessCoins(it->first);
-                if (coins) {
-                    BOOST_CHECK(*coins == it->second);
-                    found_an_entry = true;
-                } else {
-                    BOOST_CHECK(it->second.IsPruned());
+            for (std::map<COutPoint, Coin>::iterator it = result.begin(); it != result.end(); it++) {
+                bool have = stack.back()->HaveCoin(it->first);
+                const Coin& coin = stack.back()->AccessCoin(it->first);
+                BOOST_CHECK(have == !coin.IsSpent());
+                BOOST_CHECK(coin == it->second);
+                if (coin.IsSpent()) {
                     missed_an_entry = true;
+                } else {
+                    BOOST_CHECK(stack.back()->HaveCoinInCache(it->first));
+                    found_an_entry = true;
                 }
             }
+            for (unsigned int n = 0; n < stack.size(); n++)
+                stack[n]->SelfTest();
         }
 
+        if (insecure_rand() % 100 == 0) {
+            // Every 100 iterations, flush an intermediate cache
+            if (stack.size() > 1 && insecure_rand() % 2 == 0) {
+                unsigned int flushIndex = insecure_rand() % (stack.size() - 1);
+                stack[flushIndex]->Flush();
+            }
+        }
         if (insecure_rand() % 100 == 0) {
             // Every 100 iterations, change the cache stack.
             if (stack.size() > 0 && insecure_rand() % 2 == 0) {
@@ -151,7 +213,7 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
                 } else {
                     removed_all_caches = true;
                 }
-                stack.push_back(new CCoinsViewCache(tip));
+                stack.push_back(new CCoinsViewCacheTest(tip));
                 if (stack.size() == 4) {
                     reached_4_caches = true;
                 }
@@ -173,6 +235,71 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
     BOOST_CHECK(updated_an_entry);
     BOOST_CHECK(found_an_entry);
     BOOST_CHECK(missed_an_entry);
+    BOOST_CHECK(uncached_an_entry);
+}
+
+BOOST_AUTO_TEST_CASE(access_by_txid_bound)
+{
+    CCoinsViewCounting base;
+    CCoinsViewCache cache(&base);
+    uint256 txid = GetRandHash();
+    cache.AddCoin(COutPoint(txid, 10), Coin(CTxOut(1234, CScript() << OP_TRUE), 1, false, false), false);
+
+    // An output at or past the bound is not found
+    BOOST_CHECK(AccessByTxid(cache, txid, 10).IsSpent());
+    BOOST_CHECK_EQUAL(AccessByTxid(cache, txid, 11).out.nValue, 1234);
+    BOOST_CHECK_EQUAL(AccessByTxid(cache, txid).out.nValue, 1234);
+
+    // An unknown txid costs one lookup per output below the bound
+    base.nLookups = 0;
+    BOOST_CHECK(AccessByTxid(cache, GetRandHash(), 64).IsSpent());
+    BOOST_CHECK_EQUAL(base.nLookups, 64U);
+}
+
+BOOST_AUTO_TEST_CASE(coin_serialization)
+{
+    Coin coin(CTxOut(50000, CScript() << OP_TRUE), 120891, false, true);
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << coin;
+    Coin coin2;
+    ss >> coin2;
+    BOOST_CHECK(coin == coin2);
+    BOOST_CHECK_EQUAL(coin2.nHeight, 120891U);
+    BOOST_CHECK(!coin2.IsCoinBase());
+    BOOST_CHECK(coin2.IsCoinStake());
+    BOOST_CHECK(ss.empty());
+}
+
+BOOST_AUTO_TEST_CASE(txundo_compatibility)
+{
+    // Undo data as written before the per-output coin database: the last spend
+    // of a transaction carries its height, flags and version, the others carry none.
+    CTxOut txout(60000000000LL, CScript() << OP_TRUE);
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    WriteCompactSize(ss, 2);
+    ss << VARINT(203998U * 4 + 2) << VARINT(1) << CTxOutCompressor(REF(txout));
+    ss << VARINT(0U) << CTxOutCompressor(REF(txout));
+
+    CTxUndo undo;
+    ss >> undo;
+    BOOST_CHECK(ss.empty());
+    BOOST_REQUIRE_EQUAL(undo.vprevout.size(), 2U);
+    BOOST_CHECK_EQUAL(undo.vprevout[0].nHeight, 203998U);
+    BOOST_CHECK(undo.vprevout[0].IsCoinBase());
+    BOOST_CHECK(!undo.vprevout[0].IsCoinStake());
+    BOOST_CHECK(undo.vprevout[0].out == txout);
+    BOOST_CHECK_EQUAL(undo.vprevout[1].nHeight, 0U);
+    BOOST_CHECK(undo.vprevout[1].out == txout);
+
+    // Writing it back produces the same bytes, with a zero in place of the version
+    CDataStream ss2(SER_DISK, CLIENT_VERSION);
+    ss2 << undo;
+    CDataStream ss3(SER_DISK, CLIENT_VERSION);
+    WriteCompactSize(ss3, 2);
+    ss3 << VARINT(203998U * 4 + 2) << VARINT(0) << CTxOutCompressor(REF(txout));
+    ss3 << VARINT(0U) << CTxOutCompressor(REF(txout));
+    BOOST_CHECK_EQUAL(HexStr(ss2.begin(), ss2.end()), HexStr(ss3.begin(), ss3.end()));
+    BOOST_CHECK_EQUAL(ss2.size(), undo.GetSerializeSize(SER_DISK, CLIENT_VERSION));
 }
 
 BOOST_AUTO_TEST_SUITE_END()
@@ -12,6 +12,7 @@
 #include "random.h"
 #include "utilstrencodings.h"
 
+#include <algorithm>
 #include <vector>
 
 #include <boost/assign/list_of.hpp>
@@ -109,26 +110,58 @@ BOOST_AUTO_TEST_CASE(sha1_testvectors) {
     TestSHA1(test1, "b7755760681cbfd971451668f32af5774f4656b5");
 }
 
+/** Every set of transforms SHA256AutoDetect() can choose from */
+static const unsigned int sha256Implementations[] = {0, SHA256_USE_SSE41, SHA256_USE_AVX2, SHA256_USE_SHANI, SHA256_USE_ALL};
+
 BOOST_AUTO_TEST_CASE(sha256_testvectors) {
-    TestSHA256("", "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
-    TestSHA256("abc", "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
-    TestSHA256("message digest",
-               "f7846f55cf23e14eebeab5b4e1550cad5b509e3348fbc4efa3a1413d393cb650");
-    TestSHA256("secure hash algorithm",
-               "f30ceb2bb2829e79e4ca9753d35a8ecc00262d164cc077080295381cbd643f0d");
-    TestSHA256("SHA256 is considered to be safe",
-               "6819d915c73f4d1e77e4e1b52d1fa0f9cf9beaead3939f15874bd988e2a23630");
-    TestSHA256("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
-               "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
-    TestSHA256("For this sample, this 63-byte string will be used as input data",
-               "f08a78cbbaee082b052ae0708f32fa1e50c5c421aa772ba5dbb406a2ea6be342");
-    TestSHA256("This is exactly 64 bytes long, not counting the terminating byte",
-               "ab64eff7e88e2e46165e29f2bce41826bd4c7b3552f6b382a9e7d3af47c245f8");
-    TestSHA256("As Bitcoin relies on 80 byte header hashes, we want to have an example for that.",
-               "7406e8de7d6e4fffc573daef05aefb8806e7790f55eab5576f31349743cca743");
-    TestSHA256(std::string(1000000, 'a'),
-               "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
-    TestSHA256(test1, "a316d55510b49662420f49d145d42fb83f31ef8dc016aa4e32df049991a91e26");
+    for (unsigned int n = 0; n < sizeof(sha256Implementations) / sizeof(sha256Implementations[0]); n++) {
+        BOOST_TEST_MESSAGE("Testing SHA-256 implementation " << SHA256AutoDetect(sha256Implementations[n]));
+        TestSHA256("", "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+        TestSHA256("abc", "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+        TestSHA256("message digest",
+                   "f7846f55cf23e14eebeab5b4e1550cad5b509e3348fbc4efa3a1413d393cb650");
+        TestSHA256("secure hash algorithm",
+                   "f30ceb2bb2829e79e4ca9753d35a8ecc00262d164cc077080295381cbd643f0d");
+        TestSHA256("SHA256 is considered to be safe",
+                   "6819d915c73f4d1e77e4e1b52d1fa0f9cf9beaead3939f15874bd988e2a23630");
+        TestSHA256("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+                   "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+        TestSHA256("For this sample, this 63-byte string will be used as input data",
+                   "f08a78cbbaee082b052ae0708f32fa1e50c5c421aa772ba5dbb406a2ea6be342");
+        TestSHA256("This is exactly 64 bytes long, not counting the terminating byte",
+                   "ab64eff7e88e2e46165e29f2bce41826bd4c7b3552f6b382a9e7d3af47c245f8");
+        TestSHA256("As Bitcoin relies on 80 byte header hashes, we want to have an example for that.",
+                   "7406e8de7d6e4fffc573daef05aefb8806e7790f55eab5576f31349743cca743");
+        TestSHA256(std::string(1000000, 'a'),
+                   "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+        TestSHA256(test1, "a316d55510b49662420f49d145d42fb83f31ef8dc016aa4e32df049991a91e26");
+    }
+    SHA256AutoDetect();
+}
+
+BOOST_AUTO_TEST_CASE(sha256d64)
+{
+    // Every batch size exercises a different mix of the 8-way, 4-way and scalar transforms
+    for (unsigned int m = 0; m < sizeof(sha256Implementations) / sizeof(sha256Implementations[0]); m++) {
+        SHA256AutoDetect(sha256Implementations[m]);
+        for (int n = 1; n <= 37; n++) {
+            std::vector<unsigned char> in(64 * n), out(32 * n), expected(32 * n);
+            for (unsigned int i = 0; i < in.size(); i++)
+                in[i] = insecure_rand();
+            for (int i = 0; i < n; i++) {
+                unsigned char hash[CSHA256::OUTPUT_SIZE];
+                CSHA256().Write(&in[64 * i], 64).Finalize(hash);
+                CSHA256().Write(hash, sizeof(hash)).Finalize(&expected[32 * i]);
+            }
+            SHA256D64(&out[0], &in[0], n);
+            BOOST_CHECK(out == expected);
+
+            // In place, as merkle root computation uses it
+            SHA256D64(&in[0], &in[0], n);
+            BOOST_CHECK(std::equal(expected.begin(), expected.end(), in.begin()));
+        }
+    }
+    SHA256AutoDetect();
 }
 
 BOOST_AUTO_TEST_CASE(sha512_testvectors) {
@@ -2,12 +2,19 @@
 // Distributed under the MIT/X11 software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "crypto/quark.h"
 #include "hash.h"
+#include "primitives/block.h"
+#include "random.h"
+#include "streams.h"
 #include "utilstrencodings.h"
+#include "version.h"
 
 #include <vector>
 
+#include <boost/bind.hpp>
 #include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
 
 using namespace std;
 
@@ -46,4 +53,123 @@ BOOST_AUTO_TEST_CASE(murmurhash3)
 #undef T
 }
 
+BOOST_AUTO_TEST_CASE(quark_batch)
+{
+    // The multi-buffer engine must agree with HashQuark for any input length
+    // and batch size, including partially filled lanes.
+    QuarkAutoDetect();
+    static const size_t lengths[] = {0, 1, 63, 64, 80, 111, 112, 128, 200};
+    for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+        const size_t len = lengths[l];
+        for (size_t n = 1; n <= 19; n++) {
+            std::vector<std::vector<unsigned char> > msgs(n, std::vector<unsigned char>(len + 1));
+            std::vector<const unsigned char*> in(n);
+            for (size_t i = 0; i < n; i++) {
+                for (size_t j = 0; j < len; j++)
+                    msgs[i][j] = insecure_rand();
+                in[i] = &msgs[i][0];
+            }
+            std::vector<unsigned char> out(32 * n);
+            QuarkHashBatch(&out[0], &in[0], len, n);
+            for (size_t i = 0; i < n; i++) {
+                uint256 expected = HashQuark(msgs[i].begin(), msgs[i].begin() + len);
+                BOOST_CHECK(memcmp(&out[32 * i], expected.begin(), 32) == 0);
+            }
+        }
+    }
+
+    std::vector<CBlockHeader> headers(10);
+    for (size_t i = 0; i < headers.size(); i++) {
+        headers[i].nTime = insecure_rand();
+        headers[i].nNonce = insecure_rand();
+    }
+    std::vector<uint256> hashes;
+    GetBlockHeaderHashes(headers, hashes);
+    BOOST_CHECK_EQUAL(hashes.size(), headers.size());
+    for (size_t i = 0; i < headers.size(); i++) {
+        BOOST_CHECK(hashes[i] == HashQuark(BEGIN(headers[i].nVersion), END(headers[i].nNonce)));
+        BOOST_CHECK(hashes[i] == headers[i].GetHash());
+    }
+
+    // Headers of whole blocks, hashed in place and memoized
+    std::vector<CBlock> blocks(headers.begin(), headers.begin() + 5);
+    std::vector<const CBlockHeader*> pheaders;
+    for (size_t i = 0; i < blocks.size(); i++) {
+        blocks[i].nNonce++;
+        pheaders.push_back(&blocks[i]);
+    }
+    uint64_t nHashes = GetThreadBlockHashCount();
+    GetBlockHeaderHashes(pheaders, hashes);
+    BOOST_CHECK_EQUAL(hashes.size(), blocks.size());
+    for (size_t i = 0; i < blocks.size(); i++)
+        BOOST_CHECK(hashes[i] == blocks[i].GetHash());
+    BOOST_CHECK_EQUAL(GetThreadBlockHashCount(), nHashes + blocks.size());
+}
+
+BOOST_AUTO_TEST_CASE(block_hash_memo)
+{
+    CBlockHeader header;
+    header.nTime = insecure_rand();
+    header.nBits = 0x1e0ffff0;
+
+    uint64_t nHashes = GetThreadBlockHashCount();
+    uint256 hash = header.GetHash();
+    BOOST_CHECK(hash == HashQuark(BEGIN(header.nVersion), END(header.nNonce)));
+    BOOST_CHECK(header.GetHash() == hash);
+    BOOST_CHECK_EQUAL(GetThreadBlockHashCount(), nHashes + 1);
+
+    // Copies keep the memo
+    CBlock block(header);
+    BOOST_CHECK(block.GetHash() == hash);
+    BOOST_CHECK(block.GetBlockHeader().GetHash() == hash);
+    BOOST_CHECK_EQUAL(GetThreadBlockHashCount(), nHashes + 1);
+
+    // Any change to a field is noticed
+    block.nNonce++;
+    BOOST_CHECK(block.GetHash() != hash);
+    BOOST_CHECK(block.GetHash() == HashQuark(BEGIN(block.nVersion), END(block.nNonce)));
+    block.nNonce--;
+    BOOST_CHECK(block.GetHash() == hash);
+    block.hashMerkleRoot = GetRandHash();
+    BOOST_CHECK(block.GetHash() != hash);
+    BOOST_CHECK_EQUAL(GetThreadBlockHashCount(), nHashes + 4);
+
+    // Deserializing over a hashed header
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << header;
+    block.SetNull();
+    block.GetHash();
+    ss >> *(CBlockHeader*)&block;
+    BOOST_CHECK(block.GetHash() == hash);
+}
+
+static void HashSharedHeader(const CBlockHeader* pheader, uint256 hashExpected, bool* pfOk)
+{
+    for (int i = 0; i < 100; i++) {
+        CBlockHeader copy(*pheader);
+        if (pheader->GetHash() != hashExpected || copy.GetHash() != hashExpected)
+            *pfOk = false;
+    }
+}
+
+BOOST_AUTO_TEST_CASE(block_hash_memo_threads)
+{
+    // Threads hashing and copying one header race to make its memo
+    for (int n = 0; n < 20; n++) {
+        CBlockHeader header;
+        header.nTime = insecure_rand();
+        header.nNonce = n;
+        uint256 hashExpected = HashQuark(BEGIN(header.nVersion), END(header.nNonce));
+
+        bool vfOk[4] = {true, true, true, true};
+        boost::thread_group threads;
+        for (int i = 0; i < 4; i++)
+            threads.create_thread(boost::bind(&HashSharedHeader, &header, hashExpected, &vfOk[i]));
+        threads.join_all();
+        for (int i = 0; i < 4; i++)
+            BOOST_CHECK(vfOk[i]);
+        BOOST_CHECK(header.GetHash() == hashExpected);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,236 @@
+// Copyright (c) 2018 The KoinMudra developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+//
+// Unit tests for AcceptBlockHeader(), the pending headers budget and the
+// headers-first network switch
+//
+
+#include "chainparams.h"
+#include "main.h"
+#include "net.h"
+#include "pow.h"
+
+#include <boost/test/unit_test.hpp>
+
+extern std::set<CBlockIndex*> setDirtyBlockIndex;
+
+// Tests these internal-to-main.cpp methods:
+extern unsigned int CountPendingHeaders();
+extern unsigned int CountPendingHeaders(NodeId nodeid);
+extern void AddPendingHeader(NodeId nodeid, CBlockIndex* pindex);
+extern bool HeadersHaveMoreWork(const std::vector<CBlockHeader>& headers, unsigned int nFirst);
+
+BOOST_AUTO_TEST_SUITE(headers_tests)
+
+/** A header on top of pindexPrev that passes every contextual check. */
+static CBlock BuildHeader(const CBlockIndex* pindexPrev, uint32_t nNonce)
+{
+    CBlock block;
+    block.nVersion = 3;
+    block.hashPrevBlock = pindexPrev->GetBlockHash();
+    block.hashMerkleRoot = uint256(nNonce);
+    block.nTime = pindexPrev->GetMedianTimePast() + 1;
+    block.nNonce = nNonce;
+    block.nBits = GetNextWorkRequired(pindexPrev, &block);
+    return block;
+}
+
+/** Remove the indexes the test added and restore the tip's links. */
+static void RemoveHeaders(const std::vector<CBlockIndex*>& vIndexes)
+{
+    BOOST_FOREACH (CBlockIndex* pindex, vIndexes) {
+        mapBlockIndex.erase(pindex->GetBlockHash());
+        setDirtyBlockIndex.erase(pindex);
+        delete pindex;
+    }
+    chainActive.Tip()->pnext = NULL;
+    pindexBestHeader = chainActive.Tip();
+}
+
+BOOST_AUTO_TEST_CASE(header_accept)
+{
+    LOCK(cs_main);
+    CBlockIndex* pindexTip = chainActive.Tip();
+    std::vector<CBlockIndex*> vIndexes;
+
+    CBlock header = BuildHeader(pindexTip, 1);
+    CValidationState state;
+    CBlockIndex* pindex = NULL;
+    BOOST_CHECK(AcceptBlockHeader(header, state, &pindex));
+    BOOST_REQUIRE(pindex != NULL);
+    vIndexes.push_back(pindex);
+    BOOST_CHECK(mapBlockIndex.count(header.GetHash()));
+    BOOST_CHECK(pindex->pprev == pindexTip);
+    BOOST_CHECK_EQUAL(pindex->nHeight, pindexTip->nHeight + 1);
+    BOOST_CHECK(!(pindex->nStatus & BLOCK_HAVE_DATA));
+
+    // A known header yields the same index
+    CBlockIndex* pindexAgain = NULL;
+    BOOST_CHECK(AcceptBlockHeader(header, state, &pindexAgain));
+    BOOST_CHECK(pindexAgain == pindex);
+
+    // Headers chain on each other before their blocks arrive
+    CBlock child = BuildHeader(pindex, 2);
+    CBlockIndex* pindexChild = NULL;
+    BOOST_CHECK(AcceptBlockHeader(child, state, &pindexChild));
+    BOOST_REQUIRE(pindexChild != NULL);
+    vIndexes.push_back(pindexChild);
+    BOOST_CHECK(pindexChild->pprev == pindex);
+
+    RemoveHeaders(vIndexes);
+}
+
+BOOST_AUTO_TEST_CASE(header_reject)
+{
+    LOCK(cs_main);
+    CBlockIndex* pindexTip = chainActive.Tip();
+    std::vector<CBlockIndex*> vIndexes;
+    int nDoS;
+
+    // Unknown parent: not the peer's fault, the headers may arrive out of order
+    {
+        CBlock header = BuildHeader(pindexTip, 3);
+        header.hashPrevBlock = uint256(12345);
+        CValidationState state;
+        BOOST_CHECK(!AcceptBlockHeader(header, state));
+        BOOST_CHECK(state.IsInvalid(nDoS));
+        BOOST_CHECK_EQUAL(nDoS, 0);
+        BOOST_CHECK_EQUAL(state.GetRejectReason(), "bad-prevblk");
+        BOOST_CHECK(!mapBlockIndex.count(header.GetHash()));
+    }
+
+    // Difficulty well off the required target
+    {
+        CBlock header = BuildHeader(pindexTip, 4);
+        uint256 bnTarget;
+        bnTarget.SetCompact(header.nBits);
+        bnTarget >>= 2;
+        header.nBits = bnTarget.GetCompact();
+        CValidationState state;
+        BOOST_CHECK(!AcceptBlockHeader(header, state));
+        BOOST_CHECK(state.IsInvalid(nDoS));
+        BOOST_CHECK_EQUAL(nDoS, 100);
+        BOOST_CHECK_EQUAL(state.GetRejectReason(), "bad-diffbits");
+        BOOST_CHECK(!mapBlockIndex.count(header.GetHash()));
+    }
+
+    // Timestamp not past the median of the previous blocks
+    {
+        CBlock header = BuildHeader(pindexTip, 5);
+        header.nTime = pindexTip->GetMedianTimePast();
+        CValidationState state;
+        BOOST_CHECK(!AcceptBlockHeader(header, state));
+        BOOST_CHECK_EQUAL(state.GetRejectReason(), "time-too-old");
+        BOOST_CHECK(!mapBlockIndex.count(header.GetHash()));
+    }
+
+    // Children of a header marked invalid are rejected and punished
+    {
+        CBlock header = BuildHeader(pindexTip, 6);
+        CValidationState state;
+        CBlockIndex* pindex = NULL;
+        BOOST_CHECK(AcceptBlockHeader(header, state, &pindex));
+        BOOST_REQUIRE(pindex != NULL);
+        vIndexes.push_back(pindex);
+        pindex->nStatus |= BLOCK_FAILED_VALID;
+
+        BOOST_CHECK(!AcceptBlockHeader(header, state));
+        BOOST_CHECK_EQUAL(state.GetRejectReason(), "duplicate");
+
+        CBlock child = BuildHeader(pindex, 7);
+        CValidationState stateChild;
+        BOOST_CHECK(!AcceptBlockHeader(child, stateChild));
+        BOOST_CHECK(stateChild.IsInvalid(nDoS));
+        BOOST_CHECK_EQUAL(nDoS, 100);
+        BOOST_CHECK_EQUAL(stateChild.GetRejectReason(), "bad-prevblk");
+        BOOST_CHECK(!mapBlockIndex.count(child.GetHash()));
+    }
+
+    RemoveHeaders(vIndexes);
+}
+
+BOOST_AUTO_TEST_CASE(header_budget)
+{
+    LOCK(cs_main);
+    std::vector<CBlockIndex*> vIndexes;
+    CBlockIndex* pindexPrev = chainActive.Tip();
+    for (uint32_t n = 0; n < 3; n++) {
+        CValidationState state;
+        CBlockIndex* pindex = NULL;
+        BOOST_CHECK(AcceptBlockHeader(BuildHeader(pindexPrev, 100 + n), state, &pindex));
+        BOOST_REQUIRE(pindex != NULL);
+        vIndexes.push_back(pindex);
+        pindexPrev = pindex;
+    }
+
+    unsigned int nPendingTotal = CountPendingHeaders();
+    {
+        CNode dummyNode(INVALID_SOCKET, CAddress(CService("1.2.3.4", Params().GetDefaultPort())), "", true);
+        BOOST_FOREACH (CBlockIndex* pindex, vIndexes)
+            AddPendingHeader(dummyNode.GetId(), pindex);
+        BOOST_CHECK_EQUAL(CountPendingHeaders(dummyNode.GetId()), 3U);
+        BOOST_CHECK_EQUAL(CountPendingHeaders(), nPendingTotal + 3);
+    }
+
+    // The budget outlives the connection, and is shared with the peer's network group
+    CNode dummyNodeAgain(INVALID_SOCKET, CAddress(CService("1.2.3.4", Params().GetDefaultPort() + 1)), "", true);
+    CNode dummyNodeNeighbour(INVALID_SOCKET, CAddress(CService("1.2.200.5", Params().GetDefaultPort())), "", true);
+    CNode dummyNodeOther(INVALID_SOCKET, CAddress(CService("1.3.3.4", Params().GetDefaultPort())), "", true);
+    BOOST_CHECK_EQUAL(CountPendingHeaders(dummyNodeAgain.GetId()), 3U);
+    BOOST_CHECK_EQUAL(CountPendingHeaders(dummyNodeNeighbour.GetId()), 3U);
+    BOOST_CHECK_EQUAL(CountPendingHeaders(dummyNodeOther.GetId()), 0U);
+
+    // A header stops counting once its block is stored
+    vIndexes[1]->nStatus |= BLOCK_HAVE_DATA;
+    BOOST_CHECK_EQUAL(CountPendingHeaders(dummyNodeAgain.GetId()), 2U);
+    BOOST_CHECK_EQUAL(CountPendingHeaders(), nPendingTotal + 2);
+
+    // and so does one buried further under the tip than any download window reaches
+    vIndexes[0]->nHeight -= BLOCK_DOWNLOAD_WINDOW + 1;
+    BOOST_CHECK_EQUAL(CountPendingHeaders(dummyNodeAgain.GetId()), 1U);
+    vIndexes[0]->nHeight += BLOCK_DOWNLOAD_WINDOW + 1;
+
+    // Unknown peers have no budget in use
+    BOOST_CHECK_EQUAL(CountPendingHeaders(dummyNodeAgain.GetId() + 1000), 0U);
+
+    vIndexes[2]->nStatus |= BLOCK_HAVE_DATA;
+    BOOST_CHECK_EQUAL(CountPendingHeaders(), nPendingTotal);
+    RemoveHeaders(vIndexes);
+}
+
+BOOST_AUTO_TEST_CASE(header_more_work)
+{
+    LOCK(cs_main);
+    CBlockIndex* pindexTip = chainActive.Tip();
+    std::vector<CBlockHeader> headers;
+    headers.push_back(BuildHeader(pindexTip, 1));
+    headers.push_back(BuildHeader(pindexTip, 2));
+    headers[1].hashPrevBlock = headers[0].GetHash();
+
+    // Headers extending the tip have more work than it
+    BOOST_CHECK(HeadersHaveMoreWork(headers, 0));
+
+    // Headers claiming no work do not, however many there are
+    headers[0].nBits = headers[1].nBits = 0;
+    BOOST_CHECK(!HeadersHaveMoreWork(headers, 0));
+
+    // Headers of unknown parents are left to AcceptBlockHeader()
+    BOOST_CHECK(HeadersHaveMoreWork(headers, 1));
+}
+
+BOOST_AUTO_TEST_CASE(headers_first_networks)
+{
+    // Pending headers are bounded per network group and in total, so every network syncs headers first
+    SelectParams(CBaseChainParams::MAIN);
+    BOOST_CHECK(Params().HeadersFirstSyncingActive());
+    SelectParams(CBaseChainParams::TESTNET);
+    BOOST_CHECK(Params().HeadersFirstSyncingActive());
+    SelectParams(CBaseChainParams::REGTEST);
+    BOOST_CHECK(Params().HeadersFirstSyncingActive());
+    SelectParams(CBaseChainParams::UNITTEST);
+    BOOST_CHECK(Params().HeadersFirstSyncingActive());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,144 @@
+// Copyright (c) 2018 The KoinMudra developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+//
+// Unit tests for the address, spent and timestamp indexes kept by
+// ConnectBlock() and DisconnectBlock()
+//
+
+#include "main.h"
+#include "random.h"
+#include "script/standard.h"
+#include "txdb.h"
+
+#include <boost/test/unit_test.hpp>
+
+extern std::set<CBlockIndex*> setDirtyBlockIndex;
+
+BOOST_AUTO_TEST_SUITE(index_tests)
+
+/** Index state of a block that spends prevout from hashFrom and pays hashTo. */
+struct CIndexState {
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vFrom, vTo;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vUnspentFrom, vUnspentTo;
+    bool fSpent;
+    CSpentIndexValue spent;
+    std::vector<uint256> vHashes;
+
+    CIndexState(const uint160& hashFrom, const uint160& hashTo, const COutPoint& prevout, unsigned int nTime)
+    {
+        BOOST_CHECK(GetAddressIndex(hashFrom, ADDRESS_INDEX_SCRIPT, vFrom));
+        BOOST_CHECK(GetAddressIndex(hashTo, ADDRESS_INDEX_SCRIPT, vTo));
+        BOOST_CHECK(GetAddressUnspent(hashFrom, ADDRESS_INDEX_SCRIPT, vUnspentFrom));
+        BOOST_CHECK(GetAddressUnspent(hashTo, ADDRESS_INDEX_SCRIPT, vUnspentTo));
+        fSpent = GetSpentIndex(CSpentIndexKey(prevout.hash, prevout.n), spent);
+        BOOST_CHECK(GetTimestampIndex(nTime, nTime, vHashes));
+    }
+};
+
+BOOST_AUTO_TEST_CASE(index_connect_disconnect)
+{
+    LOCK(cs_main);
+    bool fAddressIndexOld = fAddressIndex, fSpentIndexOld = fSpentIndex, fTimestampIndexOld = fTimestampIndex;
+    fAddressIndex = fSpentIndex = fTimestampIndex = true;
+
+    // Pay-to-script-hash outputs of trivial scripts can be spent without keys
+    CScript redeemFrom = CScript() << OP_TRUE;
+    CScript redeemTo = CScript() << OP_2;
+    uint160 hashFrom = CScriptID(redeemFrom);
+    uint160 hashTo = CScriptID(redeemTo);
+
+    CCoinsViewCache view(pcoinsTip);
+    COutPoint prevout(GetRandHash(), 0);
+    // Undo data at height 0 means "no metadata" to DisconnectBlock(), so fund the spend at height 1
+    view.AddCoin(prevout, Coin(CTxOut(10 * COIN, GetScriptForDestination(CScriptID(redeemFrom))), 1, false, false), false);
+
+    CBlockIndex* pindexGenesis = chainActive.Genesis();
+    CBlock block;
+    block.nVersion = 3;
+    block.hashPrevBlock = pindexGenesis->GetBlockHash();
+    block.nTime = pindexGenesis->GetBlockTime() + 60;
+    CMutableTransaction txCoinBase;
+    txCoinBase.vin.resize(1);
+    txCoinBase.vin[0].prevout.SetNull();
+    txCoinBase.vin[0].scriptSig = CScript() << 1 << OP_0;
+    txCoinBase.vout.push_back(CTxOut(GetBlockValue(1), CScript() << OP_TRUE));
+    block.vtx.push_back(txCoinBase);
+    CMutableTransaction tx;
+    tx.vin.push_back(CTxIn(prevout, CScript() << std::vector<unsigned char>(redeemFrom.begin(), redeemFrom.end())));
+    tx.vout.push_back(CTxOut(9 * COIN, GetScriptForDestination(CScriptID(redeemTo))));
+    block.vtx.push_back(tx);
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    const uint256 hashTx = block.vtx[1].GetHash();
+
+    uint256 hashBlock = block.GetHash();
+    CBlockIndex* pindex = new CBlockIndex(block);
+    pindex->phashBlock = &hashBlock;
+    pindex->pprev = pindexGenesis;
+    pindex->nHeight = 1;
+    pindex->nFile = pindexGenesis->nFile;
+
+    // Connecting records the spend and the new output
+    CValidationState state;
+    BOOST_REQUIRE(ConnectBlock(block, state, pindex, view, false, true));
+    {
+        CIndexState index(hashFrom, hashTo, prevout, block.nTime);
+        BOOST_REQUIRE_EQUAL(index.vFrom.size(), 1U);
+        BOOST_CHECK(index.vFrom[0].first.spending);
+        BOOST_CHECK(index.vFrom[0].first.txhash == hashTx);
+        BOOST_CHECK_EQUAL(index.vFrom[0].second, -10 * COIN);
+        BOOST_REQUIRE_EQUAL(index.vTo.size(), 1U);
+        BOOST_CHECK(!index.vTo[0].first.spending);
+        BOOST_CHECK_EQUAL(index.vTo[0].second, 9 * COIN);
+        BOOST_CHECK(index.vUnspentFrom.empty());
+        BOOST_REQUIRE_EQUAL(index.vUnspentTo.size(), 1U);
+        BOOST_CHECK(index.vUnspentTo[0].first.txhash == hashTx);
+        BOOST_CHECK_EQUAL(index.vUnspentTo[0].second.blockHeight, 1);
+        BOOST_CHECK(index.fSpent);
+        BOOST_CHECK(index.spent.txid == hashTx);
+        BOOST_CHECK_EQUAL(index.spent.blockHeight, 1);
+        BOOST_CHECK(index.vHashes.size() == 1 && index.vHashes[0] == hashBlock);
+    }
+
+    // VerifyDB's trial disconnect leaves the indexes alone
+    {
+        CCoinsViewCache viewTrial(&view);
+        bool fClean = true;
+        BOOST_CHECK(DisconnectBlock(block, state, pindex, viewTrial, &fClean, true));
+        BOOST_CHECK(fClean);
+        CIndexState index(hashFrom, hashTo, prevout, block.nTime);
+        BOOST_CHECK_EQUAL(index.vTo.size(), 1U);
+        BOOST_CHECK(index.fSpent);
+        BOOST_CHECK_EQUAL(index.vHashes.size(), 1U);
+    }
+
+    // Both the regular and the tolerant disconnect undo them
+    for (int n = 0; n < 2; n++) {
+        bool fClean = true;
+        BOOST_CHECK(DisconnectBlock(block, state, pindex, view, n ? &fClean : NULL));
+        BOOST_CHECK(fClean);
+        CIndexState index(hashFrom, hashTo, prevout, block.nTime);
+        BOOST_CHECK(index.vFrom.empty());
+        BOOST_CHECK(index.vTo.empty());
+        BOOST_REQUIRE_EQUAL(index.vUnspentFrom.size(), 1U);
+        BOOST_CHECK(index.vUnspentFrom[0].first.txhash == prevout.hash);
+        BOOST_CHECK_EQUAL(index.vUnspentFrom[0].second.satoshis, 10 * COIN);
+        BOOST_CHECK(index.vUnspentTo.empty());
+        BOOST_CHECK(!index.fSpent);
+        BOOST_CHECK(index.vHashes.empty());
+        BOOST_CHECK(view.HaveCoin(prevout));
+        BOOST_CHECK(!view.HaveCoin(COutPoint(hashTx, 0)));
+
+        if (n == 0)
+            BOOST_REQUIRE(ConnectBlock(block, state, pindex, view, false, true));
+    }
+
+    fAddressIndex = fAddressIndexOld;
+    fSpentIndex = fSpentIndexOld;
+    fTimestampIndex = fTimestampIndexOld;
+    setDirtyBlockIndex.erase(pindex);
+    delete pindex;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,58 @@
+// Copyright (c) 2018 The KoinMudra developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "jsonstream.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(jsonstream_tests)
+
+BOOST_AUTO_TEST_CASE(jsonstream_matches_univalue)
+{
+    UniValue inner(UniValue::VOBJ);
+    inner.push_back(Pair("asm", "OP_DUP \"quoted\"\n"));
+    inner.push_back(Pair("reqSigs", 1));
+
+    UniValue txs(UniValue::VARR);
+    txs.push_back(inner);
+    txs.push_back(UniValue(UniValue::VARR));
+    txs.push_back(inner);
+
+    UniValue expected(UniValue::VOBJ);
+    expected.push_back(Pair("hash", "00ff"));
+    expected.push_back(Pair("height", 12345));
+    expected.push_back(Pair("difficulty", 0.5));
+    expected.push_back(Pair("tx", txs));
+    expected.push_back(Pair("empty", UniValue(UniValue::VOBJ)));
+    expected.push_back(Pair("flag", true));
+
+    std::string strOut;
+    CJSONStreamWriter writer(strOut);
+    writer.BeginObject();
+    writer.Pair("hash", "00ff");
+    writer.Pair("height", 12345);
+    writer.Pair("difficulty", 0.5);
+    writer.Key("tx");
+    writer.BeginArray();
+    writer.Value(inner);
+    writer.BeginArray();
+    writer.EndArray();
+    writer.BeginObject();
+    writer.Members(inner);
+    writer.EndObject();
+    writer.EndArray();
+    writer.Key("empty");
+    writer.BeginObject();
+    writer.EndObject();
+    writer.Pair("flag", true);
+    writer.EndObject();
+
+    BOOST_CHECK_EQUAL(strOut, expected.write());
+
+    UniValue parsed;
+    BOOST_CHECK(parsed.read(strOut));
+    BOOST_CHECK_EQUAL(parsed["tx"].size(), 3U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
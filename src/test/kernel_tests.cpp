@@ -0,0 +1,116 @@
+// Copyright (c) 2018 The KoinMudra developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+//
+// Unit tests for the stake modifier index behind GetKernelStakeModifier()
+//
+
+#include "kernel.h"
+#include "main.h"
+#include "random.h"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(kernel_tests)
+
+/** Extend pindexPrev by nBlocks, with jittered block times and every third block or so generating a modifier. */
+static void BuildBranch(CBlockIndex* pindexPrev, int nBlocks, std::vector<CBlockIndex*>& vIndexes)
+{
+    for (int i = 0; i < nBlocks; i++) {
+        CBlockIndex* pindex = new CBlockIndex();
+        BlockMap::iterator mi = mapBlockIndex.insert(std::make_pair(GetRandHash(), pindex)).first;
+        pindex->phashBlock = &((*mi).first);
+        pindex->pprev = pindexPrev;
+        pindex->nHeight = pindexPrev->nHeight + 1;
+        pindex->nTime = chainActive.Genesis()->nTime + 60 * pindex->nHeight + (int)(insecure_rand() % 401) - 200;
+        if (insecure_rand() % 20 == 0) {
+            // Now and then a block far ahead of the ones that follow it
+            pindex->nTime += 4 * GetStakeModifierSelectionInterval();
+        }
+        pindex->SetStakeModifier(((uint64_t)insecure_rand() << 32) | insecure_rand(), insecure_rand() % 3 == 0);
+        pindex->BuildSkip();
+        vIndexes.push_back(pindex);
+        pindexPrev = pindex;
+    }
+}
+
+/** The stake modifier of a kernel from pindexFrom, found by walking the active chain. */
+static const CBlockIndex* WalkChain(const CBlockIndex* pindexFrom)
+{
+    int64_t nTime = pindexFrom->GetBlockTime() + GetStakeModifierSelectionInterval();
+    for (int nHeight = pindexFrom->nHeight + 1; nHeight <= chainActive.Height(); nHeight++) {
+        const CBlockIndex* pindex = chainActive[nHeight];
+        if (pindex->GeneratedStakeModifier() && pindex->GetBlockTime() >= nTime)
+            return pindex;
+    }
+    return NULL;
+}
+
+/** Check GetKernelStakeModifier() against the chain walk for every block in vIndexes; returns how many were found. */
+static int CheckModifiers(const std::vector<CBlockIndex*>& vIndexes)
+{
+    int nFound = 0;
+    BOOST_FOREACH (const CBlockIndex* pindexFrom, vIndexes) {
+        uint64_t nStakeModifier;
+        int nStakeModifierHeight = -1;
+        int64_t nStakeModifierTime = 0;
+        bool fFound = GetKernelStakeModifier(pindexFrom->GetBlockHash(), nStakeModifier, nStakeModifierHeight, nStakeModifierTime, false);
+        const CBlockIndex* pindex = WalkChain(pindexFrom);
+        BOOST_CHECK_EQUAL(fFound, pindex != NULL);
+        if (!fFound || !pindex)
+            continue;
+        BOOST_CHECK_EQUAL(nStakeModifierHeight, pindex->nHeight);
+        BOOST_CHECK_EQUAL(nStakeModifierTime, pindex->GetBlockTime());
+        BOOST_CHECK_EQUAL(nStakeModifier, pindex->nStakeModifier);
+        nFound++;
+    }
+    return nFound;
+}
+
+BOOST_AUTO_TEST_CASE(stake_modifier_index)
+{
+    LOCK(cs_main);
+    CBlockIndex* pindexGenesis = chainActive.Genesis();
+    std::vector<CBlockIndex*> vMain, vBranch, vAll;
+    BuildBranch(pindexGenesis, 400, vMain);
+    BuildBranch(vMain[199], 250, vBranch);
+    vAll.push_back(pindexGenesis);
+    vAll.insert(vAll.end(), vMain.begin(), vMain.end());
+    vAll.insert(vAll.end(), vBranch.begin(), vBranch.end());
+
+    // Unknown blocks have no modifier
+    uint64_t nStakeModifier;
+    int nStakeModifierHeight;
+    int64_t nStakeModifierTime;
+    BOOST_CHECK(!GetKernelStakeModifier(GetRandHash(), nStakeModifier, nStakeModifierHeight, nStakeModifierTime, false));
+
+    // Grown a block at a time, then in one step
+    for (int i = 0; i < 50; i++) {
+        chainActive.SetTip(vMain[i]);
+        CheckModifiers(std::vector<CBlockIndex*>(vAll.begin(), vAll.begin() + i + 2));
+    }
+    chainActive.SetTip(vMain.back());
+    BOOST_CHECK(CheckModifiers(vAll) > 0);
+
+    // Over a reorganisation to the branch and back, and after the tip moves back
+    chainActive.SetTip(vBranch.back());
+    BOOST_CHECK(CheckModifiers(vAll) > 0);
+    chainActive.SetTip(vMain.back());
+    CheckModifiers(vAll);
+    chainActive.SetTip(vMain[299]);
+    CheckModifiers(vAll);
+
+    // Let go of the blocks before they are deleted
+    chainActive.SetTip(pindexGenesis);
+    UpdateStakeModifierIndex();
+    for (unsigned int i = 1; i < vAll.size(); i++) {
+        uint256 hash = vAll[i]->GetBlockHash();
+        mapBlockIndex.erase(hash);
+        delete vAll[i];
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
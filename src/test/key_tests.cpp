@@ -187,4 +187,96 @@ BOOST_AUTO_TEST_CASE(key_test1)
     BOOST_CHECK(detsigc == ParseHex("20469e065172b99b782ac742d54a568867eb13274864665e605272a8f11c696cdf5892001019e2813b39887c3f5e67048751b16ebb5fd2f9f3a38639538234e4f1"));
 }
 
+/** Encode r and s the loose ways OpenSSL accepted: padded integers, long form lengths and trailing data */
+static vector<unsigned char> LaxDER(const vector<unsigned char>& vchR, const vector<unsigned char>& vchS, bool fLongLengths)
+{
+    vector<unsigned char> vchBody;
+    vchBody.push_back(0x02);
+    if (fLongLengths)
+        vchBody.push_back(0x81);
+    vchBody.push_back(vchR.size() + 2);
+    vchBody.push_back(0);
+    vchBody.push_back(0);
+    vchBody.insert(vchBody.end(), vchR.begin(), vchR.end());
+    vchBody.push_back(0x02);
+    if (fLongLengths) {
+        vchBody.push_back(0x82);
+        vchBody.push_back(0);
+    }
+    vchBody.push_back(vchS.size());
+    vchBody.insert(vchBody.end(), vchS.begin(), vchS.end());
+
+    vector<unsigned char> vchSig;
+    vchSig.push_back(0x30);
+    if (fLongLengths)
+        vchSig.push_back(0x81);
+    vchSig.push_back(vchBody.size());
+    vchSig.insert(vchSig.end(), vchBody.begin(), vchBody.end());
+    vchSig.push_back(0x01);
+    return vchSig;
+}
+
+BOOST_AUTO_TEST_CASE(key_signature_lax_der)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CPubKey pubkey = key.GetPubKey();
+    string strMsg = "Loosely encoded message";
+    uint256 hashMsg = Hash(strMsg.begin(), strMsg.end());
+    vector<unsigned char> vchSig;
+    BOOST_CHECK(key.Sign(hashMsg, vchSig));
+    BOOST_CHECK(pubkey.Verify(hashMsg, vchSig));
+
+    // Split the strict DER signature back into r and s
+    BOOST_REQUIRE(vchSig.size() > 8 && vchSig[0] == 0x30 && vchSig[2] == 0x02);
+    unsigned int nLenR = vchSig[3];
+    unsigned int nLenS = vchSig[5 + nLenR];
+    vector<unsigned char> vchR(vchSig.begin() + 4, vchSig.begin() + 4 + nLenR);
+    vector<unsigned char> vchS(vchSig.begin() + 6 + nLenR, vchSig.begin() + 6 + nLenR + nLenS);
+
+    BOOST_CHECK(pubkey.Verify(hashMsg, LaxDER(vchR, vchS, false)));
+    BOOST_CHECK(pubkey.Verify(hashMsg, LaxDER(vchR, vchS, true)));
+
+    // A valid signature of another message, an r too large and truncated signatures all fail
+    uint256 hashOther = Hash(strMsg.begin(), strMsg.end() - 1);
+    BOOST_CHECK(!pubkey.Verify(hashOther, vchSig));
+    BOOST_CHECK(!pubkey.Verify(hashMsg, LaxDER(vector<unsigned char>(33, 0x01), vchS, false)));
+    for (unsigned int i = 0; i < vchSig.size(); i++)
+        BOOST_CHECK(!pubkey.Verify(hashMsg, vector<unsigned char>(vchSig.begin(), vchSig.begin() + i)));
+
+    // An indefinite sequence length needs its end-of-contents bytes
+    vector<unsigned char> vchIndefinite(vchSig);
+    vchIndefinite[1] = 0x80;
+    BOOST_CHECK(!pubkey.Verify(hashMsg, vchIndefinite));
+    vchIndefinite.push_back(0);
+    vchIndefinite.push_back(0);
+    BOOST_CHECK(pubkey.Verify(hashMsg, vchIndefinite));
+
+    // The sequence length must match the two integers, even with room to spare
+    vector<unsigned char> vchLonger(vchSig);
+    vchLonger[1]++;
+    vchLonger.push_back(0x01);
+    BOOST_CHECK(!pubkey.Verify(hashMsg, vchLonger));
+    vector<unsigned char> vchShorter(vchSig);
+    vchShorter[1]--;
+    BOOST_CHECK(!pubkey.Verify(hashMsg, vchShorter));
+    vchSig.push_back(0x01);
+    BOOST_CHECK(pubkey.Verify(hashMsg, vchSig));
+
+    // r and s are unsigned, as OpenSSL stores them, so dropping the zero byte that keeps a high r
+    // positive in strict DER changes nothing
+    for (int i = 0; nLenR != 33; i++) {
+        hashMsg = Hash(BEGIN(i), END(i));
+        BOOST_CHECK(key.Sign(hashMsg, vchSig));
+        nLenR = vchSig[3];
+    }
+    BOOST_REQUIRE(vchSig[4] == 0 && vchSig[5] >= 0x80);
+    vector<unsigned char> vchUnpadded(vchSig);
+    vchUnpadded.erase(vchUnpadded.begin() + 4);
+    vchUnpadded[1]--;
+    vchUnpadded[3]--;
+    BOOST_CHECK(pubkey.Verify(hashMsg, vchSig));
+    BOOST_CHECK(pubkey.Verify(hashMsg, vchUnpadded));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -6,6 +6,10 @@
 
 #include "primitives/transaction.h"
 #include "main.h"
+#include "chainparams.h"
+#include "clientversion.h"
+#include "random.h"
+#include "streams.h"
 
 #include <boost/test/unit_test.hpp>
 
@@ -26,4 +30,28 @@ BOOST_AUTO_TEST_CASE(subsidy_limit_test)
     BOOST_CHECK(nSum == 50000000000000ULL);
 }
 
+BOOST_AUTO_TEST_CASE(load_external_block_file)
+{
+    // Junk, the genesis block, a block whose parent is unknown and the genesis block again
+    const CBlock& genesis = Params().GenesisBlock();
+    CBlock orphan(genesis);
+    orphan.hashPrevBlock = GetRandHash();
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << FLATDATA(Params().MessageStart()) << (uint32_t)123;
+    const CBlock* pblocks[] = {&genesis, &orphan, &genesis};
+    for (unsigned int i = 0; i < 3; i++)
+        ss << FLATDATA(Params().MessageStart()) << (uint32_t)::GetSerializeSize(*pblocks[i], SER_DISK, CLIENT_VERSION) << *pblocks[i];
+
+    FILE* file = tmpfile();
+    BOOST_REQUIRE(file);
+    BOOST_REQUIRE_EQUAL(fwrite(&ss[0], 1, ss.size(), file), ss.size());
+    rewind(file);
+
+    // Each header read is hashed once, in one batch, and nothing new is loaded
+    uint64_t nHashes = GetThreadBlockHashCount();
+    BOOST_CHECK(!LoadExternalBlockFile(file, NULL));
+    BOOST_CHECK_EQUAL(GetThreadBlockHashCount(), nHashes + 3);
+    BOOST_CHECK(!mapBlockIndex.count(orphan.GetHash()));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
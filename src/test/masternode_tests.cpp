@@ -0,0 +1,314 @@
+// Copyright (c) 2018 The KoinMudra developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chain.h"
+#include "key.h"
+#include "main.h"
+#include "masternode.h"
+#include "masternode-helpers.h"
+#include "masternodeman.h"
+#include "net.h"
+#include "random.h"
+#include "version.h"
+
+#include <deque>
+
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+BOOST_AUTO_TEST_SUITE(masternode_tests)
+
+/** A run of signed mnp messages as they sit in a peer's receive queue. */
+static void BuildPings(std::deque<CNetMessage>& vMsgs, std::vector<CMasternodePing>& vPings, const CKey& key, int nCount)
+{
+    for (int i = 0; i < nCount; i++) {
+        CMasternodePing mnp;
+        mnp.vin = CTxIn(COutPoint(GetRandHash(), i));
+        mnp.blockHash = GetRandHash();
+        mnp.sigTime = 1593691200 + i;
+        std::string strError;
+        BOOST_REQUIRE(masternodeSigner.SignMessage(mnp.GetStrMessage(), strError, mnp.vchSig, key));
+        vPings.push_back(mnp);
+
+        CNetMessage msg(SER_NETWORK, PROTOCOL_VERSION);
+        msg.vRecv << mnp;
+        msg.hdr = CMessageHeader("mnp", msg.vRecv.size());
+        msg.in_data = true;
+        msg.nDataPos = msg.vRecv.size();
+        vMsgs.push_back(msg);
+    }
+}
+
+static void PreVerifyRuns(std::vector<std::deque<CNetMessage> >* pvRuns)
+{
+    for (unsigned int i = 0; i < pvRuns->size(); i++)
+        masternodeSigner.PreVerifyMessages((*pvRuns)[i].begin(), (*pvRuns)[i].end());
+}
+
+BOOST_AUTO_TEST_CASE(preverify_concurrent_batches)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CPubKey pubkey = key.GetPubKey();
+
+    // Two message threads, each with its own peers' runs of pings
+    std::vector<std::deque<CNetMessage> > vRuns[2];
+    std::vector<CMasternodePing> vPings;
+    for (int n = 0; n < 2; n++) {
+        for (int i = 0; i < 8; i++) {
+            vRuns[n].push_back(std::deque<CNetMessage>());
+            BuildPings(vRuns[n].back(), vPings, key, 16);
+        }
+    }
+
+    // Overlapping batches share the signature check queue
+    boost::thread_group threads;
+    for (int n = 0; n < 2; n++)
+        threads.create_thread(boost::bind(&PreVerifyRuns, &vRuns[n]));
+    threads.join_all();
+
+    BOOST_FOREACH (CMasternodePing& mnp, vPings) {
+        uint256 hashMessage = CMasternodeSigner::GetMessageHash(mnp.GetStrMessage());
+        BOOST_CHECK(masternodeSigner.HaveRecoveredKey(hashMessage, mnp.vchSig));
+        std::string strError;
+        BOOST_CHECK(masternodeSigner.VerifyMessage(pubkey, mnp.vchSig, mnp.GetStrMessage(), strError));
+        // Used up by the verification
+        BOOST_CHECK(!masternodeSigner.HaveRecoveredKey(hashMessage, mnp.vchSig));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(preverify_forget_processed)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    std::deque<CNetMessage> vMsgs;
+    std::vector<CMasternodePing> vPings;
+    BuildPings(vMsgs, vPings, key, 4);
+    std::vector<uint256> vHashes;
+    BOOST_FOREACH (CMasternodePing& mnp, vPings)
+        vHashes.push_back(CMasternodeSigner::GetMessageHash(mnp.GetStrMessage()));
+
+    masternodeSigner.PreVerifyMessages(vMsgs.begin(), vMsgs.end());
+    for (int i = 0; i < 4; i++)
+        BOOST_CHECK(masternodeSigner.HaveRecoveredKey(vHashes[i], vPings[i].vchSig));
+
+    // A message dropped without verification leaves nothing behind
+    masternodeSigner.ForgetMessage(CMasternodeSigner::GetPayloadHash(vMsgs[0]));
+    vMsgs.pop_front();
+    BOOST_CHECK(!masternodeSigner.HaveRecoveredKey(vHashes[0], vPings[0].vchSig));
+    BOOST_CHECK(masternodeSigner.HaveRecoveredKey(vHashes[1], vPings[1].vchSig));
+
+    // The rest of the run was verified with the first message, so it is not done again
+    CKeyID keyIDWrong;
+    masternodeSigner.AddRecoveredKey(vHashes[1], vPings[1].vchSig, keyIDWrong);
+    masternodeSigner.PreVerifyMessages(vMsgs.begin(), vMsgs.end());
+    std::string strError;
+    BOOST_CHECK(!masternodeSigner.VerifyMessage(key.GetPubKey(), vPings[1].vchSig, vPings[1].GetStrMessage(), strError));
+
+    while (!vMsgs.empty()) {
+        masternodeSigner.ForgetMessage(CMasternodeSigner::GetPayloadHash(vMsgs.front()));
+        vMsgs.pop_front();
+    }
+    for (int i = 0; i < 4; i++)
+        BOOST_CHECK(!masternodeSigner.HaveRecoveredKey(vHashes[i], vPings[i].vchSig));
+}
+
+/** A chain of nCount blocks on top of pindexFork (or from a genesis block), with hashes salted by nSalt */
+static void BuildChain(std::vector<CBlockIndex*>& vIndexes, std::vector<uint256*>& vHashes, CBlockIndex* pindexFork, int nCount, int nSalt)
+{
+    CBlockIndex* pindexPrev = pindexFork;
+    for (int i = 0; i < nCount; i++) {
+        CBlockIndex* pindex = new CBlockIndex();
+        pindex->pprev = pindexPrev;
+        pindex->nHeight = pindexPrev ? pindexPrev->nHeight + 1 : 0;
+        vHashes.push_back(new uint256(((uint64_t)nSalt << 32) + pindex->nHeight + 1));
+        pindex->phashBlock = vHashes.back();
+        pindex->BuildSkip();
+        vIndexes.push_back(pindex);
+        pindexPrev = pindex;
+    }
+}
+
+BOOST_AUTO_TEST_CASE(masternode_height_context)
+{
+    CBlockIndex* pindexOldTip = chainActive.Tip();
+    std::vector<CBlockIndex*> vIndexes;
+    std::vector<uint256*> vHashes;
+    BuildChain(vIndexes, vHashes, NULL, 300, 1);
+    CBlockIndex* pindexTip = vIndexes.back();
+    chainActive.SetTip(pindexTip);
+    masternodeHeights.Clear();
+
+    // A height is scored against the block below it; 0 stands for the tip height
+    uint256 hash;
+    BOOST_CHECK(masternodeHeights.GetBlockHash(hash, 150));
+    BOOST_CHECK(hash == vIndexes[149]->GetBlockHash());
+    BOOST_CHECK(masternodeHeights.GetBlockHash(hash, 0));
+    BOOST_CHECK(hash == vIndexes[298]->GetBlockHash());
+    BOOST_CHECK(masternodeHeights.GetBlockHash(hash, 300));
+    BOOST_CHECK(hash == pindexTip->GetBlockHash());
+    BOOST_CHECK(!masternodeHeights.GetBlockHash(hash, 301));
+    BOOST_CHECK(!masternodeHeights.GetBlockHash(hash, 1));
+
+    // Negative heights, as in nBlockHeight - 100 early in the chain, have no block
+    CMasternodeScoreContext context;
+    BOOST_CHECK(!masternodeHeights.GetBlockHash(hash, -1));
+    BOOST_CHECK(!masternodeHeights.GetBlockHash(hash, -100));
+    BOOST_CHECK(!masternodeHeights.GetScoreContext(context, -1));
+
+    // Contexts stay right for more heights than are cached
+    for (int nHeight = 2; nHeight <= 301; nHeight++) {
+        bool fExists = nHeight <= 300;
+        BOOST_CHECK_EQUAL(masternodeHeights.GetScoreContext(context, nHeight), fExists);
+        if (fExists)
+            BOOST_CHECK(context.hashBlock == vIndexes[nHeight - 1]->GetBlockHash());
+    }
+    BOOST_CHECK(masternodeHeights.GetScoreContext(context, 250));
+    BOOST_CHECK(context.hashBlock == vIndexes[249]->GetBlockHash());
+    BOOST_CHECK(context.hashBlockScore == CMasternodeScoreContext(vIndexes[249]->GetBlockHash()).hashBlockScore);
+
+    // A cached context follows a reorganisation of its block
+    BuildChain(vIndexes, vHashes, vIndexes[239], 60, 2);
+    chainActive.SetTip(vIndexes.back());
+    BOOST_CHECK(masternodeHeights.GetScoreContext(context, 250));
+    BOOST_CHECK(context.hashBlock == vIndexes.back()->GetAncestor(249)->GetBlockHash());
+    BOOST_CHECK(context.hashBlock != vIndexes[249]->GetBlockHash());
+    BOOST_CHECK(masternodeHeights.GetScoreContext(context, 240));
+    BOOST_CHECK(context.hashBlock == vIndexes[239]->GetBlockHash());
+
+    chainActive.SetTip(pindexOldTip);
+    masternodeHeights.Clear();
+    BOOST_FOREACH (CBlockIndex* pindex, vIndexes)
+        delete pindex;
+    BOOST_FOREACH (uint256* phash, vHashes)
+        delete phash;
+}
+
+/** Order (score, index) pairs highest score first, as the masternode manager does */
+struct CompareScore {
+    bool operator()(const std::pair<int64_t, unsigned int>& a, const std::pair<int64_t, unsigned int>& b) const
+    {
+        return a.first > b.first;
+    }
+};
+
+/** An enabled masternode with a fresh ping, old enough to be ranked */
+static CMasternode BuildMasternode()
+{
+    CMasternode mn;
+    mn.vin = CTxIn(COutPoint(GetRandHash(), 0));
+    mn.activeState = CMasternode::MASTERNODE_ENABLED;
+    mn.protocolVersion = PROTOCOL_VERSION;
+    mn.sigTime = GetAdjustedTime() - 2 * 24 * 60 * 60;
+    mn.lastPing.vin = mn.vin;
+    mn.lastPing.blockHash = GetRandHash();
+    mn.lastPing.sigTime = GetAdjustedTime();
+    mn.unitTest = true;
+    return mn;
+}
+
+/** Check every rank lookup at nBlockHeight against a fresh scoring of the whole list */
+static void CheckRanks(CMasternodeMan& man, int nBlockHeight)
+{
+    std::vector<CMasternode> vMasternodes = man.GetFullMasternodeVector();
+    std::vector<std::pair<int64_t, unsigned int> > vScores;
+    for (unsigned int i = 0; i < vMasternodes.size(); i++)
+        vScores.push_back(std::make_pair(vMasternodes[i].CalculateScore(1, nBlockHeight).GetCompact(false), i));
+    std::stable_sort(vScores.begin(), vScores.end(), CompareScore());
+
+    std::vector<std::pair<int, CMasternode> > vRanks = man.GetMasternodeRanks(nBlockHeight);
+    BOOST_REQUIRE_EQUAL(vRanks.size(), vScores.size());
+    for (unsigned int i = 0; i < vScores.size(); i++) {
+        const CTxIn& vin = vMasternodes[vScores[i].second].vin;
+        BOOST_CHECK_EQUAL(man.GetMasternodeRank(vin, nBlockHeight, 0, false), (int)i + 1);
+        CMasternode* pmn = man.GetMasternodeByRank(i + 1, nBlockHeight, 0, false);
+        BOOST_CHECK(pmn != NULL && pmn->vin == vin);
+        BOOST_CHECK_EQUAL(vRanks[i].first, (int)i + 1);
+        BOOST_CHECK(vRanks[i].second.vin == vin);
+    }
+    BOOST_CHECK(man.GetMasternodeByRank(vScores.size() + 1, nBlockHeight, 0, false) == NULL);
+}
+
+BOOST_AUTO_TEST_CASE(masternode_rank_cache)
+{
+    CBlockIndex* pindexOldTip = chainActive.Tip();
+    std::vector<CBlockIndex*> vIndexes;
+    std::vector<uint256*> vHashes;
+    BuildChain(vIndexes, vHashes, NULL, 300, 3);
+    chainActive.SetTip(vIndexes.back());
+    masternodeHeights.Clear();
+
+    CMasternodeMan man;
+    std::vector<CTxIn> vVins;
+    for (int i = 0; i < 30; i++) {
+        CMasternode mn = BuildMasternode();
+        BOOST_CHECK(man.Add(mn));
+        BOOST_CHECK(!man.Add(mn));
+        vVins.push_back(mn.vin);
+    }
+
+    // More heights than are cached, then the evicted ones again
+    for (int nHeight = 150; nHeight < 150 + 2 * MASTERNODES_RANK_CACHE_HEIGHTS; nHeight++)
+        CheckRanks(man, nHeight);
+    CheckRanks(man, 150);
+    CheckRanks(man, 0);
+
+    // Unknown heights have no ranks
+    BOOST_CHECK_EQUAL(man.GetMasternodeRank(vVins[0], 302, 0, false), -1);
+    BOOST_CHECK(man.GetMasternodeByRank(1, -1, 0, false) == NULL);
+    BOOST_CHECK(man.GetMasternodeRanks(302).empty());
+
+    // The cached heights follow additions and removals
+    for (int i = 0; i < 10; i++) {
+        CMasternode mn = BuildMasternode();
+        BOOST_CHECK(man.Add(mn));
+        vVins.push_back(mn.vin);
+    }
+    for (int nHeight = 200; nHeight < 210; nHeight++)
+        CheckRanks(man, nHeight);
+    man.Remove(vVins[0]);
+    man.Remove(vVins[17]);
+    man.Remove(vVins.back());
+    BOOST_CHECK_EQUAL(man.size(), 37);
+    for (int nHeight = 200; nHeight < 210; nHeight++)
+        CheckRanks(man, nHeight);
+
+    // Entries dropped by CheckAndRemove(), from the front, middle and back of the list
+    const int vRemove[] = {1, 2, 20, 38};
+    BOOST_FOREACH (int i, vRemove) {
+        CMasternode* pmn = man.Find(vVins[i]);
+        BOOST_REQUIRE(pmn != NULL);
+        pmn->activeState = CMasternode::MASTERNODE_REMOVE;
+        pmn->lastPing.sigTime = GetAdjustedTime() - MASTERNODE_REMOVAL_SECONDS - 1;
+    }
+    man.CheckAndRemove();
+    BOOST_CHECK_EQUAL(man.size(), 33);
+    BOOST_FOREACH (int i, vRemove)
+        BOOST_CHECK(man.Find(vVins[i]) == NULL);
+    for (int nHeight = 200; nHeight < 210; nHeight++)
+        CheckRanks(man, nHeight);
+
+    // A cached height is rescored after a reorganisation of its block
+    BuildChain(vIndexes, vHashes, vIndexes[199], 100, 4);
+    chainActive.SetTip(vIndexes.back());
+    for (int nHeight = 195; nHeight < 210; nHeight++)
+        CheckRanks(man, nHeight);
+
+    // Nothing is left over after Clear()
+    man.Clear();
+    BOOST_CHECK(man.GetMasternodeRanks(205).empty());
+    CMasternode mn = BuildMasternode();
+    BOOST_CHECK(man.Add(mn));
+    BOOST_CHECK_EQUAL(man.GetMasternodeRank(mn.vin, 205, 0, false), 1);
+    CheckRanks(man, 205);
+
+    chainActive.SetTip(pindexOldTip);
+    masternodeHeights.Clear();
+    BOOST_FOREACH (CBlockIndex* pindex, vIndexes)
+        delete pindex;
+    BOOST_FOREACH (uint256* phash, vHashes)
+        delete phash;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -99,4 +99,69 @@ BOOST_AUTO_TEST_CASE(MempoolRemoveTest)
     removed.clear();
 }
 
+BOOST_AUTO_TEST_CASE(MempoolAncestorIndexTest)
+{
+    // A free parent with a child paying for it, and an unrelated transaction
+    CMutableTransaction txParent;
+    txParent.vin.resize(1);
+    txParent.vin[0].scriptSig = CScript() << OP_11;
+    txParent.vout.resize(1);
+    txParent.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txParent.vout[0].nValue = 33000LL;
+    CMutableTransaction txChild;
+    txChild.vin.resize(1);
+    txChild.vin[0].scriptSig = CScript() << OP_11;
+    txChild.vin[0].prevout.hash = txParent.GetHash();
+    txChild.vin[0].prevout.n = 0;
+    txChild.vout.resize(1);
+    txChild.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txChild.vout[0].nValue = 23000LL;
+    CMutableTransaction txOther;
+    txOther.vin.resize(1);
+    txOther.vin[0].scriptSig = CScript() << OP_12;
+    txOther.vout.resize(1);
+    txOther.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txOther.vout[0].nValue = 33000LL;
+
+    CTxMemPool testPool(CFeeRate(0));
+    testPool.addUnchecked(txParent.GetHash(), CTxMemPoolEntry(txParent, 0, 0, 0.0, 1));
+    testPool.addUnchecked(txChild.GetHash(), CTxMemPoolEntry(txChild, 10000LL, 0, 0.0, 1));
+    testPool.addUnchecked(txOther.GetHash(), CTxMemPoolEntry(txOther, 1000LL, 0, 0.0, 1));
+
+    const CTxMemPoolEntry& entryParent = testPool.mapTx[txParent.GetHash()];
+    const CTxMemPoolEntry& entryChild = testPool.mapTx[txChild.GetHash()];
+    BOOST_CHECK_EQUAL(entryParent.GetCountWithAncestors(), 1U);
+    BOOST_CHECK_EQUAL(entryChild.GetCountWithAncestors(), 2U);
+    BOOST_CHECK_EQUAL(entryChild.GetSizeWithAncestors(), entryParent.GetTxSize() + entryChild.GetTxSize());
+    BOOST_CHECK_EQUAL(entryChild.GetModFeesWithAncestors(), 10000LL);
+
+    std::set<uint256> setAncestors, setDescendants;
+    testPool.CalculateAncestors(txChild.GetHash(), setAncestors);
+    BOOST_CHECK(setAncestors.size() == 1 && setAncestors.count(txParent.GetHash()));
+    testPool.CalculateDescendants(txParent.GetHash(), setDescendants);
+    BOOST_CHECK(setDescendants.size() == 1 && setDescendants.count(txChild.GetHash()));
+
+    // The child pays for its parent and goes first; the free parent on its own comes last
+    BOOST_CHECK_EQUAL(testPool.setTxByAncestorFee.size(), 3U);
+    CTxMemPool::setEntriesByAncestorFee::const_iterator it = testPool.setTxByAncestorFee.begin();
+    BOOST_CHECK((*it++)->GetTx().GetHash() == txChild.GetHash());
+    BOOST_CHECK((*it++)->GetTx().GetHash() == txOther.GetHash());
+    BOOST_CHECK((*it++)->GetTx().GetHash() == txParent.GetHash());
+
+    // Prioritising the parent carries over to its descendants
+    testPool.PrioritiseTransaction(txParent.GetHash(), txParent.GetHash().ToString(), 0.0, 20000LL);
+    BOOST_CHECK_EQUAL(entryParent.GetModifiedFee(), 20000LL);
+    BOOST_CHECK_EQUAL(entryChild.GetModFeesWithAncestors(), 30000LL);
+    BOOST_CHECK((*testPool.setTxByAncestorFee.begin())->GetTx().GetHash() == txParent.GetHash());
+
+    // The parent is mined: the child no longer counts it
+    std::list<CTransaction> removed;
+    testPool.remove(txParent, removed, false);
+    BOOST_CHECK_EQUAL(removed.size(), 1);
+    BOOST_CHECK_EQUAL(entryChild.GetCountWithAncestors(), 1U);
+    BOOST_CHECK_EQUAL(entryChild.GetSizeWithAncestors(), entryChild.GetTxSize());
+    BOOST_CHECK_EQUAL(entryChild.GetModFeesWithAncestors(), 10000LL);
+    BOOST_CHECK_EQUAL(testPool.setTxByAncestorFee.size(), 2U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,74 @@
+// Copyright (c) 2018 The KoinMudra developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "messagestats.h"
+
+#include "tinyformat.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(messagestats_tests)
+
+BOOST_AUTO_TEST_CASE(messagestats_buckets)
+{
+    CMessageTypeStats stats;
+    stats.Add(100, 0, 0, 0, 0);
+    stats.Add(100, 9, 0, 0, 0);
+    stats.Add(100, 10, 0, 0, 0);
+    stats.Add(100, 999999, 0, 0, 0);
+    stats.Add(100, 10000000, 0, 0, 0);
+    stats.Add(100, 500000000, 0, 0, 0);
+
+    BOOST_CHECK_EQUAL(stats.nCount, 6U);
+    BOOST_CHECK_EQUAL(stats.nBytes, 600U);
+    BOOST_CHECK_EQUAL(stats.nMaxTimeMicros, 500000000);
+    BOOST_CHECK_EQUAL(stats.vLatency[0], 2U);
+    BOOST_CHECK_EQUAL(stats.vLatency[1], 1U);
+    BOOST_CHECK_EQUAL(stats.vLatency[5], 1U);
+    BOOST_CHECK_EQUAL(stats.vLatency[MESSAGE_LATENCY_BUCKETS - 1], 2U);
+
+    BOOST_CHECK_EQUAL(CMessageTypeStats::GetBucketLimit(0), 10);
+    BOOST_CHECK_EQUAL(CMessageTypeStats::GetBucketLimit(MESSAGE_LATENCY_BUCKETS - 2), 10000000);
+    BOOST_CHECK_EQUAL(CMessageTypeStats::GetBucketLimit(MESSAGE_LATENCY_BUCKETS - 1), -1);
+}
+
+BOOST_AUTO_TEST_CASE(messagestats_record)
+{
+    CMessageStats stats;
+    std::map<std::string, CMessageTypeStats> mapStats;
+    int64_t nSince;
+
+    stats.Record("inv", 37, 20, 15, 5, 100);
+    stats.Record("inv", 73, 40, 25, 0, 0);
+    stats.GetStats(mapStats, nSince);
+    BOOST_CHECK_EQUAL(mapStats.size(), 1U);
+    BOOST_CHECK_EQUAL(mapStats["inv"].nCount, 2U);
+    BOOST_CHECK_EQUAL(mapStats["inv"].nBytes, 110U);
+    BOOST_CHECK_EQUAL(mapStats["inv"].nTimeMicros, 60);
+    BOOST_CHECK_EQUAL(mapStats["inv"].nCPUMicros, 40);
+    BOOST_CHECK_EQUAL(mapStats["inv"].nLockWaitMicros, 5);
+    BOOST_CHECK_EQUAL(mapStats["inv"].nQueueMicros, 100);
+
+    // Peer-chosen commands are counted together and don't grow the map
+    for (unsigned int i = 0; i < 100; i++)
+        stats.Record(strprintf("junk%u", i), 1, 1, 1, 0, 0);
+    stats.Record("mnb", 1, 1, 1, 0, 0);
+    stats.GetStats(mapStats, nSince);
+    BOOST_CHECK_EQUAL(mapStats.size(), 3U);
+    BOOST_CHECK_EQUAL(mapStats["*other*"].nCount, 100U);
+    BOOST_CHECK_EQUAL(mapStats["mnb"].nCount, 1U);
+    BOOST_CHECK_EQUAL(mapStats["inv"].nCount, 2U);
+
+    stats.GetStatsAndReset(mapStats, nSince);
+    BOOST_CHECK_EQUAL(mapStats.size(), 3U);
+    stats.GetStats(mapStats, nSince);
+    BOOST_CHECK(mapStats.empty());
+
+    stats.Record("inv", 1, 1, 1, 0, 0);
+    stats.Reset();
+    stats.GetStats(mapStats, nSince);
+    BOOST_CHECK(mapStats.empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -2,10 +2,13 @@
 // Distributed under the MIT/X11 software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "crypto/sha256.h"
+#include "hash.h"
 #include "merkleblock.h"
 #include "serialize.h"
 #include "streams.h"
 #include "uint256.h"
+#include "utilstrencodings.h"
 #include "version.h"
 
 #include <vector>
@@ -26,8 +29,57 @@ public:
     }
 };
 
+/** Merkle root the way BuildMerkleTree() computed it one pair at a time */
+static uint256 ReferenceMerkleRoot(std::vector<uint256> vHashes, bool& mutated)
+{
+    mutated = false;
+    while (vHashes.size() > 1) {
+        if (vHashes.size() % 2 == 0 && vHashes[vHashes.size() - 2] == vHashes.back())
+            mutated = true;
+        if (vHashes.size() % 2 == 1)
+            vHashes.push_back(vHashes.back());
+        for (unsigned int i = 0; i < vHashes.size() / 2; i++)
+            vHashes[i] = Hash(BEGIN(vHashes[2 * i]), END(vHashes[2 * i]), BEGIN(vHashes[2 * i + 1]), END(vHashes[2 * i + 1]));
+        vHashes.resize(vHashes.size() / 2);
+    }
+    return vHashes.empty() ? uint256() : vHashes[0];
+}
+
 BOOST_AUTO_TEST_SUITE(pmt_tests)
 
+BOOST_AUTO_TEST_CASE(merkle_root)
+{
+    SHA256AutoDetect();
+    for (unsigned int nTx = 0; nTx <= 70; nTx++) {
+        for (int nDup = 0; nDup < 2; nDup++) {
+            CBlock block;
+            std::vector<uint256> vTxid;
+            for (unsigned int j = 0; j < nTx; j++) {
+                CMutableTransaction tx;
+                tx.nLockTime = j;
+                block.vtx.push_back(CTransaction(tx));
+            }
+            if (nDup && nTx > 1 && nTx % 2 == 0) {
+                // Repeat the last transaction, the CVE-2012-2459 mutation
+                block.vtx.back() = block.vtx[nTx - 2];
+            }
+            for (unsigned int j = 0; j < block.vtx.size(); j++)
+                vTxid.push_back(block.vtx[j].GetHash());
+
+            bool fExpectedMutated, fMutated, fTreeMutated;
+            uint256 expected = ReferenceMerkleRoot(vTxid, fExpectedMutated);
+            BOOST_CHECK(block.ComputeMerkleRoot(&fMutated) == expected);
+            BOOST_CHECK_EQUAL(fMutated, fExpectedMutated);
+            BOOST_CHECK(block.vMerkleTree.empty());
+            BOOST_CHECK(block.BuildMerkleTree(&fTreeMutated) == expected);
+            BOOST_CHECK_EQUAL(fTreeMutated, fExpectedMutated);
+
+            for (unsigned int j = 0; j < nTx; j++)
+                BOOST_CHECK(CBlock::CheckMerkleBranch(vTxid[j], block.GetMerkleBranch(j), j) == expected);
+        }
+    }
+}
+
 BOOST_AUTO_TEST_CASE(pmt_test1)
 {
     static const unsigned int nTxCounts[] = {1, 4, 7, 17, 56, 100, 127, 256, 312, 513, 1000, 4095};
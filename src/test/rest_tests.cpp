@@ -0,0 +1,160 @@
+// Copyright (c) 2018 The KoinMudra developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+//
+// Unit tests for the /rest/headers/ and /rest/blocks/ range requests
+//
+
+#include "blockfilemap.h"
+#include "chainparams.h"
+#include "main.h"
+#include "random.h"
+#include "rpcserver.h"
+#include "streams.h"
+
+#include <sstream>
+#include <stdio.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(rest_tests)
+
+/** Connection that keeps the reply in memory. */
+class CTestConnection : public AcceptedConnection
+{
+public:
+    std::stringstream ss;
+
+    std::iostream& stream() { return ss; }
+    std::string peer_address_to_string() const { return "127.0.0.1"; }
+    void close() {}
+};
+
+/** Run a REST request; returns the body of the reply and sets its status. */
+static std::string Request(const std::string& strURI, int& nStatus)
+{
+    if (RPCIsInWarmup(NULL))
+        SetRPCWarmupFinished();
+    CTestConnection conn;
+    std::string strRequest = strURI;
+    std::map<std::string, std::string> mapHeaders;
+    HTTPReq_REST(&conn, strRequest, mapHeaders, false);
+    std::string strReply = conn.ss.str();
+    nStatus = 0;
+    sscanf(strReply.c_str(), "HTTP/1.1 %d", &nStatus);
+    size_t nBody = strReply.find("\r\n\r\n");
+    BOOST_REQUIRE(nBody != std::string::npos);
+    return strReply.substr(nBody + 4);
+}
+
+/** Append a record as WriteBlockToDisk() does; returns the position of its payload. */
+static unsigned int AppendRecord(int nFile, const std::string& strPayload)
+{
+    boost::filesystem::path path = GetBlockPosFilename(CDiskBlockPos(nFile, 0), "blk");
+    FILE* file = fopen(path.string().c_str(), "ab");
+    BOOST_REQUIRE(file != NULL);
+    unsigned int nSize = strPayload.size();
+    fwrite(Params().MessageStart(), 1, MESSAGE_START_SIZE, file);
+    fwrite(&nSize, 1, sizeof(nSize), file);
+    unsigned int nPos = ftell(file);
+    fwrite(strPayload.data(), 1, strPayload.size(), file);
+    fclose(file);
+    return nPos;
+}
+
+BOOST_AUTO_TEST_CASE(rest_range_counts)
+{
+    const CBlockIndex* pindexGenesis = chainActive.Genesis();
+    const std::string strHash = pindexGenesis->GetBlockHash().GetHex();
+    int nStatus;
+
+    // Up to 2000 headers per request
+    Request("/rest/headers/2001/" + strHash + ".bin", nStatus);
+    BOOST_CHECK_EQUAL(nStatus, HTTP_BAD_REQUEST);
+    Request("/rest/headers/0/" + strHash + ".bin", nStatus);
+    BOOST_CHECK_EQUAL(nStatus, HTTP_BAD_REQUEST);
+    std::string strBody = Request("/rest/headers/2000/" + strHash + ".bin", nStatus);
+    BOOST_CHECK_EQUAL(nStatus, HTTP_OK);
+    CDataStream ssHeader(SER_NETWORK, PROTOCOL_VERSION);
+    ssHeader << pindexGenesis->GetBlockHeader();
+    BOOST_CHECK(strBody == ssHeader.str());
+
+    // Up to 1000 blocks per request
+    Request("/rest/blocks/1001/" + strHash + ".bin", nStatus);
+    BOOST_CHECK_EQUAL(nStatus, HTTP_BAD_REQUEST);
+    strBody = Request("/rest/blocks/1000/" + strHash + ".bin", nStatus);
+    BOOST_CHECK_EQUAL(nStatus, HTTP_OK);
+    std::vector<unsigned char> vchGenesis;
+    BOOST_REQUIRE(ReadRawBlockFromDisk(vchGenesis, pindexGenesis->GetBlockPos()));
+    BOOST_CHECK(strBody == std::string(vchGenesis.begin(), vchGenesis.end()));
+
+    Request("/rest/blocks/1/" + strHash + ".json", nStatus);
+    BOOST_CHECK_EQUAL(nStatus, HTTP_NOT_FOUND);
+}
+
+BOOST_AUTO_TEST_CASE(rest_blocks_size_cutoff)
+{
+    LOCK(cs_main);
+    CBlockIndex* pindexGenesis = chainActive.Genesis();
+
+    // Twenty blocks on top of genesis, all stored as the same record of just over 1 MB
+    const std::string strRecord(1000001, 'x');
+    unsigned int nPos = AppendRecord(930, strRecord);
+    std::vector<CBlockIndex*> vIndexes;
+    std::vector<uint256*> vHashes;
+    CBlockIndex* pindexPrev = pindexGenesis;
+    for (int i = 0; i < 20; i++) {
+        CBlockIndex* pindex = new CBlockIndex();
+        vHashes.push_back(new uint256(GetRandHash()));
+        pindex->phashBlock = vHashes.back();
+        pindex->pprev = pindexPrev;
+        pindex->nHeight = pindexPrev->nHeight + 1;
+        pindex->nFile = 930;
+        pindex->nDataPos = nPos;
+        pindex->nStatus = BLOCK_HAVE_DATA;
+        pindex->BuildSkip();
+        vIndexes.push_back(pindex);
+        pindexPrev = pindex;
+    }
+    mapBlockIndex.insert(std::make_pair(*vHashes[0], vIndexes[0]));
+    chainActive.SetTip(vIndexes.back());
+
+    // The reply stops with the block that takes it to 16 MB
+    int nStatus;
+    std::string strBody = Request("/rest/blocks/20/" + vHashes[0]->GetHex() + ".bin", nStatus);
+    BOOST_CHECK_EQUAL(nStatus, HTTP_OK);
+    BOOST_CHECK_EQUAL(strBody.size(), 16 * strRecord.size());
+
+    // A shorter range below the cutoff is returned whole
+    strBody = Request("/rest/blocks/3/" + vHashes[0]->GetHex() + ".bin", nStatus);
+    BOOST_CHECK_EQUAL(nStatus, HTTP_OK);
+    BOOST_CHECK_EQUAL(strBody.size(), 3 * strRecord.size());
+
+    chainActive.SetTip(pindexGenesis);
+    mapBlockIndex.erase(*vHashes[0]);
+    BOOST_FOREACH (CBlockIndex* pindex, vIndexes)
+        delete pindex;
+    BOOST_FOREACH (uint256* phash, vHashes)
+        delete phash;
+    boost::filesystem::remove(GetBlockPosFilename(CDiskBlockPos(930, 0), "blk"));
+}
+
+BOOST_AUTO_TEST_CASE(raw_block_empty_record)
+{
+    unsigned int nPos = AppendRecord(931, "");
+    std::vector<unsigned char> vchBlock;
+    BOOST_CHECK(!ReadRawBlockFromDisk(vchBlock, CDiskBlockPos(931, nPos)));
+
+    // Served from a mapped file the record is refused just the same
+    CBlockFileMap* pblockfilemapOld = pblockfilemap;
+    CBlockFileMap map(1);
+    pblockfilemap = &map;
+    BOOST_CHECK(!ReadRawBlockFromDisk(vchBlock, CDiskBlockPos(931, nPos)));
+    pblockfilemap = pblockfilemapOld;
+
+    boost::filesystem::remove(GetBlockPosFilename(CDiskBlockPos(931, 0), "blk"));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
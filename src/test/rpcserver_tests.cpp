@@ -0,0 +1,281 @@
+// Copyright (c) 2018 The KoinMudra developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+//
+// Unit tests for the RPC server's connections and work queue, over loopback
+//
+
+#include "main.h"
+#include "netbase.h"
+#include "random.h"
+#include "rpcprotocol.h"
+#include "rpcserver.h"
+#include "serialize.h"
+#include "util.h"
+#include "utilstrencodings.h"
+#include "utiltime.h"
+
+#include <map>
+#include <sstream>
+#include <string>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(rpcserver_tests)
+
+#ifndef WIN32
+
+/** Runs the RPC server on a random loopback port while in scope. */
+class CRPCTestServer
+{
+public:
+    int nPort;
+
+    CRPCTestServer(int nThreads, int nWorkQueue, int nTimeout = DEFAULT_RPC_SERVER_TIMEOUT) : mapArgsOld(mapArgs)
+    {
+        nPort = 20000 + GetRand(20000);
+        mapArgs["-rpcuser"] = "user";
+        mapArgs["-rpcpassword"] = "pass";
+        mapArgs["-rpcport"] = itostr(nPort);
+        mapArgs["-rpcthreads"] = itostr(nThreads);
+        mapArgs["-rpcworkqueue"] = itostr(nWorkQueue);
+        mapArgs["-rpcservertimeout"] = itostr(nTimeout);
+        if (RPCIsInWarmup(NULL))
+            SetRPCWarmupFinished();
+        StartRPCThreads();
+        BOOST_REQUIRE(IsRPCRunning());
+    }
+
+    ~CRPCTestServer()
+    {
+        StopRPCThreads();
+        mapArgs = mapArgsOld;
+    }
+
+private:
+    std::map<std::string, std::string> mapArgsOld;
+};
+
+/** A blocking client connection; reads give up after five seconds. */
+class CRPCTestClient
+{
+public:
+    CRPCTestClient(int nPort) : fClosed(false)
+    {
+        hSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        BOOST_REQUIRE(hSocket != INVALID_SOCKET);
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(nPort);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        BOOST_REQUIRE(connect(hSocket, (struct sockaddr*)&addr, sizeof(addr)) == 0);
+        struct timeval timeout = {5, 0};
+        setsockopt(hSocket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    }
+
+    ~CRPCTestClient()
+    {
+        CloseSocket(hSocket);
+    }
+
+    void Send(const std::string& str)
+    {
+        BOOST_REQUIRE_EQUAL(send(hSocket, str.data(), str.size(), MSG_NOSIGNAL), (ssize_t)str.size());
+    }
+
+    /** Read the next reply; false if the connection closes or times out first. */
+    bool ReadReply(int& nStatus, std::string& strConnection, std::string& strBody)
+    {
+        size_t nHeaders;
+        while ((nHeaders = strBuffer.find("\r\n\r\n")) == std::string::npos)
+            if (!Receive())
+                return false;
+        nHeaders += 4;
+        std::istringstream stream(strBuffer.substr(0, nHeaders));
+        int nProto;
+        std::map<std::string, std::string> mapHeaders;
+        nStatus = ReadHTTPStatus(stream, nProto);
+        size_t nLen = ReadHTTPHeaders(stream, mapHeaders);
+        while (strBuffer.size() < nHeaders + nLen)
+            if (!Receive())
+                return false;
+        strConnection = mapHeaders["connection"];
+        strBody = strBuffer.substr(nHeaders, nLen);
+        strBuffer.erase(0, nHeaders + nLen);
+        return true;
+    }
+
+    /** Whether the server closes the connection without sending anything more. */
+    bool IsClosed()
+    {
+        while (!fClosed && Receive()) {
+        }
+        return fClosed && strBuffer.empty();
+    }
+
+private:
+    SOCKET hSocket;
+    std::string strBuffer;
+    bool fClosed;
+
+    bool Receive()
+    {
+        char buf[4096];
+        ssize_t nBytes = recv(hSocket, buf, sizeof(buf), 0);
+        if (nBytes > 0) {
+            strBuffer.append(buf, nBytes);
+            return true;
+        }
+        int nErr = WSAGetLastError();
+        if (nBytes == 0 || (nErr != WSAEWOULDBLOCK && nErr != WSAEINTR))
+            fClosed = true;
+        return false;
+    }
+};
+
+/** A JSON-RPC call of strMethod, without parameters, as an HTTP request. */
+static std::string Request(const std::string& strMethod, int nId, const std::string& strProto = "HTTP/1.1", const std::string& strConnection = "")
+{
+    std::string strBody = JSONRPCRequest(strMethod, UniValue(UniValue::VARR), nId);
+    std::string strRequest = "POST / " + strProto + "\r\n" +
+                             "Host: 127.0.0.1\r\n" +
+                             "Authorization: Basic " + EncodeBase64("user:pass") + "\r\n" +
+                             "Content-Length: " + itostr(strBody.size()) + "\r\n";
+    if (!strConnection.empty())
+        strRequest += "Connection: " + strConnection + "\r\n";
+    return strRequest + "\r\n" + strBody;
+}
+
+/** Read a successful JSON-RPC reply and return its id. */
+static int ReadResult(CRPCTestClient& client, const std::string& strConnectionExpected)
+{
+    int nStatus;
+    std::string strConnection, strBody;
+    BOOST_REQUIRE(client.ReadReply(nStatus, strConnection, strBody));
+    BOOST_CHECK_EQUAL(nStatus, HTTP_OK);
+    BOOST_CHECK_EQUAL(strConnection, strConnectionExpected);
+    UniValue reply;
+    BOOST_REQUIRE(reply.read(strBody));
+    BOOST_CHECK(find_value(reply, "error").isNull());
+    return find_value(reply, "id").get_int();
+}
+
+BOOST_AUTO_TEST_CASE(rpcserver_keepalive)
+{
+    CRPCTestServer server(2, 4);
+
+    // HTTP/1.1 connections persist unless the client asks to close them
+    {
+        CRPCTestClient client(server.nPort);
+        client.Send(Request("getblockcount", 1));
+        BOOST_CHECK_EQUAL(ReadResult(client, "keep-alive"), 1);
+        client.Send(Request("getblockcount", 2, "HTTP/1.1", "Close"));
+        BOOST_CHECK_EQUAL(ReadResult(client, "close"), 2);
+        BOOST_CHECK(client.IsClosed());
+    }
+
+    // HTTP/1.0 connections only persist if the client asks to keep them
+    {
+        CRPCTestClient client(server.nPort);
+        client.Send(Request("getblockcount", 3, "HTTP/1.0", "keep-alive"));
+        BOOST_CHECK_EQUAL(ReadResult(client, "keep-alive"), 3);
+        client.Send(Request("getblockcount", 4, "HTTP/1.0"));
+        BOOST_CHECK_EQUAL(ReadResult(client, "close"), 4);
+        BOOST_CHECK(client.IsClosed());
+    }
+
+    // ... and never with -rpckeepalive=0
+    mapArgs["-rpckeepalive"] = "0";
+    {
+        CRPCTestClient client(server.nPort);
+        client.Send(Request("getblockcount", 5, "HTTP/1.1", "keep-alive"));
+        BOOST_CHECK_EQUAL(ReadResult(client, "close"), 5);
+        BOOST_CHECK(client.IsClosed());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(rpcserver_pipelining)
+{
+    CRPCTestServer server(4, 16);
+
+    // Requests sent at once are answered in order, even with several workers free
+    CRPCTestClient client(server.nPort);
+    std::string strRequests;
+    for (int i = 0; i < 8; i++)
+        strRequests += Request(i % 2 ? "getblockcount" : "help", i);
+    client.Send(strRequests);
+    for (int i = 0; i < 8; i++)
+        BOOST_CHECK_EQUAL(ReadResult(client, "keep-alive"), i);
+}
+
+BOOST_AUTO_TEST_CASE(rpcserver_workqueue_full)
+{
+    CRPCTestServer server(1, 1);
+    CRPCTestClient clientRunning(server.nPort), clientQueued(server.nPort), clientRejected(server.nPort);
+    int nStatus;
+    std::string strConnection, strBody;
+
+    {
+        // getblockcount waits for cs_main, so the only worker stays busy with the
+        // first request and the second fills the queue
+        LOCK(cs_main);
+        clientRunning.Send(Request("getblockcount", 1));
+        MilliSleep(500);
+        clientQueued.Send(Request("getblockcount", 2));
+        MilliSleep(500);
+        clientRejected.Send(Request("getblockcount", 3));
+        BOOST_REQUIRE(clientRejected.ReadReply(nStatus, strConnection, strBody));
+        BOOST_CHECK_EQUAL(nStatus, HTTP_SERVICE_UNAVAILABLE);
+        BOOST_CHECK_EQUAL(strConnection, "close");
+        BOOST_CHECK(clientRejected.IsClosed());
+    }
+
+    BOOST_CHECK_EQUAL(ReadResult(clientRunning, "keep-alive"), 1);
+    BOOST_CHECK_EQUAL(ReadResult(clientQueued, "keep-alive"), 2);
+}
+
+BOOST_AUTO_TEST_CASE(rpcserver_timeout)
+{
+    CRPCTestServer server(1, 1, 1);
+
+    // Idle before the first request, idle between requests and stalled mid-request
+    for (int i = 0; i < 3; i++) {
+        CRPCTestClient client(server.nPort);
+        if (i == 1) {
+            client.Send(Request("getblockcount", 1));
+            BOOST_CHECK_EQUAL(ReadResult(client, "keep-alive"), 1);
+        } else if (i == 2) {
+            std::string strRequest = Request("getblockcount", 1);
+            client.Send(strRequest.substr(0, strRequest.size() - 1));
+        }
+        int64_t nStart = GetTimeMillis();
+        BOOST_CHECK(client.IsClosed());
+        BOOST_CHECK(GetTimeMillis() - nStart < 4000);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(rpcserver_content_length)
+{
+    CRPCTestServer server(1, 1);
+
+    // Bodies over MAX_SIZE are refused before they are read
+    std::string strLengths[] = {strprintf("%u", MAX_SIZE + 1), "-1"};
+    for (unsigned int i = 0; i < sizeof(strLengths) / sizeof(strLengths[0]); i++) {
+        CRPCTestClient client(server.nPort);
+        client.Send("POST / HTTP/1.1\r\n"
+                    "Authorization: Basic " + EncodeBase64("user:pass") + "\r\n" +
+                    "Content-Length: " + strLengths[i] + "\r\n\r\n{}");
+        int nStatus;
+        std::string strConnection, strBody;
+        BOOST_REQUIRE(client.ReadReply(nStatus, strConnection, strBody));
+        BOOST_CHECK_EQUAL(nStatus, HTTP_BAD_REQUEST);
+        BOOST_CHECK_EQUAL(strConnection, "close");
+        BOOST_CHECK(client.IsClosed());
+    }
+}
+
+#endif // WIN32
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -161,4 +161,27 @@ BOOST_AUTO_TEST_CASE(insert_delete)
     BOOST_CHECK_EQUAL(ss.size(), 0);
 }
 
+
+BOOST_AUTO_TEST_CASE(memory_reader)
+{
+    CDataStream ss(SER_DISK, 0);
+    std::vector<unsigned char> vch(3, 0xab);
+    ss << 12345 << std::string("mapped") << vch;
+    std::vector<char> vchData(ss.begin(), ss.end());
+
+    CMemoryReader reader(begin_ptr(vchData), end_ptr(vchData), SER_DISK, 0);
+    int n;
+    std::string str;
+    std::vector<unsigned char> vchOut;
+    reader >> n >> str >> vchOut;
+    BOOST_CHECK_EQUAL(n, 12345);
+    BOOST_CHECK_EQUAL(str, "mapped");
+    BOOST_CHECK(vchOut == vch);
+    BOOST_CHECK(reader.empty());
+
+    // Reading past the end throws instead of running off the buffer
+    CMemoryReader readerShort(begin_ptr(vchData), begin_ptr(vchData) + 2, SER_DISK, 0);
+    BOOST_CHECK_THROW(readerShort >> n, std::ios_base::failure);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,116 @@
+// Copyright (c) 2018 The KoinMudra developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "script/sigcache.h"
+
+#include "pubkey.h"
+#include "random.h"
+
+#include <limits>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(sigcache_tests)
+
+static CPubKey RandomPubKey()
+{
+    std::vector<unsigned char> vch(33);
+    GetRandBytes(&vch[0], vch.size());
+    vch[0] = 0x02;
+    return CPubKey(vch);
+}
+
+BOOST_AUTO_TEST_CASE(sigcache_get_set)
+{
+    CSignatureCache cache(1 << 16);
+    BOOST_CHECK(cache.GetSlots() > 0);
+    BOOST_CHECK(cache.GetMemoryUsage() <= (1 << 16));
+
+    uint256 hash = GetRandHash();
+    std::vector<unsigned char> vchSig(72, 0x30);
+    CPubKey pubKey = RandomPubKey();
+
+    BOOST_CHECK(!cache.Get(hash, vchSig, pubKey, false));
+    cache.Set(hash, vchSig, pubKey);
+    BOOST_CHECK(cache.Get(hash, vchSig, pubKey, false));
+
+    // Any part of the key differing is a miss
+    BOOST_CHECK(!cache.Get(GetRandHash(), vchSig, pubKey, false));
+    BOOST_CHECK(!cache.Get(hash, std::vector<unsigned char>(71, 0x30), pubKey, false));
+    BOOST_CHECK(!cache.Get(hash, vchSig, RandomPubKey(), false));
+
+    // Erasing only marks the slot reusable; until then the entry is still found
+    BOOST_CHECK(cache.Get(hash, vchSig, pubKey, true));
+    BOOST_CHECK(cache.Get(hash, vchSig, pubKey, false));
+
+    uint64_t nHits, nMisses, nInserts, nEvictions;
+    cache.GetStats(nHits, nMisses, nInserts, nEvictions);
+    BOOST_CHECK_EQUAL(nHits, 3U);
+    BOOST_CHECK_EQUAL(nMisses, 4U);
+    BOOST_CHECK_EQUAL(nInserts, 1U);
+    BOOST_CHECK_EQUAL(nEvictions, 0U);
+}
+
+BOOST_AUTO_TEST_CASE(sigcache_bounded)
+{
+    CSignatureCache cache(1 << 16);
+    size_t nSlots = cache.GetSlots();
+    std::vector<unsigned char> vchSig(72, 0x30);
+    CPubKey pubKey = RandomPubKey();
+
+    // Half full: cuckoo displacement finds room for everything
+    std::vector<uint256> vHashes;
+    for (size_t i = 0; i < nSlots / 2; i++) {
+        vHashes.push_back(GetRandHash());
+        cache.Set(vHashes.back(), vchSig, pubKey);
+    }
+    for (size_t i = 0; i < vHashes.size(); i++)
+        BOOST_CHECK(cache.Get(vHashes[i], vchSig, pubKey, false));
+
+    // Overfilling it evicts entries instead of growing
+    for (size_t i = 0; i < 4 * nSlots; i++)
+        cache.Set(GetRandHash(), vchSig, pubKey);
+    BOOST_CHECK_EQUAL(cache.GetSlots(), nSlots);
+    uint64_t nHits, nMisses, nInserts, nEvictions;
+    cache.GetStats(nHits, nMisses, nInserts, nEvictions);
+    BOOST_CHECK_EQUAL(nInserts, nSlots / 2 + 4 * nSlots);
+    BOOST_CHECK(nEvictions >= nInserts - nSlots);
+}
+
+BOOST_AUTO_TEST_CASE(sigcache_size_option)
+{
+    bool fEntryCount;
+
+    // Sizes in MiB, up to the limit
+    BOOST_CHECK_EQUAL(GetSignatureCacheBytes(DEFAULT_MAX_SIG_CACHE_SIZE, fEntryCount), (size_t)DEFAULT_MAX_SIG_CACHE_SIZE << 20);
+    BOOST_CHECK(!fEntryCount);
+    BOOST_CHECK_EQUAL(GetSignatureCacheBytes(MAX_MAX_SIG_CACHE_SIZE, fEntryCount), (size_t)MAX_MAX_SIG_CACHE_SIZE << 20);
+    BOOST_CHECK(!fEntryCount);
+    BOOST_CHECK_EQUAL(GetSignatureCacheBytes(0, fEntryCount), 0U);
+    BOOST_CHECK_EQUAL(GetSignatureCacheBytes(-1, fEntryCount), 0U);
+
+    // Larger values are the old entry counts, such as the old default of 50000
+    size_t nBytes = GetSignatureCacheBytes(50000, fEntryCount);
+    BOOST_CHECK(fEntryCount);
+    BOOST_CHECK_EQUAL(nBytes, 50000 * CSignatureCache::GetSlotSize());
+    BOOST_CHECK_EQUAL(CSignatureCache(nBytes).GetSlots(), 50000U);
+    BOOST_CHECK(GetSignatureCacheBytes(MAX_MAX_SIG_CACHE_SIZE + 1, fEntryCount) < ((size_t)1 << 20));
+    BOOST_CHECK(fEntryCount);
+
+    // Even as entries, the cache stays within the limit
+    BOOST_CHECK(GetSignatureCacheBytes(std::numeric_limits<int64_t>::max(), fEntryCount) <= (size_t)MAX_MAX_SIG_CACHE_SIZE << 20);
+}
+
+BOOST_AUTO_TEST_CASE(sigcache_disabled)
+{
+    CSignatureCache cache(0);
+    uint256 hash = GetRandHash();
+    std::vector<unsigned char> vchSig(72, 0x30);
+    CPubKey pubKey = RandomPubKey();
+    cache.Set(hash, vchSig, pubKey);
+    BOOST_CHECK(!cache.Get(hash, vchSig, pubKey, false));
+    BOOST_CHECK_EQUAL(cache.GetMemoryUsage(), 0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,220 @@
+// Copyright (c) 2018 The KoinMudra developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+//
+// Unit tests for the select and epoll socket events backends
+//
+
+#include "netbase.h"
+#include "socketevents.h"
+#include "utiltime.h"
+
+#include <string>
+#include <vector>
+
+#ifndef WIN32
+#include <sys/socket.h>
+#endif
+
+#include <boost/foreach.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(socketevents_tests)
+
+BOOST_AUTO_TEST_CASE(socketevents_modes)
+{
+    BOOST_CHECK(IsSocketEventsModeSupported("select"));
+    BOOST_CHECK(IsSocketEventsModeSupported(DEFAULT_SOCKETEVENTS));
+    BOOST_CHECK(!IsSocketEventsModeSupported(""));
+    BOOST_CHECK(!IsSocketEventsModeSupported("poll"));
+    BOOST_CHECK(CreateSocketEvents("poll") == NULL);
+
+    boost::scoped_ptr<CSocketEvents> events(CreateSocketEvents("select"));
+    BOOST_REQUIRE(events);
+    BOOST_CHECK_EQUAL(events->GetName(), "select");
+}
+
+#ifndef WIN32
+
+/** The backends available here, by name. */
+static std::vector<std::string> GetModes()
+{
+    std::vector<std::string> vModes;
+    vModes.push_back("select");
+    if (IsSocketEventsModeSupported("epoll"))
+        vModes.push_back("epoll");
+    return vModes;
+}
+
+/** A connected pair of non-blocking stream sockets. */
+static void OpenPair(SOCKET& hSocket, SOCKET& hPeer)
+{
+    int hSockets[2];
+    BOOST_REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, hSockets) == 0);
+    hSocket = hSockets[0];
+    hPeer = hSockets[1];
+    BOOST_REQUIRE(SetSocketNonBlocking(hSocket, true));
+    BOOST_REQUIRE(SetSocketNonBlocking(hPeer, true));
+}
+
+/** Run one round with hSocket watched in the given directions. */
+static void Round(CSocketEvents& events, SOCKET hSocket, const void* pOwner, bool fRecv, bool fSend, int64_t nTimeout)
+{
+    events.Watch(hSocket, pOwner, fRecv, fSend);
+    events.Wait(nTimeout);
+}
+
+/** Read everything queued on hSocket, as the socket handler does; returns the number of bytes read. */
+static int Drain(CSocketEvents& events, SOCKET hSocket)
+{
+    char pchBuf[0x10000];
+    int nTotal = 0;
+    while (true) {
+        int nBytes = recv(hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
+        if (nBytes <= 0)
+            break;
+        nTotal += nBytes;
+        if (nBytes < (int)sizeof(pchBuf))
+            break;
+    }
+    events.RecvDrained(hSocket);
+    return nTotal;
+}
+
+BOOST_AUTO_TEST_CASE(socketevents_readiness)
+{
+    BOOST_FOREACH (const std::string& strMode, GetModes()) {
+        BOOST_TEST_MESSAGE("socket events mode " + strMode);
+        boost::scoped_ptr<CSocketEvents> events(CreateSocketEvents(strMode));
+        BOOST_REQUIRE(events);
+        SOCKET hSocket, hPeer;
+        OpenPair(hSocket, hPeer);
+        BOOST_CHECK(events->CanWatch(hSocket));
+        int nOwner;
+
+        // A fresh socket can be written to but has nothing to read
+        Round(*events, hSocket, &nOwner, true, true, 0);
+        BOOST_CHECK(!events->IsRecvReady(hSocket));
+        BOOST_CHECK(events->IsSendReady(hSocket));
+
+        // Only the directions asked for are reported
+        BOOST_CHECK_EQUAL(send(hPeer, "ping", 4, MSG_NOSIGNAL), 4);
+        Round(*events, hSocket, &nOwner, true, false, 1000);
+        BOOST_CHECK(events->IsRecvReady(hSocket));
+        BOOST_CHECK(!events->IsSendReady(hSocket));
+
+        // Data left unread stays ready, and a wait does not block on it
+        int64_t nStart = GetTimeMillis();
+        Round(*events, hSocket, &nOwner, true, true, 10000);
+        BOOST_CHECK(GetTimeMillis() - nStart < 5000);
+        BOOST_CHECK(events->IsRecvReady(hSocket));
+        BOOST_CHECK(events->IsSendReady(hSocket));
+
+        // Once drained it is not reported again until more data arrives
+        BOOST_CHECK_EQUAL(Drain(*events, hSocket), 4);
+        Round(*events, hSocket, &nOwner, true, false, 0);
+        BOOST_CHECK(!events->IsRecvReady(hSocket));
+        BOOST_CHECK_EQUAL(send(hPeer, "pong", 4, MSG_NOSIGNAL), 4);
+        Round(*events, hSocket, &nOwner, true, false, 1000);
+        BOOST_CHECK(events->IsRecvReady(hSocket));
+        BOOST_CHECK_EQUAL(Drain(*events, hSocket), 4);
+
+        // The directions stay watched until they change
+        BOOST_CHECK_EQUAL(send(hPeer, "more", 4, MSG_NOSIGNAL), 4);
+        events->Wait(1000);
+        BOOST_CHECK(events->IsRecvReady(hSocket));
+        BOOST_CHECK(!events->IsSendReady(hSocket));
+
+        // Another owner cannot unwatch the socket, its own can
+        int nOther;
+        events->Unwatch(hSocket, &nOther);
+        events->Wait(0);
+        BOOST_CHECK(events->IsRecvReady(hSocket));
+        events->Unwatch(hSocket, &nOwner);
+        events->Wait(0);
+        BOOST_CHECK(!events->IsRecvReady(hSocket));
+        BOOST_CHECK(!events->IsSendReady(hSocket));
+        BOOST_CHECK_EQUAL(Drain(*events, hSocket), 4);
+
+        // The peer closing the connection makes the socket readable
+        CloseSocket(hPeer);
+        Round(*events, hSocket, &nOwner, true, true, 1000);
+        BOOST_CHECK(events->IsRecvReady(hSocket));
+        CloseSocket(hSocket);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(socketevents_send_blocked)
+{
+    BOOST_FOREACH (const std::string& strMode, GetModes()) {
+        BOOST_TEST_MESSAGE("socket events mode " + strMode);
+        boost::scoped_ptr<CSocketEvents> events(CreateSocketEvents(strMode));
+        BOOST_REQUIRE(events);
+        SOCKET hSocket, hPeer;
+        OpenPair(hSocket, hPeer);
+        int nOwner;
+
+        // Fill the send buffer until send() takes no more
+        Round(*events, hSocket, &nOwner, false, true, 0);
+        BOOST_CHECK(events->IsSendReady(hSocket));
+        std::string strData(0x10000, 'x');
+        while (send(hSocket, strData.data(), strData.size(), MSG_NOSIGNAL | MSG_DONTWAIT) > 0) {
+        }
+        events->SendBlocked(hSocket);
+        Round(*events, hSocket, &nOwner, false, true, 0);
+        BOOST_CHECK(!events->IsSendReady(hSocket));
+
+        // The peer reading makes room again
+        BOOST_CHECK(Drain(*events, hPeer) > 0);
+        while (Drain(*events, hPeer) > 0) {
+        }
+        Round(*events, hSocket, &nOwner, false, true, 1000);
+        BOOST_CHECK(events->IsSendReady(hSocket));
+
+        CloseSocket(hPeer);
+        CloseSocket(hSocket);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(socketevents_reused_descriptor)
+{
+    BOOST_FOREACH (const std::string& strMode, GetModes()) {
+        BOOST_TEST_MESSAGE("socket events mode " + strMode);
+        boost::scoped_ptr<CSocketEvents> events(CreateSocketEvents(strMode));
+        BOOST_REQUIRE(events);
+        SOCKET hSocket, hPeer;
+        OpenPair(hSocket, hPeer);
+        int nOwnerOld, nOwnerNew;
+
+        BOOST_CHECK_EQUAL(send(hPeer, "old", 3, MSG_NOSIGNAL), 3);
+        Round(*events, hSocket, &nOwnerOld, true, false, 1000);
+        BOOST_CHECK(events->IsRecvReady(hSocket));
+
+        // A new connection on the descriptor number of a closed one, watched by its new owner
+        SOCKET hSocketOld = hSocket;
+        CloseSocket(hSocket);
+        CloseSocket(hPeer);
+        OpenPair(hSocket, hPeer);
+        BOOST_CHECK(hSocket == hSocketOld || hPeer == hSocketOld);
+        if (hPeer == hSocketOld)
+            std::swap(hSocket, hPeer);
+
+        // Nothing from the old connection carries over
+        Round(*events, hSocket, &nOwnerNew, true, true, 0);
+        BOOST_CHECK(!events->IsRecvReady(hSocket));
+        BOOST_CHECK(events->IsSendReady(hSocket));
+        BOOST_CHECK_EQUAL(send(hPeer, "new", 3, MSG_NOSIGNAL), 3);
+        Round(*events, hSocket, &nOwnerNew, true, false, 1000);
+        BOOST_CHECK(events->IsRecvReady(hSocket));
+        BOOST_CHECK_EQUAL(Drain(*events, hSocket), 3);
+
+        CloseSocket(hPeer);
+        CloseSocket(hSocket);
+    }
+}
+
+#endif
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,355 @@
+// Copyright (c) 2018 The KoinMudra developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+//
+// Unit tests for the coin database: batched writes, the write-behind thread
+// and recovery from a write interrupted between two batches
+//
+
+#include "chainparams.h"
+#include "coins.h"
+#include "main.h"
+#include "random.h"
+#include "script/standard.h"
+#include "txdb.h"
+#include "util.h"
+
+#include <boost/test/unit_test.hpp>
+
+extern std::map<std::string, std::string> mapArgs;
+extern std::set<CBlockIndex*> setDirtyBlockIndex;
+
+BOOST_AUTO_TEST_SUITE(txdb_tests)
+
+/** A proof-of-stake block on top of pindexPrev whose coinstake spends prevout and which creates nOutputs spendable outputs per transaction. */
+static CBlock BuildBlock(const CBlockIndex* pindexPrev, const COutPoint& prevout, int nOutputs)
+{
+    CBlock block;
+    block.nVersion = 3;
+    block.hashPrevBlock = pindexPrev->GetBlockHash();
+    block.nTime = pindexPrev->GetBlockTime() + 60;
+
+    CMutableTransaction txCoinBase;
+    txCoinBase.vin.resize(1);
+    txCoinBase.vin[0].prevout.SetNull();
+    txCoinBase.vin[0].scriptSig = CScript() << (pindexPrev->nHeight + 1) << OP_0;
+    txCoinBase.vout.resize(1);
+    txCoinBase.vout[0].SetEmpty();
+    block.vtx.push_back(txCoinBase);
+
+    CMutableTransaction txCoinStake;
+    txCoinStake.vin.push_back(CTxIn(prevout));
+    txCoinStake.vout.resize(1);
+    txCoinStake.vout[0].SetEmpty();
+    for (int i = 0; i < nOutputs; i++)
+        txCoinStake.vout.push_back(CTxOut(1000 + i, CScript() << OP_TRUE));
+    block.vtx.push_back(txCoinStake);
+
+    CMutableTransaction tx;
+    tx.vin.push_back(CTxIn(COutPoint(block.vtx[1].GetHash(), 1)));
+    for (int i = 0; i < nOutputs; i++)
+        tx.vout.push_back(CTxOut(2000 + i, CScript() << OP_TRUE));
+    block.vtx.push_back(tx);
+
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    return block;
+}
+
+/** Store block at nPos of block file nFile and index it as the child of pindexPrev. */
+static CBlockIndex* StoreBlock(CBlock& block, CBlockIndex* pindexPrev, int nFile, unsigned int nPos = 0)
+{
+    CDiskBlockPos pos(nFile, nPos);
+    BOOST_REQUIRE(WriteBlockToDisk(block, pos));
+    CBlockIndex* pindex = new CBlockIndex(block);
+    BlockMap::iterator mi = mapBlockIndex.insert(std::make_pair(block.GetHash(), pindex)).first;
+    pindex->phashBlock = &((*mi).first);
+    pindex->pprev = pindexPrev;
+    pindex->nHeight = pindexPrev->nHeight + 1;
+    pindex->nFile = pos.nFile;
+    pindex->nDataPos = pos.nPos;
+    pindex->nStatus |= BLOCK_HAVE_DATA;
+    pindex->BuildSkip();
+    return pindex;
+}
+
+/** A block on top of pindexPrev that spends prevout, a pay-to-script-hash output of redeemFrom, to scriptTo. */
+static CBlock BuildSpend(const CBlockIndex* pindexPrev, const COutPoint& prevout, const CScript& redeemFrom, const CScript& scriptTo)
+{
+    CBlock block;
+    block.nVersion = 3;
+    block.hashPrevBlock = pindexPrev->GetBlockHash();
+    block.nTime = pindexPrev->GetBlockTime() + 60;
+
+    CMutableTransaction txCoinBase;
+    txCoinBase.vin.resize(1);
+    txCoinBase.vin[0].prevout.SetNull();
+    txCoinBase.vin[0].scriptSig = CScript() << (pindexPrev->nHeight + 1) << OP_0;
+    txCoinBase.vout.push_back(CTxOut(GetBlockValue(pindexPrev->nHeight + 1), CScript() << OP_TRUE));
+    block.vtx.push_back(txCoinBase);
+
+    CMutableTransaction tx;
+    tx.vin.push_back(CTxIn(prevout, CScript() << std::vector<unsigned char>(redeemFrom.begin(), redeemFrom.end())));
+    tx.vout.push_back(CTxOut(9 * COIN, scriptTo));
+    block.vtx.push_back(tx);
+
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    return block;
+}
+
+/** Apply block to view the way ConnectBlock() would. */
+static void ApplyBlock(CCoinsViewCache& view, const CBlock& block, int nHeight)
+{
+    BOOST_FOREACH (const CTransaction& tx, block.vtx) {
+        if (!tx.IsCoinBase()) {
+            BOOST_FOREACH (const CTxIn& txin, tx.vin)
+                view.SpendCoin(txin.prevout);
+        }
+        AddCoins(view, tx, nHeight);
+    }
+}
+
+/** Number of the spendable outputs of block found in view. */
+static int CountOutputs(const CCoinsView& view, const CBlock& block)
+{
+    int nFound = 0;
+    for (unsigned int i = 1; i < block.vtx.size(); i++) {
+        for (unsigned int n = 0; n < block.vtx[i].vout.size(); n++) {
+            if (block.vtx[i].vout[n].IsEmpty())
+                continue;
+            Coin coin;
+            if (view.GetCoin(COutPoint(block.vtx[i].GetHash(), n), coin)) {
+                BOOST_CHECK(coin.out == block.vtx[i].vout[n]);
+                nFound++;
+            }
+        }
+    }
+    return nFound;
+}
+
+BOOST_AUTO_TEST_CASE(coindb_replay_after_partial_write)
+{
+    CBlockIndex* pindexGenesis = chainActive.Genesis();
+    CCoinsViewDB db(1 << 20, true);
+
+    // The database at the old tip holds the coin the block stakes
+    COutPoint prevout(GetRandHash(), 0);
+    {
+        CCoinsViewCache cache(&db);
+        cache.AddCoin(prevout, Coin(CTxOut(100000, CScript() << OP_TRUE), 0, false, false), false);
+        cache.SetBestBlock(pindexGenesis->GetBlockHash());
+        BOOST_CHECK(cache.Flush());
+    }
+    BOOST_CHECK(db.GetHeadBlocks().empty());
+
+    CBlock block = BuildBlock(pindexGenesis, prevout, 20);
+    CBlockIndex* pindex = StoreBlock(block, pindexGenesis, 900);
+    const int nOutputs = 2 * 20;
+
+    // Every entry is a batch of its own; the write stops after three of them
+    mapArgs["-dbbatchsize"] = "1";
+    mapArgs["-dbcrashbatch"] = "3";
+    {
+        CCoinsViewCache cache(&db);
+        ApplyBlock(cache, block, pindex->nHeight);
+        cache.SetBestBlock(pindex->GetBlockHash());
+        BOOST_CHECK(!cache.Flush());
+    }
+    std::vector<uint256> vhashHeads = db.GetHeadBlocks();
+    BOOST_REQUIRE_EQUAL(vhashHeads.size(), 2U);
+    BOOST_CHECK(vhashHeads[0] == pindex->GetBlockHash());
+    BOOST_CHECK(vhashHeads[1] == pindexGenesis->GetBlockHash());
+    BOOST_CHECK(db.GetBestBlock() == uint256(0));
+    BOOST_CHECK(CountOutputs(db, block) < nOutputs);
+
+    // A replay interrupted the same way keeps the old tip on record
+    BOOST_CHECK(!ReplayBlocks(&db));
+    vhashHeads = db.GetHeadBlocks();
+    BOOST_REQUIRE_EQUAL(vhashHeads.size(), 2U);
+    BOOST_CHECK(vhashHeads[0] == pindex->GetBlockHash());
+    BOOST_CHECK(vhashHeads[1] == pindexGenesis->GetBlockHash());
+
+    // A complete replay reaches the state of an uninterrupted write
+    mapArgs.erase("-dbcrashbatch");
+    BOOST_CHECK(ReplayBlocks(&db));
+    BOOST_CHECK(db.GetHeadBlocks().empty());
+    BOOST_CHECK(db.GetBestBlock() == pindex->GetBlockHash());
+    BOOST_CHECK_EQUAL(CountOutputs(db, block), nOutputs - 1);
+    BOOST_CHECK(!db.HaveCoin(prevout));
+    BOOST_CHECK(!db.HaveCoin(COutPoint(block.vtx[1].GetHash(), 1)));
+
+    // Nothing is left to replay
+    BOOST_CHECK(ReplayBlocks(&db));
+    BOOST_CHECK(db.GetBestBlock() == pindex->GetBlockHash());
+
+    mapArgs.erase("-dbbatchsize");
+    mapBlockIndex.erase(pindex->GetBlockHash());
+    delete pindex;
+}
+
+BOOST_AUTO_TEST_CASE(coindb_replay_keeps_indexes)
+{
+    LOCK(cs_main);
+    bool fAddressIndexOld = fAddressIndex, fSpentIndexOld = fSpentIndex;
+    fAddressIndex = fSpentIndex = true;
+
+    // Trivial scripts, unique to this test, so the index entries are its own
+    CScript redeemFrom = CScript() << ToByteVector(GetRandHash()) << OP_DROP << OP_TRUE;
+    CScript redeemOld = CScript() << ToByteVector(GetRandHash()) << OP_DROP << OP_TRUE;
+    CScript redeemNew = CScript() << ToByteVector(GetRandHash()) << OP_DROP << OP_TRUE;
+    uint160 hashFrom = CScriptID(redeemFrom), hashOld = CScriptID(redeemOld), hashNew = CScriptID(redeemNew);
+
+    CBlockIndex* pindexGenesis = chainActive.Genesis();
+    CCoinsViewDB db(1 << 20, true);
+    COutPoint prevout(GetRandHash(), 0);
+    {
+        CCoinsViewCache cache(&db);
+        cache.AddCoin(prevout, Coin(CTxOut(10 * COIN, GetScriptForDestination(CScriptID(redeemFrom))), 1, false, false), false);
+        cache.SetBestBlock(pindexGenesis->GetBlockHash());
+        BOOST_CHECK(cache.Flush());
+    }
+
+    // Two competing unmined children of the genesis block; their undo data goes
+    // next to the genesis block's, so they are stored past it in the same file
+    ModifiableParams()->setSkipProofOfWorkCheck(true);
+    CBlock blockOld = BuildSpend(pindexGenesis, prevout, redeemFrom, GetScriptForDestination(CScriptID(redeemOld)));
+    CBlock blockNew = BuildSpend(pindexGenesis, prevout, redeemFrom, GetScriptForDestination(CScriptID(redeemNew)));
+    CBlockIndex* pindexOld = StoreBlock(blockOld, pindexGenesis, pindexGenesis->nFile, 1 << 22);
+    CBlockIndex* pindexNew = StoreBlock(blockNew, pindexGenesis, pindexGenesis->nFile, (1 << 22) + (1 << 16));
+    CValidationState state;
+    {
+        CCoinsViewCache cache(&db);
+        BOOST_REQUIRE(ConnectBlock(blockOld, state, pindexOld, cache, false, true));
+        BOOST_CHECK(cache.Flush());
+    }
+
+    // The reorganization updates the indexes as it goes, and its coins only partly reach the database
+    mapArgs["-dbbatchsize"] = "1";
+    mapArgs["-dbcrashbatch"] = "3";
+    {
+        CCoinsViewCache cache(&db);
+        BOOST_REQUIRE(DisconnectBlock(blockOld, state, pindexOld, cache, NULL));
+        BOOST_REQUIRE(ConnectBlock(blockNew, state, pindexNew, cache, false, true));
+        BOOST_CHECK(!cache.Flush());
+    }
+    BOOST_REQUIRE_EQUAL(db.GetHeadBlocks().size(), 2U);
+
+    // Replaying the coins leaves the indexes as the new tip left them
+    mapArgs.erase("-dbcrashbatch");
+    BOOST_CHECK(ReplayBlocks(&db));
+    BOOST_CHECK(db.GetBestBlock() == pindexNew->GetBlockHash());
+    BOOST_CHECK(!db.HaveCoin(prevout));
+    BOOST_CHECK(!db.HaveCoin(COutPoint(blockOld.vtx[1].GetHash(), 0)));
+    BOOST_CHECK(db.HaveCoin(COutPoint(blockNew.vtx[1].GetHash(), 0)));
+
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > vUnspentFrom, vUnspentOld, vUnspentNew;
+    BOOST_CHECK(GetAddressUnspent(hashFrom, ADDRESS_INDEX_SCRIPT, vUnspentFrom));
+    BOOST_CHECK(GetAddressUnspent(hashOld, ADDRESS_INDEX_SCRIPT, vUnspentOld));
+    BOOST_CHECK(GetAddressUnspent(hashNew, ADDRESS_INDEX_SCRIPT, vUnspentNew));
+    BOOST_CHECK(vUnspentFrom.empty());
+    BOOST_CHECK(vUnspentOld.empty());
+    BOOST_REQUIRE_EQUAL(vUnspentNew.size(), 1U);
+    BOOST_CHECK(vUnspentNew[0].first.txhash == blockNew.vtx[1].GetHash());
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vHistoryOld;
+    BOOST_CHECK(GetAddressIndex(hashOld, ADDRESS_INDEX_SCRIPT, vHistoryOld));
+    BOOST_CHECK(vHistoryOld.empty());
+    CSpentIndexValue spent;
+    BOOST_REQUIRE(GetSpentIndex(CSpentIndexKey(prevout.hash, prevout.n), spent));
+    BOOST_CHECK(spent.txid == blockNew.vtx[1].GetHash());
+
+    mapArgs.erase("-dbbatchsize");
+    ModifiableParams()->setSkipProofOfWorkCheck(false);
+    fAddressIndex = fAddressIndexOld;
+    fSpentIndex = fSpentIndexOld;
+    setDirtyBlockIndex.erase(pindexOld);
+    setDirtyBlockIndex.erase(pindexNew);
+    mapBlockIndex.erase(pindexOld->GetBlockHash());
+    mapBlockIndex.erase(pindexNew->GetBlockHash());
+    delete pindexOld;
+    delete pindexNew;
+}
+
+BOOST_AUTO_TEST_CASE(coindb_write_behind)
+{
+    CCoinsViewDB db(1 << 20, true);
+    db.StartWriteBehind();
+    BOOST_CHECK(db.IsWriteBehind());
+
+    std::vector<COutPoint> vOutpoints;
+    uint256 hashBlock = GetRandHash();
+    {
+        CCoinsViewCache cache(&db);
+        for (int i = 0; i < 100; i++) {
+            vOutpoints.push_back(COutPoint(GetRandHash(), i));
+            cache.AddCoin(vOutpoints.back(), Coin(CTxOut(i + 1, CScript() << OP_TRUE), 1, false, false), false);
+        }
+        cache.SetBestBlock(hashBlock);
+        BOOST_CHECK(cache.Flush());
+    }
+
+    // Written or not, the coins and the best block are visible right away
+    BOOST_CHECK(db.GetBestBlock() == hashBlock);
+    BOOST_FOREACH (const COutPoint& outpoint, vOutpoints)
+        BOOST_CHECK(db.HaveCoin(outpoint));
+
+    // Spends handed over after the coins shadow them until written
+    {
+        CCoinsViewCache cache(&db);
+        for (int i = 0; i < 50; i++)
+            BOOST_CHECK(cache.SpendCoin(vOutpoints[i]));
+        BOOST_CHECK(cache.Flush());
+    }
+    for (int i = 0; i < 100; i++)
+        BOOST_CHECK_EQUAL(db.HaveCoin(vOutpoints[i]), i >= 50);
+
+    BOOST_CHECK(db.WaitForWrites());
+    BOOST_CHECK(!db.IsWriting());
+    BOOST_CHECK(db.GetWriteStats().nFlushes >= 1);
+    BOOST_CHECK(db.GetBestBlock() == hashBlock);
+    for (int i = 0; i < 100; i++) {
+        Coin coin;
+        BOOST_CHECK_EQUAL(db.GetCoin(vOutpoints[i], coin), i >= 50);
+        if (i >= 50)
+            BOOST_CHECK_EQUAL(coin.out.nValue, i + 1);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(coindb_write_behind_failure)
+{
+    CCoinsViewDB db(1 << 20, true);
+    db.StartWriteBehind();
+
+    std::vector<COutPoint> vOutpoints;
+    uint256 hashBlock = GetRandHash();
+    mapArgs["-dbbatchsize"] = "1";
+    mapArgs["-dbcrashbatch"] = "2";
+    {
+        CCoinsViewCache cache(&db);
+        for (int i = 0; i < 10; i++) {
+            vOutpoints.push_back(COutPoint(GetRandHash(), i));
+            cache.AddCoin(vOutpoints.back(), Coin(CTxOut(i + 1, CScript() << OP_TRUE), 1, false, false), false);
+        }
+        cache.SetBestBlock(hashBlock);
+        BOOST_CHECK(cache.Flush());
+    }
+
+    // The failed write is reported, and its changes stay visible
+    BOOST_CHECK(!db.WaitForWrites());
+    BOOST_CHECK(db.IsWriting());
+    BOOST_CHECK(db.GetBestBlock() == hashBlock);
+    BOOST_FOREACH (const COutPoint& outpoint, vOutpoints)
+        BOOST_CHECK(db.HaveCoin(outpoint));
+    BOOST_CHECK_EQUAL(db.GetHeadBlocks().size(), 2U);
+
+    // Later flushes fail rather than pile up
+    {
+        CCoinsViewCache cache(&db);
+        cache.AddCoin(COutPoint(GetRandHash(), 0), Coin(CTxOut(1, CScript() << OP_TRUE), 2, false, false), false);
+        BOOST_CHECK(!cache.Flush());
+    }
+
+    mapArgs.erase("-dbcrashbatch");
+    mapArgs.erase("-dbbatchsize");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
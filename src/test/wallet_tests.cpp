@@ -2,15 +2,22 @@
 // Distributed under the MIT/X11 software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "chainparams.h"
+#include "kernel.h"
+#include "main.h"
+#include "random.h"
 #include "wallet.h"
 
+#include <limits>
 #include <set>
 #include <stdint.h>
 #include <utility>
 #include <vector>
 
+#include <boost/assign/list_of.hpp>
 #include <boost/foreach.hpp>
 #include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
 
 // how many times to run all the tests to have a chance to catch errors that only show up with particular random shuffles
 #define RUN_TESTS 100
@@ -305,4 +312,169 @@ BOOST_AUTO_TEST_CASE(coin_selection_tests)
     empty_wallet();
 }
 
+/** Indexed headers a minute apart, each of which generated a stake modifier; the active chain while in scope */
+class CStakeTestChain
+{
+public:
+    std::vector<CBlockHeader> vHeaders;
+    std::vector<CBlockIndex> vIndex;
+
+    CStakeTestChain(int nBlocks) : vHeaders(nBlocks), vIndex(nBlocks)
+    {
+        LOCK(cs_main);
+        pindexTipOld = chainActive.Tip();
+        for (int i = 0; i < nBlocks; i++) {
+            CBlockHeader& header = vHeaders[i];
+            header.nVersion = 4;
+            header.hashPrevBlock = i > 0 ? vHeaders[i - 1].GetHash() : uint256(0);
+            header.hashMerkleRoot = GetRandHash();
+            header.nTime = 1500000000 + i * 60;
+            header.nBits = Params().ProofOfWorkLimit().GetCompact();
+
+            CBlockIndex& index = vIndex[i];
+            index.nVersion = header.nVersion;
+            index.hashMerkleRoot = header.hashMerkleRoot;
+            index.nTime = header.nTime;
+            index.nBits = header.nBits;
+            index.nHeight = i;
+            index.pprev = i > 0 ? &vIndex[i - 1] : NULL;
+            index.SetStakeModifier(GetRand(std::numeric_limits<uint64_t>::max()), true);
+            index.phashBlock = &mapBlockIndex.insert(std::make_pair(header.GetHash(), &index)).first->first;
+            index.BuildSkip();
+        }
+        chainActive.SetTip(&vIndex.back());
+    }
+
+    ~CStakeTestChain()
+    {
+        LOCK(cs_main);
+        chainActive.SetTip(pindexTipOld);
+        UpdateStakeModifierIndex();
+        for (unsigned int i = 0; i < vHeaders.size(); i++)
+            mapBlockIndex.erase(vHeaders[i].GetHash());
+    }
+
+private:
+    CBlockIndex* pindexTipOld;
+};
+
+/** Search every coin on its own and all of them together, and compare with CheckStakeKernelHash(). */
+static void CheckStakeKernelSearch(CStakeTestChain& chain, unsigned int nBits, const CTransaction& txPrev, unsigned int nTimeTx, unsigned int nHashDrift)
+{
+    std::vector<CStakeKernel> vKernels(txPrev.vout.size());
+    std::vector<bool> vfHit(vKernels.size());
+    int nFirstHit = -1;
+    for (unsigned int n = 0; n < vKernels.size(); n++) {
+        COutPoint prevout(txPrev.GetHash(), n);
+        // Coins come from the first blocks, whose stake modifiers are a selection interval before the tip
+        const CBlockIndex* pindexFrom = &chain.vIndex[n % 20];
+        CBlock blockFrom(chain.vHeaders[n % 20]);
+        BOOST_REQUIRE(PrepareStakeKernel(nBits, pindexFrom, txPrev, prevout, vKernels[n]));
+
+        // The precomputed kernel hashes what stakeHash() hashes
+        uint256 hashCheck;
+        unsigned int nTimeCheck = nTimeTx + 1;
+        CheckStakeKernelHash(nBits, blockFrom, txPrev, prevout, nTimeCheck, 0, true, hashCheck);
+        size_t nKernel;
+        unsigned int nTimeFound;
+        uint256 hashProofOfStake;
+        std::vector<CStakeKernel> vKernel(1, vKernels[n]);
+        vKernel[0].bnTarget = hashCheck + 1;
+        BOOST_CHECK(FindStakeKernel(vKernel, nTimeTx, 1, nKernel, nTimeFound, hashProofOfStake));
+        BOOST_CHECK_EQUAL(nTimeFound, nTimeCheck);
+        BOOST_CHECK(hashProofOfStake == hashCheck);
+
+        // ... and hits at the same timestamp as CheckStakeKernelHash(), if at all
+        nTimeCheck = nTimeTx;
+        vfHit[n] = CheckStakeKernelHash(nBits, blockFrom, txPrev, prevout, nTimeCheck, nHashDrift, false, hashCheck);
+        vKernel[0] = vKernels[n];
+        BOOST_CHECK_EQUAL(FindStakeKernel(vKernel, nTimeTx, nHashDrift, nKernel, nTimeFound, hashProofOfStake), vfHit[n]);
+        if (vfHit[n]) {
+            BOOST_CHECK_EQUAL(nTimeFound, nTimeCheck);
+            BOOST_CHECK(hashProofOfStake == hashCheck);
+            if (nFirstHit < 0)
+                nFirstHit = n;
+        }
+    }
+
+    // Searching all coins finds one that hits; the sequential search finds the first
+    size_t nKernel;
+    unsigned int nTimeFound;
+    uint256 hashProofOfStake;
+    BOOST_CHECK_EQUAL(FindStakeKernel(vKernels, nTimeTx, nHashDrift, nKernel, nTimeFound, hashProofOfStake), nFirstHit >= 0);
+    if (nFirstHit >= 0) {
+        BOOST_REQUIRE(nKernel < vKernels.size());
+        BOOST_CHECK(vfHit[nKernel]);
+        if (!nStakeSearchThreads)
+            BOOST_CHECK_EQUAL(nKernel, (size_t)nFirstHit);
+        BOOST_CHECK(hashProofOfStake < vKernels[nKernel].bnTarget);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(stake_kernel_search)
+{
+    CStakeTestChain chain(200);
+    unsigned int nTimeTx = chain.vIndex.back().GetBlockTime();
+    unsigned int nHashDrift = 45;
+
+    // 40 coin outputs, with a target that about one in 64 hashes meets
+    CMutableTransaction txPrev;
+    txPrev.vout.resize(40);
+    for (unsigned int n = 0; n < txPrev.vout.size(); n++)
+        txPrev.vout[n].nValue = 100 * COIN;
+    unsigned int nBits = uint256((~uint256(0) >> 6) / uint256(COIN)).GetCompact();
+
+    CheckStakeKernelSearch(chain, nBits, txPrev, nTimeTx, nHashDrift);
+
+    // again on the kernel search threads
+    boost::thread_group threads;
+    nStakeSearchThreads = 4;
+    for (int i = 0; i < nStakeSearchThreads - 1; i++)
+        threads.create_thread(&ThreadStakeKernelSearch);
+    CheckStakeKernelSearch(chain, nBits, txPrev, nTimeTx, nHashDrift);
+    threads.interrupt_all();
+    threads.join_all();
+    nStakeSearchThreads = 0;
+}
+
+BOOST_AUTO_TEST_CASE(script_match_set)
+{
+    CWallet keystore;
+    CKey key[3];
+    for (int i = 0; i < 3; i++) {
+        key[i].MakeNewKey(true);
+        if (i < 2)
+            keystore.AddKey(key[i]);
+    }
+    CScript redeem = GetScriptForMultisig(2, boost::assign::list_of(key[0].GetPubKey())(key[1].GetPubKey()));
+    keystore.AddCScript(redeem);
+    CScript watched = GetScriptForDestination(key[2].GetPubKey().GetID());
+    keystore.AddWatchOnly(watched);
+
+    CScriptMatchSet matchSet;
+    keystore.GetScriptMatchSet(matchSet);
+
+    // Everything IsMine() accepts must be matched
+    vector<CScript> vMine;
+    vMine.push_back(GetScriptForDestination(key[0].GetPubKey().GetID()));
+    vMine.push_back(CScript() << ToByteVector(key[1].GetPubKey()) << OP_CHECKSIG);
+    vMine.push_back(GetScriptForDestination(CScriptID(redeem)));
+    vMine.push_back(redeem);
+    vMine.push_back(watched);
+    BOOST_FOREACH (const CScript& script, vMine) {
+        BOOST_CHECK(IsMine(keystore, script) != ISMINE_NO);
+        BOOST_CHECK(matchSet.MayBeMine(script));
+    }
+
+    // A multisig output with a key we lack is matched but not ours
+    CScript partial = GetScriptForMultisig(1, boost::assign::list_of(key[0].GetPubKey())(key[2].GetPubKey()));
+    BOOST_CHECK(matchSet.MayBeMine(partial));
+    BOOST_CHECK(IsMine(keystore, partial) == ISMINE_NO);
+
+    CKey other;
+    other.MakeNewKey(true);
+    BOOST_CHECK(!matchSet.MayBeMine(GetScriptForDestination(other.GetPubKey().GetID())));
+    BOOST_CHECK(!matchSet.MayBeMine(CScript() << OP_RETURN));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,67 @@
+// Copyright (c) 2018 The KoinMudra developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_TIMESTAMPINDEX_H
+#define BITCOIN_TIMESTAMPINDEX_H
+
+#include "addressindex.h"
+#include "uint256.h"
+
+/** A block by its timestamp; the timestamp is stored big-endian so blocks sort by time */
+struct CTimestampIndexKey {
+    unsigned int timestamp;
+    uint256 blockHash;
+
+    CTimestampIndexKey()
+    {
+        SetNull();
+    }
+
+    CTimestampIndexKey(unsigned int timestampIn, const uint256& blockHashIn) : timestamp(timestampIn), blockHash(blockHashIn) {}
+
+    void SetNull()
+    {
+        timestamp = 0;
+        blockHash = 0;
+    }
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        return 4 + 32;
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        WriteIndexBE32(s, timestamp);
+        s << blockHash;
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
+    {
+        timestamp = ReadIndexBE32(s);
+        s >> blockHash;
+    }
+};
+
+/** Where to start reading the timestamp index */
+struct CTimestampIndexIteratorKey {
+    unsigned int timestamp;
+
+    CTimestampIndexIteratorKey(unsigned int timestampIn) : timestamp(timestampIn) {}
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        return 4;
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        WriteIndexBE32(s, timestamp);
+    }
+};
+
+#endif // BITCOIN_TIMESTAMPINDEX_H
@@ -7,71 +7,442 @@
 #include "txdb.h"
 
 #include "main.h"
+#include "memusage.h"
 #include "pow.h"
+#include "ui_interface.h"
 #include "uint256.h"
+#include "util.h"
+#include "utiltime.h"
 
+#include <algorithm>
 #include <stdint.h>
 
+#include <boost/bind.hpp>
 #include <boost/thread.hpp>
 
 using namespace std;
 
-void static BatchWriteCoins(CLevelDBBatch& batch, const uint256& hash, const CCoins& coins)
+static const char DB_COIN = 'C';
+static const char DB_COINS = 'c';
+static const char DB_BEST_BLOCK = 'B';
+static const char DB_HEAD_BLOCKS = 'H';
+
+/** Block index records LoadBlockIndexGuts() reads before hashing their headers together */
+static const size_t BLOCK_INDEX_LOAD_BATCH = 1024;
+
+namespace
+{
+/** Database key of one unspent output: 'C', txid, VARINT(output index) */
+struct CoinEntry {
+    char key;
+    uint256 hash;
+    uint32_t n;
+
+    CoinEntry() : key(DB_COIN), n(0) {}
+    CoinEntry(const COutPoint& outpoint) : key(DB_COIN), hash(outpoint.hash), n(outpoint.n) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion)
+    {
+        READWRITE(key);
+        READWRITE(hash);
+        READWRITE(VARINT(n));
+    }
+};
+
+/**
+ * Reader for the records of the per-transaction chainstate layout, kept only
+ * to convert them in CCoinsViewDB::Upgrade().
+ *
+ * Serialized format:
+ * - VARINT(nVersion)
+ * - VARINT(nCode): bit 1 coinbase, bit 2 coinstake, bit 4 vout[0] unspent,
+ *   bit 8 vout[1] unspent, the higher bits the number of non-zero bytes
+ *   in the following bitvector (minus one if neither vout[0] nor vout[1] is unspent)
+ * - unspentness bitvector, for vout[2] and further; least significant byte first
+ * - the non-spent CTxOuts (via CTxOutCompressor)
+ * - VARINT(nHeight)
+ */
+class CLegacyCoins
+{
+public:
+    bool fCoinBase;
+    bool fCoinStake;
+    std::vector<CTxOut> vout;
+    int nHeight;
+
+    CLegacyCoins() : fCoinBase(false), fCoinStake(false), nHeight(0) {}
+
+    template <typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
+    {
+        unsigned int nCode = 0;
+        int nTxVersion = 0;
+        ::Unserialize(s, VARINT(nTxVersion), nType, nVersion);
+        ::Unserialize(s, VARINT(nCode), nType, nVersion);
+        fCoinBase = nCode & 1;
+        fCoinStake = (nCode & 2) != 0;
+        std::vector<bool> vAvail(2, false);
+        vAvail[0] = (nCode & 4) != 0;
+        vAvail[1] = (nCode & 8) != 0;
+        unsigned int nMaskCode = (nCode / 16) + ((nCode & 12) != 0 ? 0 : 1);
+        while (nMaskCode > 0) {
+            unsigned char chAvail = 0;
+            ::Unserialize(s, chAvail, nType, nVersion);
+            for (unsigned int p = 0; p < 8; p++)
+                vAvail.push_back((chAvail & (1 << p)) != 0);
+            if (chAvail != 0)
+                nMaskCode--;
+        }
+        vout.assign(vAvail.size(), CTxOut());
+        for (unsigned int i = 0; i < vAvail.size(); i++) {
+            if (vAvail[i])
+                ::Unserialize(s, REF(CTxOutCompressor(vout[i])), nType, nVersion);
+        }
+        ::Unserialize(s, VARINT(nHeight), nType, nVersion);
+    }
+};
+} // namespace
+
+CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe),
+                                                                          pthreadWrite(NULL), fStopWrite(false), fWriteError(false), nPendingUsage(0), nWritingUsage(0), fWriting(false)
 {
-    if (coins.IsPruned())
-        batch.Erase(make_pair('c', hash));
-    else
-        batch.Write(make_pair('c', hash), coins);
 }
 
-void static BatchWriteHashBestChain(CLevelDBBatch& batch, const uint256& hash)
+CCoinsViewDB::~CCoinsViewDB()
 {
-    batch.Write('B', hash);
+    if (pthreadWrite) {
+        {
+            boost::mutex::scoped_lock lock(csWrite);
+            fStopWrite = true;
+        }
+        condWrite.notify_all();
+        pthreadWrite->join();
+        delete pthreadWrite;
+    }
 }
 
-CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe)
+bool CCoinsViewDB::GetUnwrittenCoin(const COutPoint& outpoint, Coin& coin, bool& fFound) const
 {
+    fFound = false;
+    if (!pthreadWrite)
+        return false;
+    boost::mutex::scoped_lock lock(csWrite);
+    CCoinsMap::const_iterator it = mapPending.find(outpoint);
+    if (it == mapPending.end()) {
+        if (!fWriting)
+            return false;
+        it = mapWriting.find(outpoint);
+        if (it == mapWriting.end())
+            return false;
+    }
+    fFound = true;
+    if (it->second.coin.IsSpent())
+        return false;
+    coin = it->second.coin;
+    return true;
 }
 
-bool CCoinsViewDB::GetCoins(const uint256& txid, CCoins& coins) const
+bool CCoinsViewDB::GetCoin(const COutPoint& outpoint, Coin& coin) const
 {
-    return db.Read(make_pair('c', txid), coins);
+    bool fFound;
+    bool fHave = GetUnwrittenCoin(outpoint, coin, fFound);
+    if (fFound)
+        return fHave;
+    return db.Read(CoinEntry(outpoint), coin);
 }
 
-bool CCoinsViewDB::HaveCoins(const uint256& txid) const
+bool CCoinsViewDB::HaveCoin(const COutPoint& outpoint) const
 {
-    return db.Exists(make_pair('c', txid));
+    if (pthreadWrite) {
+        Coin coin;
+        bool fFound;
+        bool fHave = GetUnwrittenCoin(outpoint, coin, fFound);
+        if (fFound)
+            return fHave;
+    }
+    return db.Exists(CoinEntry(outpoint));
 }
 
 uint256 CCoinsViewDB::GetBestBlock() const
 {
+    if (pthreadWrite) {
+        boost::mutex::scoped_lock lock(csWrite);
+        if (hashPending != uint256(0))
+            return hashPending;
+        if (fWriting && hashWriting != uint256(0))
+            return hashWriting;
+    }
     uint256 hashBestChain;
-    if (!db.Read('B', hashBestChain))
+    if (!db.Read(DB_BEST_BLOCK, hashBestChain))
         return uint256(0);
     return hashBestChain;
 }
 
-bool CCoinsViewDB::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock)
+std::vector<uint256> CCoinsViewDB::GetHeadBlocks() const
+{
+    std::vector<uint256> vhashHeadBlocks;
+    if (!db.Read(DB_HEAD_BLOCKS, vhashHeadBlocks))
+        return std::vector<uint256>();
+    return vhashHeadBlocks;
+}
+
+bool CCoinsViewDB::WriteCoins(const CCoinsMap& mapCoins, const uint256& hashBlock)
 {
     CLevelDBBatch batch;
     size_t count = 0;
     size_t changed = 0;
-    for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
+    size_t nBatchSize = (size_t)GetArg("-dbbatchsize", nDefaultDbBatchSize);
+    int nCrashBatch = (int)GetArg("-dbcrashbatch", 0);
+    int nBatches = 0;
+    bool fHeadBlocks = false;
+
+    for (CCoinsMap::const_iterator it = mapCoins.begin(); it != mapCoins.end(); it++) {
         if (it->second.flags & CCoinsCacheEntry::DIRTY) {
-            BatchWriteCoins(batch, it->first, it->second.coins);
+            CoinEntry entry(it->first);
+            if (it->second.coin.IsSpent())
+                batch.Erase(entry);
+            else
+                batch.Write(entry, it->second.coin);
             changed++;
         }
         count++;
-        CCoinsMap::iterator itOld = it++;
-        mapCoins.erase(itOld);
+        if (batch.SizeEstimate() > nBatchSize) {
+            if (!fHeadBlocks && hashBlock != uint256(0)) {
+                // Until the last batch is written the database is between the
+                // old and the new tip; record both so startup can recover.
+                uint256 hashOld;
+                if (!db.Read(DB_BEST_BLOCK, hashOld)) {
+                    std::vector<uint256> vhashOldHeads = GetHeadBlocks();
+                    if (vhashOldHeads.size() == 2)
+                        hashOld = vhashOldHeads[1];
+                }
+                std::vector<uint256> vhashHeadBlocks;
+                vhashHeadBlocks.push_back(hashBlock);
+                vhashHeadBlocks.push_back(hashOld);
+                batch.Erase(DB_BEST_BLOCK);
+                batch.Write(DB_HEAD_BLOCKS, vhashHeadBlocks);
+                fHeadBlocks = true;
+            }
+            LogPrint("coindb", "Writing partial batch of %.2f MiB\n", batch.SizeEstimate() * (1.0 / 1048576.0));
+            if (!db.WriteBatch(batch))
+                return false;
+            batch.Clear();
+            if (++nBatches == nCrashBatch) {
+                // Leave the database as a crash between two batches would
+                LogPrintf("%s : simulating a crash after %d partial batches\n", __func__, nBatches);
+                return false;
+            }
+        }
+    }
+    if (hashBlock != uint256(0)) {
+        batch.Erase(DB_HEAD_BLOCKS);
+        batch.Write(DB_BEST_BLOCK, hashBlock);
     }
-    if (hashBlock != uint256(0))
-        BatchWriteHashBestChain(batch, hashBlock);
 
-    LogPrint("coindb", "Committing %u changed transactions (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
+    LogPrint("coindb", "Committing %u changed transaction outputs (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
     return db.WriteBatch(batch);
 }
 
+bool CCoinsViewDB::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock)
+{
+    if (!pthreadWrite) {
+        int64_t nStart = GetTimeMillis();
+        bool fOk = WriteCoins(mapCoins, hashBlock);
+        int64_t nTime = GetTimeMillis() - nStart;
+        boost::mutex::scoped_lock lock(csWrite);
+        writeStats.nFlushes++;
+        writeStats.nLastEntries = mapCoins.size();
+        writeStats.nLastWriteMillis = nTime;
+        writeStats.nTotalWriteMillis += nTime;
+        writeStats.nMaxWriteMillis = std::max(writeStats.nMaxWriteMillis, nTime);
+        mapCoins.clear();
+        return fOk;
+    }
+
+    {
+        boost::mutex::scoped_lock lock(csWrite);
+        if (fWriteError)
+            return error("%s : an earlier write to the coin database failed", __func__);
+        for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); it = mapCoins.erase(it)) {
+            if (!(it->second.flags & CCoinsCacheEntry::DIRTY))
+                continue;
+            CCoinsMap::iterator itUs = mapPending.find(it->first);
+            if (itUs == mapPending.end()) {
+                // A fresh output spent before it was ever written has nothing to erase below
+                if ((it->second.flags & CCoinsCacheEntry::FRESH) && it->second.coin.IsSpent())
+                    continue;
+                CCoinsCacheEntry& entry = mapPending[it->first];
+                entry.coin = std::move(it->second.coin);
+                entry.flags = CCoinsCacheEntry::DIRTY;
+                nPendingUsage += entry.coin.DynamicMemoryUsage();
+            } else {
+                nPendingUsage -= itUs->second.coin.DynamicMemoryUsage();
+                itUs->second.coin = std::move(it->second.coin);
+                nPendingUsage += itUs->second.coin.DynamicMemoryUsage();
+            }
+        }
+        if (hashBlock != uint256(0))
+            hashPending = hashBlock;
+    }
+    condWrite.notify_all();
+    return true;
+}
+
+void CCoinsViewDB::ThreadWriteBehind()
+{
+    RenameThread("koinmudra-coinwriter");
+    boost::mutex::scoped_lock lock(csWrite);
+    while (true) {
+        while (!fStopWrite && mapPending.empty() && hashPending == uint256(0))
+            condWrite.wait(lock);
+        // Whatever is pending when stopping is still written
+        if (mapPending.empty() && hashPending == uint256(0))
+            break;
+
+        mapWriting.swap(mapPending);
+        hashWriting = hashPending;
+        hashPending = uint256(0);
+        nWritingUsage = nPendingUsage;
+        nPendingUsage = 0;
+        fWriting = true;
+
+        lock.unlock();
+        int64_t nStart = GetTimeMillis();
+        bool fOk = WriteCoins(mapWriting, hashWriting);
+        int64_t nTime = GetTimeMillis() - nStart;
+        lock.lock();
+
+        if (!fOk) {
+            // Keep the unwritten changes visible; the next flush reports the failure
+            LogPrintf("%s : writing the coin database failed\n", __func__);
+            fWriteError = true;
+            condWrite.notify_all();
+            break;
+        }
+        writeStats.nFlushes++;
+        writeStats.nLastEntries = mapWriting.size();
+        writeStats.nLastWriteMillis = nTime;
+        writeStats.nTotalWriteMillis += nTime;
+        writeStats.nMaxWriteMillis = std::max(writeStats.nMaxWriteMillis, nTime);
+        LogPrint("coindb", "Wrote %u coin database entries in the background in %dms\n", (unsigned int)mapWriting.size(), nTime);
+
+        fWriting = false;
+        mapWriting.clear();
+        hashWriting = uint256(0);
+        nWritingUsage = 0;
+        condWrite.notify_all();
+    }
+}
+
+void CCoinsViewDB::StartWriteBehind()
+{
+    if (!pthreadWrite)
+        pthreadWrite = new boost::thread(boost::bind(&CCoinsViewDB::ThreadWriteBehind, this));
+}
+
+bool CCoinsViewDB::IsWriteBehind() const
+{
+    return pthreadWrite != NULL;
+}
+
+bool CCoinsViewDB::IsWriting() const
+{
+    boost::mutex::scoped_lock lock(csWrite);
+    return fWriting || !mapPending.empty() || hashPending != uint256(0);
+}
+
+bool CCoinsViewDB::WaitForWrites() const
+{
+    boost::mutex::scoped_lock lock(csWrite);
+    while (pthreadWrite && !fWriteError && (fWriting || !mapPending.empty() || hashPending != uint256(0)))
+        condWrite.wait(lock);
+    return !fWriteError;
+}
+
+size_t CCoinsViewDB::GetUnwrittenUsage() const
+{
+    boost::mutex::scoped_lock lock(csWrite);
+    size_t nUsage = memusage::DynamicUsage(mapPending) + nPendingUsage;
+    if (fWriting)
+        nUsage += memusage::DynamicUsage(mapWriting) + nWritingUsage;
+    return nUsage;
+}
+
+CCoinsWriteStats CCoinsViewDB::GetWriteStats() const
+{
+    boost::mutex::scoped_lock lock(csWrite);
+    return writeStats;
+}
+
+void CCoinsViewDB::SetLastFlushTime(int64_t nMicros)
+{
+    boost::mutex::scoped_lock lock(csWrite);
+    writeStats.nLastFlushMicros = nMicros;
+}
+
+bool CCoinsViewDB::Upgrade()
+{
+    boost::scoped_ptr<leveldb::Iterator> pcursor(db.NewIterator());
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    ssKeySet << DB_COINS;
+    pcursor->Seek(ssKeySet.str());
+    if (!pcursor->Valid() || pcursor->key().size() == 0 || pcursor->key()[0] != DB_COINS)
+        return true;
+
+    int64_t nStart = GetTimeMillis();
+    LogPrintf("Upgrading chainstate database to one record per transaction output...\n");
+    uiInterface.InitMessage(_("Upgrading chainstate database..."));
+    size_t nTransactions = 0, nOutputs = 0, nBatch = 0;
+    CLevelDBBatch batch;
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        leveldb::Slice slKey = pcursor->key();
+        if (slKey.size() == 0 || slKey[0] != DB_COINS)
+            break;
+        try {
+            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+            char chType;
+            uint256 txhash;
+            ssKey >> chType >> txhash;
+
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+            CLegacyCoins old;
+            ssValue >> old;
+
+            for (size_t i = 0; i < old.vout.size(); i++) {
+                if (!old.vout[i].IsNull() && !old.vout[i].scriptPubKey.IsUnspendable()) {
+                    Coin newcoin(old.vout[i], old.nHeight, old.fCoinBase, old.fCoinStake);
+                    batch.Write(CoinEntry(COutPoint(txhash, i)), newcoin);
+                    nOutputs++;
+                    nBatch++;
+                }
+            }
+            batch.Erase(make_pair(DB_COINS, txhash));
+            nTransactions++;
+            nBatch++;
+        } catch (std::exception& e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+
+        if (nBatch >= 100000) {
+            if (!db.WriteBatch(batch))
+                return false;
+            batch.Clear();
+            nBatch = 0;
+            LogPrintf("Upgrading chainstate database: %u transactions, %u outputs converted\n", nTransactions, nOutputs);
+        }
+        pcursor->Next();
+    }
+    if (!db.WriteBatch(batch, true))
+        return false;
+    LogPrintf("Upgraded chainstate database: %u transactions, %u outputs converted in %dms\n", nTransactions, nOutputs, GetTimeMillis() - nStart);
+    return true;
+}
+
 CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CLevelDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe)
 {
 }
@@ -117,6 +488,9 @@ bool CBlockTreeDB::ReadLastBlockFile(int& nFile)
 
 bool CCoinsViewDB::GetStats(CCoinsStats& stats) const
 {
+    if (!WaitForWrites())
+        return false;
+
     /* It seems that there are no "const iterators" for LevelDB.  Since we
        only need read operations on it, use a const-cast to get around
        that restriction.  */
@@ -127,6 +501,7 @@ bool CCoinsViewDB::GetStats(CCoinsStats& stats) const
     stats.hashBlock = GetBestBlock();
     ss << stats.hashBlock;
     CAmount nTotalAmount = 0;
+    uint256 prevkey;
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
         try {
@@ -134,35 +509,37 @@ bool CCoinsViewDB::GetStats(CCoinsStats& stats) const
             CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
             char chType;
             ssKey >> chType;
-            if (chType == 'c') {
+            if (chType == DB_COIN) {
                 leveldb::Slice slValue = pcursor->value();
                 CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
-                CCoins coins;
-                ssValue >> coins;
+                Coin coin;
+                ssValue >> coin;
                 uint256 txhash;
-                ssKey >> txhash;
-                ss << txhash;
-                ss << VARINT(coins.nVersion);
-                ss << (coins.fCoinBase ? 'c' : 'n');
-                ss << VARINT(coins.nHeight);
-                stats.nTransactions++;
-                for (unsigned int i = 0; i < coins.vout.size(); i++) {
-                    const CTxOut& out = coins.vout[i];
-                    if (!out.IsNull()) {
-                        stats.nTransactionOutputs++;
-                        ss << VARINT(i + 1);
-                        ss << out;
-                        nTotalAmount += out.nValue;
-                    }
+                uint32_t n;
+                ssKey >> txhash >> VARINT(n);
+                // Outputs of one transaction are stored next to each other
+                if (txhash != prevkey) {
+                    if (stats.nTransactions > 0)
+                        ss << VARINT(0);
+                    ss << txhash;
+                    ss << (coin.fCoinBase ? 'c' : 'n');
+                    ss << VARINT(coin.nHeight);
+                    prevkey = txhash;
+                    stats.nTransactions++;
                 }
+                stats.nTransactionOutputs++;
+                ss << VARINT(n + 1);
+                ss << coin.out;
+                nTotalAmount += coin.out.nValue;
                 stats.nSerializedSize += 32 + slValue.size();
-                ss << VARINT(0);
             }
             pcursor->Next();
         } catch (std::exception& e) {
             return error("%s : Deserialize or I/O error - %s", __func__, e.what());
         }
     }
+    if (stats.nTransactions > 0)
+        ss << VARINT(0);
     stats.nHeight = mapBlockIndex.find(GetBestBlock())->second->nHeight;
     stats.hashSerialized = ss.GetHash();
     stats.nTotalAmount = nTotalAmount;
@@ -182,6 +559,157 @@ bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos>
     return WriteBatch(batch);
 }
 
+bool CBlockTreeDB::UpdateAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> >& vect, bool fErase)
+{
+    CLevelDBBatch batch;
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it = vect.begin(); it != vect.end(); it++) {
+        if (fErase)
+            batch.Erase(make_pair('a', it->first));
+        else
+            batch.Write(make_pair('a', it->first), it->second);
+    }
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadAddressIndex(const uint160& addressHash, int type, std::vector<std::pair<CAddressIndexKey, CAmount> >& vect, int nStart, int nEnd)
+{
+    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    if (nStart > 0)
+        ssKeySet << make_pair('a', CAddressIndexIteratorKey(type, addressHash, nStart));
+    else
+        ssKeySet << make_pair('a', CAddressIndexIteratorKey(type, addressHash));
+    pcursor->Seek(ssKeySet.str());
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+            char chType;
+            CAddressIndexKey key;
+            ssKey >> chType;
+            if (chType != 'a')
+                break;
+            ssKey >> key;
+            if (key.type != type || key.hashBytes != addressHash || (nEnd > 0 && key.blockHeight > nEnd))
+                break;
+
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+            CAmount nValue;
+            ssValue >> nValue;
+            vect.push_back(make_pair(key, nValue));
+            pcursor->Next();
+        } catch (std::exception& e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+    }
+    return true;
+}
+
+bool CBlockTreeDB::UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& vect)
+{
+    CLevelDBBatch batch;
+    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it = vect.begin(); it != vect.end(); it++) {
+        if (it->second.IsNull())
+            batch.Erase(make_pair('u', it->first));
+        else
+            batch.Write(make_pair('u', it->first), it->second);
+    }
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadAddressUnspentIndex(const uint160& addressHash, int type, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& vect)
+{
+    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    ssKeySet << make_pair('u', CAddressIndexIteratorKey(type, addressHash));
+    pcursor->Seek(ssKeySet.str());
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+            char chType;
+            CAddressUnspentKey key;
+            ssKey >> chType;
+            if (chType != 'u')
+                break;
+            ssKey >> key;
+            if (key.type != type || key.hashBytes != addressHash)
+                break;
+
+            leveldb::Slice slValue = pcursor->value();
+            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+            CAddressUnspentValue value;
+            ssValue >> value;
+            vect.push_back(make_pair(key, value));
+            pcursor->Next();
+        } catch (std::exception& e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+    }
+    return true;
+}
+
+bool CBlockTreeDB::UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >& vect)
+{
+    CLevelDBBatch batch;
+    for (std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >::const_iterator it = vect.begin(); it != vect.end(); it++) {
+        if (it->second.IsNull())
+            batch.Erase(make_pair('p', it->first));
+        else
+            batch.Write(make_pair('p', it->first), it->second);
+    }
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::ReadSpentIndex(const CSpentIndexKey& key, CSpentIndexValue& value)
+{
+    return Read(make_pair('p', key), value);
+}
+
+bool CBlockTreeDB::WriteTimestampIndex(const CTimestampIndexKey& key, bool fErase)
+{
+    if (fErase)
+        return Erase(make_pair('s', key));
+    return Write(make_pair('s', key), '1');
+}
+
+bool CBlockTreeDB::ReadTimestampIndex(unsigned int nHigh, unsigned int nLow, std::vector<uint256>& vHashes)
+{
+    boost::scoped_ptr<leveldb::Iterator> pcursor(NewIterator());
+
+    CDataStream ssKeySet(SER_DISK, CLIENT_VERSION);
+    ssKeySet << make_pair('s', CTimestampIndexIteratorKey(nLow));
+    pcursor->Seek(ssKeySet.str());
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        try {
+            leveldb::Slice slKey = pcursor->key();
+            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+            char chType;
+            CTimestampIndexKey key;
+            ssKey >> chType;
+            if (chType != 's')
+                break;
+            ssKey >> key;
+            if (key.timestamp > nHigh)
+                break;
+            vHashes.push_back(key.blockHash);
+            pcursor->Next();
+        } catch (std::exception& e) {
+            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+    }
+    return true;
+}
+
 bool CBlockTreeDB::WriteFlag(const std::string& name, bool fValue)
 {
     return Write(std::make_pair('F', name), fValue ? '1' : '0');
@@ -214,60 +742,78 @@ bool CBlockTreeDB::LoadBlockIndexGuts()
     ssKeySet << make_pair('b', uint256(0));
     pcursor->Seek(ssKeySet.str());
 
-    // Load mapBlockIndex
-    uint256 nPreviousCheckpoint;
-    while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
-        try {
-            leveldb::Slice slKey = pcursor->key();
-            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
-            char chType;
-            ssKey >> chType;
-            if (chType == 'b') {
+    // Load mapBlockIndex, reading a batch of records at a time so their headers can be hashed together
+    std::vector<CDiskBlockIndex> vDiskIndex;
+    std::vector<CBlockHeader> vHeaders;
+    std::vector<uint256> vHashes;
+    bool fDone = false;
+    while (!fDone) {
+        vDiskIndex.clear();
+        while (vDiskIndex.size() < BLOCK_INDEX_LOAD_BATCH) {
+            boost::this_thread::interruption_point();
+            if (!pcursor->Valid()) {
+                fDone = true;
+                break;
+            }
+            try {
+                leveldb::Slice slKey = pcursor->key();
+                CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+                char chType;
+                ssKey >> chType;
+                if (chType != 'b') {
+                    fDone = true;
+                    break; // if shutdown requested or finished loading block index
+                }
                 leveldb::Slice slValue = pcursor->value();
                 CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
-                CDiskBlockIndex diskindex;
-                ssValue >> diskindex;
-
-                // Construct block index object
-                CBlockIndex* pindexNew = InsertBlockIndex(diskindex.GetBlockHash());
-                pindexNew->pprev = InsertBlockIndex(diskindex.hashPrev);
-                pindexNew->pnext = InsertBlockIndex(diskindex.hashNext);
-                pindexNew->nHeight = diskindex.nHeight;
-                pindexNew->nFile = diskindex.nFile;
-                pindexNew->nDataPos = diskindex.nDataPos;
-                pindexNew->nUndoPos = diskindex.nUndoPos;
-                pindexNew->nVersion = diskindex.nVersion;
-                pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
-                pindexNew->nTime = diskindex.nTime;
-                pindexNew->nBits = diskindex.nBits;
-                pindexNew->nNonce = diskindex.nNonce;
-                pindexNew->nStatus = diskindex.nStatus;
-                pindexNew->nTx = diskindex.nTx;
-
-                //Proof Of Stake
-                pindexNew->nMint = diskindex.nMint;
-                pindexNew->nMoneySupply = diskindex.nMoneySupply;
-                pindexNew->nFlags = diskindex.nFlags;
-                pindexNew->nStakeModifier = diskindex.nStakeModifier;
-                pindexNew->prevoutStake = diskindex.prevoutStake;
-                pindexNew->nStakeTime = diskindex.nStakeTime;
-                pindexNew->hashProofOfStake = diskindex.hashProofOfStake;
-
-                if (pindexNew->nHeight <= Params().LAST_POW_BLOCK()) {
-                    if (!CheckProofOfWork(pindexNew->GetBlockHash(), pindexNew->nBits))
-                        return error("LoadBlockIndex() : CheckProofOfWork failed: %s", pindexNew->ToString());
-                }
-                // ppcoin: build setStakeSeen
-                if (pindexNew->IsProofOfStake())
-                    setStakeSeen.insert(make_pair(pindexNew->prevoutStake, pindexNew->nStakeTime));
-
+                vDiskIndex.push_back(CDiskBlockIndex());
+                ssValue >> vDiskIndex.back();
                 pcursor->Next();
-            } else {
-                break; // if shutdown requested or finished loading block index
+            } catch (std::exception& e) {
+                return error("%s : Deserialize or I/O error - %s", __func__, e.what());
             }
-        } catch (std::exception& e) {
-            return error("%s : Deserialize or I/O error - %s", __func__, e.what());
+        }
+
+        vHeaders.resize(vDiskIndex.size());
+        for (size_t i = 0; i < vDiskIndex.size(); i++)
+            vHeaders[i] = vDiskIndex[i].GetBlockHeader();
+        GetBlockHeaderHashes(vHeaders, vHashes);
+
+        for (size_t i = 0; i < vDiskIndex.size(); i++) {
+            const CDiskBlockIndex& diskindex = vDiskIndex[i];
+
+            // Construct block index object
+            CBlockIndex* pindexNew = InsertBlockIndex(vHashes[i]);
+            pindexNew->pprev = InsertBlockIndex(diskindex.hashPrev);
+            pindexNew->pnext = InsertBlockIndex(diskindex.hashNext);
+            pindexNew->nHeight = diskindex.nHeight;
+            pindexNew->nFile = diskindex.nFile;
+            pindexNew->nDataPos = diskindex.nDataPos;
+            pindexNew->nUndoPos = diskindex.nUndoPos;
+            pindexNew->nVersion = diskindex.nVersion;
+            pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
+            pindexNew->nTime = diskindex.nTime;
+            pindexNew->nBits = diskindex.nBits;
+            pindexNew->nNonce = diskindex.nNonce;
+            pindexNew->nStatus = diskindex.nStatus;
+            pindexNew->nTx = diskindex.nTx;
+
+            //Proof Of Stake
+            pindexNew->nMint = diskindex.nMint;
+            pindexNew->nMoneySupply = diskindex.nMoneySupply;
+            pindexNew->nFlags = diskindex.nFlags;
+            pindexNew->nStakeModifier = diskindex.nStakeModifier;
+            pindexNew->prevoutStake = diskindex.prevoutStake;
+            pindexNew->nStakeTime = diskindex.nStakeTime;
+            pindexNew->hashProofOfStake = diskindex.hashProofOfStake;
+
+            if (pindexNew->nHeight <= Params().LAST_POW_BLOCK()) {
+                if (!CheckProofOfWork(pindexNew->GetBlockHash(), pindexNew->nBits))
+                    return error("LoadBlockIndex() : CheckProofOfWork failed: %s", pindexNew->ToString());
+            }
+            // ppcoin: build setStakeSeen
+            if (pindexNew->IsProofOfStake())
+                setStakeSeen.insert(make_pair(pindexNew->prevoutStake, pindexNew->nStakeTime));
         }
     }
 
@@ -7,15 +7,21 @@
 #ifndef BITCOIN_TXDB_H
 #define BITCOIN_TXDB_H
 
+#include "addressindex.h"
 #include "leveldbwrapper.h"
 #include "main.h"
+#include "spentindex.h"
+#include "timestampindex.h"
 
 #include <map>
 #include <string>
 #include <utility>
 #include <vector>
 
-class CCoins;
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
 class uint256;
 
 //! -dbcache default (MiB)
@@ -24,21 +30,91 @@ static const int64_t nDefaultDbCache = 100;
 static const int64_t nMaxDbCache = sizeof(void*) > 4 ? 4096 : 1024;
 //! min. -dbcache in (MiB)
 static const int64_t nMinDbCache = 4;
+//! -dbbatchsize default (bytes)
+static const int64_t nDefaultDbBatchSize = 16 << 20;
+//! -dbwritebehind default
+static const bool DEFAULT_DB_WRITE_BEHIND = true;
+
+/** Timing of the coin database writes */
+struct CCoinsWriteStats {
+    uint64_t nFlushes;         //! number of completed writes
+    uint64_t nLastEntries;     //! outputs written or erased by the last write
+    int64_t nLastWriteMillis;  //! duration of the last write
+    int64_t nTotalWriteMillis;
+    int64_t nMaxWriteMillis;
+    int64_t nLastFlushMicros;  //! time the last flush held up the caller (cs_main)
 
-/** CCoinsView backed by the LevelDB coin database (chainstate/) */
+    CCoinsWriteStats() : nFlushes(0), nLastEntries(0), nLastWriteMillis(0), nTotalWriteMillis(0), nMaxWriteMillis(0), nLastFlushMicros(0) {}
+};
+
+/**
+ * CCoinsView backed by the LevelDB coin database (chainstate/)
+ *
+ * Large writes are split into batches of -dbbatchsize bytes. While such a
+ * write is in progress the database holds a head blocks marker instead of a
+ * best block, so that a node interrupted half way can replay the blocks
+ * between the old and the new tip on startup (see GetHeadBlocks()).
+ *
+ * With StartWriteBehind(), BatchWrite() only hands the changes to a
+ * background thread and returns; the changes stay visible to readers of this
+ * view until they are on disk.
+ */
 class CCoinsViewDB : public CCoinsView
 {
 protected:
     CLevelDBWrapper db;
 
+private:
+    mutable boost::mutex csWrite;
+    mutable boost::condition_variable condWrite;
+    boost::thread* pthreadWrite;
+    bool fStopWrite;
+    bool fWriteError;
+    //! changes handed over by BatchWrite() and not yet picked up by the writer
+    CCoinsMap mapPending;
+    uint256 hashPending;
+    size_t nPendingUsage;
+    //! changes the writer is storing right now; read only while fWriting is set
+    CCoinsMap mapWriting;
+    uint256 hashWriting;
+    size_t nWritingUsage;
+    bool fWriting;
+    CCoinsWriteStats writeStats;
+
+    CCoinsViewDB(const CCoinsViewDB&);
+    void operator=(const CCoinsViewDB&);
+
+    //! Store the dirty entries of mapCoins and the new best block
+    bool WriteCoins(const CCoinsMap& mapCoins, const uint256& hashBlock);
+    //! Look a coin up in the changes that have not reached the database yet
+    bool GetUnwrittenCoin(const COutPoint& outpoint, Coin& coin, bool& fFound) const;
+    void ThreadWriteBehind();
+
 public:
     CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    ~CCoinsViewDB();
 
-    bool GetCoins(const uint256& txid, CCoins& coins) const;
-    bool HaveCoins(const uint256& txid) const;
+    bool GetCoin(const COutPoint& outpoint, Coin& coin) const;
+    bool HaveCoin(const COutPoint& outpoint) const;
     uint256 GetBestBlock() const;
+    std::vector<uint256> GetHeadBlocks() const;
     bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock);
     bool GetStats(CCoinsStats& stats) const;
+
+    //! Convert a chainstate with one record per transaction to one record per output
+    bool Upgrade();
+
+    //! Write the changes passed to BatchWrite() on a background thread from now on
+    void StartWriteBehind();
+    bool IsWriteBehind() const;
+    //! Whether changes are still waiting for or being written by the background thread
+    bool IsWriting() const;
+    //! Block until all changes passed to BatchWrite() are on disk; false if writing failed
+    bool WaitForWrites() const;
+    //! Memory held by changes that have not reached the database yet
+    size_t GetUnwrittenUsage() const;
+    CCoinsWriteStats GetWriteStats() const;
+    void SetLastFlushTime(int64_t nMicros);
 };
 
 /** Access to the block database (blocks/index/) */
@@ -61,6 +137,14 @@ public:
     bool ReadReindexing(bool& fReindex);
     bool ReadTxIndex(const uint256& txid, CDiskTxPos& pos);
     bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> >& list);
+    bool UpdateAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> >& vect, bool fErase);
+    bool ReadAddressIndex(const uint160& addressHash, int type, std::vector<std::pair<CAddressIndexKey, CAmount> >& vect, int nStart = 0, int nEnd = 0);
+    bool UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& vect);
+    bool ReadAddressUnspentIndex(const uint160& addressHash, int type, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >& vect);
+    bool UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >& vect);
+    bool ReadSpentIndex(const CSpentIndexKey& key, CSpentIndexValue& value);
+    bool WriteTimestampIndex(const CTimestampIndexKey& key, bool fErase);
+    bool ReadTimestampIndex(unsigned int nHigh, unsigned int nLow, std::vector<uint256>& vHashes);
     bool WriteFlag(const std::string& name, bool fValue);
     bool ReadFlag(const std::string& name, bool& fValue);
     bool WriteInt(const std::string& name, int nValue);
@@ -17,16 +17,21 @@
 
 using namespace std;
 
-CTxMemPoolEntry::CTxMemPoolEntry() : nFee(0), nTxSize(0), nModSize(0), nTime(0), dPriority(0.0)
+CTxMemPoolEntry::CTxMemPoolEntry() : nFee(0), nTxSize(0), nModSize(0), nTime(0), dPriority(0.0), nFeeDelta(0),
+                                     nCountWithAncestors(0), nSizeWithAncestors(0), nModFeesWithAncestors(0)
 {
     nHeight = MEMPOOL_HEIGHT;
 }
 
-CTxMemPoolEntry::CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee, int64_t _nTime, double _dPriority, unsigned int _nHeight) : tx(_tx), nFee(_nFee), nTime(_nTime), dPriority(_dPriority), nHeight(_nHeight)
+CTxMemPoolEntry::CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee, int64_t _nTime, double _dPriority, unsigned int _nHeight) : tx(_tx), nFee(_nFee), nTime(_nTime), dPriority(_dPriority), nHeight(_nHeight), nFeeDelta(0)
 {
     nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
 
     nModSize = tx.CalculateModifiedSize(nTxSize);
+
+    nCountWithAncestors = 1;
+    nSizeWithAncestors = nTxSize;
+    nModFeesWithAncestors = nFee;
 }
 
 CTxMemPoolEntry::CTxMemPoolEntry(const CTxMemPoolEntry& other)
@@ -376,17 +381,10 @@ CTxMemPool::~CTxMemPool()
     delete minerPolicyEstimator;
 }
 
-void CTxMemPool::pruneSpent(const uint256& hashTx, CCoins& coins)
+bool CTxMemPool::isSpent(const COutPoint& outpoint)
 {
     LOCK(cs);
-
-    std::map<COutPoint, CInPoint>::iterator it = mapNextTx.lower_bound(COutPoint(hashTx, 0));
-
-    // iterate over all COutPoints in mapNextTx whose hash equals the provided hashTx
-    while (it != mapNextTx.end() && it->first.hash == hashTx) {
-        coins.Spend(it->first.n); // and remove those outputs from coins
-        it++;
-    }
+    return mapNextTx.count(outpoint);
 }
 
 unsigned int CTxMemPool::GetTransactionsUpdated() const
@@ -402,6 +400,64 @@ void CTxMemPool::AddTransactionsUpdated(unsigned int n)
 }
 
 
+void CTxMemPool::CalculateAncestors(const uint256& hash, std::set<uint256>& setAncestors) const
+{
+    std::map<uint256, CTxLinks>::const_iterator it = mapLinks.find(hash);
+    if (it == mapLinks.end())
+        return;
+    std::vector<uint256> vToVisit(it->second.setParents.begin(), it->second.setParents.end());
+    while (!vToVisit.empty()) {
+        uint256 hashParent = vToVisit.back();
+        vToVisit.pop_back();
+        if (!setAncestors.insert(hashParent).second)
+            continue;
+        const std::set<uint256>& setParents = mapLinks.find(hashParent)->second.setParents;
+        vToVisit.insert(vToVisit.end(), setParents.begin(), setParents.end());
+    }
+}
+
+void CTxMemPool::CalculateDescendants(const uint256& hash, std::set<uint256>& setDescendants) const
+{
+    std::map<uint256, CTxLinks>::const_iterator it = mapLinks.find(hash);
+    if (it == mapLinks.end())
+        return;
+    std::vector<uint256> vToVisit(it->second.setChildren.begin(), it->second.setChildren.end());
+    while (!vToVisit.empty()) {
+        uint256 hashChild = vToVisit.back();
+        vToVisit.pop_back();
+        if (!setDescendants.insert(hashChild).second)
+            continue;
+        const std::set<uint256>& setChildren = mapLinks.find(hashChild)->second.setChildren;
+        vToVisit.insert(vToVisit.end(), setChildren.begin(), setChildren.end());
+    }
+}
+
+void CTxMemPool::UpdateEntryAncestors(CTxMemPoolEntry& entry, int64_t nCount, int64_t nSize, CAmount nModFees)
+{
+    setTxByAncestorFee.erase(&entry);
+    entry.nCountWithAncestors += nCount;
+    entry.nSizeWithAncestors += nSize;
+    entry.nModFeesWithAncestors += nModFees;
+    setTxByAncestorFee.insert(&entry);
+}
+
+void CTxMemPool::UpdateAncestorState(CTxMemPoolEntry& entry)
+{
+    std::set<uint256> setAncestors;
+    CalculateAncestors(entry.GetTx().GetHash(), setAncestors);
+
+    int64_t nCount = 1;
+    int64_t nSize = entry.GetTxSize();
+    CAmount nModFees = entry.GetModifiedFee();
+    BOOST_FOREACH (const uint256& hashAncestor, setAncestors) {
+        const CTxMemPoolEntry& ancestor = mapTx.find(hashAncestor)->second;
+        nCount++;
+        nSize += ancestor.GetTxSize();
+        nModFees += ancestor.GetModifiedFee();
+    }
+    UpdateEntryAncestors(entry, nCount - entry.nCountWithAncestors, nSize - entry.nSizeWithAncestors, nModFees - entry.nModFeesWithAncestors);
+}
+
 bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry& entry)
 {
     // Add to memory pool without checking anything.
@@ -409,17 +465,49 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry& entry)
     // all the appropriate checks.
     LOCK(cs);
     {
-        mapTx[hash] = entry;
-        const CTransaction& tx = mapTx[hash].GetTx();
-        for (unsigned int i = 0; i < tx.vin.size(); i++)
+        if (mapTx.count(hash))
+            return true;
+        CTxMemPoolEntry& newEntry = mapTx[hash];
+        newEntry = entry;
+        const CTransaction& tx = newEntry.GetTx();
+
+        std::map<uint256, std::pair<double, CAmount> >::const_iterator itDeltas = mapDeltas.find(hash);
+        if (itDeltas != mapDeltas.end())
+            newEntry.nFeeDelta = itDeltas->second.second;
+
+        CTxLinks& links = mapLinks[hash];
+        for (unsigned int i = 0; i < tx.vin.size(); i++) {
             mapNextTx[tx.vin[i].prevout] = CInPoint(&tx, i);
+            if (mapTx.count(tx.vin[i].prevout.hash)) {
+                links.setParents.insert(tx.vin[i].prevout.hash);
+                mapLinks[tx.vin[i].prevout.hash].setChildren.insert(hash);
+            }
+        }
+        // Transactions of a disconnected block can come back while their spenders are still here
+        std::map<COutPoint, CInPoint>::iterator itNext = mapNextTx.lower_bound(COutPoint(hash, 0));
+        for (; itNext != mapNextTx.end() && itNext->first.hash == hash; ++itNext) {
+            uint256 hashChild = itNext->second.ptx->GetHash();
+            links.setChildren.insert(hashChild);
+            mapLinks[hashChild].setParents.insert(hash);
+        }
+
+        newEntry.nCountWithAncestors = 0;
+        newEntry.nSizeWithAncestors = 0;
+        newEntry.nModFeesWithAncestors = 0;
+        UpdateAncestorState(newEntry);
+        if (!links.setChildren.empty()) {
+            std::set<uint256> setDescendants;
+            CalculateDescendants(hash, setDescendants);
+            BOOST_FOREACH (const uint256& hashDescendant, setDescendants)
+                UpdateAncestorState(mapTx[hashDescendant]);
+        }
+
         nTransactionsUpdated++;
         totalTxSize += entry.GetTxSize();
     }
     return true;
 }
 
-
 void CTxMemPool::remove(const CTransaction& origTx, std::list<CTransaction>& removed, bool fRecursive)
 {
     // Remove transaction from memory pool
@@ -444,7 +532,8 @@ void CTxMemPool::remove(const CTransaction& origTx, std::list<CTransaction>& rem
             txToRemove.pop_front();
             if (!mapTx.count(hash))
                 continue;
-            const CTransaction& tx = mapTx[hash].GetTx();
+            CTxMemPoolEntry& entry = mapTx[hash];
+            const CTransaction& tx = entry.GetTx();
             if (fRecursive) {
                 for (unsigned int i = 0; i < tx.vout.size(); i++) {
                     std::map<COutPoint, CInPoint>::iterator it = mapNextTx.find(COutPoint(hash, i));
@@ -452,12 +541,26 @@ void CTxMemPool::remove(const CTransaction& origTx, std::list<CTransaction>& rem
                         continue;
                     txToRemove.push_back(it->second.ptx->GetHash());
                 }
+            } else {
+                // Descendants stay behind and no longer count this one as an ancestor
+                std::set<uint256> setDescendants;
+                CalculateDescendants(hash, setDescendants);
+                BOOST_FOREACH (const uint256& hashDescendant, setDescendants)
+                    UpdateEntryAncestors(mapTx[hashDescendant], -1, -(int64_t)entry.GetTxSize(), -entry.GetModifiedFee());
             }
             BOOST_FOREACH (const CTxIn& txin, tx.vin)
                 mapNextTx.erase(txin.prevout);
 
+            std::map<uint256, CTxLinks>::iterator itLinks = mapLinks.find(hash);
+            BOOST_FOREACH (const uint256& hashParent, itLinks->second.setParents)
+                mapLinks[hashParent].setChildren.erase(hash);
+            BOOST_FOREACH (const uint256& hashChild, itLinks->second.setChildren)
+                mapLinks[hashChild].setParents.erase(hash);
+            mapLinks.erase(itLinks);
+            setTxByAncestorFee.erase(&entry);
+
             removed.push_back(tx);
-            totalTxSize -= mapTx[hash].GetTxSize();
+            totalTxSize -= entry.GetTxSize();
             mapTx.erase(hash);
             nTransactionsUpdated++;
         }
@@ -475,9 +578,9 @@ void CTxMemPool::removeCoinbaseSpends(const CCoinsViewCache* pcoins, unsigned in
             std::map<uint256, CTxMemPoolEntry>::const_iterator it2 = mapTx.find(txin.prevout.hash);
             if (it2 != mapTx.end())
                 continue;
-            const CCoins* coins = pcoins->AccessCoins(txin.prevout.hash);
-            if (fSanityCheck) assert(coins);
-            if (!coins || ((coins->IsCoinBase() || coins->IsCoinStake()) && nMemPoolHeight - coins->nHeight < (unsigned)Params().COINBASE_MATURITY())) {
+            const Coin& coin = pcoins->AccessCoin(txin.prevout);
+            if (fSanityCheck) assert(!coin.IsSpent());
+            if (coin.IsSpent() || ((coin.IsCoinBase() || coin.IsCoinStake()) && nMemPoolHeight - coin.nHeight < (unsigned)Params().COINBASE_MATURITY())) {
                 transactionsToRemove.push_back(tx);
                 break;
             }
@@ -530,6 +633,8 @@ void CTxMemPool::removeForBlock(const std::vector<CTransaction>& vtx, unsigned i
 void CTxMemPool::clear()
 {
     LOCK(cs);
+    setTxByAncestorFee.clear();
+    mapLinks.clear();
     mapTx.clear();
     mapNextTx.clear();
     totalTxSize = 0;
@@ -562,8 +667,7 @@ void CTxMemPool::check(const CCoinsViewCache* pcoins) const
                 assert(tx2.vout.size() > txin.prevout.n && !tx2.vout[txin.prevout.n].IsNull());
                 fDependsWait = true;
             } else {
-                const CCoins* coins = pcoins->AccessCoins(txin.prevout.hash);
-                assert(coins && coins->IsAvailable(txin.prevout.n));
+                assert(pcoins->HaveCoin(txin.prevout));
             }
             // Check whether its inputs are marked in mapNextTx.
             std::map<COutPoint, CInPoint>::const_iterator it3 = mapNextTx.find(txin.prevout);
@@ -608,6 +712,23 @@ void CTxMemPool::check(const CCoinsViewCache* pcoins) const
     }
 
     assert(totalTxSize == checkTotal);
+
+    assert(setTxByAncestorFee.size() == mapTx.size());
+    assert(mapLinks.size() == mapTx.size());
+    for (std::map<uint256, CTxMemPoolEntry>::const_iterator it = mapTx.begin(); it != mapTx.end(); it++) {
+        std::set<uint256> setAncestors;
+        CalculateAncestors(it->first, setAncestors);
+        uint64_t nSizeCheck = it->second.GetTxSize();
+        CAmount nFeesCheck = it->second.GetModifiedFee();
+        BOOST_FOREACH (const uint256& hashAncestor, setAncestors) {
+            nSizeCheck += mapTx.find(hashAncestor)->second.GetTxSize();
+            nFeesCheck += mapTx.find(hashAncestor)->second.GetModifiedFee();
+        }
+        assert(it->second.GetCountWithAncestors() == setAncestors.size() + 1);
+        assert(it->second.GetSizeWithAncestors() == nSizeCheck);
+        assert(it->second.GetModFeesWithAncestors() == nFeesCheck);
+        assert(setTxByAncestorFee.count(&it->second));
+    }
 }
 
 void CTxMemPool::queryHashes(vector<uint256>& vtxid)
@@ -678,6 +799,19 @@ void CTxMemPool::PrioritiseTransaction(const uint256 hash, const string strHash,
         std::pair<double, CAmount>& deltas = mapDeltas[hash];
         deltas.first += dPriorityDelta;
         deltas.second += nFeeDelta;
+
+        std::map<uint256, CTxMemPoolEntry>::iterator it = mapTx.find(hash);
+        if (it != mapTx.end() && nFeeDelta != 0) {
+            setTxByAncestorFee.erase(&it->second);
+            it->second.nFeeDelta += nFeeDelta;
+            it->second.nModFeesWithAncestors += nFeeDelta;
+            setTxByAncestorFee.insert(&it->second);
+
+            std::set<uint256> setDescendants;
+            CalculateDescendants(hash, setDescendants);
+            BOOST_FOREACH (const uint256& hashDescendant, setDescendants)
+                UpdateEntryAncestors(mapTx[hashDescendant], 0, 0, nFeeDelta);
+        }
     }
     LogPrintf("PrioritiseTransaction: %s priority += %f, fee += %d\n", strHash, dPriorityDelta, FormatMoney(nFeeDelta));
 }
@@ -702,20 +836,33 @@ void CTxMemPool::ClearPrioritisation(const uint256 hash)
 
 CCoinsViewMemPool::CCoinsViewMemPool(CCoinsView* baseIn, CTxMemPool& mempoolIn) : CCoinsViewBacked(baseIn), mempool(mempoolIn) {}
 
-bool CCoinsViewMemPool::GetCoins(const uint256& txid, CCoins& coins) const
+bool CCoinsViewMemPool::GetCoin(const COutPoint& outpoint, Coin& coin) const
 {
     // If an entry in the mempool exists, always return that one, as it's guaranteed to never
     // conflict with the underlying cache, and it cannot have pruned entries (as it contains full)
     // transactions. First checking the underlying cache risks returning a pruned entry instead.
-    CTransaction tx;
-    if (mempool.lookup(txid, tx)) {
-        coins = CCoins(tx, MEMPOOL_HEIGHT);
-        return true;
+    {
+        LOCK(mempool.cs);
+        std::map<uint256, CTxMemPoolEntry>::const_iterator it = mempool.mapTx.find(outpoint.hash);
+        if (it != mempool.mapTx.end()) {
+            const CTransaction& tx = it->second.GetTx();
+            if (outpoint.n < tx.vout.size()) {
+                coin = Coin(tx.vout[outpoint.n], MEMPOOL_HEIGHT, false, false);
+                return true;
+            }
+            return false;
+        }
     }
-    return (base->GetCoins(txid, coins) && !coins.IsPruned());
+    return base->GetCoin(outpoint, coin);
 }
 
-bool CCoinsViewMemPool::HaveCoins(const uint256& txid) const
+bool CCoinsViewMemPool::HaveCoin(const COutPoint& outpoint) const
 {
-    return mempool.exists(txid) || base->HaveCoins(txid);
+    {
+        LOCK(mempool.cs);
+        std::map<uint256, CTxMemPoolEntry>::const_iterator it = mempool.mapTx.find(outpoint.hash);
+        if (it != mempool.mapTx.end())
+            return outpoint.n < it->second.GetTx().vout.size();
+    }
+    return base->HaveCoin(outpoint);
 }
@@ -8,6 +8,7 @@
 #define BITCOIN_TXMEMPOOL_H
 
 #include <list>
+#include <set>
 
 #include "amount.h"
 #include "coins.h"
@@ -29,7 +30,7 @@ inline bool AllowFree(double dPriority)
 }
 
 
-/** Fake height value used in CCoins to signify they are only in the memory pool (since 0.8) */
+/** Fake height value used in Coin to signify they are only in the memory pool (since 0.8) */
 static const unsigned int MEMPOOL_HEIGHT = 0x7FFFFFFF;
 
 /**
@@ -37,6 +38,8 @@ static const unsigned int MEMPOOL_HEIGHT = 0x7FFFFFFF;
  */
 class CTxMemPoolEntry
 {
+    friend class CTxMemPool;
+
 private:
     CTransaction tx;
     CAmount nFee;         //! Cached to avoid expensive parent-transaction lookups
@@ -45,6 +48,12 @@ private:
     int64_t nTime;        //! Local time when entering the mempool
     double dPriority;     //! Priority when entering the mempool
     unsigned int nHeight; //! Chain height when entering the mempool
+    CAmount nFeeDelta;    //! Fee delta from PrioritiseTransaction
+
+    // Totals over this transaction and all of its unconfirmed ancestors, maintained by CTxMemPool
+    uint64_t nCountWithAncestors;
+    uint64_t nSizeWithAncestors;
+    CAmount nModFeesWithAncestors;
 
 public:
     CTxMemPoolEntry(const CTransaction& _tx, const CAmount& _nFee, int64_t _nTime, double _dPriority, unsigned int _nHeight);
@@ -57,6 +66,45 @@ public:
     size_t GetTxSize() const { return nTxSize; }
     int64_t GetTime() const { return nTime; }
     unsigned int GetHeight() const { return nHeight; }
+    CAmount GetModifiedFee() const { return nFee + nFeeDelta; }
+
+    uint64_t GetCountWithAncestors() const { return nCountWithAncestors; }
+    uint64_t GetSizeWithAncestors() const { return nSizeWithAncestors; }
+    CAmount GetModFeesWithAncestors() const { return nModFeesWithAncestors; }
+};
+
+/**
+ * Sort mempool entries by the fee rate of the package they form with their
+ * unconfirmed ancestors, highest first. A transaction paying less than its
+ * ancestors is ranked by its own fee rate instead, so that it does not ride
+ * on its parents' fees.
+ */
+class CompareTxMemPoolEntryByAncestorFee
+{
+public:
+    static void GetScore(const CTxMemPoolEntry& entry, CAmount& nFees, uint64_t& nSize)
+    {
+        nFees = entry.GetModFeesWithAncestors();
+        nSize = entry.GetSizeWithAncestors();
+        // own fee rate lower than the package's: compare fee * size cross products
+        if ((double)entry.GetModifiedFee() * nSize < (double)nFees * entry.GetTxSize()) {
+            nFees = entry.GetModifiedFee();
+            nSize = entry.GetTxSize();
+        }
+    }
+
+    bool operator()(const CTxMemPoolEntry* a, const CTxMemPoolEntry* b) const
+    {
+        CAmount nFeesA, nFeesB;
+        uint64_t nSizeA, nSizeB;
+        GetScore(*a, nFeesA, nSizeA);
+        GetScore(*b, nFeesB, nSizeB);
+        double f1 = (double)nFeesA * nSizeB;
+        double f2 = (double)nFeesB * nSizeA;
+        if (f1 == f2)
+            return a->GetTx().GetHash() < b->GetTx().GetHash();
+        return f1 > f2;
+    }
 };
 
 class CMinerPolicyEstimator;
@@ -102,11 +150,27 @@ private:
     CFeeRate minRelayFee; //! Passed to constructor to avoid dependency on main
     uint64_t totalTxSize; //! sum of all mempool tx' byte sizes
 
+    /** In-mempool parents and children of a transaction */
+    struct CTxLinks {
+        std::set<uint256> setParents;
+        std::set<uint256> setChildren;
+    };
+    std::map<uint256, CTxLinks> mapLinks;
+
+    /** Recompute the ancestor totals of an entry from scratch */
+    void UpdateAncestorState(CTxMemPoolEntry& entry);
+    /** Add to the ancestor totals of an entry, keeping the ancestor fee index in order */
+    void UpdateEntryAncestors(CTxMemPoolEntry& entry, int64_t nCount, int64_t nSize, CAmount nModFees);
+
 public:
+    typedef std::set<const CTxMemPoolEntry*, CompareTxMemPoolEntryByAncestorFee> setEntriesByAncestorFee;
+
     mutable CCriticalSection cs;
     std::map<uint256, CTxMemPoolEntry> mapTx;
     std::map<COutPoint, CInPoint> mapNextTx;
     std::map<uint256, std::pair<double, CAmount> > mapDeltas;
+    //! all entries of mapTx, best ancestor package fee rate first
+    setEntriesByAncestorFee setTxByAncestorFee;
 
     CTxMemPool(const CFeeRate& _minRelayFee);
     ~CTxMemPool();
@@ -127,7 +191,7 @@ public:
     void removeForBlock(const std::vector<CTransaction>& vtx, unsigned int nBlockHeight, std::list<CTransaction>& conflicts);
     void clear();
     void queryHashes(std::vector<uint256>& vtxid);
-    void pruneSpent(const uint256& hash, CCoins& coins);
+    bool isSpent(const COutPoint& outpoint);
     unsigned int GetTransactionsUpdated() const;
     void AddTransactionsUpdated(unsigned int n);
 
@@ -155,6 +219,11 @@ public:
 
     bool lookup(uint256 hash, CTransaction& result) const;
 
+    /** Collect the unconfirmed ancestors of a mempool transaction, not including itself. */
+    void CalculateAncestors(const uint256& hash, std::set<uint256>& setAncestors) const;
+    /** Collect the in-mempool descendants of a transaction, not including itself. */
+    void CalculateDescendants(const uint256& hash, std::set<uint256>& setDescendants) const;
+
     /** Estimate fee rate needed to get into the next nBlocks */
     CFeeRate estimateFee(int nBlocks) const;
 
@@ -177,8 +246,8 @@ protected:
 
 public:
     CCoinsViewMemPool(CCoinsView* baseIn, CTxMemPool& mempoolIn);
-    bool GetCoins(const uint256& txid, CCoins& coins) const;
-    bool HaveCoins(const uint256& txid) const;
+    bool GetCoin(const COutPoint& outpoint, Coin& coin) const;
+    bool HaveCoin(const COutPoint& outpoint) const;
 };
 
 #endif // BITCOIN_TXMEMPOOL_H
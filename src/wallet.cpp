@@ -22,6 +22,7 @@
 #include "timedata.h"
 #include "util.h"
 #include "utilmoneystr.h"
+#include "walletscan.h"
 
 #include <assert.h>
 
@@ -41,6 +42,7 @@ bool bSpendZeroConfChange = true;
 bool bdisableSystemnotifications = false; // Those bubbles can be annoying and slow down the UI when you get lots of trx
 bool fSendFreeTransactions = false;
 bool fPayAtLeastCustomFee = true;
+int nRescanThreads = 0;
 
 /**
  * Fees smaller than this (in ukmi) are considered zero fee (for transaction creation)
@@ -997,6 +999,8 @@ int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
 {
     int ret = 0;
     int64_t nNow = GetTime();
+    int64_t nStart = GetTimeMillis();
+    int nBlocks = 0;
 
     CBlockIndex* pindex = pindexStart;
     {
@@ -1010,27 +1014,62 @@ int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
         ShowProgress(_("Rescanning..."), 0); // show rescan progress in GUI as dialog or on splashscreen, if -rescan on startup
         double dProgressStart = Checkpoints::GuessVerificationProgress(pindex, false);
         double dProgressTip = Checkpoints::GuessVerificationProgress(chainActive.Tip(), false);
+
+        // Worker threads read the blocks ahead of us and match their outputs
+        // against a snapshot of our keys and scripts. Only the transactions
+        // that may be ours, or spend what the wallet already has, are added
+        // here, in chain order.
+        CScriptMatchSet matchSet;
+        GetScriptMatchSet(matchSet);
+        CWalletScanner scanner(matchSet, nRescanThreads);
+        const size_t nBlocksAhead = RESCAN_BLOCKS_AHEAD_PER_THREAD * (nRescanThreads + 1);
+        CBlockIndex* pindexPush = pindex;
         while (pindex) {
+            while (pindexPush && scanner.GetQueueSize() < nBlocksAhead) {
+                scanner.Push(boost::shared_ptr<CScannedBlock>(new CScannedBlock(pindexPush)));
+                pindexPush = chainActive.Next(pindexPush);
+            }
+
             if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0)
                 ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((Checkpoints::GuessVerificationProgress(pindex, false) - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
 
-            CBlock block;
-            ReadBlockFromDisk(block, pindex);
-            BOOST_FOREACH (CTransaction& tx, block.vtx) {
+            boost::shared_ptr<CScannedBlock> pscanned = scanner.Pop();
+            assert(pscanned && pscanned->pindex == pindex);
+            const CBlock& block = pscanned->block;
+            for (unsigned int i = 0; i < block.vtx.size(); i++) {
+                const CTransaction& tx = block.vtx[i];
+                if (!pscanned->vMayBeMine[i] && !mapWallet.count(tx.GetHash()) && !IsFromMe(tx))
+                    continue;
                 if (AddToWalletIfInvolvingMe(tx, &block, fUpdate))
                     ret++;
             }
-            pindex = chainActive.Next(pindex);
+            nBlocks++;
+
             if (GetTime() >= nNow + 60) {
                 nNow = GetTime();
-                LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->nHeight, Checkpoints::GuessVerificationProgress(pindex));
+                LogPrintf("Still rescanning. At block %d. Progress=%f, %.1f blocks/s\n", pindex->nHeight, Checkpoints::GuessVerificationProgress(pindex),
+                    nBlocks * 1000.0 / std::max(GetTimeMillis() - nStart, (int64_t)1));
             }
+            pindex = chainActive.Next(pindex);
         }
         ShowProgress(_("Rescanning..."), 100); // hide progress dialog in GUI
     }
+    LogPrintf("Rescanned %d blocks in %dms with %d threads, %d wallet transactions found\n", nBlocks, GetTimeMillis() - nStart, nRescanThreads, ret);
     return ret;
 }
 
+void CWallet::GetScriptMatchSet(CScriptMatchSet& matchSet) const
+{
+    GetKeys(matchSet.setKeyIDs);
+    {
+        LOCK(cs_KeyStore);
+        for (ScriptMap::const_iterator it = mapScripts.begin(); it != mapScripts.end(); ++it)
+            matchSet.setScriptIDs.insert(it->first);
+        matchSet.setScripts.insert(setWatchOnly.begin(), setWatchOnly.end());
+        matchSet.setScripts.insert(setMultiSig.begin(), setMultiSig.end());
+    }
+}
+
 void CWallet::ReacceptWalletTransactions()
 {
     LOCK2(cs_main, cs_wallet);
@@ -1911,88 +1950,118 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int
     if (GetAdjustedTime() <= chainActive.Tip()->nTime)
         MilliSleep(10000);
 
-    BOOST_FOREACH (PAIRTYPE(const CWalletTx*, unsigned int) pcoin, setStakeCoins) {
-        //make sure that enough time has elapsed between
-        CBlockIndex* pindex = NULL;
-        BlockMap::iterator it = mapBlockIndex.find(pcoin.first->hashBlock);
-        if (it != mapBlockIndex.end())
-            pindex = it->second;
-        else {
-            if (fDebug)
-                LogPrintf("CreateCoinStake() failed to find block index \n");
-            continue;
-        }
+    // Precompute the fixed part of every coin's kernel once per block and stake set
+    static std::vector<pair<const CWalletTx*, unsigned int> > vKernelCoins;
+    static std::vector<CStakeKernel> vKernels;
+    static uint256 hashKernelTip = 0;
+    static int nKernelSetUpdate = 0;
+
+    if (hashKernelTip != chainActive.Tip()->GetBlockHash() || nKernelSetUpdate != nLastStakeSetUpdate) {
+        vKernelCoins.clear();
+        vKernels.clear();
+        BOOST_FOREACH (PAIRTYPE(const CWalletTx*, unsigned int) pcoin, setStakeCoins) {
+            BlockMap::iterator it = mapBlockIndex.find(pcoin.first->hashBlock);
+            if (it == mapBlockIndex.end()) {
+                if (fDebug)
+                    LogPrintf("CreateCoinStake() failed to find block index \n");
+                continue;
+            }
 
-        // Read block header
-        CBlockHeader block = pindex->GetBlockHeader();
+            CStakeKernel kernel;
+            if (!PrepareStakeKernel(nBits, it->second, *pcoin.first, COutPoint(pcoin.first->GetHash(), pcoin.second), kernel))
+                continue;
+            vKernelCoins.push_back(pcoin);
+            vKernels.push_back(kernel);
+        }
+        hashKernelTip = chainActive.Tip()->GetBlockHash();
+        nKernelSetUpdate = nLastStakeSetUpdate;
+    }
 
-        bool fKernelFound = false;
-        uint256 hashProofOfStake = 0;
-        COutPoint prevoutStake = COutPoint(pcoin.first->GetHash(), pcoin.second);
-        nTxNewTime = GetAdjustedTime();
+    if (vKernels.empty())
+        return false;
 
-        //iterates each utxo inside of CheckStakeKernelHash()
-        if (CheckStakeKernelHash(nBits, block, *pcoin.first, prevoutStake, nTxNewTime, nHashDrift, false, hashProofOfStake, true)) {
-            //Double check that this will pass time requirements
-            if (nTxNewTime <= chainActive.Tip()->GetMedianTimePast()) {
-                LogPrintf("CreateCoinStake() : kernel found, but it is too far in the past \n");
-                continue;
+    // Search every coin and timestamp on the kernel search threads
+    // (the cached vectors are only copied if a kernel has to be dropped)
+    std::vector<CStakeKernel> vSearch;
+    std::vector<pair<const CWalletTx*, unsigned int> > vSearchCoins;
+    const std::vector<CStakeKernel>* pvSearch = &vKernels;
+    const std::vector<pair<const CWalletTx*, unsigned int> >* pvSearchCoins = &vKernelCoins;
+    size_t nKernel = 0;
+    uint256 hashProofOfStake = 0;
+    nTxNewTime = GetAdjustedTime();
+    while (FindStakeKernel(*pvSearch, nTxNewTime, nHashDrift, nKernel, nTxNewTime, hashProofOfStake)) {
+        PAIRTYPE(const CWalletTx*, unsigned int) pcoin = (*pvSearchCoins)[nKernel];
+
+        //Double check that this will pass time requirements
+        if (nTxNewTime <= chainActive.Tip()->GetMedianTimePast()) {
+            LogPrintf("CreateCoinStake() : kernel found, but it is too far in the past \n");
+            if (pvSearch != &vSearch) {
+                vSearch = vKernels;
+                vSearchCoins = vKernelCoins;
+                pvSearch = &vSearch;
+                pvSearchCoins = &vSearchCoins;
             }
+            vSearch.erase(vSearch.begin() + nKernel);
+            vSearchCoins.erase(vSearchCoins.begin() + nKernel);
+            nTxNewTime = GetAdjustedTime();
+            continue;
+        }
 
-            // Found a kernel
-            if (fDebug && GetBoolArg("-printcoinstake", false))
-                LogPrintf("CreateCoinStake : kernel found\n");
-
-            vector<valtype> vSolutions;
-            txnouttype whichType;
-            CScript scriptPubKeyOut;
-            scriptPubKeyKernel = pcoin.first->vout[pcoin.second].scriptPubKey;
-            if (!Solver(scriptPubKeyKernel, whichType, vSolutions)) {
-                LogPrintf("CreateCoinStake : failed to parse kernel\n");
-                break;
-            }
+        // Found a kernel
+        if (fDebug && GetBoolArg("-printcoinstake", false))
+            LogPrintf("CreateCoinStake : kernel found prevout=%s:%u nTimeTx=%u hashProof=%s\n",
+                pcoin.first->GetHash().ToString(), pcoin.second, nTxNewTime, hashProofOfStake.ToString());
+
+        vector<valtype> vSolutions;
+        txnouttype whichType;
+        CScript scriptPubKeyOut;
+        scriptPubKeyKernel = pcoin.first->vout[pcoin.second].scriptPubKey;
+        if (!Solver(scriptPubKeyKernel, whichType, vSolutions)) {
+            LogPrintf("CreateCoinStake : failed to parse kernel\n");
+            break;
+        }
+        if (fDebug && GetBoolArg("-printcoinstake", false))
+            LogPrintf("CreateCoinStake : parsed kernel type=%d\n", whichType);
+        if (whichType != TX_PUBKEY && whichType != TX_PUBKEYHASH) {
             if (fDebug && GetBoolArg("-printcoinstake", false))
-                LogPrintf("CreateCoinStake : parsed kernel type=%d\n", whichType);
-            if (whichType != TX_PUBKEY && whichType != TX_PUBKEYHASH) {
+                LogPrintf("CreateCoinStake : no support for kernel type=%d\n", whichType);
+            break; // only support pay to public key and pay to address
+        }
+        if (whichType == TX_PUBKEYHASH) // pay to address type
+        {
+            //convert to pay to public key type
+            CKey key;
+            if (!keystore.GetKey(uint160(vSolutions[0]), key)) {
                 if (fDebug && GetBoolArg("-printcoinstake", false))
-                    LogPrintf("CreateCoinStake : no support for kernel type=%d\n", whichType);
-                break; // only support pay to public key and pay to address
+                    LogPrintf("CreateCoinStake : failed to get key for kernel type=%d\n", whichType);
+                break; // unable to find corresponding public key
             }
-            if (whichType == TX_PUBKEYHASH) // pay to address type
-            {
-                //convert to pay to public key type
-                CKey key;
-                if (!keystore.GetKey(uint160(vSolutions[0]), key)) {
-                    if (fDebug && GetBoolArg("-printcoinstake", false))
-                        LogPrintf("CreateCoinStake : failed to get key for kernel type=%d\n", whichType);
-                    break; // unable to find corresponding public key
-                }
 
-                scriptPubKeyOut << key.GetPubKey() << OP_CHECKSIG;
-            } else
-                scriptPubKeyOut = scriptPubKeyKernel;
+            scriptPubKeyOut << key.GetPubKey() << OP_CHECKSIG;
+        } else
+            scriptPubKeyOut = scriptPubKeyKernel;
 
-            txNew.vin.push_back(CTxIn(pcoin.first->GetHash(), pcoin.second));
-            nCredit += pcoin.first->vout[pcoin.second].nValue;
-            vwtxPrev.push_back(pcoin.first);
-            txNew.vout.push_back(CTxOut(0, scriptPubKeyOut));
+        txNew.vin.push_back(CTxIn(pcoin.first->GetHash(), pcoin.second));
+        nCredit += pcoin.first->vout[pcoin.second].nValue;
+        vwtxPrev.push_back(pcoin.first);
+        txNew.vout.push_back(CTxOut(0, scriptPubKeyOut));
 
-            //presstab HyperStake - calculate the total size of our new output including the stake reward so that we can use it to decide whether to split the stake outputs
-            const CBlockIndex* pIndex0 = chainActive.Tip();
-            uint64_t nTotalSize = pcoin.first->vout[pcoin.second].nValue + GetBlockValue(pIndex0->nHeight+1);
+        //presstab HyperStake - calculate the total size of our new output including the stake reward so that we can use it to decide whether to split the stake outputs
+        const CBlockIndex* pIndex0 = chainActive.Tip();
+        uint64_t nTotalSize = pcoin.first->vout[pcoin.second].nValue + GetBlockValue(pIndex0->nHeight+1);
 
-            //presstab HyperStake - if MultiSend is set to send in coinstake we will add our outputs here (values asigned further down)
-            if (nTotalSize / 2 > nStakeSplitThreshold * COIN)
-                txNew.vout.push_back(CTxOut(0, scriptPubKeyOut)); //split stake
+        //presstab HyperStake - if MultiSend is set to send in coinstake we will add our outputs here (values asigned further down)
+        if (nTotalSize / 2 > nStakeSplitThreshold * COIN)
+            txNew.vout.push_back(CTxOut(0, scriptPubKeyOut)); //split stake
 
-            if (fDebug && GetBoolArg("-printcoinstake", false))
-                LogPrintf("CreateCoinStake : added kernel type=%d\n", whichType);
-            fKernelFound = true;
-            break;
-        }
-        if (fKernelFound)
-            break; // if kernel is found stop searching
+        if (fDebug && GetBoolArg("-printcoinstake", false))
+            LogPrintf("CreateCoinStake : added kernel type=%d\n", whichType);
+        break; // if kernel is found stop searching
     }
+
+    mapHashedBlocks.clear();
+    mapHashedBlocks[chainActive.Tip()->nHeight] = GetTime(); //store a time stamp of when we last hashed on this block
+
     if (nCredit == 0 || nCredit > nBalance - nReserveBalance)
         return false;
 
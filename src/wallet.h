@@ -42,6 +42,7 @@ extern bool bSpendZeroConfChange;
 extern bool bdisableSystemnotifications;
 extern bool fSendFreeTransactions;
 extern bool fPayAtLeastCustomFee;
+extern int nRescanThreads;
 
 //! -paytxfee default
 static const CAmount DEFAULT_TRANSACTION_FEE = 0;
@@ -53,6 +54,12 @@ static const CAmount DEFAULT_TRANSACTION_MAXFEE = 1 * COIN;
 static const CAmount nHighTransactionMaxFeeWarning = 100 * nHighTransactionFeeWarning;
 //! Largest (in bytes) free transaction we're willing to create
 static const unsigned int MAX_FREE_TRANSACTION_CREATE_SIZE = 1000;
+//! Maximum number of threads reading and matching blocks during a rescan
+static const int MAX_RESCAN_THREADS = 16;
+//! -rescanthreads default (0 = auto)
+static const int DEFAULT_RESCAN_THREADS = 0;
+//! Blocks a rescan reads ahead per thread
+static const unsigned int RESCAN_BLOCKS_AHEAD_PER_THREAD = 4;
 
 class CAccountingEntry;
 class CCoinControl;
@@ -380,6 +387,8 @@ public:
     bool AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pblock, bool fUpdate);
     void EraseFromWallet(const uint256& hash);
     int ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate = false);
+    //! Snapshot of the keys and scripts IsMine() looks for, to match outputs against during a rescan
+    void GetScriptMatchSet(CScriptMatchSet& matchSet) const;
     void ReacceptWalletTransactions();
     void ResendWalletTransactions();
     CAmount GetBalance() const;
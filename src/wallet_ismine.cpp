@@ -98,3 +98,33 @@ isminetype IsMine(const CKeyStore& keystore, const CScript& scriptPubKey)
 
     return ISMINE_NO;
 }
+
+bool CScriptMatchSet::MayBeMine(const CScript& scriptPubKey) const
+{
+    if (!setScripts.empty() && setScripts.count(scriptPubKey))
+        return true;
+
+    vector<valtype> vSolutions;
+    txnouttype whichType;
+    if (!Solver(scriptPubKey, whichType, vSolutions))
+        return false;
+
+    switch (whichType) {
+    case TX_NONSTANDARD:
+    case TX_NULL_DATA:
+        break;
+    case TX_PUBKEY:
+        return setKeyIDs.count(CPubKey(vSolutions[0]).GetID()) > 0;
+    case TX_PUBKEYHASH:
+        return setKeyIDs.count(CKeyID(uint160(vSolutions[0]))) > 0;
+    case TX_SCRIPTHASH:
+        return setScriptIDs.count(CScriptID(uint160(vSolutions[0]))) > 0;
+    case TX_MULTISIG:
+        for (unsigned int i = 1; i + 1 < vSolutions.size(); i++) {
+            if (setKeyIDs.count(CPubKey(vSolutions[i]).GetID()))
+                return true;
+        }
+        break;
+    }
+    return false;
+}
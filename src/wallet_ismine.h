@@ -9,6 +9,8 @@
 #include "key.h"
 #include "script/standard.h"
 
+#include <set>
+
 class CKeyStore;
 class CScript;
 
@@ -28,4 +30,21 @@ typedef uint8_t isminefilter;
 isminetype IsMine(const CKeyStore& keystore, const CScript& scriptPubKey);
 isminetype IsMine(const CKeyStore& keystore, const CTxDestination& dest);
 
+/**
+ * Snapshot of the keys and scripts IsMine() looks for in a keystore, to match
+ * many outputs without going through the keystore and its lock for each.
+ * MayBeMine() accepts every script IsMine() accepts for that keystore, and
+ * some it does not, such as multisig outputs with only some of the keys.
+ */
+class CScriptMatchSet
+{
+public:
+    std::set<CKeyID> setKeyIDs;
+    std::set<CScriptID> setScriptIDs;
+    //! watch-only and multisig scripts, matched as a whole
+    std::set<CScript> setScripts;
+
+    bool MayBeMine(const CScript& scriptPubKey) const;
+};
+
 #endif // BITCOIN_WALLET_ISMINE_H
@@ -0,0 +1,103 @@
+// Copyright (c) 2018 The KoinMudra developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "walletscan.h"
+
+#include "main.h"
+#include "util.h"
+
+#include <boost/bind.hpp>
+
+CWalletScanner::CWalletScanner(const CScriptMatchSet& matchSetIn, int nThreads) : matchSet(matchSetIn), nNextJob(0), fQuit(false)
+{
+    for (int i = 0; i < nThreads; i++)
+        threadGroup.create_thread(boost::bind(&CWalletScanner::ThreadWorker, this));
+}
+
+CWalletScanner::~CWalletScanner()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        fQuit = true;
+    }
+    condWorker.notify_all();
+    threadGroup.join_all();
+}
+
+void CWalletScanner::Process(CScannedBlock& scanned) const
+{
+    // A block that cannot be read is scanned as empty, as before
+    if (scanned.pindex)
+        ReadBlockFromDisk(scanned.block, scanned.pindex);
+
+    scanned.vMayBeMine.assign(scanned.block.vtx.size(), false);
+    for (unsigned int i = 0; i < scanned.block.vtx.size(); i++) {
+        const CTransaction& tx = scanned.block.vtx[i];
+        for (unsigned int j = 0; j < tx.vout.size(); j++) {
+            if (matchSet.MayBeMine(tx.vout[j].scriptPubKey)) {
+                scanned.vMayBeMine[i] = true;
+                break;
+            }
+        }
+    }
+}
+
+void CWalletScanner::ThreadWorker()
+{
+    RenameThread("koinmudra-rescan");
+    while (true) {
+        boost::shared_ptr<CScannedBlock> pscanned;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            while (!fQuit && nNextJob == queue.size())
+                condWorker.wait(lock);
+            if (fQuit)
+                return;
+            pscanned = queue[nNextJob++];
+        }
+        Process(*pscanned);
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            pscanned->fDone = true;
+        }
+        condDone.notify_all();
+    }
+}
+
+void CWalletScanner::Push(const boost::shared_ptr<CScannedBlock>& pscanned)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        queue.push_back(pscanned);
+    }
+    condWorker.notify_one();
+}
+
+size_t CWalletScanner::GetQueueSize()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    return queue.size();
+}
+
+boost::shared_ptr<CScannedBlock> CWalletScanner::Pop()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    if (queue.empty())
+        return boost::shared_ptr<CScannedBlock>();
+
+    boost::shared_ptr<CScannedBlock> pscanned = queue.front();
+    if (nNextJob == 0) {
+        // No worker has taken it yet, so do it here rather than wait
+        nNextJob++;
+        lock.unlock();
+        Process(*pscanned);
+        lock.lock();
+        pscanned->fDone = true;
+    }
+    while (!pscanned->fDone)
+        condDone.wait(lock);
+    queue.pop_front();
+    nNextJob--;
+    return pscanned;
+}
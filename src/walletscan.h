@@ -0,0 +1,74 @@
+// Copyright (c) 2018 The KoinMudra developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_WALLETSCAN_H
+#define BITCOIN_WALLETSCAN_H
+
+#include "primitives/block.h"
+#include "wallet_ismine.h"
+
+#include <deque>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+class CBlockIndex;
+
+/** A block on its way through a wallet rescan */
+class CScannedBlock
+{
+public:
+    //! block to read from disk, or NULL when block is filled in already
+    CBlockIndex* pindex;
+    CBlock block;
+    //! per transaction: whether one of its outputs may belong to the wallet
+    std::vector<bool> vMayBeMine;
+    //! set by the scanner once block is read and matched
+    bool fDone;
+
+    CScannedBlock(CBlockIndex* pindexIn) : pindex(pindexIn), fDone(false) {}
+    CScannedBlock(const CBlock& blockIn) : pindex(NULL), block(blockIn), fDone(false) {}
+};
+
+/**
+ * Reads blocks for a wallet rescan and matches their outputs against a
+ * CScriptMatchSet on worker threads, while the caller adds the matches of
+ * earlier blocks to the wallet. Blocks come back out of Pop() in the order
+ * they were pushed. With no worker threads, Pop() does the work itself.
+ */
+class CWalletScanner
+{
+private:
+    const CScriptMatchSet& matchSet;
+
+    boost::mutex mutex;
+    boost::condition_variable condWorker;
+    boost::condition_variable condDone;
+    std::deque<boost::shared_ptr<CScannedBlock> > queue;
+    //! index in queue of the first block no thread has taken yet
+    size_t nNextJob;
+    bool fQuit;
+    boost::thread_group threadGroup;
+
+    CWalletScanner(const CWalletScanner&);
+    void operator=(const CWalletScanner&);
+
+    void ThreadWorker();
+    void Process(CScannedBlock& scanned) const;
+
+public:
+    CWalletScanner(const CScriptMatchSet& matchSetIn, int nThreads);
+    ~CWalletScanner();
+
+    void Push(const boost::shared_ptr<CScannedBlock>& pscanned);
+    size_t GetQueueSize();
+
+    /** Wait for the oldest block to be read and matched and take it, or return NULL if there is none. */
+    boost::shared_ptr<CScannedBlock> Pop();
+};
+
+#endif // BITCOIN_WALLETSCAN_H